@@ -0,0 +1,197 @@
+/*
+ * BENCH_KERNEL
+ * Micro-benchmark for the vectorized string filters against testing 
+ * each row with strcmp()/strncmp()/strstr(). The kernels run over leaves
+ * in both the row and the columnar layout.
+ *
+ * Build with DEBUG=0 to get an optimized build.
+ *
+ * Stefan Wong 2020
+ */
+
+#define _POSIX_C_SOURCE 199309L     // for clock_gettime()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "kernel.h"
+#include "table.h"
+
+#define BENCH_NUM_LEAVES  256
+#define BENCH_NUM_ROWS    (LEAF_NODE_MAX_CELLS * BENCH_NUM_LEAVES)
+#define BENCH_NUM_REPEATS 200
+
+
+/*
+ * now_ns()
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+/*
+ * bench_rows()
+ * Baseline. Test each row with the C library, one at a time.
+ */
+static uint32_t bench_rows(KernelOp op, uint32_t offset, const char* text, uint8_t* values)
+{
+    uint32_t count = 0;
+    size_t   len = strlen(text);
+
+    for(uint32_t r = 0; r < BENCH_NUM_ROWS; ++r)
+    {
+        const char* field = (const char*) values + r * ROW_SIZE + offset;
+
+        switch(op)
+        {
+            case KERNEL_EQ:
+                count += (strcmp(field, text) == 0);
+                break;
+            case KERNEL_PREFIX:
+                count += (strncmp(field, text, len) == 0);
+                break;
+            case KERNEL_CONTAINS:
+                count += (strstr(field, text) != NULL);
+                break;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * bench_kernel()
+ * Run the kernel over each leaf, the way a scan would.
+ */
+static uint32_t bench_kernel(KernelOp op, LeafColumn column, uint32_t size, const char* text, uint8_t* leaves)
+{
+    uint32_t      count = 0;
+    uint64_t      matches[KERNEL_BITMAP_WORDS(LEAF_NODE_MAX_CELLS)];
+    KernelPattern pattern;
+
+    kernel_pattern_init(&pattern, op, 0, size, text);
+    for(uint32_t n = 0; n < BENCH_NUM_LEAVES; ++n)
+    {
+        void* node = leaves + n * PAGE_SIZE;
+
+        kernel_bitmap_fill(matches, LEAF_NODE_MAX_CELLS);
+        kernel_filter(
+            &pattern, 
+            leaf_node_column(node, 0, column), 
+            leaf_node_column_stride(node, column), 
+            LEAF_NODE_MAX_CELLS, 
+            matches
+        );
+        for(uint32_t w = 0; w < KERNEL_BITMAP_WORDS(LEAF_NODE_MAX_CELLS); ++w)
+            count += __builtin_popcountll(matches[w]);
+    }
+
+    return count;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct {
+        const char* name;
+        KernelOp    op;
+        LeafColumn  column;
+        uint32_t    offset;
+        uint32_t    size;
+        const char* text;
+    } cases[] = {
+        {"username = ",       KERNEL_EQ,       LEAF_COLUMN_USERNAME, USERNAME_OFFSET, USERNAME_SIZE, "user4242"},
+        {"username like %",   KERNEL_PREFIX,   LEAF_COLUMN_USERNAME, USERNAME_OFFSET, USERNAME_SIZE, "user42"},
+        {"email = ",          KERNEL_EQ,       LEAF_COLUMN_EMAIL,    EMAIL_OFFSET,    EMAIL_SIZE,    "user4242@example4.com"},
+        {"email contains ",   KERNEL_CONTAINS, LEAF_COLUMN_EMAIL,    EMAIL_OFFSET,    EMAIL_SIZE,    "@example4."},
+    };
+    uint8_t* values;
+    uint8_t* row_leaves;
+    uint8_t* columnar_leaves;
+    Row      row;
+
+    values          = calloc(BENCH_NUM_ROWS, ROW_SIZE);
+    row_leaves      = calloc(BENCH_NUM_LEAVES, PAGE_SIZE);
+    columnar_leaves = calloc(BENCH_NUM_LEAVES, PAGE_SIZE);
+    if(!values || !row_leaves || !columnar_leaves)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for %d rows\n", __func__, (int) BENCH_NUM_ROWS);
+        exit(EXIT_FAILURE);
+    }
+
+    srand(2020);
+    for(uint32_t r = 0; r < BENCH_NUM_ROWS; ++r)
+    {
+        memset(&row, 0, sizeof(row));
+        row.id = r;
+        sprintf(row.username, "user%d", rand() % 100000);
+        sprintf(row.email, "user%d@example%d.com", rand() % 100000, rand() % 10);
+        serialize_row(&row, values + r * ROW_SIZE);
+    }
+    for(uint32_t n = 0; n < BENCH_NUM_LEAVES; ++n)
+    {
+        init_leaf_node_value(row_leaves + n * PAGE_SIZE);
+        init_leaf_node_value(columnar_leaves + n * PAGE_SIZE);
+        leaf_node_set_layout(columnar_leaves + n * PAGE_SIZE, LEAF_LAYOUT_COLUMNAR);
+        for(uint32_t c = 0; c < LEAF_NODE_MAX_CELLS; ++c)
+        {
+            void* record = values + (n * LEAF_NODE_MAX_CELLS + c) * ROW_SIZE;
+
+            leaf_node_write_record(row_leaves + n * PAGE_SIZE, c, record);
+            leaf_node_write_record(columnar_leaves + n * PAGE_SIZE, c, record);
+        }
+    }
+
+    fprintf(stdout, "%d rows, %d repeats, %s kernels\n\n", 
+            (int) BENCH_NUM_ROWS, BENCH_NUM_REPEATS, kernel_impl_name());
+    fprintf(stdout, "%-20s %-24s %12s %12s %12s %8s\n", 
+            "filter", "pattern", "row ns/row", "kernel ns/row", "columnar", "speedup");
+
+    for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        uint32_t row_count = 0;
+        uint32_t kernel_count = 0;
+        uint32_t columnar_count = 0;
+        double   start;
+        double   row_ns;
+        double   kernel_ns;
+        double   columnar_ns;
+
+        start = now_ns();
+        for(int n = 0; n < BENCH_NUM_REPEATS; ++n)
+            row_count = bench_rows(cases[c].op, cases[c].offset, cases[c].text, values);
+        row_ns = (now_ns() - start) / ((double) BENCH_NUM_ROWS * BENCH_NUM_REPEATS);
+
+        start = now_ns();
+        for(int n = 0; n < BENCH_NUM_REPEATS; ++n)
+            kernel_count = bench_kernel(cases[c].op, cases[c].column, cases[c].size, cases[c].text, row_leaves);
+        kernel_ns = (now_ns() - start) / ((double) BENCH_NUM_ROWS * BENCH_NUM_REPEATS);
+
+        start = now_ns();
+        for(int n = 0; n < BENCH_NUM_REPEATS; ++n)
+            columnar_count = bench_kernel(cases[c].op, cases[c].column, cases[c].size, cases[c].text, columnar_leaves);
+        columnar_ns = (now_ns() - start) / ((double) BENCH_NUM_ROWS * BENCH_NUM_REPEATS);
+
+        if(row_count != kernel_count || row_count != columnar_count)
+        {
+            fprintf(stderr, "[%s] %s%s: kernel found %d and %d rows, expected %d\n",
+                    __func__, cases[c].name, cases[c].text, kernel_count, columnar_count, row_count);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stdout, "%-20s %-24s %12.2f %12.2f %12.2f %7.2fx\n",
+                cases[c].name, cases[c].text, row_ns, kernel_ns, columnar_ns, row_ns / kernel_ns);
+    }
+
+    free(values);
+    free(row_leaves);
+    free(columnar_leaves);
+
+    return 0;
+}
@@ -34,7 +34,36 @@ int main(int argc, char *argv[])
     Statement statement;
     Table* table;
 
-    // For now we just accept a single argument - the name of the db file
+    // The name of the db file, optionally after --compress to create a new
+    // file with compressed pages, --columnar to create one with columnar 
+    // leaves, --direct to bypass the OS page cache and --record <log> to 
+    // log every line for the replay program
+    uint32_t flags = 0;
+    WorkloadWriter recorder;
+    while(argc > 2 && argv[1][0] == '-')
+    {
+        if(strcmp(argv[1], "--compress") == 0)
+            flags |= DB_FLAG_COMPRESSED;
+        else if(strcmp(argv[1], "--columnar") == 0)
+            flags |= DB_FLAG_COLUMNAR;
+        else if(strcmp(argv[1], "--direct") == 0)
+            flags |= DB_OPEN_DIRECT_IO;
+        else if(strcmp(argv[1], "--record") == 0 && argc > 3)
+        {
+            if(workload_writer_open(&recorder, argv[2]) != WORKLOAD_OK)
+                exit(EXIT_FAILURE);
+            input_buffer->recorder = &recorder;
+            argv++;
+            argc--;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[1]);
+            exit(EXIT_FAILURE);
+        }
+        argv++;
+        argc--;
+    }
     if(argc < 2)
     {
         fprintf(stderr, "No database name specified\n");
@@ -42,7 +71,7 @@ int main(int argc, char *argv[])
     }
 
     filename = argv[1];
-    table = db_open(filename);
+    table = db_open_with_flags(filename, flags);
     if(!table)
     {
         fprintf(stderr, "[%s] failed to allocate memory for table\n", __func__);
@@ -85,6 +114,11 @@ int main(int argc, char *argv[])
                 fprintf(stdout, "String too long (%ld chars)\n", strlen(input_buffer->buffer));
                 continue;
 
+            case PREPARE_ROW_TOO_WIDE:
+                fprintf(stdout, "Rows of [%s] would be wider than %lu bytes\n",
+                        statement.table.name, (unsigned long) ROW_SIZE);
+                continue;
+
             case PREPARE_UNRECOGNIZED_STATEMENT:
                 fprintf(stdout, "Unrecognized keyword at start of [%s]\n",
                         input_buffer->buffer
@@ -102,6 +136,41 @@ int main(int argc, char *argv[])
             case EXECUTE_TABLE_FULL:
                 fprintf(stdout, "ERROR: Table full\n");
                 break;
+
+            case EXECUTE_TABLE_EXISTS:
+                fprintf(stdout, "ERROR: Table [%s] already exists\n", statement.table.name);
+                break;
+
+            case EXECUTE_NO_SUCH_TABLE:
+                fprintf(stdout, "ERROR: No such table [%s]\n", statement.table.name);
+                break;
+
+            case EXECUTE_BAD_VALUE:
+                fprintf(stdout, "ERROR: Values don't match the columns of [%s]\n", statement.table.name);
+                break;
+
+            case EXECUTE_IO_ERROR:
+                if(statement.type == STATEMENT_COMMIT)
+                    fprintf(stdout, "ERROR: Unable to write the transaction to the db file\n");
+                else
+                    fprintf(stdout, "ERROR: Unable to write the temporary files for the sort or group by\n");
+                break;
+
+            case EXECUTE_DUPLICATE_KEY:
+                fprintf(stdout, "ERROR: Duplicate key\n");
+                break;
+
+            case EXECUTE_IN_TRANSACTION:
+                fprintf(stdout, "ERROR: Already in a transaction\n");
+                break;
+
+            case EXECUTE_NO_TRANSACTION:
+                fprintf(stdout, "ERROR: No transaction to commit or roll back\n");
+                break;
+
+            case EXECUTE_CORRUPT:
+                fprintf(stdout, "ERROR: Database file is corrupt, run .integrity_check for details\n");
+                break;
         }
     }
 
@@ -0,0 +1,97 @@
+/*
+ * REPLAY
+ * Run a workload recorded by the REPL against a database, and report 
+ * the throughput and latency of the statements
+ *
+ * Stefan Wong 2020
+ */
+
+// for fdopen()
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "workload.h"
+
+
+/*
+ * print_usage()
+ */
+void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--paced] [--show-output] <workload log> <db file>\n", program);
+    fprintf(stderr, "  --paced        wait between statements as long as they were recorded apart\n");
+    fprintf(stderr, "  --show-output  print the rows selected instead of discarding them\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char*    program = argv[0];
+    ReplayOptions  options;
+    ReplayStats    stats;
+    WorkloadReader reader;
+    WorkloadResult result;
+    Table*         table;
+    FILE*          report = stdout;
+    int            show_output = 0;
+
+    options.paced = 0;
+    while(argc > 1 && argv[1][0] == '-')
+    {
+        if(strcmp(argv[1], "--paced") == 0)
+            options.paced = 1;
+        else if(strcmp(argv[1], "--show-output") == 0)
+            show_output = 1;
+        else
+        {
+            print_usage(program);
+            exit(EXIT_FAILURE);
+        }
+        argv++;
+        argc--;
+    }
+    if(argc != 3)
+    {
+        print_usage(program);
+        exit(EXIT_FAILURE);
+    }
+
+    if(workload_reader_open(&reader, argv[1]) != WORKLOAD_OK)
+        exit(EXIT_FAILURE);
+    table = db_open(argv[2]);
+    if(!table)
+    {
+        workload_reader_close(&reader);
+        exit(EXIT_FAILURE);
+    }
+
+    // Selected rows go to stdout, so keep a copy of it for the report and
+    // send the rows nowhere
+    if(!show_output)
+    {
+        report = fdopen(dup(STDOUT_FILENO), "w");
+        if(!report || !freopen("/dev/null", "w", stdout))
+        {
+            fprintf(stderr, "[%s] unable to discard output\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    result = workload_replay(table, &reader, &options, &stats);
+    if(result != WORKLOAD_OK)
+        fprintf(stderr, "Workload log [%s] ends with a damaged record, replayed up to it\n", argv[1]);
+    db_close(table);
+    workload_reader_close(&reader);
+
+    replay_print_report(&stats, report);
+    replay_stats_free(&stats);
+    if(report != stdout)
+        fclose(report);
+
+    return (result == WORKLOAD_OK) ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/*
+ * ARENA
+ * Bump allocators for statements and page frames
+ *
+ * Stefan Wong 2020
+ */
+
+// for MAP_ANONYMOUS and madvise()
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+// Data starts after the block header, rounded up to keep it aligned
+#define ARENA_BLOCK_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+
+// ================ ARENA
+
+/*
+ * arena_new_block()
+ */
+static ArenaBlock* arena_new_block(size_t size)
+{
+    ArenaBlock* block;
+
+    block = malloc(ARENA_BLOCK_HEADER_SIZE + size);
+    if(!block)
+    {
+        fprintf(stderr, "[%s] failed to allocate %lu byte block\n", __func__, (unsigned long) size);
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+/*
+ * arena_init()
+ * No memory is allocated until the first call to arena_alloc()
+ */
+void arena_init(Arena* arena, size_t block_size)
+{
+    arena->first      = NULL;
+    arena->current    = NULL;
+    arena->block_size = block_size;
+}
+
+/*
+ * arena_alloc()
+ * Returns memory aligned to ARENA_ALIGN, or NULL if there is no memory
+ * left. The memory is not cleared.
+ */
+void* arena_alloc(Arena* arena, size_t size)
+{
+    ArenaBlock* block;
+    void*       ptr;
+
+    size  = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    block = arena->current;
+    // Move on to the next kept block, or add one, until one has room
+    while(block == NULL || block->used + size > block->size)
+    {
+        if(block && block->next)
+        {
+            block       = block->next;
+            block->used = 0;
+            continue;
+        }
+
+        ArenaBlock* new_block = arena_new_block((size > arena->block_size) ? size : arena->block_size);
+        if(!new_block)
+            return NULL;
+        if(block)
+            block->next = new_block;
+        else
+            arena->first = new_block;
+        block = new_block;
+    }
+    arena->current = block;
+
+    ptr          = (char*) block + ARENA_BLOCK_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+/*
+ * arena_reset()
+ * Free everything allocated from the arena at once. The blocks are kept
+ * for the next round of allocations.
+ */
+void arena_reset(Arena* arena)
+{
+    arena->current = arena->first;
+    if(arena->first)
+        arena->first->used = 0;
+}
+
+/*
+ * arena_destroy()
+ */
+void arena_destroy(Arena* arena)
+{
+    ArenaBlock* block = arena->first;
+
+    while(block)
+    {
+        ArenaBlock* next = block->next;
+
+        free(block);
+        block = next;
+    }
+    arena->first   = NULL;
+    arena->current = NULL;
+}
+
+/*
+ * arena_capacity()
+ * Total bytes in all blocks, used or not
+ */
+size_t arena_capacity(Arena* arena)
+{
+    size_t capacity = 0;
+
+    for(ArenaBlock* block = arena->first; block; block = block->next)
+        capacity += block->size;
+
+    return capacity;
+}
+
+
+// ================ FRAME POOL
+
+/*
+ * frame_pool_init()
+ * Returns 0 on success
+ */
+int frame_pool_init(FramePool* pool, size_t frame_size, uint32_t num_frames)
+{
+    size_t size;
+
+    size = frame_size * num_frames;
+    if(size >= FRAME_POOL_HUGE_PAGE_SIZE)
+        size = (size + FRAME_POOL_HUGE_PAGE_SIZE - 1) & ~((size_t) FRAME_POOL_HUGE_PAGE_SIZE - 1);
+
+    pool->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pool->base == MAP_FAILED)
+    {
+        fprintf(stderr, "[%s] failed to map %lu bytes for page frames\n", __func__, (unsigned long) size);
+        pool->base = NULL;
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    // Only a hint, the pool works the same if the kernel says no
+    if(size >= FRAME_POOL_HUGE_PAGE_SIZE)
+        madvise(pool->base, size, MADV_HUGEPAGE);
+#endif
+    pool->mapped_size = size;
+    pool->frame_size  = frame_size;
+    pool->num_frames  = num_frames;
+
+    return 0;
+}
+
+/*
+ * frame_pool_frame()
+ */
+void* frame_pool_frame(FramePool* pool, uint32_t frame_num)
+{
+    if(frame_num >= pool->num_frames)
+        return NULL;
+
+    return (char*) pool->base + (size_t) frame_num * pool->frame_size;
+}
+
+/*
+ * frame_pool_destroy()
+ */
+void frame_pool_destroy(FramePool* pool)
+{
+    if(pool->base)
+        munmap(pool->base, pool->mapped_size);
+    pool->base = NULL;
+}
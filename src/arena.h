@@ -0,0 +1,69 @@
+/*
+ * ARENA
+ * Bump allocators for statements and page frames
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_ARENA_H
+#define __SQ_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Arena
+ * Memory for things that all go away at the same time, like the cursors
+ * and temporary arrays used by one statement. Allocation moves a pointer
+ * along a block, and a reset moves it back to the start. Blocks are kept
+ * across resets, so once an arena has grown to fit a statement, running
+ * the statement again doesn't call malloc.
+ */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN      16
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    size_t             size;    // bytes of data after the header
+    size_t             used;
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t      block_size;
+} Arena;
+
+void   arena_init(Arena* arena, size_t block_size);
+void*  arena_alloc(Arena* arena, size_t size);
+void   arena_reset(Arena* arena);
+void   arena_destroy(Arena* arena);
+size_t arena_capacity(Arena* arena);
+
+/*
+ * FramePool
+ * Page frames for the pager, carved out of one page aligned mapping. The
+ * pager keeps every page it loads until it is closed, so page n simply 
+ * always uses frame n and the frames are released all together. The 
+ * mapping is made with mmap, so frames that are never used never take 
+ * up memory. Pools of at least FRAME_POOL_HUGE_PAGE_SIZE are marked for
+ * transparent huge pages.
+ */
+#define FRAME_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct
+{
+    void*    base;
+    size_t   mapped_size;
+    size_t   frame_size;
+    uint32_t num_frames;
+} FramePool;
+
+int   frame_pool_init(FramePool* pool, size_t frame_size, uint32_t num_frames);
+void* frame_pool_frame(FramePool* pool, uint32_t frame_num);
+void  frame_pool_destroy(FramePool* pool);
+
+
+#endif /*__SQ_ARENA_H*/
@@ -0,0 +1,229 @@
+/*
+ * CACHE
+ * Results of select statements, kept until the table changes
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+
+/*
+ * cache_hash()
+ * 32 bit FNV-1a
+ */
+static uint32_t cache_hash(const char* key)
+{
+    uint32_t hash = 2166136261u;
+
+    for(; *key != '\0'; ++key)
+    {
+        hash ^= (uint8_t) *key;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * cache_create()
+ */
+ResultCache* cache_create(size_t max_memory)
+{
+    ResultCache* cache;
+
+    cache = calloc(1, sizeof(ResultCache));
+    if(!cache)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for result cache\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    cache->max_memory = max_memory;
+
+    return cache;
+}
+
+/*
+ * cache_remove()
+ * Unlink an entry from its bucket and the LRU list and free it
+ */
+static void cache_remove(ResultCache* cache, CacheEntry* entry)
+{
+    CacheEntry** link = &cache->buckets[entry->hash % CACHE_NUM_BUCKETS];
+
+    while(*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+
+    if(entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+    if(entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+
+    cache->memory -= entry->memory;
+    cache->num_entries--;
+    free(entry->key);
+    free(entry->result);
+    free(entry);
+}
+
+/*
+ * cache_clear()
+ * Drop every result, the counters are kept
+ */
+void cache_clear(ResultCache* cache)
+{
+    while(cache->lru_head != NULL)
+        cache_remove(cache, cache->lru_head);
+}
+
+/*
+ * cache_free()
+ */
+void cache_free(ResultCache* cache)
+{
+    if(!cache)
+        return;
+    cache_clear(cache);
+    free(cache);
+}
+
+/*
+ * cache_normalize()
+ * Write text to key with leading and trailing whitespace removed and
+ * every other run of whitespace made a single space. Returns the length
+ * of the key, or 0 if it doesn't fit in size bytes.
+ */
+uint32_t cache_normalize(const char* text, char* key, uint32_t size)
+{
+    uint32_t len   = 0;
+    int      space = 0;
+
+    for(; *text != '\0'; ++text)
+    {
+        if(*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r')
+        {
+            space = (len > 0);
+            continue;
+        }
+        if(len + space + 1 >= size)
+        {
+            key[0] = '\0';
+            return 0;
+        }
+        if(space)
+            key[len++] = ' ';
+        key[len++] = *text;
+        space      = 0;
+    }
+    key[len] = '\0';
+
+    return len;
+}
+
+/*
+ * cache_get()
+ * Look up the result for key at this version of the table. A hit moves
+ * the result to the front of the LRU list.
+ */
+CacheEntry* cache_get(ResultCache* cache, const char* key, uint64_t version)
+{
+    CacheEntry* entry;
+    uint32_t    hash = cache_hash(key);
+
+    for(entry = cache->buckets[hash % CACHE_NUM_BUCKETS]; entry != NULL; entry = entry->next)
+    {
+        if(entry->hash == hash && strcmp(entry->key, key) == 0)
+            break;
+    }
+    if(entry == NULL || entry->version != version)
+    {
+        // A result for an older version will never be used again
+        if(entry != NULL)
+            cache_remove(cache, entry);
+        cache->misses++;
+        return NULL;
+    }
+
+    if(entry != cache->lru_head)
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+        if(entry->lru_next)
+            entry->lru_next->lru_prev = entry->lru_prev;
+        else
+            cache->lru_tail = entry->lru_prev;
+        entry->lru_prev           = NULL;
+        entry->lru_next           = cache->lru_head;
+        cache->lru_head->lru_prev = entry;
+        cache->lru_head           = entry;
+    }
+    cache->hits++;
+
+    return entry;
+}
+
+/*
+ * cache_put()
+ * Keep a copy of the result for key, replacing any older one, and evict
+ * the least recently used results until the cache is under its limit
+ */
+void cache_put(ResultCache* cache, const char* key, uint64_t version, const char* result, size_t length)
+{
+    CacheEntry* entry;
+    size_t      key_size = strlen(key) + 1;
+    uint32_t    hash     = cache_hash(key);
+
+    for(entry = cache->buckets[hash % CACHE_NUM_BUCKETS]; entry != NULL; entry = entry->next)
+    {
+        if(entry->hash == hash && strcmp(entry->key, key) == 0)
+        {
+            cache_remove(cache, entry);
+            break;
+        }
+    }
+    if(sizeof(CacheEntry) + key_size + length > cache->max_memory)
+        return;
+
+    entry = malloc(sizeof(CacheEntry));
+    if(entry)
+    {
+        entry->key    = malloc(key_size);
+        entry->result = malloc(length + 1);
+    }
+    if(!entry || !entry->key || !entry->result)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for cached result\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry->key, key, key_size);
+    memcpy(entry->result, result, length);
+    entry->hash    = hash;
+    entry->version = version;
+    entry->length  = length;
+    entry->memory  = sizeof(CacheEntry) + key_size + length;
+
+    while(cache->memory + entry->memory > cache->max_memory)
+    {
+        cache_remove(cache, cache->lru_tail);
+        cache->evictions++;
+    }
+
+    entry->next     = cache->buckets[hash % CACHE_NUM_BUCKETS];
+    cache->buckets[hash % CACHE_NUM_BUCKETS] = entry;
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if(cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+    cache->memory  += entry->memory;
+    cache->num_entries++;
+}
@@ -0,0 +1,64 @@
+/*
+ * CACHE
+ * Results of select statements, kept until the table changes
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_CACHE_H
+#define __SQ_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A result is the text a select printed, keyed by the statement with its
+ * whitespace normalized. Each result is stamped with the version of the
+ * table it was read from, and the table's version goes up with every
+ * statement that writes to it, so a result from an older version is
+ * never returned. Stale results are dropped when they are looked up or
+ * when they reach the end of the LRU list.
+ *
+ * The memory of a result counts its key, its text and the entry itself.
+ * Once the cache is over its limit the least recently used results are
+ * evicted, and a result larger than the whole limit is not kept at all.
+ */
+#define CACHE_DEFAULT_MEMORY   (1024 * 1024)
+#define CACHE_MAX_KEY          512      // longer statements are not cached
+#define CACHE_NUM_BUCKETS      256
+
+typedef struct CacheEntry
+{
+    struct CacheEntry* next;            // in the hash bucket
+    struct CacheEntry* lru_prev;        // towards the most recently used
+    struct CacheEntry* lru_next;
+    uint32_t hash;
+    uint64_t version;
+    char*    key;
+    char*    result;
+    size_t   length;                    // of the result
+    size_t   memory;
+} CacheEntry;
+
+typedef struct ResultCache
+{
+    CacheEntry* buckets[CACHE_NUM_BUCKETS];
+    CacheEntry* lru_head;               // most recently used
+    CacheEntry* lru_tail;
+    uint32_t    num_entries;
+    size_t      memory;
+    size_t      max_memory;
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    evictions;
+} ResultCache;
+
+ResultCache* cache_create(size_t max_memory);
+void         cache_free(ResultCache* cache);
+void         cache_clear(ResultCache* cache);
+uint32_t     cache_normalize(const char* text, char* key, uint32_t size);
+CacheEntry*  cache_get(ResultCache* cache, const char* key, uint64_t version);
+void         cache_put(ResultCache* cache, const char* key, uint64_t version, const char* result, size_t length);
+
+
+#endif /*__SQ_CACHE_H*/
@@ -0,0 +1,607 @@
+/*
+ * CATALOG
+ * Schemas and the catalog of tables made with create table
+ *
+ * Stefan Wong 2020
+ */
+
+// for strnlen()
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+
+static const char* column_type_names[] = {
+    "integer",
+    "real",
+    "text",
+    "varchar"
+};
+
+
+// ================ SCHEMA
+
+/*
+ * valid_name()
+ * Names are letters, digits and _ and don't start with a digit
+ */
+static int valid_name(const char* name)
+{
+    size_t len = strlen(name);
+
+    if(len == 0 || len > CATALOG_MAX_NAME || isdigit((unsigned char) name[0]))
+        return 0;
+    for(size_t i = 0; i < len; ++i)
+    {
+        if(!isalnum((unsigned char) name[i]) && name[i] != '_')
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * schema_init()
+ */
+CatalogResult schema_init(Schema* schema, const char* name)
+{
+    memset(schema, 0, sizeof(Schema));
+    if(!valid_name(name))
+        return CATALOG_BAD_NAME;
+    strcpy(schema->name, name);
+
+    return CATALOG_OK;
+}
+
+/*
+ * schema_add_column()
+ * The layout is worked out by schema_layout() once every column is in
+ */
+CatalogResult schema_add_column(Schema* schema, const char* name, ColumnType type, uint32_t size)
+{
+    ColumnDef* column;
+
+    if(schema->num_columns >= CATALOG_MAX_COLUMNS)
+        return CATALOG_TOO_MANY_COLUMNS;
+    if(!valid_name(name))
+        return CATALOG_BAD_NAME;
+    if(schema_find_column(schema, name) >= 0)
+        return CATALOG_DUPLICATE_COLUMN;
+
+    switch(type)
+    {
+        case COLUMN_TYPE_INTEGER:
+            size = sizeof(int32_t);
+            break;
+        case COLUMN_TYPE_REAL:
+            size = sizeof(double);
+            break;
+        case COLUMN_TYPE_TEXT:
+        case COLUMN_TYPE_VARCHAR:
+            if(size == 0 || size > CATALOG_MAX_TEXT)
+                return CATALOG_BAD_TYPE;
+            break;
+        default:
+            return CATALOG_BAD_TYPE;
+    }
+
+    column = &schema->cols[schema->num_columns++];
+    strcpy(column->name, name);
+    column->type   = type;
+    column->size   = size;
+    column->offset = 0;
+
+    return CATALOG_OK;
+}
+
+/*
+ * schema_layout()
+ * Place the fixed size columns in the order they were declared, and find
+ * the largest record the schema can make.
+ */
+CatalogResult schema_layout(Schema* schema)
+{
+    uint32_t offset = 0;
+    uint32_t max_size;
+
+    if(schema->num_columns == 0 || schema->cols[0].type != COLUMN_TYPE_INTEGER)
+        return CATALOG_BAD_KEY;
+
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        if(schema->cols[c].type == COLUMN_TYPE_VARCHAR)
+            continue;
+        schema->cols[c].offset = offset;
+        offset += schema->cols[c].size;
+    }
+    schema->fixed_size  = offset;
+    schema->fixed_width = 1;
+
+    max_size = offset;
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        if(schema->cols[c].type != COLUMN_TYPE_VARCHAR)
+            continue;
+        schema->fixed_width = 0;
+        max_size += sizeof(uint16_t) + schema->cols[c].size;
+    }
+    schema->max_size = max_size;
+    if(max_size > ROW_SIZE)
+        return CATALOG_ROW_TOO_WIDE;
+
+    return CATALOG_OK;
+}
+
+/*
+ * schema_find_column()
+ * Returns the position of the column, or -1 if there isn't one
+ */
+int schema_find_column(Schema* schema, const char* name)
+{
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        if(strcmp(schema->cols[c].name, name) == 0)
+            return (int) c;
+    }
+
+    return -1;
+}
+
+/*
+ * column_type_name()
+ */
+const char* column_type_name(ColumnType type)
+{
+    if(type > COLUMN_TYPE_VARCHAR)
+        return "unknown";
+
+    return column_type_names[type];
+}
+
+/*
+ * schema_users()
+ * The schema of the built in table. Its rows are still written by
+ * serialize_row(), the schema gives the same layout. The text columns
+ * are as wide as an insert allows, and Row keeps a terminator after 
+ * each, so the columns are placed at the offsets of Row rather than 
+ * one after another.
+ */
+void schema_users(Schema* schema)
+{
+    schema_init(schema, CATALOG_USERS_TABLE);
+    schema_add_column(schema, "id", COLUMN_TYPE_INTEGER, 0);
+    schema_add_column(schema, "username", COLUMN_TYPE_TEXT, COLUMN_USERNAME_SIZE);
+    schema_add_column(schema, "email", COLUMN_TYPE_TEXT, COLUMN_EMAIL_SIZE);
+    schema_layout(schema);
+    schema->cols[1].offset = USERNAME_OFFSET;
+    schema->cols[2].offset = EMAIL_OFFSET;
+    schema->fixed_size     = ROW_SIZE;
+    schema->max_size       = ROW_SIZE;
+}
+
+/*
+ * schema_put_fixed()
+ */
+static inline void schema_put_fixed(ColumnDef* column, Value* value, void* record)
+{
+    switch(column->type)
+    {
+        case COLUMN_TYPE_INTEGER:
+            memcpy(record + column->offset, &value->integer, sizeof(int32_t));
+            break;
+        case COLUMN_TYPE_REAL:
+            memcpy(record + column->offset, &value->real, sizeof(double));
+            break;
+        default:
+            // zero padded, as in serialize_row()
+            memcpy(record + column->offset, value->text, value->length);
+            memset(record + column->offset + value->length, 0, column->size - value->length);
+            break;
+    }
+}
+
+/*
+ * schema_get_fixed()
+ */
+static inline void schema_get_fixed(ColumnDef* column, void* record, Value* value)
+{
+    switch(column->type)
+    {
+        case COLUMN_TYPE_INTEGER:
+            memcpy(&value->integer, record + column->offset, sizeof(int32_t));
+            break;
+        case COLUMN_TYPE_REAL:
+            memcpy(&value->real, record + column->offset, sizeof(double));
+            break;
+        default:
+            value->length = strnlen(record + column->offset, column->size);
+            memcpy(value->text, record + column->offset, value->length);
+            value->text[value->length] = '\0';
+            break;
+    }
+}
+
+/*
+ * schema_serialize()
+ * Write a row into record, which must have room for schema->max_size
+ * bytes. Text values must already fit their column.
+ */
+void schema_serialize(Schema* schema, Value* values, void* record)
+{
+    uint32_t offset;
+
+    // Every column is at a fixed offset. Any bytes between columns, such
+    // as the terminators in a users row, are zero.
+    if(schema->fixed_width)
+    {
+        memset(record, 0, schema->fixed_size);
+        for(uint32_t c = 0; c < schema->num_columns; ++c)
+            schema_put_fixed(&schema->cols[c], &values[c], record);
+        return;
+    }
+
+    offset = schema->fixed_size;
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        ColumnDef* column = &schema->cols[c];
+        uint16_t   length;
+
+        if(column->type != COLUMN_TYPE_VARCHAR)
+        {
+            schema_put_fixed(column, &values[c], record);
+            continue;
+        }
+        length = (uint16_t) values[c].length;
+        memcpy(record + offset, &length, sizeof(uint16_t));
+        memcpy(record + offset + sizeof(uint16_t), values[c].text, length);
+        offset += sizeof(uint16_t) + length;
+    }
+    // The rest of the record is zeroed so the file doesn't hold old bytes
+    memset(record + offset, 0, schema->max_size - offset);
+}
+
+/*
+ * schema_deserialize()
+ */
+void schema_deserialize(Schema* schema, void* record, Value* values)
+{
+    uint32_t offset;
+
+    if(schema->fixed_width)
+    {
+        for(uint32_t c = 0; c < schema->num_columns; ++c)
+            schema_get_fixed(&schema->cols[c], record, &values[c]);
+        return;
+    }
+
+    offset = schema->fixed_size;
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        ColumnDef* column = &schema->cols[c];
+        uint16_t   length;
+
+        if(column->type != COLUMN_TYPE_VARCHAR)
+        {
+            schema_get_fixed(column, record, &values[c]);
+            continue;
+        }
+        memcpy(&length, record + offset, sizeof(uint16_t));
+        if(length > column->size)
+            length = column->size;
+        values[c].length = length;
+        memcpy(values[c].text, record + offset + sizeof(uint16_t), length);
+        values[c].text[length] = '\0';
+        offset += sizeof(uint16_t) + length;
+    }
+}
+
+/*
+ * schema_record_key()
+ * The key is the first column, which is always an integer at offset 0
+ */
+uint32_t schema_record_key(void* record)
+{
+    int32_t key;
+
+    memcpy(&key, record, sizeof(int32_t));
+
+    return (uint32_t) key;
+}
+
+/*
+ * schema_parse_value()
+ * Returns 0 if the text isn't a value of the column's type, or is too
+ * long for it. Text may be wrapped in single quotes.
+ */
+int schema_parse_value(ColumnDef* column, const char* text, Value* value)
+{
+    char*  end;
+    size_t len;
+
+    switch(column->type)
+    {
+        case COLUMN_TYPE_INTEGER:
+        {
+            long integer;
+
+            errno   = 0;
+            integer = strtol(text, &end, 10);
+            if(end == text || *end != '\0' || errno != 0 || integer < INT32_MIN || integer > INT32_MAX)
+                return 0;
+            value->integer = (int32_t) integer;
+            return 1;
+        }
+        case COLUMN_TYPE_REAL:
+            errno       = 0;
+            value->real = strtod(text, &end);
+            return end != text && *end == '\0' && errno == 0;
+        default:
+            break;
+    }
+
+    len = strlen(text);
+    if(len >= 2 && text[0] == '\'' && text[len-1] == '\'')
+    {
+        text++;
+        len -= 2;
+    }
+    if(len > column->size)
+        return 0;
+    memcpy(value->text, text, len);
+    value->text[len] = '\0';
+    value->length    = len;
+
+    return 1;
+}
+
+/*
+ * schema_print_values()
+ * Same format as print_row()
+ */
+void schema_print_values(Schema* schema, Value* values, FILE* fp)
+{
+    fprintf(fp, "(");
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        if(c > 0)
+            fprintf(fp, ", ");
+        switch(schema->cols[c].type)
+        {
+            case COLUMN_TYPE_INTEGER:
+                fprintf(fp, "%d", values[c].integer);
+                break;
+            case COLUMN_TYPE_REAL:
+                fprintf(fp, "%g", values[c].real);
+                break;
+            default:
+                fprintf(fp, "%s", values[c].text);
+                break;
+        }
+    }
+    fprintf(fp, ")\n");
+}
+
+/*
+ * schema_print()
+ * The schema as a create table statement
+ */
+void schema_print(Schema* schema, FILE* fp)
+{
+    fprintf(fp, "create table %s (", schema->name);
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        ColumnDef* column = &schema->cols[c];
+
+        fprintf(fp, "%s%s %s", (c == 0) ? "" : ", ", column->name, column_type_name(column->type));
+        if(column->type == COLUMN_TYPE_TEXT || column->type == COLUMN_TYPE_VARCHAR)
+            fprintf(fp, "(%u)", column->size);
+    }
+    fprintf(fp, ")\n");
+}
+
+
+// ================ CATALOG
+
+/*
+ * catalog_write_record()
+ */
+static void catalog_write_record(void* record, Schema* schema, uint32_t root_page_num)
+{
+    memset(record, 0, ROW_SIZE);
+    strncpy(record + CATALOG_RECORD_NAME_OFFSET, schema->name, CATALOG_MAX_NAME + 1);
+    memcpy(record + CATALOG_RECORD_ROOT_OFFSET, &root_page_num, sizeof(uint32_t));
+    *((uint8_t*) (record + CATALOG_RECORD_NUM_COLS_OFFSET)) = (uint8_t) schema->num_columns;
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        void*    dest = record + CATALOG_RECORD_COLUMNS_OFFSET + c * CATALOG_RECORD_COLUMN_SIZE;
+        uint16_t size = (uint16_t) schema->cols[c].size;
+
+        strncpy(dest, schema->cols[c].name, CATALOG_MAX_NAME + 1);
+        *((uint8_t*) (dest + CATALOG_MAX_NAME + 1)) = (uint8_t) schema->cols[c].type;
+        memcpy(dest + CATALOG_MAX_NAME + 2, &size, sizeof(uint16_t));
+    }
+}
+
+/*
+ * catalog_read_record()
+ * Returns 0 if the record doesn't hold a valid schema
+ */
+static int catalog_read_record(void* record, Schema* schema, uint32_t* root_page_num)
+{
+    char     name[CATALOG_MAX_NAME + 1];
+    uint32_t num_columns;
+
+    memcpy(name, record + CATALOG_RECORD_NAME_OFFSET, CATALOG_MAX_NAME);
+    name[CATALOG_MAX_NAME] = '\0';
+    if(schema_init(schema, name) != CATALOG_OK)
+        return 0;
+    memcpy(root_page_num, record + CATALOG_RECORD_ROOT_OFFSET, sizeof(uint32_t));
+    if(*root_page_num == DB_HEADER_PAGE_NUM || *root_page_num >= TABLE_MAX_PAGES)
+        return 0;
+
+    num_columns = *((uint8_t*) (record + CATALOG_RECORD_NUM_COLS_OFFSET));
+    if(num_columns > CATALOG_MAX_COLUMNS)
+        return 0;
+    for(uint32_t c = 0; c < num_columns; ++c)
+    {
+        void*    src = record + CATALOG_RECORD_COLUMNS_OFFSET + c * CATALOG_RECORD_COLUMN_SIZE;
+        uint16_t size;
+
+        memcpy(name, src, CATALOG_MAX_NAME);
+        name[CATALOG_MAX_NAME] = '\0';
+        memcpy(&size, src + CATALOG_MAX_NAME + 2, sizeof(uint16_t));
+        if(schema_add_column(schema, name, *((uint8_t*) (src + CATALOG_MAX_NAME + 1)), size) != CATALOG_OK)
+            return 0;
+    }
+
+    return schema_layout(schema) == CATALOG_OK;
+}
+
+/*
+ * catalog_get()
+ * Read the catalog the first time it's asked for. Records that don't
+ * make sense are reported and left out.
+ */
+Catalog* catalog_get(Table* table)
+{
+    Catalog* catalog;
+    Cursor*  cursor;
+    uint32_t root_page_num;
+
+    if(table->catalog)
+        return table->catalog;
+
+    catalog = calloc(1, sizeof(Catalog));
+    if(!catalog)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for catalog\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    table->catalog = catalog;
+
+    root_page_num = *db_header_catalog_root(get_page(table->pager, DB_HEADER_PAGE_NUM));
+    if(root_page_num == 0)
+        return catalog;
+    if(root_page_num >= TABLE_MAX_PAGES)
+    {
+        fprintf(stderr, "[%s] catalog root %u is outside the file\n", __func__, root_page_num);
+        return catalog;
+    }
+
+    catalog->tree = table_open_tree(table->pager, root_page_num);
+    cursor        = table_start(catalog->tree);
+    while(cursor && !(cursor->end_of_table) && catalog->num_tables < CATALOG_MAX_TABLES)
+    {
+        CatalogEntry* entry = &catalog->tables[catalog->num_tables];
+        uint32_t      table_root;
+
+        entry->table_id = *leaf_node_key(get_page(table->pager, cursor->page_num), cursor->cell_num);
+        if(catalog_read_record(cursor_value(cursor), &entry->schema, &table_root))
+        {
+            entry->table = table_open_tree(table->pager, table_root);
+            catalog->num_tables++;
+        }
+        else
+            fprintf(stderr, "[%s] catalog record for table %u is damaged\n", __func__, entry->table_id);
+        cursor_advance(cursor);
+    }
+    table_reset_arena(catalog->tree);
+
+    return catalog;
+}
+
+/*
+ * catalog_find()
+ */
+CatalogEntry* catalog_find(Table* table, const char* name)
+{
+    Catalog* catalog = catalog_get(table);
+
+    for(uint32_t t = 0; t < catalog->num_tables; ++t)
+    {
+        if(strcmp(catalog->tables[t].schema.name, name) == 0)
+            return &catalog->tables[t];
+    }
+
+    return NULL;
+}
+
+/*
+ * catalog_new_root()
+ * An empty leaf for the root of a new tree
+ */
+static uint32_t catalog_new_root(Pager* pager)
+{
+    uint32_t page_num;
+    void*    node;
+
+    page_num = get_unused_page_num(pager);
+    node     = get_page(pager, page_num);
+    init_leaf_node_value(node);
+    set_node_root(node, 1);
+
+    return page_num;
+}
+
+/*
+ * catalog_create_table()
+ * The schema must already be laid out
+ */
+CatalogResult catalog_create_table(Table* table, Schema* schema)
+{
+    Catalog*      catalog;
+    CatalogEntry* entry;
+    Cursor*       cursor;
+    uint32_t      pages_needed;
+    uint32_t      root_page_num;
+    uint8_t       record[ROW_SIZE];
+
+    catalog = catalog_get(table);
+    if(strcmp(schema->name, CATALOG_USERS_TABLE) == 0 || catalog_find(table, schema->name))
+        return CATALOG_TABLE_EXISTS;
+    if(catalog->num_tables >= CATALOG_MAX_TABLES)
+        return CATALOG_FULL;
+
+    // The new table's root, and either the catalog root or a split of
+    // every node on the way down the catalog
+    pages_needed = 1 + (catalog->tree ? tree_depth(table->pager, catalog->tree->root_page_num) + 1 : 1);
+    if(pages_needed > pager_pages_available(table->pager))
+        return CATALOG_FULL;
+
+    if(!catalog->tree)
+    {
+        root_page_num = catalog_new_root(table->pager);
+        *db_header_catalog_root(get_page(table->pager, DB_HEADER_PAGE_NUM)) = root_page_num;
+        catalog->tree = table_open_tree(table->pager, root_page_num);
+    }
+
+    entry = &catalog->tables[catalog->num_tables];
+    memcpy(&entry->schema, schema, sizeof(Schema));
+    entry->table_id = (catalog->num_tables == 0) ? 1 : catalog->tables[catalog->num_tables - 1].table_id + 1;
+    root_page_num   = catalog_new_root(table->pager);
+    entry->table    = table_open_tree(table->pager, root_page_num);
+
+    catalog_write_record(record, schema, root_page_num);
+    cursor = table_find(catalog->tree, entry->table_id);
+    leaf_node_insert_record(cursor, entry->table_id, record);
+    table_reset_arena(catalog->tree);
+    catalog->num_tables++;
+
+    return CATALOG_OK;
+}
+
+/*
+ * catalog_free()
+ */
+void catalog_free(Catalog* catalog)
+{
+    if(!catalog)
+        return;
+    for(uint32_t t = 0; t < catalog->num_tables; ++t)
+        table_close_tree(catalog->tables[t].table);
+    table_close_tree(catalog->tree);
+    free(catalog);
+}
@@ -0,0 +1,142 @@
+/*
+ * CATALOG
+ * Schemas and the catalog of tables made with create table
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_CATALOG_H
+#define __SQ_CATALOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "table.h"
+
+#define CATALOG_MAX_NAME     15     // longest table or column name
+#define CATALOG_MAX_COLUMNS  12
+#define CATALOG_MAX_TABLES   16
+#define CATALOG_MAX_TEXT     256    // longest text or varchar column, as long as the email
+// The built in table, which keeps its own tree, index and row layout
+#define CATALOG_USERS_TABLE  "users"
+
+/*
+ * Column types
+ *   integer     signed 32 bit, 4 bytes
+ *   real        double, 8 bytes
+ *   text(n)     n bytes, zero padded like the username and email
+ *   varchar(n)  2 byte length then that many bytes, at most n
+ */
+typedef enum
+{
+    COLUMN_TYPE_INTEGER,
+    COLUMN_TYPE_REAL,
+    COLUMN_TYPE_TEXT,
+    COLUMN_TYPE_VARCHAR
+} ColumnType;
+
+typedef struct
+{
+    char       name[CATALOG_MAX_NAME + 1];
+    ColumnType type;
+    uint32_t   size;        // bytes for integer, real and text, most characters for varchar
+    uint32_t   offset;      // in the record, only for fixed size columns
+} ColumnDef;
+
+/*
+ * Schema
+ * The first column is an integer and is the key of the table's tree.
+ * Fixed size columns are laid out first in the order they were declared,
+ * each at a fixed offset, then the varchar columns one after another. A
+ * schema with no varchar columns is fixed width and every record is
+ * fixed_size bytes, which lets records be written and read without
+ * tracking where each column ends. A record must fit in a leaf cell,
+ * which is ROW_SIZE bytes.
+ */
+typedef struct
+{
+    char      name[CATALOG_MAX_NAME + 1];
+    uint32_t  num_columns;
+    ColumnDef cols[CATALOG_MAX_COLUMNS];    // not columns, which <term.h> defines
+    uint32_t  fixed_size;   // bytes taken by the fixed size columns
+    uint32_t  max_size;     // largest a record can be
+    int       fixed_width;
+} Schema;
+
+// The value of one column of a row
+typedef struct
+{
+    int32_t  integer;
+    double   real;
+    uint32_t length;                        // of text, for text and varchar
+    char     text[CATALOG_MAX_TEXT + 1];
+} Value;
+
+typedef enum
+{
+    CATALOG_OK,
+    CATALOG_BAD_NAME,           // empty, too long, or not letters, digits and _
+    CATALOG_DUPLICATE_COLUMN,
+    CATALOG_TOO_MANY_COLUMNS,
+    CATALOG_BAD_TYPE,           // unknown type, or a text size out of range
+    CATALOG_BAD_KEY,            // the first column is not an integer
+    CATALOG_ROW_TOO_WIDE,
+    CATALOG_TABLE_EXISTS,
+    CATALOG_FULL                // no room for another table, or no free pages
+} CatalogResult;
+
+CatalogResult schema_init(Schema* schema, const char* name);
+CatalogResult schema_add_column(Schema* schema, const char* name, ColumnType type, uint32_t size);
+CatalogResult schema_layout(Schema* schema);
+int           schema_find_column(Schema* schema, const char* name);
+const char*   column_type_name(ColumnType type);
+void          schema_users(Schema* schema);
+
+void     schema_serialize(Schema* schema, Value* values, void* record);
+void     schema_deserialize(Schema* schema, void* record, Value* values);
+uint32_t schema_record_key(void* record);
+int      schema_parse_value(ColumnDef* column, const char* text, Value* value);
+void     schema_print_values(Schema* schema, Value* values, FILE* fp);
+void     schema_print(Schema* schema, FILE* fp);
+
+/*
+ * Catalog
+ * Tables made with create table live in the same file as the users
+ * table. Each has its own tree, keyed on its first column, and the
+ * catalog is one more tree with a record per table giving its name,
+ * root page and schema, keyed by a table id. The header holds the root
+ * of the catalog tree. Roots never move, so a table is always found at
+ * the page it was created on until the file is vacuumed.
+ *
+ * The catalog is read into memory the first time it is needed and kept
+ * with the users table until it is closed.
+ */
+#define CATALOG_RECORD_NAME_OFFSET     0
+#define CATALOG_RECORD_ROOT_OFFSET     (CATALOG_RECORD_NAME_OFFSET + CATALOG_MAX_NAME + 1)
+#define CATALOG_RECORD_NUM_COLS_OFFSET (CATALOG_RECORD_ROOT_OFFSET + 4)
+#define CATALOG_RECORD_COLUMNS_OFFSET  (CATALOG_RECORD_NUM_COLS_OFFSET + 1)
+// name, then a byte for the type and two for the size
+#define CATALOG_RECORD_COLUMN_SIZE     (CATALOG_MAX_NAME + 1 + 1 + 2)
+// 249 bytes, which fits in a leaf cell
+#define CATALOG_RECORD_SIZE            (CATALOG_RECORD_COLUMNS_OFFSET + CATALOG_MAX_COLUMNS * CATALOG_RECORD_COLUMN_SIZE)
+
+typedef struct
+{
+    uint32_t table_id;          // key in the catalog tree
+    Schema   schema;
+    Table*   table;             // view of the table's tree
+} CatalogEntry;
+
+typedef struct Catalog
+{
+    Table*       tree;          // NULL until the first table is created
+    uint32_t     num_tables;
+    CatalogEntry tables[CATALOG_MAX_TABLES];
+} Catalog;
+
+Catalog*      catalog_get(Table* table);
+CatalogEntry* catalog_find(Table* table, const char* name);
+CatalogResult catalog_create_table(Table* table, Schema* schema);
+void          catalog_free(Catalog* catalog);
+
+
+#endif /*__SQ_CATALOG_H*/
@@ -0,0 +1,227 @@
+/*
+ * CHECKSUM
+ * CRC32C (Castagnoli) checksums for pages
+ *
+ * The table driven version processes 8 bytes per step with 8 tables
+ * (slicing by 8). The SSE4.2 version runs three independent crc32
+ * streams over thirds of the buffer so that the 3 cycle latency of the
+ * instruction is hidden, then combines them.
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include "checksum.h"
+
+#if defined(__x86_64__)
+#define SQ_X86_64
+#include <immintrin.h>
+#endif
+
+typedef uint32_t (*Crc32cFunc)(const void* data, size_t len);
+
+static Crc32cFunc  crc32c_func = NULL;
+static const char* crc32c_name = NULL;
+
+static uint32_t    crc32c_table[8][256];
+static int         crc32c_table_ready = 0;
+
+
+/*
+ * crc32c_init_table()
+ */
+static void crc32c_init_table(void)
+{
+    for(uint32_t n = 0; n < 256; ++n)
+    {
+        uint32_t crc = n;
+
+        for(int k = 0; k < 8; ++k)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[0][n] = crc;
+    }
+    for(uint32_t n = 0; n < 256; ++n)
+    {
+        for(int t = 1; t < 8; ++t)
+            crc32c_table[t][n] = (crc32c_table[t - 1][n] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][n] & 0xFF];
+    }
+    crc32c_table_ready = 1;
+}
+
+/*
+ * crc32c_scalar()
+ */
+uint32_t crc32c_scalar(const void* data, size_t len)
+{
+    const uint8_t* p   = data;
+    uint32_t       crc = 0xFFFFFFFF;
+
+    if(!crc32c_table_ready)
+        crc32c_init_table();
+
+    while(len >= 8)
+    {
+        uint32_t lo;
+        uint32_t hi;
+
+        memcpy(&lo, p, sizeof(uint32_t));
+        memcpy(&hi, p + 4, sizeof(uint32_t));
+        lo ^= crc;
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p   += 8;
+        len -= 8;
+    }
+    while(len--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+
+    return ~crc;
+}
+
+#ifdef SQ_X86_64
+/*
+ * crc32c_multiply()
+ * Product of two polynomials mod P, in the same reflected bit order as
+ * the crc (bit 31 is x^0)
+ */
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t prod = 0;
+
+    for(int i = 0; i < 32; ++i)
+    {
+        if(a & (0x80000000 >> i))
+            prod ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+
+    return prod;
+}
+
+/*
+ * crc32c_shift()
+ * Advance a crc over len zero bytes, which is what combining a stream
+ * with the one after it needs. This is a multiply by x^(8 len) mod P, 
+ * found by repeated squaring. Buffers are nearly always a page, so the
+ * power for the last length is kept.
+ */
+static uint32_t crc32c_shift(uint32_t crc, size_t len)
+{
+    static size_t   shift_len   = 0;
+    static uint32_t shift_power = 0x80000000;   // x^0
+
+    if(len != shift_len)
+    {
+        uint32_t result = 0x80000000;           // x^0
+        uint32_t power  = 0x00800000;           // x^8
+
+        for(size_t n = len; n; n >>= 1)
+        {
+            if(n & 1)
+                result = crc32c_multiply(power, result);
+            power = crc32c_multiply(power, power);
+        }
+        shift_power = result;
+        shift_len   = len;
+    }
+
+    return crc32c_multiply(crc, shift_power);
+}
+
+/*
+ * crc32c_sse42()
+ */
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(const void* data, size_t len)
+{
+    const uint8_t* p   = data;
+    uint64_t       crc = 0xFFFFFFFF;
+
+    // Three streams over equal thirds of the buffer
+    if(len >= 3 * 256)
+    {
+        size_t         block = (len / 3) & ~(size_t) 7;
+        const uint8_t* p1    = p + block;
+        const uint8_t* p2    = p + 2 * block;
+        uint64_t       crc1  = 0;
+        uint64_t       crc2  = 0;
+
+        for(size_t i = 0; i < block; i += 8)
+        {
+            uint64_t v0;
+            uint64_t v1;
+            uint64_t v2;
+
+            memcpy(&v0, p + i, sizeof(uint64_t));
+            memcpy(&v1, p1 + i, sizeof(uint64_t));
+            memcpy(&v2, p2 + i, sizeof(uint64_t));
+            crc  = _mm_crc32_u64(crc, v0);
+            crc1 = _mm_crc32_u64(crc1, v1);
+            crc2 = _mm_crc32_u64(crc2, v2);
+        }
+        crc  = crc32c_shift((uint32_t) crc, block) ^ crc1;
+        crc  = crc32c_shift((uint32_t) crc, block) ^ crc2;
+        p   += 3 * block;
+        len -= 3 * block;
+    }
+    while(len >= 8)
+    {
+        uint64_t v;
+
+        memcpy(&v, p, sizeof(uint64_t));
+        crc  = _mm_crc32_u64(crc, v);
+        p   += 8;
+        len -= 8;
+    }
+    while(len--)
+        crc = _mm_crc32_u8((uint32_t) crc, *p++);
+
+    return ~(uint32_t) crc;
+}
+#else
+uint32_t crc32c_sse42(const void* data, size_t len)
+{
+    return crc32c_scalar(data, len);
+}
+#endif /*SQ_X86_64*/
+
+/*
+ * crc32c_init()
+ */
+static void crc32c_init(void)
+{
+    crc32c_func = crc32c_scalar;
+    crc32c_name = "scalar";
+#ifdef SQ_X86_64
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_func = crc32c_sse42;
+        crc32c_name = "sse4.2";
+    }
+#endif /*SQ_X86_64*/
+}
+
+/*
+ * crc32c()
+ */
+uint32_t crc32c(const void* data, size_t len)
+{
+    if(crc32c_func == NULL)
+        crc32c_init();
+
+    return crc32c_func(data, len);
+}
+
+/*
+ * crc32c_impl_name()
+ */
+const char* crc32c_impl_name(void)
+{
+    if(crc32c_func == NULL)
+        crc32c_init();
+
+    return crc32c_name;
+}
@@ -0,0 +1,28 @@
+/*
+ * CHECKSUM
+ * CRC32C (Castagnoli) checksums for pages
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_CHECKSUM_H
+#define __SQ_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Reflected polynomial, the same one the SSE4.2 crc32 instruction uses
+#define CRC32C_POLY 0x82F63B78
+
+/*
+ * crc32c()
+ * Checksum of len bytes. Uses the crc32 instruction where the CPU has
+ * one and a table driven version otherwise, both give the same result.
+ */
+uint32_t    crc32c(const void* data, size_t len);
+uint32_t    crc32c_scalar(const void* data, size_t len);
+uint32_t    crc32c_sse42(const void* data, size_t len);
+const char* crc32c_impl_name(void);
+
+
+#endif /*__SQ_CHECKSUM_H*/
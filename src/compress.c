@@ -0,0 +1,212 @@
+/*
+ * COMPRESS
+ * LZ4 block compression for pages
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include "compress.h"
+
+
+/*
+ * lz4_read32()
+ */
+static inline uint32_t lz4_read32(const uint8_t* p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+/*
+ * lz4_hash()
+ */
+static inline uint32_t lz4_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/*
+ * lz4_write_length()
+ * Lengths of 15 or more spill into bytes of 255 and a final byte
+ */
+static uint8_t* lz4_write_length(uint8_t* op, uint32_t len)
+{
+    while(len >= 255)
+    {
+        *op++ = 255;
+        len  -= 255;
+    }
+    *op++ = (uint8_t) len;
+
+    return op;
+}
+
+/*
+ * lz4_write_sequence()
+ * Write literals and, if match_len is not zero, a match. Returns NULL if
+ * the sequence doesn't fit.
+ */
+static uint8_t* lz4_write_sequence(uint8_t* op, uint8_t* oend,
+        const uint8_t* literals, uint32_t lit_len, uint32_t offset, uint32_t match_len)
+{
+    uint8_t* token;
+    uint32_t ml;
+
+    ml = (match_len > 0) ? match_len - LZ4_MIN_MATCH : 0;
+    if((uint64_t) (oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1)
+        return NULL;
+
+    token  = op++;
+    *token = (uint8_t) (((lit_len >= 15) ? 15 : lit_len) << 4);
+    if(lit_len >= 15)
+        op = lz4_write_length(op, lit_len - 15);
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+
+    if(match_len == 0)
+        return op;
+
+    *op++ = (uint8_t) (offset & 0xFF);
+    *op++ = (uint8_t) (offset >> 8);
+    *token |= (uint8_t) ((ml >= 15) ? 15 : ml);
+    if(ml >= 15)
+        op = lz4_write_length(op, ml - 15);
+
+    return op;
+}
+
+/*
+ * lz4_compress_block()
+ * Greedy single pass compressor with a small hash table of the last
+ * position each 4 byte sequence was seen at. Returns the compressed size,
+ * or 0 if it would not fit in dst_capacity.
+ */
+uint32_t lz4_compress_block(const void* src, uint32_t src_size, void* dst, uint32_t dst_capacity)
+{
+    uint32_t       table[1 << LZ4_HASH_LOG];
+    const uint8_t* base   = src;
+    const uint8_t* ip     = base;
+    const uint8_t* anchor = base;
+    const uint8_t* end    = base + src_size;
+    uint8_t*       op     = dst;
+    uint8_t*       oend   = op + dst_capacity;
+
+    memset(table, 0, sizeof(table));
+    if(src_size > LZ4_MATCH_LIMIT)
+    {
+        const uint8_t* mflimit    = end - LZ4_MATCH_LIMIT;
+        const uint8_t* matchlimit = end - LZ4_LAST_LITERALS;
+
+        while(ip < mflimit)
+        {
+            uint32_t       seq = lz4_read32(ip);
+            uint32_t       h   = lz4_hash(seq);
+            const uint8_t* ref = base + table[h];
+
+            table[h] = (uint32_t) (ip - base);
+            if(ref < ip && ip - ref <= LZ4_MAX_OFFSET && lz4_read32(ref) == seq)
+            {
+                const uint8_t* mp = ip + LZ4_MIN_MATCH;
+                const uint8_t* rp = ref + LZ4_MIN_MATCH;
+
+                while(mp < matchlimit && *mp == *rp)
+                {
+                    mp++;
+                    rp++;
+                }
+                op = lz4_write_sequence(op, oend, anchor, (uint32_t) (ip - anchor),
+                        (uint32_t) (ip - ref), (uint32_t) (mp - ip));
+                if(!op)
+                    return 0;
+                ip     = mp;
+                anchor = ip;
+            }
+            else
+                ip++;
+        }
+    }
+
+    op = lz4_write_sequence(op, oend, anchor, (uint32_t) (end - anchor), 0, 0);
+    if(!op)
+        return 0;
+
+    return (uint32_t) (op - (uint8_t*) dst);
+}
+
+/*
+ * lz4_read_length()
+ * Returns 0 if the block ends in the middle of a length
+ */
+static int lz4_read_length(const uint8_t** ip, const uint8_t* iend, uint32_t* len)
+{
+    uint8_t b;
+
+    do
+    {
+        if(*ip >= iend)
+            return 0;
+        b     = *(*ip)++;
+        *len += b;
+    } while(b == 255);
+
+    return 1;
+}
+
+/*
+ * lz4_decompress_block()
+ * Every length and offset is checked against the buffers, so a damaged
+ * block gives an error rather than a bad write. Returns the number of
+ * bytes written or -1 if the block is malformed.
+ */
+int lz4_decompress_block(const void* src, uint32_t src_size, void* dst, uint32_t dst_size)
+{
+    const uint8_t* ip   = src;
+    const uint8_t* iend = ip + src_size;
+    uint8_t*       op   = dst;
+    uint8_t*       oend = op + dst_size;
+
+    while(ip < iend)
+    {
+        uint8_t  token   = *ip++;
+        uint32_t lit_len = token >> 4;
+        uint32_t offset;
+        uint32_t match_len;
+
+        if(lit_len == 15 && !lz4_read_length(&ip, iend, &lit_len))
+            return -1;
+        if(lit_len > (uint32_t) (iend - ip) || lit_len > (uint32_t) (oend - op))
+            return -1;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        // The last sequence has no match
+        if(ip == iend)
+            break;
+
+        if(iend - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip    += 2;
+        if(offset == 0 || offset > (uint32_t) (op - (uint8_t*) dst))
+            return -1;
+
+        match_len = token & 0x0F;
+        if(match_len == 15 && !lz4_read_length(&ip, iend, &match_len))
+            return -1;
+        match_len += LZ4_MIN_MATCH;
+        if(match_len > (uint32_t) (oend - op))
+            return -1;
+
+        // Matches may overlap the output, so copy forwards a byte at a time
+        const uint8_t* match = op - offset;
+        for(uint32_t i = 0; i < match_len; ++i)
+            op[i] = match[i];
+        op += match_len;
+    }
+
+    return (int) (op - (uint8_t*) dst);
+}
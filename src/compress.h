@@ -0,0 +1,30 @@
+/*
+ * COMPRESS
+ * LZ4 block compression for pages
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_COMPRESS_H
+#define __SQ_COMPRESS_H
+
+#include <stdint.h>
+
+/*
+ * Blocks use the LZ4 block format so that they can be read with any LZ4
+ * decoder. Each sequence is a token (literal length in the high nibble,
+ * match length - 4 in the low nibble), extra literal length bytes, the
+ * literals, a 2 byte little endian match offset and extra match length
+ * bytes. The last sequence is literals only and the last 5 bytes of a
+ * block are always literals.
+ */
+#define LZ4_MIN_MATCH      4
+#define LZ4_MAX_OFFSET     65535
+#define LZ4_LAST_LITERALS  5
+#define LZ4_MATCH_LIMIT    12      // no match may start in the last 12 bytes
+#define LZ4_HASH_LOG       12
+
+uint32_t lz4_compress_block(const void* src, uint32_t src_size, void* dst, uint32_t dst_capacity);
+int      lz4_decompress_block(const void* src, uint32_t src_size, void* dst, uint32_t dst_size);
+
+#endif /*__SQ_COMPRESS_H*/
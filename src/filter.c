@@ -0,0 +1,227 @@
+/*
+ * FILTER
+ * Where clauses compiled to run directly against serialized cells
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include "filter.h"
+#include "table.h"
+
+
+// ================ TEST FUNCTIONS
+// Keys are compared as integers. Strings are given as a pointer to the
+// column, wherever it is stored, and are zero padded to the column 
+// width, so an equality test only needs to look at the literal plus the
+// terminating zero.
+
+static int key_eq(FilterTerm* term, uint32_t key, const char* field) { return key == term->id; }
+static int key_ne(FilterTerm* term, uint32_t key, const char* field) { return key != term->id; }
+static int key_lt(FilterTerm* term, uint32_t key, const char* field) { return key <  term->id; }
+static int key_le(FilterTerm* term, uint32_t key, const char* field) { return key <= term->id; }
+static int key_gt(FilterTerm* term, uint32_t key, const char* field) { return key >  term->id; }
+static int key_ge(FilterTerm* term, uint32_t key, const char* field) { return key >= term->id; }
+
+static int str_eq(FilterTerm* term, uint32_t key, const char* field)
+{
+    return memcmp(field, term->text, term->len + 1) == 0;
+}
+
+static int str_ne(FilterTerm* term, uint32_t key, const char* field)
+{
+    return memcmp(field, term->text, term->len + 1) != 0;
+}
+
+static int str_prefix(FilterTerm* term, uint32_t key, const char* field)
+{
+    return memcmp(field, term->text, term->len) == 0;
+}
+
+static int str_contains(FilterTerm* term, uint32_t key, const char* field)
+{
+    // string columns always have a terminating zero
+    return strstr(field, term->text) != NULL;
+}
+
+static int str_lt(FilterTerm* term, uint32_t key, const char* field)
+{
+    return strncmp(field, term->text, term->size) < 0;
+}
+
+static int str_le(FilterTerm* term, uint32_t key, const char* field)
+{
+    return strncmp(field, term->text, term->size) <= 0;
+}
+
+static int str_gt(FilterTerm* term, uint32_t key, const char* field)
+{
+    return strncmp(field, term->text, term->size) > 0;
+}
+
+static int str_ge(FilterTerm* term, uint32_t key, const char* field)
+{
+    return strncmp(field, term->text, term->size) >= 0;
+}
+
+/*
+ * filter_cost()
+ * Rough relative cost of a term, used to order the terms so that the 
+ * cheap and selective ones run first.
+ */
+static int filter_cost(Predicate* predicate)
+{
+    if(predicate->column == COLUMN_ID)
+        return 0;
+    if(predicate->op == OP_EQ || predicate->op == OP_PREFIX || predicate->op == OP_CONTAINS)
+        return 1;
+
+    return 2;
+}
+
+// ================ FILTER
+
+/*
+ * filter_compile()
+ * Resolve every predicate in the where clause to a test function. The
+ * filter points at the literals in the where clause, so it must not
+ * outlive the statement.
+ */
+void filter_compile(Filter* filter, WhereClause* where)
+{
+    static const FilterFunc key_funcs[] = {
+        [OP_EQ] = key_eq, [OP_NE] = key_ne, [OP_LT] = key_lt,
+        [OP_LE] = key_le, [OP_GT] = key_gt, [OP_GE] = key_ge,
+        [OP_PREFIX] = NULL, [OP_CONTAINS] = NULL
+    };
+    static const FilterFunc str_funcs[] = {
+        [OP_EQ] = str_eq, [OP_NE] = str_ne, [OP_LT] = str_lt,
+        [OP_LE] = str_le, [OP_GT] = str_gt, [OP_GE] = str_ge,
+        [OP_PREFIX] = str_prefix, [OP_CONTAINS] = str_contains
+    };
+
+    filter->num_terms = 0;
+    for(int cost = 0; cost <= 2; ++cost)
+    {
+        for(uint32_t p = 0; p < where->num_predicates; ++p)
+        {
+            Predicate*  pred = &where->predicates[p];
+            FilterTerm* term;
+
+            if(filter_cost(pred) != cost)
+                continue;
+
+            term = &filter->terms[filter->num_terms++];
+            term->id   = pred->id;
+            term->text = pred->text;
+            term->len  = strlen(pred->text);
+            switch(pred->column)
+            {
+                case COLUMN_ID:
+                    term->match  = key_funcs[pred->op];
+                    term->column = LEAF_COLUMN_ID;
+                    term->offset = ID_OFFSET;
+                    term->size   = ID_SIZE;
+                    break;
+                case COLUMN_USERNAME:
+                    term->match  = str_funcs[pred->op];
+                    term->column = LEAF_COLUMN_USERNAME;
+                    term->offset = USERNAME_OFFSET;
+                    term->size   = USERNAME_SIZE;
+                    break;
+                case COLUMN_EMAIL:
+                    term->match  = str_funcs[pred->op];
+                    term->column = LEAF_COLUMN_EMAIL;
+                    term->offset = EMAIL_OFFSET;
+                    term->size   = EMAIL_SIZE;
+                    break;
+            }
+
+            term->use_kernel = (pred->column != COLUMN_ID) && 
+                (pred->op == OP_EQ || pred->op == OP_PREFIX || pred->op == OP_CONTAINS);
+            if(term->use_kernel)
+            {
+                KernelOp op = (pred->op == OP_EQ) ? KERNEL_EQ :
+                              (pred->op == OP_PREFIX) ? KERNEL_PREFIX : KERNEL_CONTAINS;
+                // Leaves are scanned from the start of the column, see filter_match_leaf()
+                kernel_pattern_init(&term->pattern, op, 0, term->size, term->text);
+            }
+        }
+    }
+}
+
+/*
+ * filter_matches()
+ * Test a serialized row against the filter without deserializing it
+ */
+int filter_matches(Filter* filter, uint32_t key, void* value)
+{
+    for(uint32_t t = 0; t < filter->num_terms; ++t)
+    {
+        FilterTerm* term = &filter->terms[t];
+
+        if(!term->match(term, key, value + term->offset))
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * filter_matches_cell()
+ * Test one cell of a table leaf. Only the columns in the filter are 
+ * read, which in a columnar leaf leaves the other minipages alone.
+ */
+int filter_matches_cell(Filter* filter, void* node, uint32_t cell_num)
+{
+    for(uint32_t t = 0; t < filter->num_terms; ++t)
+    {
+        FilterTerm* term = &filter->terms[t];
+
+        if(!term->match(term, *leaf_node_key(node, cell_num), leaf_node_column(node, cell_num, term->column)))
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * filter_match_leaf()
+ * Test every cell in a table leaf, setting a bit in matches for each
+ * one that passes. String tests run over the whole leaf with the vector
+ * kernels, other tests run per cell on the cells still in the running.
+ * Either way a term only reads its own column, striding over whole rows
+ * in a row leaf or along one minipage in a columnar leaf.
+ */
+void filter_match_leaf(Filter* filter, void* node, uint64_t* matches)
+{
+    uint32_t num_cells;
+
+    num_cells = *leaf_node_num_cells(node);
+    kernel_bitmap_fill(matches, num_cells);
+    for(uint32_t t = 0; t < filter->num_terms; ++t)
+    {
+        FilterTerm* term = &filter->terms[t];
+
+        if(term->use_kernel)
+        {
+            kernel_filter(
+                &term->pattern, 
+                leaf_node_column(node, 0, term->column), 
+                leaf_node_column_stride(node, term->column), 
+                num_cells, 
+                matches
+            );
+            continue;
+        }
+
+        for(uint32_t c = 0; c < num_cells; ++c)
+        {
+            uint64_t bit = 1ULL << (c % 64);
+
+            if((matches[c / 64] & bit) && 
+               !term->match(term, *leaf_node_key(node, c), leaf_node_column(node, c, term->column)))
+                matches[c / 64] &= ~bit;
+        }
+    }
+}
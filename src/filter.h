@@ -0,0 +1,49 @@
+/*
+ * FILTER
+ * Where clauses compiled to run directly against serialized cells
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_FILTER_H
+#define __SQ_FILTER_H
+
+#include <stdint.h>
+#include "input.h"
+#include "kernel.h"
+
+/*
+ * A FilterTerm is a predicate that has been resolved to a test function
+ * and its column, both as a leaf column and as an offset inside a 
+ * serialized row. The key is passed in separately so that the filter 
+ * does not depend on where the key sits in a cell.
+ */
+typedef struct FilterTerm FilterTerm;
+typedef int (*FilterFunc)(FilterTerm* term, uint32_t key, const char* field);
+
+struct FilterTerm
+{
+    FilterFunc    match;
+    LeafColumn    column;
+    uint32_t      offset;       // offset of the column in the serialized row
+    uint32_t      size;         // size of the column in the serialized row
+    uint32_t      len;          // length of the string literal
+    uint32_t      id;
+    const char*   text;
+    int           use_kernel;   // string tests that can run a page at a time
+    KernelPattern pattern;
+};
+
+typedef struct
+{
+    uint32_t   num_terms;
+    FilterTerm terms[WHERE_MAX_PREDICATES];
+} Filter;
+
+void filter_compile(Filter* filter, WhereClause* where);
+int  filter_matches(Filter* filter, uint32_t key, void* value);
+int  filter_matches_cell(Filter* filter, void* node, uint32_t cell_num);
+void filter_match_leaf(Filter* filter, void* node, uint64_t* matches);
+
+
+#endif /*__SQ_FILTER_H*/
@@ -0,0 +1,261 @@
+/*
+ * GROUP
+ * Hash aggregation for group by, with partitions spilled to files
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "group.h"
+
+
+/*
+ * group_hash()
+ * 32 bit FNV-1a
+ */
+uint32_t group_hash(const char* key, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+
+    for(uint32_t i = 0; i < length; ++i)
+    {
+        hash ^= (uint8_t) key[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * group_partition()
+ * Each level takes the next bits down from the top of the hash, and the
+ * slots use the bottom bits, so a partition still spreads over the slots
+ * of the next table.
+ */
+static uint32_t group_partition(GroupTable* table, uint32_t hash)
+{
+    return (hash >> (32 - GROUP_PARTITION_BITS * (table->level + 1))) & (GROUP_PARTITIONS - 1);
+}
+
+/*
+ * group_init_level()
+ */
+static void group_init_level(GroupTable* table, size_t memory, uint32_t level)
+{
+    if(memory < GROUP_MIN_MEMORY)
+        memory = GROUP_MIN_MEMORY;
+
+    // A quarter of the budget goes to the slots, which are kept at most
+    // three quarters full, and the rest to the keys
+    table->capacity = 64;
+    while((size_t) table->capacity * 2 * sizeof(GroupSlot) <= memory / 4)
+        table->capacity *= 2;
+    table->level       = level;
+    table->num_groups  = 0;
+    table->max_groups  = table->capacity / 4 * 3;
+    table->keys_size   = memory - (size_t) table->capacity * sizeof(GroupSlot);
+    table->keys_used   = 0;
+    table->memory      = memory;
+    table->num_spilled = 0;
+    table->slots       = calloc(table->capacity, sizeof(GroupSlot));
+    table->keys        = malloc(table->keys_size);
+    if(!table->slots || !table->keys)
+    {
+        fprintf(stderr, "[%s] failed to allocate %lu bytes for groups\n", __func__, (unsigned long) memory);
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t p = 0; p < GROUP_PARTITIONS; ++p)
+        table->partitions[p] = NULL;
+}
+
+/*
+ * group_init()
+ * The budget is never less than GROUP_MIN_MEMORY
+ */
+void group_init(GroupTable* table, size_t memory)
+{
+    group_init_level(table, memory, 0);
+}
+
+/*
+ * group_grow()
+ * Double the slots, or the keys, once the table is past the last level
+ * and can't spill
+ */
+static void group_grow(GroupTable* table, uint32_t key_length)
+{
+    if(table->num_groups >= table->max_groups)
+    {
+        GroupSlot* old_slots    = table->slots;
+        uint32_t   old_capacity = table->capacity;
+
+        table->capacity  *= 2;
+        table->max_groups = table->capacity / 4 * 3;
+        table->slots      = calloc(table->capacity, sizeof(GroupSlot));
+        if(!table->slots)
+        {
+            fprintf(stderr, "[%s] failed to allocate %u slots\n", __func__, table->capacity);
+            exit(EXIT_FAILURE);
+        }
+        for(uint32_t s = 0; s < old_capacity; ++s)
+        {
+            uint32_t pos;
+
+            if(old_slots[s].count == 0)
+                continue;
+            pos = old_slots[s].hash & (table->capacity - 1);
+            while(table->slots[pos].count != 0)
+                pos = (pos + 1) & (table->capacity - 1);
+            table->slots[pos] = old_slots[s];
+        }
+        free(old_slots);
+    }
+    while(table->keys_used + key_length > table->keys_size)
+    {
+        table->keys_size *= 2;
+        table->keys       = realloc(table->keys, table->keys_size);
+        if(!table->keys)
+        {
+            fprintf(stderr, "[%s] failed to allocate %lu bytes for keys\n", __func__, (unsigned long) table->keys_size);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * group_spill()
+ * Write a key and its count to its partition
+ */
+static GroupResult group_spill(GroupTable* table, uint32_t hash, const char* key, uint32_t length, uint64_t count)
+{
+    uint32_t partition = group_partition(table, hash);
+    uint16_t len16     = (uint16_t) length;
+    FILE*    fp;
+
+    if(table->partitions[partition] == NULL)
+    {
+        table->partitions[partition] = tmpfile();
+        if(!table->partitions[partition])
+            return GROUP_IO_ERROR;
+    }
+    fp = table->partitions[partition];
+    if(fwrite(&len16, sizeof(len16), 1, fp) != 1 ||
+       fwrite(&count, sizeof(count), 1, fp) != 1 ||
+       (length > 0 && fwrite(key, length, 1, fp) != 1))
+        return GROUP_IO_ERROR;
+    table->num_spilled++;
+
+    return GROUP_OK;
+}
+
+/*
+ * group_add()
+ * Add count to the group for key. Keys are at most GROUP_MAX_KEY bytes.
+ */
+GroupResult group_add(GroupTable* table, const char* key, uint32_t length, uint64_t count)
+{
+    uint32_t hash;
+    uint32_t pos;
+
+    hash = group_hash(key, length);
+    pos  = hash & (table->capacity - 1);
+    while(table->slots[pos].count != 0)
+    {
+        GroupSlot* slot = &table->slots[pos];
+
+        if(slot->hash == hash && slot->key_length == length &&
+           memcmp(table->keys + slot->key_offset, key, length) == 0)
+        {
+            slot->count += count;
+            return GROUP_OK;
+        }
+        pos = (pos + 1) & (table->capacity - 1);
+    }
+
+    // A new group
+    if(table->num_groups >= table->max_groups || table->keys_used + length > table->keys_size)
+    {
+        if(table->level < GROUP_MAX_LEVEL)
+            return group_spill(table, hash, key, length, count);
+        group_grow(table, length);
+        // The slots may have moved
+        pos = hash & (table->capacity - 1);
+        while(table->slots[pos].count != 0)
+            pos = (pos + 1) & (table->capacity - 1);
+    }
+    table->slots[pos].count      = count;
+    table->slots[pos].hash       = hash;
+    table->slots[pos].key_offset = (uint32_t) table->keys_used;
+    table->slots[pos].key_length = length;
+    memcpy(table->keys + table->keys_used, key, length);
+    table->keys_used += length;
+    table->num_groups++;
+
+    return GROUP_OK;
+}
+
+/*
+ * group_finish()
+ * Emit every group, those in the table first and then those in each
+ * partition. The table is emptied.
+ */
+GroupResult group_finish(GroupTable* table, GroupEmit emit, void* arg)
+{
+    GroupResult result = GROUP_OK;
+
+    for(uint32_t s = 0; s < table->capacity; ++s)
+    {
+        GroupSlot* slot = &table->slots[s];
+
+        if(slot->count != 0)
+            emit(arg, table->keys + slot->key_offset, slot->key_length, slot->count);
+    }
+
+    for(uint32_t p = 0; p < GROUP_PARTITIONS && result == GROUP_OK; ++p)
+    {
+        GroupTable partition;
+        FILE*      fp = table->partitions[p];
+        uint16_t   length;
+        uint64_t   count;
+        char       key[GROUP_MAX_KEY];
+
+        if(fp == NULL)
+            continue;
+        group_init_level(&partition, table->memory, table->level + 1);
+        rewind(fp);
+        while(result == GROUP_OK && fread(&length, sizeof(length), 1, fp) == 1)
+        {
+            if(length > GROUP_MAX_KEY || fread(&count, sizeof(count), 1, fp) != 1 ||
+               (length > 0 && fread(key, length, 1, fp) != 1))
+                result = GROUP_IO_ERROR;
+            else
+                result = group_add(&partition, key, length, count);
+        }
+        if(result == GROUP_OK && ferror(fp))
+            result = GROUP_IO_ERROR;
+        if(result == GROUP_OK)
+            result = group_finish(&partition, emit, arg);
+        group_free(&partition);
+    }
+
+    return result;
+}
+
+/*
+ * group_free()
+ * Release the memory and close (and so remove) the partition files
+ */
+void group_free(GroupTable* table)
+{
+    for(uint32_t p = 0; p < GROUP_PARTITIONS; ++p)
+    {
+        if(table->partitions[p] != NULL)
+            fclose(table->partitions[p]);
+        table->partitions[p] = NULL;
+    }
+    free(table->slots);
+    free(table->keys);
+    table->slots = NULL;
+    table->keys  = NULL;
+}
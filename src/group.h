@@ -0,0 +1,75 @@
+/*
+ * GROUP
+ * Hash aggregation for group by, with partitions spilled to files
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_GROUP_H
+#define __SQ_GROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Groups are counted in an open addressing hash table with linear
+ * probing. Each slot holds the hash, the count and where the key is in
+ * a separate key buffer, so a probe walks a small array of slots and
+ * only touches a key when the hashes match. The slots and the keys
+ * share the memory budget.
+ *
+ * Once the table is full, rows with a key that is already in the table
+ * are still counted, and the rest are written to one of GROUP_PARTITIONS
+ * files chosen by the top bits of their hash. When the table has been
+ * output each partition is grouped on its own in a new table, which
+ * picks its partition with the next bits of the hash if it fills up
+ * too. Past GROUP_MAX_LEVEL the table grows beyond the budget instead.
+ */
+#define GROUP_DEFAULT_MEMORY   (4 * 1024 * 1024)
+#define GROUP_MIN_MEMORY       (16 * 1024)
+#define GROUP_PARTITION_BITS   4
+#define GROUP_PARTITIONS       (1 << GROUP_PARTITION_BITS)
+#define GROUP_MAX_LEVEL        3
+#define GROUP_MAX_KEY          256
+
+typedef enum
+{
+    GROUP_OK,
+    GROUP_IO_ERROR              // a partition file could not be written or read
+} GroupResult;
+
+typedef struct
+{
+    uint64_t count;             // 0 for an empty slot
+    uint32_t hash;
+    uint32_t key_offset;        // in the key buffer
+    uint32_t key_length;
+} GroupSlot;
+
+typedef struct
+{
+    uint32_t   level;           // how deep in the partitions this table is
+    uint32_t   capacity;        // slots, a power of two
+    uint32_t   num_groups;
+    uint32_t   max_groups;      // most groups before the table is full
+    GroupSlot* slots;
+    char*      keys;
+    size_t     keys_size;
+    size_t     keys_used;
+    size_t     memory;
+    FILE*      partitions[GROUP_PARTITIONS];
+    uint64_t   num_spilled;     // rows written to partitions, at this level
+} GroupTable;
+
+// Called once for each group in group_finish()
+typedef void (*GroupEmit)(void* arg, const char* key, uint32_t length, uint64_t count);
+
+void        group_init(GroupTable* table, size_t memory);
+GroupResult group_add(GroupTable* table, const char* key, uint32_t length, uint64_t count);
+GroupResult group_finish(GroupTable* table, GroupEmit emit, void* arg);
+void        group_free(GroupTable* table);
+uint32_t    group_hash(const char* key, uint32_t length);
+
+
+#endif /*__SQ_GROUP_H*/
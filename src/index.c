@@ -0,0 +1,929 @@
+/*
+ * INDEX
+ * Secondary B+Tree index on the email column
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+
+
+// ================ KEYS
+
+/*
+ * index_make_key()
+ * Write an (email, row id) key into key, which must have space for
+ * INDEX_KEY_SIZE bytes.
+ */
+void index_make_key(void* key, const char* email, uint32_t row_id)
+{
+    // strncpy zero pads the email so that keys compare correctly
+    strncpy(key + INDEX_KEY_EMAIL_OFFSET, email, INDEX_KEY_EMAIL_SIZE);
+    memcpy(key + INDEX_KEY_ID_OFFSET, &row_id, INDEX_KEY_ID_SIZE);
+}
+
+char* index_key_email(void* key)
+{
+    return key + INDEX_KEY_EMAIL_OFFSET;
+}
+
+uint32_t* index_key_row_id(void* key)
+{
+    return key + INDEX_KEY_ID_OFFSET;
+}
+
+/*
+ * index_key_compare()
+ * Order keys by email, then by row id
+ */
+int index_key_compare(void* a, void* b)
+{
+    int      cmp;
+    uint32_t id_a;
+    uint32_t id_b;
+
+    cmp = strncmp(index_key_email(a), index_key_email(b), INDEX_KEY_EMAIL_SIZE);
+    if(cmp != 0)
+        return cmp;
+
+    id_a = *index_key_row_id(a);
+    id_b = *index_key_row_id(b);
+    if(id_a == id_b)
+        return 0;
+
+    return (id_a < id_b) ? -1 : 1;
+}
+
+
+// ================ LEAF NODES
+
+void* index_leaf_node_key(void* node, uint32_t cell_num)
+{
+    return node + LEAF_NODE_HEADER_SIZE + cell_num * INDEX_LEAF_NODE_CELL_SIZE;
+}
+
+/*
+ * index_get_node_max_key()
+ * Returns a pointer into the page holding the largest key under node
+ */
+void* index_get_node_max_key(Pager* pager, void* node)
+{
+    if(get_node_type(node) == NODE_LEAF)
+        return index_leaf_node_key(node, *leaf_node_num_cells(node) - 1);
+
+    return index_get_node_max_key(
+            pager,
+            get_page(pager, *internal_node_right_child(node))
+    );
+}
+
+/*
+ * index_leaf_node_insert()
+ */
+void index_leaf_node_insert(Cursor* cursor, void* key)
+{
+    void*    node;
+    uint32_t num_cells;
+
+    node      = get_page(cursor->table->pager, cursor->page_num);
+    num_cells = *leaf_node_num_cells(node);
+    if(num_cells >= INDEX_LEAF_NODE_MAX_CELLS)
+    {
+        index_leaf_node_split_and_insert(cursor, key);
+        return;
+    }
+
+    if(cursor->cell_num < num_cells)
+    {
+        // make room for a new cell
+        memmove(
+            index_leaf_node_key(node, cursor->cell_num + 1),
+            index_leaf_node_key(node, cursor->cell_num),
+            (num_cells - cursor->cell_num) * INDEX_LEAF_NODE_CELL_SIZE
+        );
+    }
+
+    *(leaf_node_num_cells(node)) += 1;
+    memcpy(index_leaf_node_key(node, cursor->cell_num), key, INDEX_KEY_SIZE);
+}
+
+/*
+ * index_leaf_node_split_and_insert()
+ * Same scheme as leaf_node_split_and_insert() in table.c
+ */
+void index_leaf_node_split_and_insert(Cursor* cursor, void* key)
+{
+    void*    old_node;
+    void*    new_node;
+    uint8_t  old_max[INDEX_KEY_SIZE];
+    uint32_t new_page_num;
+
+    old_node     = get_page(cursor->table->pager, cursor->page_num);
+    memcpy(old_max, index_get_node_max_key(cursor->table->pager, old_node), INDEX_KEY_SIZE);
+    new_page_num = get_unused_page_num(cursor->table->pager);
+    new_node     = get_page(cursor->table->pager, new_page_num);
+    init_leaf_node_value(new_node);
+    *node_parent(new_node) = *node_parent(old_node);
+    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
+    *leaf_node_next_leaf(old_node) = new_page_num;
+
+    for(int32_t i = INDEX_LEAF_NODE_MAX_CELLS; i >= 0; --i)
+    {
+        void*    dest_node;
+        uint32_t index_within_node;
+
+        if(i >= (int32_t) INDEX_LEAF_NODE_LEFT_SPLIT_COUNT)
+        {
+            dest_node         = new_node;
+            index_within_node = i - INDEX_LEAF_NODE_LEFT_SPLIT_COUNT;
+        }
+        else
+        {
+            dest_node         = old_node;
+            index_within_node = i;
+        }
+
+        if(i == (int32_t) cursor->cell_num)
+            memcpy(index_leaf_node_key(dest_node, index_within_node), key, INDEX_KEY_SIZE);
+        else if(i > (int32_t) cursor->cell_num)
+        {
+            memcpy(
+                index_leaf_node_key(dest_node, index_within_node),
+                index_leaf_node_key(old_node, i-1),
+                INDEX_LEAF_NODE_CELL_SIZE
+            );
+        }
+        else
+        {
+            memcpy(
+                index_leaf_node_key(dest_node, index_within_node),
+                index_leaf_node_key(old_node, i),
+                INDEX_LEAF_NODE_CELL_SIZE
+            );
+        }
+    }
+
+    *(leaf_node_num_cells(old_node)) = INDEX_LEAF_NODE_LEFT_SPLIT_COUNT;
+    *(leaf_node_num_cells(new_node)) = INDEX_LEAF_NODE_RIGHT_SPLIT_COUNT;
+
+    if(is_node_root(old_node))
+        index_create_new_root(cursor->table, new_page_num);
+    else
+    {
+        uint32_t parent_page_num;
+        void*    parent;
+
+        parent_page_num = *node_parent(old_node);
+        parent          = get_page(cursor->table->pager, parent_page_num);
+        index_update_internal_node_key(
+                parent,
+                old_max,
+                index_get_node_max_key(cursor->table->pager, old_node)
+        );
+        index_internal_node_insert(cursor->table, parent_page_num, new_page_num);
+    }
+}
+
+
+// ================ INTERNAL NODES
+
+void* index_internal_node_cell(void* node, uint32_t cell_num)
+{
+    return node + INTERNAL_NODE_HEADER_SIZE + cell_num * INDEX_INTERNAL_NODE_CELL_SIZE;
+}
+
+uint32_t* index_internal_node_child(void* node, uint32_t child_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    if(child_num > num_keys)
+    {
+        fprintf(stderr, "[%s] tried to access child_num %d > num_keys %d\n",
+                __func__, child_num, num_keys);
+        exit(EXIT_FAILURE);
+    }
+    if(child_num == num_keys)
+        return internal_node_right_child(node);
+
+    return index_internal_node_cell(node, child_num);
+}
+
+void* index_internal_node_key(void* node, uint32_t key_num)
+{
+    return index_internal_node_cell(node, key_num) + INDEX_INTERNAL_NODE_CHILD_SIZE;
+}
+
+/*
+ * index_internal_node_find_child()
+ * Return the index of the child which should contain the given key
+ */
+uint32_t index_internal_node_find_child(void* node, void* key)
+{
+    uint32_t min_index;
+    uint32_t max_index;
+
+    min_index = 0;
+    max_index = *internal_node_num_keys(node);   // there is one more child than key
+
+    while(min_index != max_index)
+    {
+        uint32_t index = (min_index + max_index) / 2;
+
+        if(index_key_compare(index_internal_node_key(node, index), key) >= 0)
+            max_index = index;
+        else
+            min_index = index + 1;
+    }
+
+    return min_index;
+}
+
+/*
+ * index_update_internal_node_key()
+ */
+void index_update_internal_node_key(void* node, void* old_key, void* new_key)
+{
+    uint32_t old_child_index;
+
+    old_child_index = index_internal_node_find_child(node, old_key);
+    if(old_child_index < *internal_node_num_keys(node))
+        memcpy(index_internal_node_key(node, old_child_index), new_key, INDEX_KEY_SIZE);
+}
+
+/*
+ * index_internal_node_insert()
+ * Add a new child/key pair to the parent that corresponds to the child
+ */
+void index_internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num)
+{
+    void*    parent;
+    void*    child;
+    void*    right_child;
+    uint8_t  child_max_key[INDEX_KEY_SIZE];
+    uint32_t index;
+    uint32_t original_num_keys;
+    uint32_t right_child_page_num;
+
+    parent = get_page(table->pager, parent_page_num);
+    child  = get_page(table->pager, child_page_num);
+    memcpy(child_max_key, index_get_node_max_key(table->pager, child), INDEX_KEY_SIZE);
+    index             = index_internal_node_find_child(parent, child_max_key);
+    original_num_keys = *internal_node_num_keys(parent);
+
+    if(original_num_keys >= INDEX_INTERNAL_NODE_MAX_CELLS)
+    {
+        index_internal_node_split_and_insert(table, parent_page_num, child_page_num);
+        return;
+    }
+
+    right_child_page_num = *internal_node_right_child(parent);
+    if(right_child_page_num == INVALID_PAGE_NUM)
+    {
+        *internal_node_right_child(parent) = child_page_num;
+        return;
+    }
+
+    right_child = get_page(table->pager, right_child_page_num);
+    *internal_node_num_keys(parent) = original_num_keys + 1;
+
+    if(index_key_compare(child_max_key, index_get_node_max_key(table->pager, right_child)) > 0)
+    {
+        // replace right child
+        *index_internal_node_child(parent, original_num_keys) = right_child_page_num;
+        memcpy(
+            index_internal_node_key(parent, original_num_keys),
+            index_get_node_max_key(table->pager, right_child),
+            INDEX_KEY_SIZE
+        );
+        *internal_node_right_child(parent) = child_page_num;
+    }
+    else
+    {
+        // make room for the new cell
+        memmove(
+            index_internal_node_cell(parent, index + 1),
+            index_internal_node_cell(parent, index),
+            (original_num_keys - index) * INDEX_INTERNAL_NODE_CELL_SIZE
+        );
+        *index_internal_node_child(parent, index) = child_page_num;
+        memcpy(index_internal_node_key(parent, index), child_max_key, INDEX_KEY_SIZE);
+    }
+}
+
+/*
+ * index_internal_node_split_and_insert()
+ * Same scheme as internal_node_split_and_insert() in table.c
+ */
+void index_internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num)
+{
+    uint32_t  old_page_num;
+    uint32_t  new_page_num;
+    uint32_t  cur_page_num;
+    uint32_t  dest_page_num;
+    uint32_t* old_num_keys;
+    uint8_t   old_max[INDEX_KEY_SIZE];
+    uint8_t   child_max[INDEX_KEY_SIZE];
+    void*     old_node;
+    void*     new_node = NULL;
+    void*     child;
+    void*     parent;
+    void*     cur;
+    int       splitting_root;
+
+    old_page_num = parent_page_num;
+    old_node     = get_page(table->pager, parent_page_num);
+    memcpy(old_max, index_get_node_max_key(table->pager, old_node), INDEX_KEY_SIZE);
+    child        = get_page(table->pager, child_page_num);
+    memcpy(child_max, index_get_node_max_key(table->pager, child), INDEX_KEY_SIZE);
+    new_page_num   = get_unused_page_num(table->pager);
+    splitting_root = is_node_root(old_node);
+
+    if(splitting_root)
+    {
+        index_create_new_root(table, new_page_num);
+        parent       = get_page(table->pager, table->index_root_page_num);
+        old_page_num = *index_internal_node_child(parent, 0);
+        old_node     = get_page(table->pager, old_page_num);
+    }
+    else
+    {
+        parent   = get_page(table->pager, *node_parent(old_node));
+        new_node = get_page(table->pager, new_page_num);
+        init_internal_node(new_node);
+    }
+
+    old_num_keys = internal_node_num_keys(old_node);
+
+    // The right child always moves to the new node
+    cur_page_num = *internal_node_right_child(old_node);
+    cur          = get_page(table->pager, cur_page_num);
+    index_internal_node_insert(table, new_page_num, cur_page_num);
+    *node_parent(cur) = new_page_num;
+    *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
+
+    // followed by the upper half of the cells
+    for(uint32_t i = INDEX_INTERNAL_NODE_MAX_CELLS - 1; i > INDEX_INTERNAL_NODE_MAX_CELLS / 2; --i)
+    {
+        cur_page_num = *index_internal_node_child(old_node, i);
+        cur          = get_page(table->pager, cur_page_num);
+        index_internal_node_insert(table, new_page_num, cur_page_num);
+        *node_parent(cur) = new_page_num;
+        (*old_num_keys)--;
+    }
+
+    // The highest remaining cell becomes the right child of the old node
+    *internal_node_right_child(old_node) = *index_internal_node_child(old_node, *old_num_keys - 1);
+    (*old_num_keys)--;
+
+    if(index_key_compare(child_max, index_get_node_max_key(table->pager, old_node)) < 0)
+        dest_page_num = old_page_num;
+    else
+        dest_page_num = new_page_num;
+    index_internal_node_insert(table, dest_page_num, child_page_num);
+    *node_parent(child) = dest_page_num;
+
+    index_update_internal_node_key(
+            parent,
+            old_max,
+            index_get_node_max_key(table->pager, old_node)
+    );
+
+    if(!splitting_root)
+    {
+        index_internal_node_insert(table, *node_parent(old_node), new_page_num);
+        *node_parent(new_node) = *node_parent(old_node);
+    }
+}
+
+/*
+ * index_create_new_root()
+ * Same scheme as create_new_root() in table.c. The index root stays at
+ * INDEX_ROOT_PAGE_NUM.
+ */
+void index_create_new_root(Table* table, uint32_t right_child_page_num)
+{
+    void*    root;
+    void*    right_child;
+    void*    left_child;
+    uint32_t left_child_page_num;
+
+    root                = get_page(table->pager, table->index_root_page_num);
+    right_child         = get_page(table->pager, right_child_page_num);
+    left_child_page_num = get_unused_page_num(table->pager);
+    left_child          = get_page(table->pager, left_child_page_num);
+
+    if(get_node_type(root) == NODE_INTERNAL)
+    {
+        init_internal_node(right_child);
+        init_internal_node(left_child);
+    }
+
+    // left child has data copied from old root
+    memcpy(left_child, root, PAGE_SIZE);
+    set_node_root(left_child, 0);
+
+    if(get_node_type(left_child) == NODE_INTERNAL)
+    {
+        void* child;
+
+        for(uint32_t i = 0; i < *internal_node_num_keys(left_child); ++i)
+        {
+            child = get_page(table->pager, *index_internal_node_child(left_child, i));
+            *node_parent(child) = left_child_page_num;
+        }
+        child = get_page(table->pager, *internal_node_right_child(left_child));
+        *node_parent(child) = left_child_page_num;
+    }
+
+    init_internal_node(root);
+    set_node_root(root, 1);
+    *internal_node_num_keys(root) = 1;
+    *index_internal_node_child(root, 0) = left_child_page_num;
+    memcpy(
+        index_internal_node_key(root, 0),
+        index_get_node_max_key(table->pager, left_child),
+        INDEX_KEY_SIZE
+    );
+    *internal_node_right_child(root) = right_child_page_num;
+    *node_parent(left_child)         = table->index_root_page_num;
+    *node_parent(right_child)        = table->index_root_page_num;
+}
+
+
+// ================ DELETION
+
+/*
+ * index_leaf_node_delete()
+ * Same scheme as leaf_node_delete() in table.c
+ */
+void index_leaf_node_delete(Cursor* cursor)
+{
+    void*    node;
+    uint32_t num_cells;
+
+    node      = get_page(cursor->table->pager, cursor->page_num);
+    num_cells = *leaf_node_num_cells(node);
+    if(cursor->cell_num >= num_cells)
+        return;
+
+    memmove(
+        index_leaf_node_key(node, cursor->cell_num),
+        index_leaf_node_key(node, cursor->cell_num + 1),
+        (num_cells - cursor->cell_num - 1) * INDEX_LEAF_NODE_CELL_SIZE
+    );
+    *leaf_node_num_cells(node) = num_cells - 1;
+
+    if(cursor->cell_num == num_cells - 1 && num_cells > 1)
+        index_update_node_max_key(cursor->table, cursor->page_num);
+
+    index_rebalance_node(cursor->table, cursor->page_num);
+}
+
+/*
+ * index_leaf_node_merge()
+ * Same scheme as leaf_node_merge() in table.c
+ */
+void index_leaf_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index)
+{
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+
+    parent         = get_page(table->pager, parent_page_num);
+    left_page_num  = *index_internal_node_child(parent, left_index);
+    right_page_num = *index_internal_node_child(parent, left_index + 1);
+    left           = get_page(table->pager, left_page_num);
+    right          = get_page(table->pager, right_page_num);
+
+    memcpy(
+        index_leaf_node_key(left, *leaf_node_num_cells(left)),
+        index_leaf_node_key(right, 0),
+        *leaf_node_num_cells(right) * INDEX_LEAF_NODE_CELL_SIZE
+    );
+    *leaf_node_num_cells(left) += *leaf_node_num_cells(right);
+    *leaf_node_next_leaf(left)  = *leaf_node_next_leaf(right);
+
+    index_internal_node_remove(parent, left_index);
+    *index_internal_node_child(parent, left_index) = left_page_num;
+    pager_free_page(table->pager, right_page_num);
+}
+
+/*
+ * index_leaf_node_redistribute()
+ */
+void index_leaf_node_redistribute(void* left, void* right)
+{
+    uint32_t num_left;
+    uint32_t num_right;
+    uint32_t new_num_left;
+
+    num_left     = *leaf_node_num_cells(left);
+    num_right    = *leaf_node_num_cells(right);
+    new_num_left = (num_left + num_right) / 2;
+
+    if(num_left > new_num_left)
+    {
+        uint32_t num_moved = num_left - new_num_left;
+
+        memmove(
+            index_leaf_node_key(right, num_moved),
+            index_leaf_node_key(right, 0),
+            num_right * INDEX_LEAF_NODE_CELL_SIZE
+        );
+        memcpy(
+            index_leaf_node_key(right, 0),
+            index_leaf_node_key(left, new_num_left),
+            num_moved * INDEX_LEAF_NODE_CELL_SIZE
+        );
+    }
+    else
+    {
+        uint32_t num_moved = new_num_left - num_left;
+
+        memcpy(
+            index_leaf_node_key(left, num_left),
+            index_leaf_node_key(right, 0),
+            num_moved * INDEX_LEAF_NODE_CELL_SIZE
+        );
+        memmove(
+            index_leaf_node_key(right, 0),
+            index_leaf_node_key(right, num_moved),
+            (num_right - num_moved) * INDEX_LEAF_NODE_CELL_SIZE
+        );
+    }
+
+    *leaf_node_num_cells(left)  = new_num_left;
+    *leaf_node_num_cells(right) = num_left + num_right - new_num_left;
+}
+
+/*
+ * index_internal_node_child_index()
+ */
+uint32_t index_internal_node_child_index(void* node, uint32_t child_page_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    for(uint32_t i = 0; i < num_keys; ++i)
+    {
+        if(*index_internal_node_child(node, i) == child_page_num)
+            return i;
+    }
+    if(*internal_node_right_child(node) != child_page_num)
+    {
+        fprintf(stderr, "[%s] page %d is not a child of this node\n",
+                __func__, child_page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    return num_keys;
+}
+
+/*
+ * index_internal_node_remove()
+ * Same as internal_node_remove() in table.c
+ */
+void index_internal_node_remove(void* node, uint32_t index)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    memmove(
+        index_internal_node_cell(node, index),
+        index_internal_node_cell(node, index + 1),
+        (num_keys - index - 1) * INDEX_INTERNAL_NODE_CELL_SIZE
+    );
+    *internal_node_num_keys(node) = num_keys - 1;
+}
+
+/*
+ * index_internal_node_merge()
+ * Same scheme as internal_node_merge() in table.c
+ */
+void index_internal_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index)
+{
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint8_t  left_max[INDEX_KEY_SIZE];
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+    uint32_t num_left;
+    uint32_t num_right;
+    uint32_t left_right_child;
+
+    parent           = get_page(table->pager, parent_page_num);
+    left_page_num    = *index_internal_node_child(parent, left_index);
+    right_page_num   = *index_internal_node_child(parent, left_index + 1);
+    left             = get_page(table->pager, left_page_num);
+    right            = get_page(table->pager, right_page_num);
+    num_left         = *internal_node_num_keys(left);
+    num_right        = *internal_node_num_keys(right);
+    left_right_child = *internal_node_right_child(left);
+    memcpy(left_max, index_get_node_max_key(table->pager, left), INDEX_KEY_SIZE);
+
+    *internal_node_num_keys(left) = num_left + 1 + num_right;
+    *index_internal_node_child(left, num_left) = left_right_child;
+    memcpy(index_internal_node_key(left, num_left), left_max, INDEX_KEY_SIZE);
+    memcpy(
+        index_internal_node_cell(left, num_left + 1),
+        index_internal_node_cell(right, 0),
+        num_right * INDEX_INTERNAL_NODE_CELL_SIZE
+    );
+    *internal_node_right_child(left) = *internal_node_right_child(right);
+
+    for(uint32_t i = num_left + 1; i <= num_left + 1 + num_right; ++i)
+        *node_parent(get_page(table->pager, *index_internal_node_child(left, i))) = left_page_num;
+
+    index_internal_node_remove(parent, left_index);
+    *index_internal_node_child(parent, left_index) = left_page_num;
+    pager_free_page(table->pager, right_page_num);
+}
+
+/*
+ * index_internal_node_redistribute()
+ * Same scheme as internal_node_redistribute() in table.c
+ */
+void index_internal_node_redistribute(Table* table, uint32_t left_page_num, uint32_t right_page_num)
+{
+    void*    left;
+    void*    right;
+    void*    child;
+    uint32_t child_page_num;
+    uint32_t num_keys;
+
+    left  = get_page(table->pager, left_page_num);
+    right = get_page(table->pager, right_page_num);
+
+    while(*internal_node_num_keys(left) + 1 < *internal_node_num_keys(right))
+    {
+        num_keys       = *internal_node_num_keys(left);
+        child_page_num = *index_internal_node_child(right, 0);
+        child          = get_page(table->pager, *internal_node_right_child(left));
+
+        *internal_node_num_keys(left) = num_keys + 1;
+        *index_internal_node_child(left, num_keys) = *internal_node_right_child(left);
+        memcpy(
+            index_internal_node_key(left, num_keys),
+            index_get_node_max_key(table->pager, child),
+            INDEX_KEY_SIZE
+        );
+        *internal_node_right_child(left) = child_page_num;
+        *node_parent(get_page(table->pager, child_page_num)) = left_page_num;
+        index_internal_node_remove(right, 0);
+    }
+
+    while(*internal_node_num_keys(right) + 1 < *internal_node_num_keys(left))
+    {
+        num_keys       = *internal_node_num_keys(right);
+        child_page_num = *internal_node_right_child(left);
+        child          = get_page(table->pager, child_page_num);
+
+        memmove(
+            index_internal_node_cell(right, 1),
+            index_internal_node_cell(right, 0),
+            num_keys * INDEX_INTERNAL_NODE_CELL_SIZE
+        );
+        *internal_node_num_keys(right) = num_keys + 1;
+        *index_internal_node_child(right, 0) = child_page_num;
+        memcpy(
+            index_internal_node_key(right, 0),
+            index_get_node_max_key(table->pager, child),
+            INDEX_KEY_SIZE
+        );
+        *node_parent(child) = right_page_num;
+
+        num_keys = *internal_node_num_keys(left);
+        *internal_node_right_child(left) = *index_internal_node_child(left, num_keys - 1);
+        *internal_node_num_keys(left)    = num_keys - 1;
+    }
+}
+
+/*
+ * index_update_node_max_key()
+ * Same as update_node_max_key() in table.c
+ */
+void index_update_node_max_key(Table* table, uint32_t page_num)
+{
+    void*    node;
+    void*    parent;
+    uint8_t  max_key[INDEX_KEY_SIZE];
+    uint32_t parent_page_num;
+    uint32_t index;
+
+    node = get_page(table->pager, page_num);
+    memcpy(max_key, index_get_node_max_key(table->pager, node), INDEX_KEY_SIZE);
+    while(!is_node_root(node))
+    {
+        parent_page_num = *node_parent(node);
+        parent          = get_page(table->pager, parent_page_num);
+        index           = index_internal_node_child_index(parent, page_num);
+        if(index < *internal_node_num_keys(parent))
+        {
+            memcpy(index_internal_node_key(parent, index), max_key, INDEX_KEY_SIZE);
+            return;
+        }
+        page_num = parent_page_num;
+        node     = parent;
+    }
+}
+
+/*
+ * index_rebalance_node()
+ * Same scheme as rebalance_node() in table.c
+ */
+void index_rebalance_node(Table* table, uint32_t page_num)
+{
+    void*    node;
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint32_t parent_page_num;
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+    uint32_t left_index;
+    uint32_t index;
+
+    node = get_page(table->pager, page_num);
+    if(is_node_root(node))
+    {
+        if(get_node_type(node) == NODE_INTERNAL && *internal_node_num_keys(node) == 0)
+            index_collapse_root(table);
+        return;
+    }
+    if(get_node_type(node) == NODE_LEAF && *leaf_node_num_cells(node) >= INDEX_LEAF_NODE_MIN_CELLS)
+        return;
+    if(get_node_type(node) == NODE_INTERNAL && *internal_node_num_keys(node) >= INDEX_INTERNAL_NODE_MIN_KEYS)
+        return;
+
+    parent_page_num = *node_parent(node);
+    parent          = get_page(table->pager, parent_page_num);
+    index           = index_internal_node_child_index(parent, page_num);
+    left_index      = (index > 0) ? index - 1 : 0;
+    left_page_num   = *index_internal_node_child(parent, left_index);
+    right_page_num  = *index_internal_node_child(parent, left_index + 1);
+    left            = get_page(table->pager, left_page_num);
+    right           = get_page(table->pager, right_page_num);
+
+    if(get_node_type(node) == NODE_LEAF)
+    {
+        if(*leaf_node_num_cells(left) + *leaf_node_num_cells(right) <= INDEX_LEAF_NODE_MAX_CELLS)
+        {
+            index_leaf_node_merge(table, parent_page_num, left_index);
+            index_rebalance_node(table, parent_page_num);
+            return;
+        }
+        index_leaf_node_redistribute(left, right);
+    }
+    else
+    {
+        if(*internal_node_num_keys(left) + 1 + *internal_node_num_keys(right) <= INDEX_INTERNAL_NODE_MAX_CELLS)
+        {
+            index_internal_node_merge(table, parent_page_num, left_index);
+            index_rebalance_node(table, parent_page_num);
+            return;
+        }
+        index_internal_node_redistribute(table, left_page_num, right_page_num);
+    }
+    memcpy(
+        index_internal_node_key(parent, left_index),
+        index_get_node_max_key(table->pager, left),
+        INDEX_KEY_SIZE
+    );
+}
+
+/*
+ * index_collapse_root()
+ * Same as collapse_root() in table.c
+ */
+void index_collapse_root(Table* table)
+{
+    void*    root;
+    void*    child;
+    uint32_t child_page_num;
+
+    root           = get_page(table->pager, table->index_root_page_num);
+    child_page_num = *internal_node_right_child(root);
+    child          = get_page(table->pager, child_page_num);
+
+    memcpy(root, child, PAGE_SIZE);
+    set_node_root(root, 1);
+    if(get_node_type(root) == NODE_INTERNAL)
+    {
+        for(uint32_t i = 0; i <= *internal_node_num_keys(root); ++i)
+            *node_parent(get_page(table->pager, *index_internal_node_child(root, i))) = table->index_root_page_num;
+    }
+    pager_free_page(table->pager, child_page_num);
+}
+
+
+// ================ INDEX
+
+/*
+ * index_find()
+ * Return a cursor at the first index entry that is not less than
+ * (email, row_id). Passing a row_id of 0 finds the first entry for
+ * an email. If there is no such entry the cursor is at the end.
+ */
+Cursor* index_find(Table* table, const char* email, uint32_t row_id)
+{
+    void*    node;
+    uint32_t page_num;
+    uint32_t min_index;
+    uint32_t one_past_max_index;
+    uint8_t  key[INDEX_KEY_SIZE];
+    Cursor*  cursor;
+
+    cursor = arena_alloc(&table->arena, sizeof(Cursor));
+    if(!cursor)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for Cursor object\n", __func__);
+        return NULL;
+    }
+
+    index_make_key(key, email, row_id);
+    page_num = table->index_root_page_num;
+    node     = get_page(table->pager, page_num);
+    while(node && get_node_type(node) == NODE_INTERNAL)
+    {
+        page_num = *index_internal_node_child(node, index_internal_node_find_child(node, key));
+        node     = get_page(table->pager, page_num);
+    }
+    if(!node)
+        return NULL;
+
+    min_index          = 0;
+    one_past_max_index = *leaf_node_num_cells(node);
+    while(one_past_max_index != min_index)
+    {
+        uint32_t index = (min_index + one_past_max_index) / 2;
+
+        if(index_key_compare(key, index_leaf_node_key(node, index)) <= 0)
+            one_past_max_index = index;
+        else
+            min_index = index + 1;
+    }
+
+    cursor->table        = table;
+    cursor->page_num     = page_num;
+    cursor->cell_num     = min_index;
+    cursor->end_of_table = (min_index >= *leaf_node_num_cells(node)) ? 1 : 0;
+
+    return cursor;
+}
+
+/*
+ * index_insert()
+ * Add an entry for a row to the email index
+ */
+void index_insert(Table* table, const char* email, uint32_t row_id)
+{
+    uint8_t key[INDEX_KEY_SIZE];
+    Cursor* cursor;
+
+    cursor = index_find(table, email, row_id);
+    if(!cursor)
+        return;
+
+    index_make_key(key, email, row_id);
+    index_leaf_node_insert(cursor, key);
+}
+
+/*
+ * index_delete()
+ * Remove the entry for a row from the email index. Returns 0 if there
+ * was no such entry.
+ */
+int index_delete(Table* table, const char* email, uint32_t row_id)
+{
+    uint8_t key[INDEX_KEY_SIZE];
+    Cursor* cursor;
+    int     found;
+
+    cursor = index_find(table, email, row_id);
+    if(!cursor)
+        return 0;
+
+    index_make_key(key, email, row_id);
+    found = !(cursor->end_of_table) && index_key_compare(key, index_cursor_key(cursor)) == 0;
+    if(found)
+        index_leaf_node_delete(cursor);
+
+    return found;
+}
+
+/*
+ * index_cursor_key()
+ * The index equivalent of cursor_value()
+ */
+void* index_cursor_key(Cursor* cursor)
+{
+    void* page;
+
+    page = get_page(cursor->table->pager, cursor->page_num);
+
+    return index_leaf_node_key(page, cursor->cell_num);
+}
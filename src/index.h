@@ -0,0 +1,99 @@
+/*
+ * INDEX
+ * Secondary B+Tree index on the email column
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_INDEX_H
+#define __SQ_INDEX_H
+
+#include <stdint.h>
+#include "table.h"
+
+// The index lives in the same file as the table. Its root comes straight
+// after the table root, and like the table root it never moves.
+#define INDEX_ROOT_PAGE_NUM (TABLE_ROOT_PAGE_NUM + 1)
+
+/*
+ * Index Key Layout
+ * Entries are keyed on (email, row id). Emails are not unique, so the
+ * row id is used to break ties and give every entry a unique position.
+ * The email is stored zero padded in the same way as in a row.
+ */
+#define INDEX_KEY_EMAIL_SIZE   EMAIL_SIZE
+#define INDEX_KEY_EMAIL_OFFSET 0
+#define INDEX_KEY_ID_SIZE      sizeof(uint32_t)
+#define INDEX_KEY_ID_OFFSET    (INDEX_KEY_EMAIL_OFFSET + INDEX_KEY_EMAIL_SIZE)
+#define INDEX_KEY_SIZE         (INDEX_KEY_EMAIL_SIZE + INDEX_KEY_ID_SIZE)
+
+/*
+ * Index Leaf Node Body Layout
+ * Index leaves use the same header as table leaves so that the cursor
+ * code can walk them, but have no summary footer. Each cell is just a 
+ * key, the row id in the key is the payload.
+ */
+#define INDEX_LEAF_NODE_CELL_SIZE         INDEX_KEY_SIZE
+#define INDEX_LEAF_NODE_SPACE_FOR_CELLS   (PAGE_SIZE - LEAF_NODE_HEADER_SIZE)
+#define INDEX_LEAF_NODE_MAX_CELLS         (INDEX_LEAF_NODE_SPACE_FOR_CELLS / INDEX_LEAF_NODE_CELL_SIZE)
+#define INDEX_LEAF_NODE_RIGHT_SPLIT_COUNT ((INDEX_LEAF_NODE_MAX_CELLS + 1) / 2)
+#define INDEX_LEAF_NODE_LEFT_SPLIT_COUNT  ((INDEX_LEAF_NODE_MAX_CELLS + 1) - INDEX_LEAF_NODE_RIGHT_SPLIT_COUNT)
+#define INDEX_LEAF_NODE_MIN_CELLS         (INDEX_LEAF_NODE_MAX_CELLS / 2)
+
+/*
+ * Index Internal Node Body Layout
+ * Same header as table internal nodes. Each cell is a child pointer
+ * followed by the largest key in that child.
+ */
+#define INDEX_INTERNAL_NODE_CHILD_SIZE sizeof(uint32_t)
+#define INDEX_INTERNAL_NODE_CELL_SIZE  (INDEX_INTERNAL_NODE_CHILD_SIZE + INDEX_KEY_SIZE)
+#define INDEX_INTERNAL_NODE_MAX_CELLS  (INTERNAL_NODE_SPACE_FOR_CELLS / INDEX_INTERNAL_NODE_CELL_SIZE)
+#define INDEX_INTERNAL_NODE_MIN_KEYS   (INDEX_INTERNAL_NODE_MAX_CELLS / 2)
+
+
+/*
+ * Keys
+ */
+void      index_make_key(void* key, const char* email, uint32_t row_id);
+char*     index_key_email(void* key);
+uint32_t* index_key_row_id(void* key);
+int       index_key_compare(void* a, void* b);
+
+/*
+ * Index Nodes
+ */
+void*     index_leaf_node_key(void* node, uint32_t cell_num);
+void*     index_get_node_max_key(Pager* pager, void* node);
+void      index_leaf_node_insert(Cursor* cursor, void* key);
+void      index_leaf_node_split_and_insert(Cursor* cursor, void* key);
+
+void*     index_internal_node_cell(void* node, uint32_t cell_num);
+uint32_t* index_internal_node_child(void* node, uint32_t child_num);
+void*     index_internal_node_key(void* node, uint32_t key_num);
+uint32_t  index_internal_node_find_child(void* node, void* key);
+void      index_internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+void      index_internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+void      index_update_internal_node_key(void* node, void* old_key, void* new_key);
+void      index_create_new_root(Table* table, uint32_t right_child_page_num);
+
+void      index_leaf_node_delete(Cursor* cursor);
+void      index_leaf_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index);
+void      index_leaf_node_redistribute(void* left, void* right);
+uint32_t  index_internal_node_child_index(void* node, uint32_t child_page_num);
+void      index_internal_node_remove(void* node, uint32_t index);
+void      index_internal_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index);
+void      index_internal_node_redistribute(Table* table, uint32_t left_page_num, uint32_t right_page_num);
+void      index_update_node_max_key(Table* table, uint32_t page_num);
+void      index_rebalance_node(Table* table, uint32_t page_num);
+void      index_collapse_root(Table* table);
+
+/*
+ * Index operations
+ */
+Cursor*   index_find(Table* table, const char* email, uint32_t row_id);
+void      index_insert(Table* table, const char* email, uint32_t row_id);
+int       index_delete(Table* table, const char* email, uint32_t row_id);
+void*     index_cursor_key(Cursor* cursor);
+
+
+#endif /*__SQ_INDEX_H*/
@@ -5,11 +5,22 @@
  * Stefan Wong 2019
  */
 
+// for open_memstream()
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "input.h"
 #include "table.h"
+#include "index.h"
+#include "filter.h"
+#include "kernel.h"
+#include "vacuum.h"
+#include "integrity.h"
+#include "trace.h"
+#include "cache.h"
+#include "rowcache.h"
 
 /*
  * new_input_buffer()
@@ -26,6 +37,7 @@ InputBuffer* new_input_buffer(void)
     input_buffer->buffer        = NULL;
     input_buffer->buffer_length = 0;
     input_buffer->input_length  = 0;
+    input_buffer->recorder      = NULL;
 
     return input_buffer;
 }
@@ -42,7 +54,7 @@ void close_input_buffer(InputBuffer* input_buffer)
 
 /*
  * read_input()
- * Read some input from stdin.
+ * Read some input from stdin, and log it if the buffer has a recorder.
  */
 void read_input(InputBuffer* input_buffer)
 {
@@ -63,6 +75,34 @@ void read_input(InputBuffer* input_buffer)
     // Ignore trailing newline
     input_buffer->input_length = bytes_read - 1;
     input_buffer->buffer[bytes_read - 1] = 0;
+
+    if(input_buffer->recorder)
+        workload_record(input_buffer->recorder, input_buffer->buffer, input_buffer->input_length, trace_now());
+}
+
+/*
+ * meta_memory_budget()
+ * Show a memory budget, or set it from args
+ */
+static MetaCommandResult meta_memory_budget(const char* args, size_t* budget, size_t min_memory)
+{
+    unsigned long memory;
+
+    if(args[0] == '\0')
+    {
+        fprintf(stdout, "%lu\n", (unsigned long) *budget);
+        return META_COMMAND_SUCCESS;
+    }
+    if(sscanf(args, " %lu", &memory) != 1)
+        return META_COMMAND_UNRECOGNIZED_COMMAND;
+    if(memory < min_memory)
+    {
+        fprintf(stdout, "Memory must be at least %lu bytes\n", (unsigned long) min_memory);
+        return META_COMMAND_SUCCESS;
+    }
+    *budget = memory;
+
+    return META_COMMAND_SUCCESS;
 }
 
 /*
@@ -77,12 +117,212 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table)
         close_input_buffer(input_buffer);
         exit(EXIT_SUCCESS);
     }
+    else if(strncmp(input_buffer->buffer, ".vacuum", 7) == 0)
+    {
+        // .vacuum [fill factor percent]
+        uint32_t     fill_factor = VACUUM_DEFAULT_FILL_FACTOR;
+        VacuumStats  stats;
+        VacuumResult result;
+
+        if(input_buffer->buffer[7] != '\0' && 
+           sscanf(input_buffer->buffer + 7, " %u", &fill_factor) != 1)
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+
+        result = db_vacuum(table, fill_factor, &stats);
+        if(result == VACUUM_BAD_FILL_FACTOR)
+            fprintf(stdout, "Fill factor must be between 1 and 100\n");
+        else if(result == VACUUM_IN_TRANSACTION)
+            fprintf(stdout, "Commit or roll back the transaction before a vacuum\n");
+        else if(result == VACUUM_TABLE_FULL)
+            fprintf(stdout, "Vacuum at %u%% fill would need more than %d pages, the database is unchanged\n",
+                    fill_factor, TABLE_MAX_PAGES);
+        else if(result != VACUUM_SUCCESS)
+            fprintf(stdout, "Vacuum failed, the database is unchanged\n");
+        else
+        {
+            // A low fill factor can leave the file larger than it was
+            fprintf(stdout, "Vacuumed %lu bytes to %lu bytes, reclaimed %ld bytes\n",
+                    (unsigned long) stats.old_size,
+                    (unsigned long) stats.new_size,
+                    (long) stats.old_size - (long) stats.new_size
+            );
+        }
+        table_reset_arena(table);
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strcmp(input_buffer->buffer, ".integrity_check") == 0)
+    {
+        uint32_t num_problems;
+
+        num_problems = db_integrity_check(table);
+        if(num_problems == 0)
+            fprintf(stdout, "ok\n");
+        else
+            fprintf(stdout, "%u problems found\n", num_problems);
+        table_reset_arena(table);
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, ".trace", 6) == 0)
+    {
+        // .trace [json|chrome [file]] or .trace reset
+        char  format[16] = "json";
+        char  filename[256] = "";
+        FILE* fp = stdout;
+
+        if(input_buffer->buffer[6] != '\0' && input_buffer->buffer[6] != ' ')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        sscanf(input_buffer->buffer + 6, " %15s %255s", format, filename);
+        if(strcmp(format, "reset") == 0)
+        {
+            trace_reset();
+            return META_COMMAND_SUCCESS;
+        }
+        if(strcmp(format, "json") != 0 && strcmp(format, "chrome") != 0)
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        if(!trace_enabled())
+            fprintf(stdout, "Tracing is not compiled in, rebuild with make TRACE=1\n");
+
+        if(filename[0] != '\0')
+        {
+            fp = fopen(filename, "w");
+            if(!fp)
+            {
+                fprintf(stdout, "Unable to open trace file [%s]\n", filename);
+                return META_COMMAND_SUCCESS;
+            }
+        }
+        if(strcmp(format, "json") == 0)
+            trace_write_json(fp);
+        else
+            trace_write_chrome(fp);
+        if(fp != stdout)
+        {
+            fclose(fp);
+            fprintf(stdout, "Wrote %s trace to [%s]\n", format, filename);
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, ".sort_memory", 12) == 0)
+    {
+        // .sort_memory [bytes]
+        return meta_memory_budget(input_buffer->buffer + 12, &table->sort_memory, SORT_MIN_MEMORY);
+    }
+    else if(strncmp(input_buffer->buffer, ".group_memory", 13) == 0)
+    {
+        // .group_memory [bytes]
+        return meta_memory_budget(input_buffer->buffer + 13, &table->group_memory, GROUP_MIN_MEMORY);
+    }
+    else if(strncmp(input_buffer->buffer, ".cache", 6) == 0)
+    {
+        // .cache [on [bytes]|off]
+        char          mode[8] = "";
+        unsigned long memory  = CACHE_DEFAULT_MEMORY;
+        ResultCache*  cache   = table->cache;
+
+        if(input_buffer->buffer[6] != '\0' && input_buffer->buffer[6] != ' ')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        sscanf(input_buffer->buffer + 6, " %7s %lu", mode, &memory);
+        if(strcmp(mode, "on") == 0)
+        {
+            cache_free(table->cache);
+            table->cache = cache_create(memory);
+        }
+        else if(strcmp(mode, "off") == 0)
+        {
+            cache_free(table->cache);
+            table->cache = NULL;
+        }
+        else if(mode[0] != '\0')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        else if(cache == NULL)
+            fprintf(stdout, "off\n");
+        else
+        {
+            fprintf(stdout, "%u results, %lu of %lu bytes, %lu hits, %lu misses, %lu evictions\n",
+                    cache->num_entries,
+                    (unsigned long) cache->memory,
+                    (unsigned long) cache->max_memory,
+                    (unsigned long) cache->hits,
+                    (unsigned long) cache->misses,
+                    (unsigned long) cache->evictions
+            );
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, ".row_cache", 10) == 0)
+    {
+        // .row_cache [on [rows]|off]
+        char          mode[8]  = "";
+        unsigned long num_rows = ROW_CACHE_DEFAULT_ROWS;
+        uint64_t      hits;
+        uint64_t      misses;
+
+        if(input_buffer->buffer[10] != '\0' && input_buffer->buffer[10] != ' ')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        sscanf(input_buffer->buffer + 10, " %7s %lu", mode, &num_rows);
+        if(strcmp(mode, "on") == 0)
+        {
+            row_cache_free(table->row_cache);
+            table->row_cache = row_cache_create(num_rows);
+        }
+        else if(strcmp(mode, "off") == 0)
+        {
+            row_cache_free(table->row_cache);
+            table->row_cache = NULL;
+        }
+        else if(mode[0] != '\0')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        else if(table->row_cache == NULL)
+            fprintf(stdout, "off\n");
+        else
+        {
+            row_cache_stats(table->row_cache, &hits, &misses);
+            fprintf(stdout, "%u rows, %lu hits, %lu misses, %.1f%% hit rate\n",
+                    row_cache_capacity(table->row_cache),
+                    (unsigned long) hits,
+                    (unsigned long) misses,
+                    (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0
+            );
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strcmp(input_buffer->buffer, ".tables") == 0)
+    {
+        Catalog* catalog = catalog_get(table);
+
+        fprintf(stdout, "%s\n", CATALOG_USERS_TABLE);
+        for(uint32_t t = 0; t < catalog->num_tables; ++t)
+            fprintf(stdout, "%s\n", catalog->tables[t].schema.name);
+        return META_COMMAND_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, ".schema", 7) == 0)
+    {
+        // .schema [table]
+        char     name[CATALOG_MAX_NAME + 2] = "";
+        Schema   users;
+        Catalog* catalog;
+
+        if(input_buffer->buffer[7] != '\0' && input_buffer->buffer[7] != ' ')
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        sscanf(input_buffer->buffer + 7, " %16s", name);
+        catalog = catalog_get(table);
+        schema_users(&users);
+        if(name[0] == '\0' || strcmp(name, CATALOG_USERS_TABLE) == 0)
+            schema_print(&users, stdout);
+        for(uint32_t t = 0; t < catalog->num_tables; ++t)
+        {
+            if(name[0] == '\0' || strcmp(name, catalog->tables[t].schema.name) == 0)
+                schema_print(&catalog->tables[t].schema, stdout);
+        }
+        return META_COMMAND_SUCCESS;
+    }
     else
         return META_COMMAND_UNRECOGNIZED_COMMAND;
 }
 
 /*
  * prepare_insert()
+ * insert [or replace] <id> <username> <email>
  */
 PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement)
 {
@@ -95,6 +335,14 @@ PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement)
     statement->type = STATEMENT_INSERT;
     keyword         = strtok(input_buffer->buffer, " ");
     id_string       = strtok(NULL, " ");
+    if(id_string != NULL && strcmp(id_string, "or") == 0)
+    {
+        keyword = strtok(NULL, " ");
+        if(keyword == NULL || strcmp(keyword, "replace") != 0)
+            return PREPARE_SYNTAX_ERROR;
+        statement->replace = 1;
+        id_string = strtok(NULL, " ");
+    }
     username        = strtok(NULL, " ");
     email           = strtok(NULL, " ");
 
@@ -122,90 +370,2056 @@ PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement)
 }
 
 /*
- * prepare_statement()
+ * prepare_predicate()
+ * Parse a single <column> <op> <value> predicate. String values may 
+ * optionally be wrapped in single quotes.
  */
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement)
+PrepareResult prepare_predicate(Predicate* predicate, char* column, char* op, char* value)
+{
+    size_t value_len;
+    size_t max_len;
+
+    if(strcmp(column, "id") == 0)
+        predicate->column = COLUMN_ID;
+    else if(strcmp(column, "username") == 0)
+        predicate->column = COLUMN_USERNAME;
+    else if(strcmp(column, "email") == 0)
+        predicate->column = COLUMN_EMAIL;
+    else
+        return PREPARE_SYNTAX_ERROR;
+
+    if(strcmp(op, "=") == 0)
+        predicate->op = OP_EQ;
+    else if(strcmp(op, "!=") == 0)
+        predicate->op = OP_NE;
+    else if(strcmp(op, "<") == 0)
+        predicate->op = OP_LT;
+    else if(strcmp(op, "<=") == 0)
+        predicate->op = OP_LE;
+    else if(strcmp(op, ">") == 0)
+        predicate->op = OP_GT;
+    else if(strcmp(op, ">=") == 0)
+        predicate->op = OP_GE;
+    else if(strcmp(op, "like") == 0)
+        predicate->op = OP_PREFIX;
+    else if(strcmp(op, "contains") == 0)
+        predicate->op = OP_CONTAINS;
+    else
+        return PREPARE_SYNTAX_ERROR;
+
+    if(predicate->column == COLUMN_ID)
+    {
+        char* end;
+        long  id;
+
+        if(predicate->op == OP_PREFIX || predicate->op == OP_CONTAINS)
+            return PREPARE_SYNTAX_ERROR;
+        id = strtol(value, &end, 10);
+        if(*end != '\0')
+            return PREPARE_SYNTAX_ERROR;
+        if(id < 0)
+            return PREPARE_NEGATIVE_ID;
+        if(id > UINT32_MAX)
+            return PREPARE_SYNTAX_ERROR;
+        predicate->id = (uint32_t) id;
+
+        return PREPARE_SUCCESS;
+    }
+
+    // strip quotes
+    value_len = strlen(value);
+    if(value_len >= 2 && value[0] == '\'' && value[value_len-1] == '\'')
+    {
+        value++;
+        value_len -= 2;
+    }
+
+    // Only prefix ('abc%') and substring ('%abc%') patterns are supported
+    // for like. A pattern without a wildcard is just an equality test.
+    if(predicate->op == OP_PREFIX)
+    {
+        if(value_len > 1 && value[0] == '%' && value[value_len-1] == '%')
+        {
+            predicate->op = OP_CONTAINS;
+            value++;
+            value_len -= 2;
+        }
+        else if(value_len > 0 && value[value_len-1] == '%')
+            value_len--;
+        else
+            predicate->op = OP_EQ;
+        if(memchr(value, '%', value_len) != NULL)
+            return PREPARE_SYNTAX_ERROR;
+    }
+
+    max_len = (predicate->column == COLUMN_USERNAME) ? COLUMN_USERNAME_SIZE : COLUMN_EMAIL_SIZE;
+    if(value_len > max_len)
+        return PREPARE_STRING_TOO_LONG;
+    memcpy(predicate->text, value, value_len);
+    predicate->text[value_len] = '\0';
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_where()
+ * Parse the predicates that follow 'where' from the remaining tokens. 
+ * If rest is given, the clause may be followed by more of the statement
+ * and rest is left at the keyword after it (or NULL).
+ */
+static PrepareResult prepare_where(WhereClause* where, char** rest)
+{
+    char* keyword;
+    char* column;
+    char* op;
+    char* value;
+    PrepareResult result;
+
+    do
+    {
+        if(where->num_predicates >= WHERE_MAX_PREDICATES)
+            return PREPARE_SYNTAX_ERROR;
+
+        column = strtok(NULL, " ");
+        op     = strtok(NULL, " ");
+        value  = strtok(NULL, " ");
+        if(column == NULL || op == NULL || value == NULL)
+            return PREPARE_SYNTAX_ERROR;
+
+        result = prepare_predicate(&where->predicates[where->num_predicates], column, op, value);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        where->num_predicates++;
+
+        keyword = strtok(NULL, " ");
+        if(keyword != NULL && strcmp(keyword, "and") != 0)
+        {
+            if(rest == NULL)
+                return PREPARE_SYNTAX_ERROR;
+            break;
+        }
+    } while(keyword != NULL);
+    if(rest != NULL)
+        *rest = keyword;
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_aggregate()
+ */
+static AggregateType prepare_aggregate(const char* token)
+{
+    if(strcmp(token, "count(*)") == 0 || strcmp(token, "count(id)") == 0)
+        return AGGREGATE_COUNT;
+    if(strcmp(token, "min(id)") == 0)
+        return AGGREGATE_MIN;
+    if(strcmp(token, "max(id)") == 0)
+        return AGGREGATE_MAX;
+    if(strcmp(token, "sum(id)") == 0)
+        return AGGREGATE_SUM;
+
+    return AGGREGATE_NONE;
+}
+
+/*
+ * is_clause_keyword()
+ * Keywords that end the column list of a select
+ */
+static int is_clause_keyword(const char* token)
+{
+    return strcmp(token, "where") == 0 || strcmp(token, "group") == 0 ||
+           strcmp(token, "order") == 0 || strcmp(token, "limit") == 0;
+}
+
+// Items in a select list besides columns, which are only allowed alone 
+// (an aggregate) or with a group by
+typedef struct
+{
+    uint32_t      num_items;
+    AggregateType aggregate;
+    int           aggregate_first;
+    int           domain;       // domain(email) is listed
+} SelectList;
+
+/*
+ * prepare_projection()
+ * Parse a list of columns separated by commas, which may or may not have
+ * spaces around them, up to the next clause or the end of the statement.
+ * The keyword is left at the start of the clause or NULL. Aggregates and
+ * domain(email) are noted in list rather than the projection.
+ */
+static PrepareResult prepare_projection(Projection* projection, char** keyword, SelectList* list)
+{
+    int expect_column = 1;
+
+    projection->num_columns  = 0;
+    projection->leaf_columns = 0;
+    while(*keyword != NULL && !is_clause_keyword(*keyword))
+    {
+        char* pos = *keyword;
+
+        while(*pos != '\0')
+        {
+            size_t len;
+            Column column;
+
+            if(*pos == ',')
+            {
+                if(expect_column)
+                    return PREPARE_SYNTAX_ERROR;
+                expect_column = 1;
+                pos++;
+                continue;
+            }
+            if(!expect_column)
+                return PREPARE_SYNTAX_ERROR;
+
+            len = strcspn(pos, ",");
+            list->num_items++;
+            if(len < 16 && pos[len - 1] == ')')
+            {
+                char          item[16];
+                AggregateType aggregate;
+
+                memcpy(item, pos, len);
+                item[len] = '\0';
+                aggregate = prepare_aggregate(item);
+                if(aggregate != AGGREGATE_NONE && list->aggregate == AGGREGATE_NONE)
+                {
+                    list->aggregate       = aggregate;
+                    list->aggregate_first = (list->num_items == 1);
+                }
+                else if(strcmp(item, "domain(email)") == 0 && !list->domain)
+                    list->domain = 1;
+                else
+                    return PREPARE_SYNTAX_ERROR;
+            }
+            else if(len == 1 && pos[0] == '*')
+            {
+                if(!projection_add(projection, COLUMN_ID) ||
+                   !projection_add(projection, COLUMN_USERNAME) ||
+                   !projection_add(projection, COLUMN_EMAIL))
+                    return PREPARE_SYNTAX_ERROR;
+            }
+            else
+            {
+                if(len == 2 && strncmp(pos, "id", len) == 0)
+                    column = COLUMN_ID;
+                else if(len == 8 && strncmp(pos, "username", len) == 0)
+                    column = COLUMN_USERNAME;
+                else if(len == 5 && strncmp(pos, "email", len) == 0)
+                    column = COLUMN_EMAIL;
+                else
+                    return PREPARE_SYNTAX_ERROR;
+                if(!projection_add(projection, column))
+                    return PREPARE_SYNTAX_ERROR;
+            }
+            pos          += len;
+            expect_column = 0;
+        }
+        *keyword = strtok(NULL, " ");
+    }
+
+    return expect_column ? PREPARE_SYNTAX_ERROR : PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_group()
+ * group by <username|email|domain(email)>, which ends the statement. The
+ * select list has to be the same key and count(*).
+ */
+static PrepareResult prepare_group(Statement* statement, SelectList* list)
+{
+    Projection* projection = &statement->projection;
+    char*       keyword;
+    int         key_listed;
+
+    keyword = strtok(NULL, " ");
+    if(keyword == NULL || strcmp(keyword, "by") != 0)
+        return PREPARE_SYNTAX_ERROR;
+    keyword = strtok(NULL, " ");
+    if(keyword == NULL)
+        return PREPARE_SYNTAX_ERROR;
+    if(strcmp(keyword, "username") == 0)
+        statement->group.key = GROUP_USERNAME;
+    else if(strcmp(keyword, "email") == 0)
+        statement->group.key = GROUP_EMAIL;
+    else if(strcmp(keyword, "domain(email)") == 0)
+        statement->group.key = GROUP_DOMAIN;
+    else
+        return PREPARE_SYNTAX_ERROR;
+    if(strtok(NULL, " ") != NULL)
+        return PREPARE_SYNTAX_ERROR;
+
+    if(statement->group.key == GROUP_DOMAIN)
+        key_listed = list->domain && projection->num_columns == 0;
+    else
+        key_listed = !list->domain && projection->num_columns == 1 &&
+            projection->cols[0] == ((statement->group.key == GROUP_USERNAME) ? COLUMN_USERNAME : COLUMN_EMAIL);
+    if(!key_listed || list->num_items != 2 || list->aggregate != AGGREGATE_COUNT)
+        return PREPARE_SYNTAX_ERROR;
+    statement->group.count_first = list->aggregate_first;
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_order()
+ * [order by <column> [asc|desc]] [limit <n>], from keyword to the end
+ */
+static PrepareResult prepare_order(OrderClause* order, char* keyword)
+{
+    if(keyword != NULL && strcmp(keyword, "order") == 0)
+    {
+        keyword = strtok(NULL, " ");
+        if(keyword == NULL || strcmp(keyword, "by") != 0)
+            return PREPARE_SYNTAX_ERROR;
+        keyword = strtok(NULL, " ");
+        if(keyword == NULL)
+            return PREPARE_SYNTAX_ERROR;
+        if(strcmp(keyword, "id") == 0)
+            order->column = COLUMN_ID;
+        else if(strcmp(keyword, "username") == 0)
+            order->column = COLUMN_USERNAME;
+        else if(strcmp(keyword, "email") == 0)
+            order->column = COLUMN_EMAIL;
+        else
+            return PREPARE_SYNTAX_ERROR;
+        order->sorted     = 1;
+        order->descending = 0;
+
+        keyword = strtok(NULL, " ");
+        if(keyword != NULL && (strcmp(keyword, "asc") == 0 || strcmp(keyword, "desc") == 0))
+        {
+            order->descending = (strcmp(keyword, "desc") == 0);
+            keyword = strtok(NULL, " ");
+        }
+    }
+
+    if(keyword != NULL && strcmp(keyword, "limit") == 0)
+    {
+        char* end;
+
+        keyword = strtok(NULL, " ");
+        if(keyword == NULL || keyword[0] < '0' || keyword[0] > '9')
+            return PREPARE_SYNTAX_ERROR;
+        order->limit = strtoull(keyword, &end, 10);
+        if(*end != '\0' || order->limit == SORT_NO_LIMIT)
+            return PREPARE_SYNTAX_ERROR;
+        keyword = strtok(NULL, " ");
+    }
+
+    return (keyword == NULL) ? PREPARE_SUCCESS : PREPARE_SYNTAX_ERROR;
+}
+
+/*
+ * prepare_select()
+ * select [count(*)|min(id)|max(id)|sum(id)|<column>[, <column>]...|*] 
+ *        [where <column> <op> <value> [and <column> <op> <value>]...]
+ *        [order by <column> [asc|desc]] [limit <n>]
+ * or
+ * select <key>, count(*) [where ...] group by <key>
+ *        where key is username, email or domain(email)
+ */
+PrepareResult prepare_select(InputBuffer* input_buffer, Statement* statement)
 {
-    if(strncmp(input_buffer->buffer, "insert", 6) == 0)
+    char*         keyword;
+    SelectList    list;
+    PrepareResult result;
+
+    statement->type                 = STATEMENT_SELECT;
+    statement->where.num_predicates = 0;
+    statement->order.sorted         = 0;
+    statement->order.column         = COLUMN_ID;
+    statement->order.descending     = 0;
+    statement->order.limit          = SORT_NO_LIMIT;
+    statement->group.key            = GROUP_NONE;
+    aggregate_init(&statement->aggregate, AGGREGATE_NONE);
+    projection_init(&statement->projection);
+    memset(&list, 0, sizeof(list));
+
+    keyword = strtok(input_buffer->buffer, " ");   // select
+    keyword = strtok(NULL, " ");
+    if(keyword != NULL && !is_clause_keyword(keyword))
+    {
+        result = prepare_projection(&statement->projection, &keyword, &list);
+        if(result != PREPARE_SUCCESS)
+            return result;
+    }
+    if(keyword != NULL && strcmp(keyword, "where") == 0)
     {
-        return prepare_insert(input_buffer, statement);
+        result = prepare_where(&statement->where, &keyword);
+        if(result != PREPARE_SUCCESS)
+            return result;
     }
+    if(keyword != NULL && strcmp(keyword, "group") == 0)
+        return prepare_group(statement, &list);
 
-    if(strncmp(input_buffer->buffer, "select", 6) == 0)
+    if(list.domain || (list.aggregate != AGGREGATE_NONE && list.num_items > 1))
+        return PREPARE_SYNTAX_ERROR;
+    if(list.aggregate != AGGREGATE_NONE)
     {
-        statement->type = STATEMENT_SELECT;
+        // An aggregate is a single row, there is nothing to order
+        if(keyword != NULL)
+            return PREPARE_SYNTAX_ERROR;
+        aggregate_init(&statement->aggregate, list.aggregate);
+        projection_init(&statement->projection);
+    }
+
+    return prepare_order(&statement->order, keyword);
+}
+
+/*
+ * prepare_delete()
+ * delete [where <column> <op> <value> [and <column> <op> <value>]...]
+ */
+PrepareResult prepare_delete(InputBuffer* input_buffer, Statement* statement)
+{
+    char* keyword;
+
+    statement->type                 = STATEMENT_DELETE;
+    statement->where.num_predicates = 0;
+
+    keyword = strtok(input_buffer->buffer, " ");   // delete
+    keyword = strtok(NULL, " ");
+    if(keyword == NULL)
         return PREPARE_SUCCESS;
+    if(strcmp(keyword, "where") != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    return prepare_where(&statement->where, NULL);
+}
+
+/*
+ * prepare_update()
+ * update set <username|email> = <value> [, <username|email> = <value>]
+ *        [where <column> <op> <value> [and <column> <op> <value>]...]
+ */
+PrepareResult prepare_update(InputBuffer* input_buffer, Statement* statement)
+{
+    char*   keyword;
+    char*   column;
+    char*   op;
+    char*   value;
+    size_t  value_len;
+    UpdateClause* update;
+
+    update                          = &statement->update;
+    statement->type                 = STATEMENT_UPDATE;
+    statement->where.num_predicates = 0;
+    update->set_username            = 0;
+    update->set_email               = 0;
+
+    keyword = strtok(input_buffer->buffer, " ");   // update
+    keyword = strtok(NULL, " ");
+    if(keyword == NULL || strcmp(keyword, "set") != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    // assignments are separated by commas
+    keyword = strtok(NULL, " ,");
+    while(keyword != NULL && strcmp(keyword, "where") != 0)
+    {
+        column = keyword;
+        op     = strtok(NULL, " ,");
+        value  = strtok(NULL, " ,");
+        if(op == NULL || value == NULL || strcmp(op, "=") != 0)
+            return PREPARE_SYNTAX_ERROR;
+
+        // strip quotes
+        value_len = strlen(value);
+        if(value_len >= 2 && value[0] == '\'' && value[value_len-1] == '\'')
+        {
+            value[value_len-1] = '\0';
+            value++;
+            value_len -= 2;
+        }
+
+        if(strcmp(column, "username") == 0)
+        {
+            if(value_len > COLUMN_USERNAME_SIZE)
+                return PREPARE_STRING_TOO_LONG;
+            strcpy(update->values.username, value);
+            update->set_username = 1;
+        }
+        else if(strcmp(column, "email") == 0)
+        {
+            if(value_len > COLUMN_EMAIL_SIZE)
+                return PREPARE_STRING_TOO_LONG;
+            strcpy(update->values.email, value);
+            update->set_email = 1;
+        }
+        else
+            return PREPARE_SYNTAX_ERROR;
+
+        keyword = strtok(NULL, " ,");
     }
+    if(!update->set_username && !update->set_email)
+        return PREPARE_SYNTAX_ERROR;
+    if(keyword == NULL)
+        return PREPARE_SUCCESS;
 
-    return PREPARE_UNRECOGNIZED_STATEMENT;
+    return prepare_where(&statement->where, NULL);
 }
 
 /*
- * execute_statement()
+ * next_token()
+ * Copy the next token from *pos into token and move past it. A token is 
+ * a word, a quoted string with its quotes, or one of ( ) and ,. Returns 
+ * the length of the token, 0 at the end of the input and -1 if the token
+ * doesn't fit in size bytes.
  */
-ExecuteResult execute_insert(Statement* statement, Table* table)
+static int next_token(const char** pos, char* token, size_t size)
 {
-    void* node;
+    const char* start;
+    const char* p;
+    size_t      len;
 
-    node = get_page(table->pager, table->root_page_num);
-    if((*leaf_node_num_cells(node) >= LEAF_NODE_MAX_CELLS))
+    p = *pos;
+    while(*p == ' ')
+        p++;
+    start = p;
+    if(*p == '(' || *p == ')' || *p == ',')
+        p++;
+    else if(*p == '\'')
     {
-        return EXECUTE_TABLE_FULL;
+        p = strchr(p + 1, '\'');
+        p = (p != NULL) ? p + 1 : start + strlen(start);
+    }
+    else
+    {
+        while(*p != '\0' && *p != ' ' && *p != '(' && *p != ')' && *p != ',')
+            p++;
     }
-    
-    Row*    row_to_insert;
-    Cursor* cursor;
 
-    cursor        = table_end(table);
-    row_to_insert = &(statement->row_to_insert);
-    leaf_node_insert(
-            cursor, 
-            row_to_insert->id, 
-            row_to_insert
-    );
+    *pos = p;
+    len  = p - start;
+    if(len >= size)
+        return -1;
+    memcpy(token, start, len);
+    token[len] = '\0';
 
-    free(cursor);
+    return (int) len;
+}
 
-    return EXECUTE_SUCCESS;
+/*
+ * prepare_create_table()
+ * create table <name> (<column> <type> [, <column> <type>]...)
+ * where each type is integer, real, text(n) or varchar(n)
+ */
+PrepareResult prepare_create_table(InputBuffer* input_buffer, Statement* statement)
+{
+    const char*   pos;
+    char          token[CATALOG_MAX_TEXT + 3];
+    char          column[CATALOG_MAX_TEXT + 3];
+    Schema*       schema;
+    CatalogResult result;
+
+    statement->type = STATEMENT_CREATE_TABLE;
+    schema          = &statement->table.schema;
+    pos             = input_buffer->buffer;
+
+    if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "create") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "table") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0)
+        return PREPARE_SYNTAX_ERROR;
+    if(schema_init(schema, token) != CATALOG_OK)
+        return PREPARE_SYNTAX_ERROR;
+    strcpy(statement->table.name, schema->name);
+    if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "(") != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    do
+    {
+        ColumnType type;
+        uint32_t   size = 0;
+
+        if(next_token(&pos, column, sizeof(column)) <= 0 ||
+           next_token(&pos, token, sizeof(token)) <= 0)
+            return PREPARE_SYNTAX_ERROR;
+        if(strcmp(token, "integer") == 0)
+            type = COLUMN_TYPE_INTEGER;
+        else if(strcmp(token, "real") == 0)
+            type = COLUMN_TYPE_REAL;
+        else if(strcmp(token, "text") == 0)
+            type = COLUMN_TYPE_TEXT;
+        else if(strcmp(token, "varchar") == 0)
+            type = COLUMN_TYPE_VARCHAR;
+        else
+            return PREPARE_SYNTAX_ERROR;
+
+        // text and varchar need a size
+        if(type == COLUMN_TYPE_TEXT || type == COLUMN_TYPE_VARCHAR)
+        {
+            char* end;
+
+            if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "(") != 0 ||
+               next_token(&pos, token, sizeof(token)) <= 0)
+                return PREPARE_SYNTAX_ERROR;
+            size = (uint32_t) strtoul(token, &end, 10);
+            if(*end != '\0' || token[0] == '-' ||
+               next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, ")") != 0)
+                return PREPARE_SYNTAX_ERROR;
+        }
+
+        if(schema_add_column(schema, column, type, size) != CATALOG_OK)
+            return PREPARE_SYNTAX_ERROR;
+        if(next_token(&pos, token, sizeof(token)) <= 0)
+            return PREPARE_SYNTAX_ERROR;
+    } while(strcmp(token, ",") == 0);
+
+    if(strcmp(token, ")") != 0 || next_token(&pos, token, sizeof(token)) != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    result = schema_layout(schema);
+    if(result == CATALOG_ROW_TOO_WIDE)
+        return PREPARE_ROW_TOO_WIDE;
+    if(result != CATALOG_OK)
+        return PREPARE_SYNTAX_ERROR;
+
+    return PREPARE_SUCCESS;
 }
 
 /*
- * execute_select()
+ * prepare_insert_users()
+ * insert into users is the same as insert, with the values checked 
+ * against the users schema
  */
-ExecuteResult execute_select(Statement* statement, Table* table)
+static PrepareResult prepare_insert_users(Statement* statement)
 {
-    Row     row;
-    Cursor* cursor;
+    Schema schema;
+    Value  values[3];
 
-    cursor = table_start(table);
-    while(!(cursor->end_of_table))
+    schema_users(&schema);
+    statement->table.name[0] = '\0';
+    if(statement->table.num_values != schema.num_columns)
+        return PREPARE_SYNTAX_ERROR;
+    if(!schema_parse_value(&schema.cols[0], statement->table.values[0], &values[0]))
+        return PREPARE_SYNTAX_ERROR;
+    if(values[0].integer < 0)
+        return PREPARE_NEGATIVE_ID;
+    if(!schema_parse_value(&schema.cols[1], statement->table.values[1], &values[1]) ||
+       !schema_parse_value(&schema.cols[2], statement->table.values[2], &values[2]) ||
+       values[1].length > COLUMN_USERNAME_SIZE || values[2].length > COLUMN_EMAIL_SIZE)
+        return PREPARE_STRING_TOO_LONG;
+
+    statement->row_to_insert.id = values[0].integer;
+    strcpy(statement->row_to_insert.username, values[1].text);
+    strcpy(statement->row_to_insert.email, values[2].text);
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_insert_into()
+ * insert [or replace] into <name> values (<value> [, <value>]...)
+ * The values are checked against the table's schema when the statement 
+ * is executed.
+ */
+PrepareResult prepare_insert_into(InputBuffer* input_buffer, Statement* statement)
+{
+    const char*  pos;
+    char         token[CATALOG_MAX_TEXT + 3];
+    TableClause* clause;
+
+    statement->type    = STATEMENT_INSERT;
+    clause             = &statement->table;
+    clause->num_values = 0;
+    pos                = input_buffer->buffer;
+
+    if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "insert") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0)
+        return PREPARE_SYNTAX_ERROR;
+    if(strcmp(token, "or") == 0)
     {
-        deserialize_row(cursor_value(cursor), &row);
-        print_row(&row);
-        cursor_advance(cursor);
+        if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "replace") != 0 ||
+           next_token(&pos, token, sizeof(token)) <= 0)
+            return PREPARE_SYNTAX_ERROR;
+        statement->replace = 1;
     }
+    if(strcmp(token, "into") != 0 ||
+       next_token(&pos, clause->name, sizeof(clause->name)) <= 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "values") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "(") != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    do
+    {
+        int len;
 
-    free(cursor);
+        if(clause->num_values >= CATALOG_MAX_COLUMNS)
+            return PREPARE_SYNTAX_ERROR;
+        len = next_token(&pos, clause->values[clause->num_values], sizeof(clause->values[0]));
+        if(len < 0)
+            return PREPARE_STRING_TOO_LONG;
+        if(len == 0)
+            return PREPARE_SYNTAX_ERROR;
+        clause->num_values++;
+        if(next_token(&pos, token, sizeof(token)) <= 0)
+            return PREPARE_SYNTAX_ERROR;
+    } while(strcmp(token, ",") == 0);
 
-    return EXECUTE_SUCCESS;
+    if(strcmp(token, ")") != 0 || next_token(&pos, token, sizeof(token)) != 0)
+        return PREPARE_SYNTAX_ERROR;
+    if(strcmp(clause->name, CATALOG_USERS_TABLE) == 0)
+        return prepare_insert_users(statement);
+
+    return PREPARE_SUCCESS;
 }
 
 /*
- * execute_statement()
+ * prepare_select_from()
+ * select * from <name>
  */
-ExecuteResult execute_statement(Statement* statement, Table* table)
+PrepareResult prepare_select_from(InputBuffer* input_buffer, Statement* statement)
 {
-    switch(statement->type)
+    const char* pos;
+    char        token[CATALOG_MAX_TEXT + 3];
+
+    statement->type                 = STATEMENT_SELECT;
+    statement->where.num_predicates = 0;
+    statement->order.sorted         = 0;
+    statement->order.column         = COLUMN_ID;
+    statement->order.descending     = 0;
+    statement->order.limit          = SORT_NO_LIMIT;
+    statement->group.key            = GROUP_NONE;
+    aggregate_init(&statement->aggregate, AGGREGATE_NONE);
+    projection_init(&statement->projection);
+    pos = input_buffer->buffer;
+
+    if(next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "select") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "*") != 0 ||
+       next_token(&pos, token, sizeof(token)) <= 0 || strcmp(token, "from") != 0 ||
+       next_token(&pos, statement->table.name, sizeof(statement->table.name)) <= 0 ||
+       next_token(&pos, token, sizeof(token)) != 0)
+        return PREPARE_SYNTAX_ERROR;
+    if(strcmp(statement->table.name, CATALOG_USERS_TABLE) == 0)
+        statement->table.name[0] = '\0';
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_transaction()
+ * begin, commit or rollback, on their own
+ */
+PrepareResult prepare_transaction(InputBuffer* input_buffer, Statement* statement)
+{
+    const char* pos;
+    char        token[16];
+
+    pos = input_buffer->buffer;
+    if(next_token(&pos, token, sizeof(token)) <= 0)
+        return PREPARE_UNRECOGNIZED_STATEMENT;
+    if(strcmp(token, "begin") == 0)
+        statement->type = STATEMENT_BEGIN;
+    else if(strcmp(token, "commit") == 0)
+        statement->type = STATEMENT_COMMIT;
+    else if(strcmp(token, "rollback") == 0)
+        statement->type = STATEMENT_ROLLBACK;
+    else
+        return PREPARE_UNRECOGNIZED_STATEMENT;
+    if(next_token(&pos, token, sizeof(token)) != 0)
+        return PREPARE_SYNTAX_ERROR;
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * prepare_statement()
+ */
+PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement)
+{
+    PrepareResult result = PREPARE_UNRECOGNIZED_STATEMENT;
+
+    TRACE_BEGIN(TRACE_PARSE);
+    statement->table.name[0] = '\0';
+    statement->replace       = 0;
+    // before the tokens are split up
+    cache_normalize(input_buffer->buffer, statement->text, CACHE_MAX_KEY);
+    if(strncmp(input_buffer->buffer, "insert into ", 12) == 0 ||
+       strncmp(input_buffer->buffer, "insert or replace into ", 23) == 0)
+        result = prepare_insert_into(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "select * from ", 14) == 0)
+        result = prepare_select_from(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "create", 6) == 0)
+        result = prepare_create_table(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "insert", 6) == 0)
+        result = prepare_insert(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "select", 6) == 0)
+        result = prepare_select(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "delete", 6) == 0)
+        result = prepare_delete(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "update", 6) == 0)
+        result = prepare_update(input_buffer, statement);
+    else if(strncmp(input_buffer->buffer, "begin", 5) == 0 ||
+            strncmp(input_buffer->buffer, "commit", 6) == 0 ||
+            strncmp(input_buffer->buffer, "rollback", 8) == 0)
+        result = prepare_transaction(input_buffer, statement);
+    TRACE_END(TRACE_PARSE);
+
+    return result;
+}
+
+/*
+ * predicate_matches()
+ */
+int predicate_matches(Predicate* predicate, Row* row)
+{
+    int cmp;
+
+    switch(predicate->column)
     {
-        case STATEMENT_INSERT:
-            return execute_insert(statement, table);
+        case COLUMN_ID:
+            cmp = (row->id > predicate->id) - (row->id < predicate->id);
+            break;
+        case COLUMN_USERNAME:
+            if(predicate->op == OP_PREFIX)
+                return strncmp(row->username, predicate->text, strlen(predicate->text)) == 0;
+            if(predicate->op == OP_CONTAINS)
+                return strstr(row->username, predicate->text) != NULL;
+            cmp = strcmp(row->username, predicate->text);
+            break;
+        case COLUMN_EMAIL:
+            if(predicate->op == OP_PREFIX)
+                return strncmp(row->email, predicate->text, strlen(predicate->text)) == 0;
+            if(predicate->op == OP_CONTAINS)
+                return strstr(row->email, predicate->text) != NULL;
+            cmp = strcmp(row->email, predicate->text);
+            break;
+        default:
+            return 0;
+    }
 
-        case STATEMENT_SELECT:
-            return execute_select(statement, table);
+    switch(predicate->op)
+    {
+        case OP_EQ: return cmp == 0;
+        case OP_NE: return cmp != 0;
+        case OP_LT: return cmp < 0;
+        case OP_LE: return cmp <= 0;
+        case OP_GT: return cmp > 0;
+        case OP_GE: return cmp >= 0;
+        default:    return 0;
+    }
+}
+
+/*
+ * where_matches()
+ */
+int where_matches(WhereClause* where, Row* row)
+{
+    for(uint32_t p = 0; p < where->num_predicates; ++p)
+    {
+        if(!predicate_matches(&where->predicates[p], row))
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * where_may_match_leaf()
+ * Check the where clause against the summary in a leaf footer. Returns 0
+ * if no row in the leaf can match, in which case the leaf can be skipped.
+ */
+int where_may_match_leaf(WhereClause* where, void* node)
+{
+    uint32_t min_key;
+    uint32_t max_key;
+
+    min_key = *leaf_node_min_key(node);
+    max_key = *leaf_node_max_key(node);
+    for(uint32_t p = 0; p < where->num_predicates; ++p)
+    {
+        Predicate* pred = &where->predicates[p];
+
+        switch(pred->column)
+        {
+            case COLUMN_ID:
+                if(pred->op == OP_EQ && (pred->id < min_key || pred->id > max_key))
+                    return 0;
+                if(pred->op == OP_LT && min_key >= pred->id)
+                    return 0;
+                if(pred->op == OP_LE && min_key > pred->id)
+                    return 0;
+                if(pred->op == OP_GT && max_key <= pred->id)
+                    return 0;
+                if(pred->op == OP_GE && max_key < pred->id)
+                    return 0;
+                break;
+            case COLUMN_USERNAME:
+                if(pred->op == OP_EQ &&
+                   !leaf_node_bloom_check(node, pred->text, USERNAME_SIZE, BLOOM_SEED_USERNAME))
+                    return 0;
+                break;
+            case COLUMN_EMAIL:
+                if(pred->op == OP_EQ &&
+                   !leaf_node_bloom_check(node, pred->text, EMAIL_SIZE, BLOOM_SEED_EMAIL))
+                    return 0;
+                break;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * aggregate_init()
+ */
+void aggregate_init(Aggregate* aggregate, AggregateType type)
+{
+    aggregate->type  = type;
+    aggregate->value = 0;
+    aggregate->count = 0;
+}
+
+/*
+ * aggregate_add()
+ */
+void aggregate_add(Aggregate* aggregate, uint32_t id)
+{
+    switch(aggregate->type)
+    {
+        case AGGREGATE_MIN:
+            if(aggregate->count == 0 || id < aggregate->value)
+                aggregate->value = id;
+            break;
+        case AGGREGATE_MAX:
+            if(aggregate->count == 0 || id > aggregate->value)
+                aggregate->value = id;
+            break;
+        case AGGREGATE_SUM:
+            aggregate->value += id;
+            break;
+        default:
+            break;
+    }
+    aggregate->count++;
+}
+
+/*
+ * print_aggregate()
+ */
+void print_aggregate(Aggregate* aggregate, FILE* fp)
+{
+    if(aggregate->type == AGGREGATE_COUNT)
+        fprintf(fp, "(%lu)\n", (unsigned long) aggregate->count);
+    else if(aggregate->count == 0)
+        fprintf(fp, "(null)\n");
+    else
+        fprintf(fp, "(%lu)\n", (unsigned long) aggregate->value);
+}
+
+/*
+ * projection_init()
+ * Start with every column, which is what a select with no list prints
+ */
+void projection_init(Projection* projection)
+{
+    projection->num_columns  = 3;
+    projection->cols[0]   = COLUMN_ID;
+    projection->cols[1]   = COLUMN_USERNAME;
+    projection->cols[2]   = COLUMN_EMAIL;
+    projection->leaf_columns = LEAF_COLUMNS_ALL;
+}
+
+/*
+ * projection_add()
+ * Returns 0 if the projection is full
+ */
+int projection_add(Projection* projection, Column column)
+{
+    static const LeafColumn leaf_columns[] = {
+        [COLUMN_ID] = LEAF_COLUMN_ID, 
+        [COLUMN_USERNAME] = LEAF_COLUMN_USERNAME, 
+        [COLUMN_EMAIL] = LEAF_COLUMN_EMAIL
+    };
+
+    if(projection->num_columns >= PROJECTION_MAX_COLUMNS)
+        return 0;
+    projection->cols[projection->num_columns++] = column;
+    projection->leaf_columns |= LEAF_COLUMN_BIT(leaf_columns[column]);
+
+    return 1;
+}
+
+/*
+ * projection_format()
+ * Write the projected columns of a row to line, which must hold 
+ * PROJECTION_LINE_SIZE bytes, in the same form as print_row(). Returns 
+ * the length of the line.
+ */
+uint32_t projection_format(Projection* projection, Row* row, char* line)
+{
+    uint32_t len = 0;
+
+    line[len++] = '(';
+    for(uint32_t c = 0; c < projection->num_columns; ++c)
+    {
+        if(c > 0)
+        {
+            line[len++] = ',';
+            line[len++] = ' ';
+        }
+        switch(projection->cols[c])
+        {
+            case COLUMN_ID:
+                len += sprintf(line + len, "%d", row->id);
+                break;
+            case COLUMN_USERNAME:
+                len += strlen(strcpy(line + len, row->username));
+                break;
+            case COLUMN_EMAIL:
+                len += strlen(strcpy(line + len, row->email));
+                break;
+        }
+    }
+    line[len++] = ')';
+    line[len++] = '\n';
+    line[len]   = '\0';
+
+    return len;
+}
+
+/*
+ * print_projection()
+ */
+void print_projection(Projection* projection, Row* row, FILE* fp)
+{
+    char     line[PROJECTION_LINE_SIZE];
+    uint32_t len;
+
+    len = projection_format(projection, row, line);
+    fwrite(line, 1, len, fp);
+}
+
+/*
+ * execute_insert()
+ * Ids are unique. The descent that finds where a row goes also finds a 
+ * row that already has its id, which is an error unless the statement
+ * is insert or replace, when that row is overwritten in place.
+ */
+ExecuteResult execute_insert(Statement* statement, Table* table)
+{
+    uint32_t pages_needed;
+    Row*     row_to_insert;
+    Row      old_row;
+    Cursor*  cursor;
+    void*    node;
+
+    // In the worst case an insert splits every node on the path down 
+    // to the leaf and adds a new root, in both the table and the index.
+    pages_needed = tree_depth(table->pager, table->root_page_num) + 1 +
+                   tree_depth(table->pager, table->index_root_page_num) + 1;
+    if(pages_needed > pager_pages_available(table->pager))
+    {
+        return EXECUTE_TABLE_FULL;
+    }
+    
+    row_to_insert = &(statement->row_to_insert);
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor        = table_find_append(table, row_to_insert->id);
+    TRACE_END(TRACE_DESCEND);
+    if(!cursor)
+        return EXECUTE_CORRUPT;
+    node          = get_page(table->pager, cursor->page_num);
+    if(cursor->cell_num < *leaf_node_num_cells(node) &&
+       *leaf_node_key(node, cursor->cell_num) == row_to_insert->id && !statement->replace)
+        return EXECUTE_DUPLICATE_KEY;
+
+    table->version++;
+    if(table->row_cache != NULL)
+        row_cache_invalidate(table->row_cache, row_to_insert->id);
+
+    if(cursor->cell_num < *leaf_node_num_cells(node) &&
+       *leaf_node_key(node, cursor->cell_num) == row_to_insert->id)
+    {
+        TRACE_BEGIN(TRACE_CELL_WRITE);
+        leaf_node_read_columns(node, cursor->cell_num, LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL), &old_row);
+        if(strcmp(old_row.email, row_to_insert->email) != 0)
+        {
+            index_delete(table, old_row.email, row_to_insert->id);
+            index_insert(table, row_to_insert->email, row_to_insert->id);
+        }
+        leaf_node_write_columns(node, cursor->cell_num, 
+                LEAF_COLUMN_BIT(LEAF_COLUMN_USERNAME) | LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL), row_to_insert);
+        leaf_node_summary_rebuild(node);
+        TRACE_END(TRACE_CELL_WRITE);
+
+        return EXECUTE_SUCCESS;
+    }
+
+    TRACE_BEGIN(TRACE_CELL_WRITE);
+    leaf_node_insert(
+            cursor, 
+            row_to_insert->id, 
+            row_to_insert
+    );
+    // keep the email index in step with the table
+    index_insert(table, row_to_insert->email, row_to_insert->id);
+    TRACE_END(TRACE_CELL_WRITE);
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * SelectOutput
+ * Where the rows of a select go. Without order by they are printed as
+ * they are found and the scan can stop at the limit. With it they go to
+ * a sorter and are printed once the scan is done. 
+ */
+typedef struct
+{
+    Projection* projection;
+    FILE*       fp;
+    Sorter      sorter;
+    int         sorted;
+    uint64_t    limit;
+    uint64_t    num_rows;
+    SortResult  error;
+} SelectOutput;
+
+/*
+ * order_leaf_column()
+ */
+static LeafColumn order_leaf_column(Column column)
+{
+    if(column == COLUMN_USERNAME)
+        return LEAF_COLUMN_USERNAME;
+    if(column == COLUMN_EMAIL)
+        return LEAF_COLUMN_EMAIL;
+    return LEAF_COLUMN_ID;
+}
+
+/*
+ * select_output_init()
+ * Rows already come out in_order when the scan follows the order by 
+ * column, and need no sort.
+ */
+static void select_output_init(SelectOutput* output, Statement* statement, Table* table, int in_order)
+{
+    OrderClause* order = &statement->order;
+
+    output->projection = &statement->projection;
+    output->fp         = table->output;
+    output->sorted     = order->sorted && !in_order;
+    output->limit      = order->limit;
+    output->num_rows   = 0;
+    output->error      = SORT_OK;
+    if(output->sorted)
+        sort_init(&output->sorter, order_leaf_column(order->column), order->descending, order->limit, table->sort_memory);
+}
+
+/*
+ * select_output_columns()
+ * Columns to read from each matching row, besides the id
+ */
+static uint32_t select_output_columns(SelectOutput* output, Statement* statement)
+{
+    uint32_t columns = output->projection->leaf_columns;
+
+    if(output->sorted)
+        columns |= LEAF_COLUMN_BIT(order_leaf_column(statement->order.column));
+
+    return columns & ~LEAF_COLUMN_BIT(LEAF_COLUMN_ID);
+}
+
+/*
+ * select_output_add()
+ * Returns 0 once no more rows are wanted
+ */
+static int select_output_add(SelectOutput* output, Row* row)
+{
+    if(output->sorted)
+    {
+        output->error = sort_add(&output->sorter, row);
+        return output->error == SORT_OK;
+    }
+    if(output->num_rows >= output->limit)
+        return 0;
+    print_projection(output->projection, row, output->fp);
+    output->num_rows++;
+
+    return output->num_rows < output->limit;
+}
+
+/*
+ * select_output_finish()
+ * Print the sorted rows
+ */
+static ExecuteResult select_output_finish(SelectOutput* output)
+{
+    Row row;
+
+    if(!output->sorted)
+        return EXECUTE_SUCCESS;
+
+    if(output->error == SORT_OK)
+        output->error = sort_finish(&output->sorter);
+    while(output->error == SORT_OK)
+    {
+        output->error = sort_next(&output->sorter, &row);
+        if(output->error == SORT_OK)
+            print_projection(output->projection, &row, output->fp);
+    }
+    sort_free(&output->sorter);
+
+    return (output->error == SORT_END) ? EXECUTE_SUCCESS : EXECUTE_IO_ERROR;
+}
+
+/*
+ * execute_select()
+ */
+ExecuteResult execute_select(Statement* statement, Table* table)
+{
+    Row          row;
+    uint32_t     columns;
+    Cursor*      cursor;
+    Filter       filter;
+    WhereClause* where;
+    SelectOutput output;
+    const char*  start = NULL;
+    int          use_index = 0;
+    int          use_id = 0;
+    uint32_t     id = 0;
+    int          done = 0;
+
+    // Any constraint on email (other than != and contains) bounds a 
+    // range of the email index. Start the scan at the largest lower bound.
+    TRACE_BEGIN(TRACE_PLAN);
+    where = &statement->where;
+    for(uint32_t p = 0; p < where->num_predicates; ++p)
+    {
+        Predicate* pred = &where->predicates[p];
+
+        // An id is at most one row, which beats any range of the index
+        if(pred->column == COLUMN_ID && pred->op == OP_EQ)
+        {
+            use_id = 1;
+            id     = pred->id;
+        }
+        if(pred->column != COLUMN_EMAIL || pred->op == OP_NE || pred->op == OP_CONTAINS)
+            continue;
+        use_index = 1;
+        if(pred->op == OP_LT || pred->op == OP_LE)
+            continue;
+        if(start == NULL || strcmp(pred->text, start) > 0)
+            start = pred->text;
+    }
+    TRACE_END(TRACE_PLAN);
+    if(statement->group.key != GROUP_NONE)
+        return execute_group(statement, table);
+    if(use_id)
+        return execute_select_id(statement, table, id);
+    if(use_index)
+        return execute_select_index(statement, table, (start != NULL) ? start : "");
+    if(statement->aggregate.type != AGGREGATE_NONE && where->num_predicates == 0)
+        return execute_aggregate(statement, table);
+
+    // Rows are tested in place a leaf at a time, and only the columns
+    // that are printed or sorted on are copied out of the ones that match.
+    // The table is in id order, so order by id needs no sort.
+    select_output_init(&output, statement, table, 
+            statement->order.column == COLUMN_ID && !statement->order.descending);
+    columns = select_output_columns(&output, statement);
+    filter_compile(&filter, where);
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor = table_start(table);
+    TRACE_END(TRACE_DESCEND);
+    while(cursor && !(cursor->end_of_table) && !done && output.limit > 0)
+    {
+        void*    node;
+        uint64_t matches[KERNEL_BITMAP_WORDS(LEAF_NODE_MAX_CELLS)];
+
+        node = get_page(table->pager, cursor->page_num);
+        // See if the leaf summary rules out every row in the leaf
+        if(where->num_predicates == 0 || where_may_match_leaf(where, node))
+        {
+            filter_match_leaf(&filter, node, matches);
+            for(uint32_t c = 0; c < *leaf_node_num_cells(node) && !done; ++c)
+            {
+                if((matches[c / 64] & (1ULL << (c % 64))) == 0)
+                    continue;
+                // aggregates only need the key
+                if(statement->aggregate.type != AGGREGATE_NONE)
+                {
+                    aggregate_add(&statement->aggregate, *leaf_node_key(node, c));
+                    continue;
+                }
+                // The id is the key, so it never has to be read from
+                // the value
+                row.id = *leaf_node_key(node, c);
+                leaf_node_read_columns(node, c, columns, &row);
+                done = !select_output_add(&output, &row);
+            }
+        }
+        // Keys are in order, so the first match is the smallest
+        if(statement->aggregate.type == AGGREGATE_MIN && statement->aggregate.count > 0)
+            break;
+        cursor_next_leaf(cursor);
+    }
+
+    if(statement->aggregate.type != AGGREGATE_NONE)
+    {
+        print_aggregate(&statement->aggregate, table->output);
+        return EXECUTE_SUCCESS;
+    }
+
+    return select_output_finish(&output);
+}
+
+/*
+ * execute_select_id()
+ * Look up the one row a select on id = <id> can match, from the row
+ * cache if it is there. A row read from the tree is read whole so that
+ * it can be cached.
+ */
+ExecuteResult execute_select_id(Statement* statement, Table* table, uint32_t id)
+{
+    Row          row;
+    Cursor*      cursor;
+    void*        node;
+    SelectOutput output;
+    int          found = 0;
+
+    if(table->row_cache != NULL && row_cache_get(table->row_cache, id, &row))
+        found = 1;
+    else
+    {
+        TRACE_BEGIN(TRACE_DESCEND);
+        cursor = table_find(table, id);
+        TRACE_END(TRACE_DESCEND);
+        if(!cursor)
+            return EXECUTE_CORRUPT;
+        node   = get_page(table->pager, cursor->page_num);
+        if(cursor->cell_num < *leaf_node_num_cells(node) &&
+           *leaf_node_key(node, cursor->cell_num) == id)
+        {
+            row.id = id;
+            leaf_node_read_columns(node, cursor->cell_num, LEAF_COLUMNS_ALL & ~LEAF_COLUMN_BIT(LEAF_COLUMN_ID), &row);
+            if(table->row_cache != NULL)
+                row_cache_put(table->row_cache, &row);
+            found = 1;
+        }
+    }
+
+    select_output_init(&output, statement, table, 1);
+    if(found && where_matches(&statement->where, &row))
+    {
+        if(statement->aggregate.type != AGGREGATE_NONE)
+            aggregate_add(&statement->aggregate, id);
+        else
+            select_output_add(&output, &row);
+    }
+    if(statement->aggregate.type != AGGREGATE_NONE)
+    {
+        print_aggregate(&statement->aggregate, table->output);
+        return EXECUTE_SUCCESS;
+    }
+
+    return select_output_finish(&output);
+}
+
+/*
+ * execute_select_index()
+ * Walk the email index from start, stopping as soon as an entry is past
+ * the upper end of the range, and look up each row by id. The index is 
+ * in (email, id) order, so order by email needs no sort.
+ */
+ExecuteResult execute_select_index(Statement* statement, Table* table, const char* start)
+{
+    Row          row;
+    Cursor*      cursor;
+    Cursor*      row_cursor;
+    Filter       filter;
+    WhereClause* where;
+    SelectOutput output;
+    uint32_t     columns;
+    int          done = 0;
+
+    where  = &statement->where;
+    select_output_init(&output, statement, table, 
+            statement->order.column == COLUMN_EMAIL && !statement->order.descending);
+    columns = select_output_columns(&output, statement);
+    done    = (output.limit == 0);
+    filter_compile(&filter, where);
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor = index_find(table, start, 0);
+    TRACE_END(TRACE_DESCEND);
+    while(cursor && !(cursor->end_of_table) && !done)
+    {
+        void*    key;
+        void*    node;
+        uint32_t row_id;
+        int      skip = 0;
+
+        key = index_cursor_key(cursor);
+        // Check the email constraints against the key first. Entries are
+        // sorted by email so once an upper bound fails nothing after this
+        // entry can match either.
+        memcpy(row.email, index_key_email(key), EMAIL_SIZE);
+        for(uint32_t p = 0; p < where->num_predicates; ++p)
+        {
+            Predicate* pred = &where->predicates[p];
+
+            if(pred->column != COLUMN_EMAIL || predicate_matches(pred, &row))
+                continue;
+            if(pred->op == OP_GT || pred->op == OP_GE || pred->op == OP_NE || pred->op == OP_CONTAINS)
+                skip = 1;
+            else
+                done = 1;
+        }
+
+        if(!skip && !done)
+        {
+            row_id     = *index_key_row_id(key);
+            TRACE_BEGIN(TRACE_DESCEND);
+            row_cursor = table_find(table, row_id);
+            TRACE_END(TRACE_DESCEND);
+            if(!row_cursor)
+                break;
+            node       = get_page(table->pager, row_cursor->page_num);
+            if(row_cursor->cell_num < *leaf_node_num_cells(node) &&
+               *leaf_node_key(node, row_cursor->cell_num) == row_id &&
+               filter_matches_cell(&filter, node, row_cursor->cell_num))
+            {
+                if(statement->aggregate.type != AGGREGATE_NONE)
+                {
+                    aggregate_add(&statement->aggregate, row_id);
+                }
+                else
+                {
+                    row.id = row_id;
+                    leaf_node_read_columns(node, row_cursor->cell_num, columns, &row);
+                    done = !select_output_add(&output, &row);
+                }
+            }
+        }
+        cursor_advance(cursor);
+    }
+
+    if(statement->aggregate.type != AGGREGATE_NONE)
+    {
+        print_aggregate(&statement->aggregate, table->output);
+        return EXECUTE_SUCCESS;
+    }
+
+    return select_output_finish(&output);
+}
+
+/*
+ * GroupOutput
+ * Prints each group as it comes out of the hash table
+ */
+typedef struct
+{
+    FILE* fp;
+    int   count_first;
+} GroupOutput;
+
+/*
+ * print_group()
+ */
+static void print_group(void* arg, const char* key, uint32_t length, uint64_t count)
+{
+    GroupOutput* output = arg;
+
+    if(output->count_first)
+        fprintf(output->fp, "(%lu, %.*s)\n", (unsigned long) count, (int) length, key);
+    else
+        fprintf(output->fp, "(%.*s, %lu)\n", (int) length, key, (unsigned long) count);
+}
+
+/*
+ * execute_group()
+ * Hash the key of every matching row straight from its leaf cell, 
+ * without copying the row out. The username and email are zero padded
+ * in the cell, and the domain is the part of the email after the last @
+ * (all of it if there is none).
+ */
+ExecuteResult execute_group(Statement* statement, Table* table)
+{
+    GroupTable   groups;
+    GroupOutput  output;
+    GroupResult  result = GROUP_OK;
+    Cursor*      cursor;
+    Filter       filter;
+    WhereClause* where;
+    LeafColumn   column;
+
+    where  = &statement->where;
+    column = (statement->group.key == GROUP_USERNAME) ? LEAF_COLUMN_USERNAME : LEAF_COLUMN_EMAIL;
+    filter_compile(&filter, where);
+    group_init(&groups, table->group_memory);
+
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor = table_start(table);
+    TRACE_END(TRACE_DESCEND);
+    while(cursor && !(cursor->end_of_table) && result == GROUP_OK)
+    {
+        void*    node;
+        uint64_t matches[KERNEL_BITMAP_WORDS(LEAF_NODE_MAX_CELLS)];
+
+        node = get_page(table->pager, cursor->page_num);
+        if(where->num_predicates == 0 || where_may_match_leaf(where, node))
+        {
+            filter_match_leaf(&filter, node, matches);
+            for(uint32_t c = 0; c < *leaf_node_num_cells(node) && result == GROUP_OK; ++c)
+            {
+                const char* key;
+                const char* at;
+                uint32_t    length;
+
+                if((matches[c / 64] & (1ULL << (c % 64))) == 0)
+                    continue;
+                key = leaf_node_column(node, c, column);
+                if(statement->group.key == GROUP_DOMAIN && (at = strrchr(key, '@')) != NULL)
+                    key = at + 1;
+                length = strlen(key);
+                result = group_add(&groups, key, length, 1);
+            }
+        }
+        cursor_next_leaf(cursor);
+    }
+
+    output.fp          = table->output;
+    output.count_first = statement->group.count_first;
+    if(result == GROUP_OK)
+        result = group_finish(&groups, print_group, &output);
+    group_free(&groups);
+
+    return (result == GROUP_OK) ? EXECUTE_SUCCESS : EXECUTE_IO_ERROR;
+}
+
+/*
+ * execute_aggregate()
+ * Aggregates with no where clause are answered from the tree structure 
+ * alone. A count only needs the number of cells in each leaf, and the 
+ * smallest and largest ids are the first key of the leftmost leaf and 
+ * the last key of the rightmost leaf.
+ */
+ExecuteResult execute_aggregate(Statement* statement, Table* table)
+{
+    Aggregate* aggregate = &statement->aggregate;
+    Cursor*    cursor;
+    void*      node;
+    uint32_t   num_cells;
+
+    switch(aggregate->type)
+    {
+        case AGGREGATE_COUNT:
+            cursor = table_start(table);
+            while(cursor && !(cursor->end_of_table))
+            {
+                node = get_page(table->pager, cursor->page_num);
+                aggregate->count += *leaf_node_num_cells(node);
+                cursor_next_leaf(cursor);
+            }
+            break;
+
+        case AGGREGATE_MIN:
+            cursor = table_start(table);
+            if(cursor && !(cursor->end_of_table))
+            {
+                node = get_page(table->pager, cursor->page_num);
+                aggregate_add(aggregate, *leaf_node_key(node, 0));
+            }
+            break;
+
+        case AGGREGATE_MAX:
+            cursor    = table_end(table);
+            if(!cursor)
+                break;
+            node      = get_page(table->pager, cursor->page_num);
+            num_cells = *leaf_node_num_cells(node);
+            if(num_cells > 0)
+                aggregate_add(aggregate, *leaf_node_key(node, num_cells - 1));
+            break;
+
+        case AGGREGATE_SUM:
+            // Sums still need every id, but never the row payload
+            cursor = table_start(table);
+            while(cursor && !(cursor->end_of_table))
+            {
+                node = get_page(table->pager, cursor->page_num);
+                for(uint32_t c = 0; c < *leaf_node_num_cells(node); ++c)
+                    aggregate_add(aggregate, *leaf_node_key(node, c));
+                cursor_next_leaf(cursor);
+            }
+            break;
+
+        default:
+            break;
+    }
+    // An answer from part of the tree would look like a real one
+    if(table->pager->read_error != PAGE_READ_OK)
+        return EXECUTE_CORRUPT;
+    print_aggregate(aggregate, table->output);
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * find_matching_ids()
+ * Collect the ids of every row that matches a where clause, so that rows 
+ * can then be changed without the tree moving under a cursor. Any bounds
+ * on the id limit the range of leaves that have to be looked at.
+ */
+static uint32_t* find_matching_ids(Table* table, WhereClause* where, uint32_t* num_ids)
+{
+    uint32_t* ids;
+    uint32_t  capacity = LEAF_NODE_MAX_CELLS;
+    uint32_t  min_id   = 0;
+    uint32_t  max_id   = UINT32_MAX;
+    int       empty    = 0;
+    Cursor*   cursor;
+    Filter    filter;
+
+    for(uint32_t p = 0; p < where->num_predicates; ++p)
+    {
+        Predicate* pred = &where->predicates[p];
+
+        if(pred->column != COLUMN_ID)
+            continue;
+        if((pred->op == OP_EQ || pred->op == OP_GE) && pred->id > min_id)
+            min_id = pred->id;
+        if((pred->op == OP_EQ || pred->op == OP_LE) && pred->id < max_id)
+            max_id = pred->id;
+        // No id is above UINT32_MAX or below 0, and the bound would wrap
+        if(pred->op == OP_GT)
+        {
+            if(pred->id == UINT32_MAX)
+                empty = 1;
+            else if(pred->id >= min_id)
+                min_id = pred->id + 1;
+        }
+        if(pred->op == OP_LT)
+        {
+            if(pred->id == 0)
+                empty = 1;
+            else if(pred->id <= max_id)
+                max_id = pred->id - 1;
+        }
+    }
+
+    // The ids only last for the statement
+    *num_ids = 0;
+    ids      = arena_alloc(&table->arena, capacity * sizeof(uint32_t));
+    if(!ids)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for ids\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    if(empty || min_id > max_id)
+        return ids;
+
+    filter_compile(&filter, where);
+    cursor = table_find(table, min_id);
+    while(cursor && !(cursor->end_of_table))
+    {
+        void*    node;
+        uint64_t matches[KERNEL_BITMAP_WORDS(LEAF_NODE_MAX_CELLS)];
+
+        node = get_page(table->pager, cursor->page_num);
+        if(*leaf_node_num_cells(node) > 0 && *leaf_node_key(node, 0) > max_id)
+            break;
+        if(where->num_predicates == 0 || where_may_match_leaf(where, node))
+        {
+            filter_match_leaf(&filter, node, matches);
+            for(uint32_t c = 0; c < *leaf_node_num_cells(node); ++c)
+            {
+                if((matches[c / 64] & (1ULL << (c % 64))) == 0)
+                    continue;
+                if(*num_ids == capacity)
+                {
+                    uint32_t* old_ids = ids;
+
+                    capacity *= 2;
+                    ids = arena_alloc(&table->arena, capacity * sizeof(uint32_t));
+                    if(!ids)
+                    {
+                        fprintf(stderr, "[%s] failed to allocate memory for ids\n", __func__);
+                        exit(EXIT_FAILURE);
+                    }
+                    memcpy(ids, old_ids, *num_ids * sizeof(uint32_t));
+                }
+                ids[(*num_ids)++] = *leaf_node_key(node, c);
+            }
+        }
+        cursor_next_leaf(cursor);
+    }
+
+    return ids;
+}
+
+/*
+ * execute_delete()
+ */
+ExecuteResult execute_delete(Statement* statement, Table* table)
+{
+    Row       row;
+    Cursor*   cursor;
+    void*     node;
+    uint32_t* ids;
+    uint32_t  num_ids;
+
+    TRACE_BEGIN(TRACE_PLAN);
+    ids = find_matching_ids(table, &statement->where, &num_ids);
+    TRACE_END(TRACE_PLAN);
+    // Nothing is deleted unless every matching row could be found
+    if(table->pager->read_error != PAGE_READ_OK)
+        return EXECUTE_CORRUPT;
+    table->version++;
+    for(uint32_t i = 0; i < num_ids; ++i)
+    {
+        TRACE_BEGIN(TRACE_DESCEND);
+        cursor = table_find(table, ids[i]);
+        TRACE_END(TRACE_DESCEND);
+        if(!cursor)
+            break;
+        node   = get_page(table->pager, cursor->page_num);
+        if(cursor->cell_num < *leaf_node_num_cells(node) &&
+           *leaf_node_key(node, cursor->cell_num) == ids[i])
+        {
+            TRACE_BEGIN(TRACE_CELL_WRITE);
+            leaf_node_read_columns(node, cursor->cell_num, 
+                    LEAF_COLUMN_BIT(LEAF_COLUMN_ID) | LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL), &row);
+            index_delete(table, row.email, row.id);
+            leaf_node_delete(cursor);
+            if(table->row_cache != NULL)
+                row_cache_invalidate(table->row_cache, row.id);
+            TRACE_END(TRACE_CELL_WRITE);
+        }
+    }
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * execute_update()
+ * Rows are changed in place. The index entry for a row is moved if its 
+ * email changes, which may need pages for index splits.
+ */
+ExecuteResult execute_update(Statement* statement, Table* table)
+{
+    Row           row;
+    uint32_t      columns;
+    Cursor*       cursor;
+    void*         node;
+    uint32_t*     ids;
+    uint32_t      num_ids;
+    uint32_t      num_moved = 0;
+    UpdateClause* update;
+
+    update = &statement->update;
+    TRACE_BEGIN(TRACE_PLAN);
+    ids    = find_matching_ids(table, &statement->where, &num_ids);
+    TRACE_END(TRACE_PLAN);
+    if(table->pager->read_error != PAGE_READ_OK)
+        return EXECUTE_CORRUPT;
+
+    // Every row whose email changes moves its index entry, and each move
+    // can split the index all the way up. The pages for all of them are
+    // checked for before any row is changed.
+    if(update->set_email)
+    {
+        for(uint32_t i = 0; i < num_ids; ++i)
+        {
+            cursor = table_find(table, ids[i]);
+            if(!cursor)
+                return EXECUTE_CORRUPT;
+            node   = get_page(table->pager, cursor->page_num);
+            if(cursor->cell_num >= *leaf_node_num_cells(node) ||
+               *leaf_node_key(node, cursor->cell_num) != ids[i])
+                continue;
+            if(strcmp(leaf_node_column(node, cursor->cell_num, LEAF_COLUMN_EMAIL), update->values.email) != 0)
+                num_moved++;
+        }
+        if((uint64_t) num_moved * (tree_depth(table->pager, table->index_root_page_num) + 1) >
+           pager_pages_available(table->pager))
+            return EXECUTE_TABLE_FULL;
+    }
+
+    table->version++;
+    for(uint32_t i = 0; i < num_ids; ++i)
+    {
+        TRACE_BEGIN(TRACE_DESCEND);
+        cursor = table_find(table, ids[i]);
+        TRACE_END(TRACE_DESCEND);
+        if(!cursor)
+            break;
+        node   = get_page(table->pager, cursor->page_num);
+        if(cursor->cell_num >= *leaf_node_num_cells(node) ||
+           *leaf_node_key(node, cursor->cell_num) != ids[i])
+            continue;
+
+        // Only the columns being set are read and written back
+        columns = 0;
+        leaf_node_read_columns(node, cursor->cell_num, 
+                LEAF_COLUMN_BIT(LEAF_COLUMN_ID) | LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL), &row);
+        if(update->set_email && strcmp(row.email, update->values.email) != 0)
+        {
+            TRACE_BEGIN(TRACE_CELL_WRITE);
+            index_delete(table, row.email, row.id);
+            index_insert(table, update->values.email, row.id);
+            TRACE_END(TRACE_CELL_WRITE);
+            strcpy(row.email, update->values.email);
+            columns |= LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL);
+        }
+        if(update->set_username)
+        {
+            strcpy(row.username, update->values.username);
+            columns |= LEAF_COLUMN_BIT(LEAF_COLUMN_USERNAME);
+        }
+
+        TRACE_BEGIN(TRACE_CELL_WRITE);
+        leaf_node_write_columns(node, cursor->cell_num, columns, &row);
+        leaf_node_summary_rebuild(node);
+        TRACE_END(TRACE_CELL_WRITE);
+        if(table->row_cache != NULL)
+            row_cache_invalidate(table->row_cache, row.id);
+    }
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * execute_create_table()
+ */
+ExecuteResult execute_create_table(Statement* statement, Table* table)
+{
+    table->version++;
+    switch(catalog_create_table(table, &statement->table.schema))
+    {
+        case CATALOG_OK:
+            return EXECUTE_SUCCESS;
+        case CATALOG_TABLE_EXISTS:
+            return EXECUTE_TABLE_EXISTS;
+        default:
+            return EXECUTE_TABLE_FULL;
+    }
+}
+
+/*
+ * execute_insert_into()
+ * Insert into a table from the catalog. The key is the first column, 
+ * and is unique in the same way as the id of the users table.
+ */
+ExecuteResult execute_insert_into(Statement* statement, Table* table)
+{
+    CatalogEntry* entry;
+    Schema*       schema;
+    Cursor*       cursor;
+    void*         node;
+    int           exists;
+    Value         values[CATALOG_MAX_COLUMNS];
+    uint8_t       record[ROW_SIZE];
+
+    entry = catalog_find(table, statement->table.name);
+    if(!entry)
+        return EXECUTE_NO_SUCH_TABLE;
+    schema = &entry->schema;
+    if(statement->table.num_values != schema->num_columns)
+        return EXECUTE_BAD_VALUE;
+    for(uint32_t c = 0; c < schema->num_columns; ++c)
+    {
+        if(!schema_parse_value(&schema->cols[c], statement->table.values[c], &values[c]))
+            return EXECUTE_BAD_VALUE;
+    }
+    if(values[0].integer < 0)
+        return EXECUTE_BAD_VALUE;
+
+    if(tree_depth(table->pager, entry->table->root_page_num) + 1 > pager_pages_available(table->pager))
+        return EXECUTE_TABLE_FULL;
+
+    memset(record, 0, sizeof(record));
+    schema_serialize(schema, values, record);
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor = table_find_append(entry->table, (uint32_t) values[0].integer);
+    TRACE_END(TRACE_DESCEND);
+    if(!cursor)
+    {
+        table_reset_arena(entry->table);
+        return EXECUTE_CORRUPT;
+    }
+    node   = get_page(table->pager, cursor->page_num);
+    exists = cursor->cell_num < *leaf_node_num_cells(node) &&
+             *leaf_node_key(node, cursor->cell_num) == (uint32_t) values[0].integer;
+    if(exists && !statement->replace)
+    {
+        table_reset_arena(entry->table);
+        return EXECUTE_DUPLICATE_KEY;
+    }
+
+    table->version++;
+    TRACE_BEGIN(TRACE_CELL_WRITE);
+    if(!exists)
+        leaf_node_insert_record(cursor, (uint32_t) values[0].integer, record);
+    else
+    {
+        leaf_node_write_record(node, cursor->cell_num, record);
+        leaf_node_summary_rebuild(node);
+    }
+    TRACE_END(TRACE_CELL_WRITE);
+    table_reset_arena(entry->table);
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * execute_select_from()
+ * Print every row of a table from the catalog in key order
+ */
+ExecuteResult execute_select_from(Statement* statement, Table* table)
+{
+    CatalogEntry* entry;
+    Cursor*       cursor;
+    Value         values[CATALOG_MAX_COLUMNS];
+
+    entry = catalog_find(table, statement->table.name);
+    if(!entry)
+        return EXECUTE_NO_SUCH_TABLE;
+
+    TRACE_BEGIN(TRACE_DESCEND);
+    cursor = table_start(entry->table);
+    TRACE_END(TRACE_DESCEND);
+    while(cursor && !(cursor->end_of_table))
+    {
+        schema_deserialize(&entry->schema, cursor_value(cursor), values);
+        schema_print_values(&entry->schema, values, table->output);
+        cursor_advance(cursor);
+    }
+    table_reset_arena(entry->table);
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * execute_select_cached()
+ * Print the cached result of the statement if the table hasn't changed 
+ * since it was stored. Otherwise run the select into a buffer, print 
+ * that and keep it.
+ */
+ExecuteResult execute_select_cached(Statement* statement, Table* table)
+{
+    CacheEntry*   entry;
+    FILE*         output;
+    FILE*         fp;
+    char*         result = NULL;
+    size_t        length = 0;
+    ExecuteResult exec_result;
+
+    entry = cache_get(table->cache, statement->text, table->version);
+    if(entry != NULL)
+    {
+        fwrite(entry->result, 1, entry->length, table->output);
+        return EXECUTE_SUCCESS;
+    }
+
+    fp = open_memstream(&result, &length);
+    if(!fp)
+        return EXECUTE_IO_ERROR;
+    output        = table->output;
+    table->output = fp;
+    if(statement->table.name[0] != '\0')
+        exec_result = execute_select_from(statement, table);
+    else
+        exec_result = execute_select(statement, table);
+    table->output = output;
+    fclose(fp);
+
+    fwrite(result, 1, length, output);
+    if(exec_result == EXECUTE_SUCCESS && table->pager->read_error == PAGE_READ_OK)
+        cache_put(table->cache, statement->text, table->version, result, length);
+    free(result);
+
+    return exec_result;
+}
+
+/*
+ * execute_transaction()
+ * Between begin and commit the changes of every statement are held in
+ * memory, and the file is written and synced once at commit
+ */
+ExecuteResult execute_transaction(Statement* statement, Table* table)
+{
+    TransactionResult result;
+
+    if(statement->type == STATEMENT_BEGIN)
+        result = db_begin(table);
+    else if(statement->type == STATEMENT_COMMIT)
+        result = db_commit(table);
+    else
+        result = db_rollback(table);
+
+    switch(result)
+    {
+        case TRANSACTION_ACTIVE:
+            return EXECUTE_IN_TRANSACTION;
+        case TRANSACTION_NONE:
+            return EXECUTE_NO_TRANSACTION;
+        case TRANSACTION_IO_ERROR:
+            return EXECUTE_IO_ERROR;
+        case TRANSACTION_OK:
+            break;
+    }
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * execute_statement()
+ */
+ExecuteResult execute_statement(Statement* statement, Table* table)
+{
+    ExecuteResult result = EXECUTE_SUCCESS;
+
+    TRACE_BEGIN(TRACE_STATEMENT);
+    table->pager->read_error = PAGE_READ_OK;
+    switch(statement->type)
+    {
+        case STATEMENT_INSERT:
+            if(statement->table.name[0] != '\0')
+                result = execute_insert_into(statement, table);
+            else
+                result = execute_insert(statement, table);
+            break;
+
+        case STATEMENT_SELECT:
+            if(table->cache != NULL && statement->text[0] != '\0')
+                result = execute_select_cached(statement, table);
+            else if(statement->table.name[0] != '\0')
+                result = execute_select_from(statement, table);
+            else
+                result = execute_select(statement, table);
+            break;
+
+        case STATEMENT_DELETE:
+            result = execute_delete(statement, table);
+            break;
+
+        case STATEMENT_UPDATE:
+            result = execute_update(statement, table);
+            break;
+
+        case STATEMENT_CREATE_TABLE:
+            result = execute_create_table(statement, table);
+            break;
+
+        case STATEMENT_BEGIN:
+        case STATEMENT_COMMIT:
+        case STATEMENT_ROLLBACK:
+            result = execute_transaction(statement, table);
+            break;
     }
+    // A scan stops at the first page that can't be read. Whatever the 
+    // statement did up to there, it didn't see the whole tree.
+    if(table->pager->read_error != PAGE_READ_OK)
+        result = EXECUTE_CORRUPT;
+    // Cursors and temporaries only last for the statement
+    table_reset_arena(table);
+    TRACE_END(TRACE_STATEMENT);
 
-    // So far, nothing could go wrong here so there is no error handling. 
-    // As the implementation becomes more complete there will need to be 
-    // additional logic here to take care of possible errors.
+    return result;
 }
 
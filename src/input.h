@@ -10,6 +10,11 @@
 
 #include <unistd.h>
 #include "table.h"
+#include "catalog.h"
+#include "sort.h"
+#include "group.h"
+#include "cache.h"
+#include "workload.h"
 
 // Input buffer structure
 typedef struct 
@@ -17,6 +22,7 @@ typedef struct
     char*   buffer;
     size_t  buffer_length;
     ssize_t input_length;
+    WorkloadWriter* recorder;   // every line read is logged here when set
 } InputBuffer;
 
 InputBuffer* new_input_buffer(void);
@@ -27,13 +33,153 @@ void         read_input(InputBuffer* input_buffer);
 typedef enum
 {
     STATEMENT_INSERT,
-    STATEMENT_SELECT
+    STATEMENT_SELECT,
+    STATEMENT_DELETE,
+    STATEMENT_UPDATE,
+    STATEMENT_CREATE_TABLE,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_ROLLBACK
 } StatementType;
 
+// Where clause stuff
+typedef enum
+{
+    COLUMN_ID,
+    COLUMN_USERNAME,
+    COLUMN_EMAIL
+} Column;
+
+typedef enum
+{
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_PREFIX,          // like 'abc%'
+    OP_CONTAINS         // like '%abc%' or contains 'abc'
+} PredicateOp;
+
+typedef struct
+{
+    Column      column;
+    PredicateOp op;
+    uint32_t    id;                             // only used for id column
+    char        text[COLUMN_EMAIL_SIZE + 1];    // only used for string columns
+} Predicate;
+
+#define WHERE_MAX_PREDICATES 4
+
+// Predicates in a where clause are combined with and
+typedef struct
+{
+    uint32_t  num_predicates;
+    Predicate predicates[WHERE_MAX_PREDICATES];
+} WhereClause;
+
+int predicate_matches(Predicate* predicate, Row* row);
+int where_matches(WhereClause* where, Row* row);
+int where_may_match_leaf(WhereClause* where, void* node);
+
+// Aggregates are all over the id column, apart from count(*)
+typedef enum
+{
+    AGGREGATE_NONE,
+    AGGREGATE_COUNT,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_SUM
+} AggregateType;
+
+typedef struct
+{
+    AggregateType type;
+    uint64_t      value;
+    uint64_t      count;    // number of rows seen, 0 means the result is null
+} Aggregate;
+
+void aggregate_init(Aggregate* aggregate, AggregateType type);
+void aggregate_add(Aggregate* aggregate, uint32_t id);
+void print_aggregate(Aggregate* aggregate, FILE* fp);
+
+// Columns printed by a select, in the order they are listed. The set of
+// leaf columns is what the scan reads out of each cell.
+#define PROJECTION_MAX_COLUMNS 8
+// Longest line a projection prints, with every column an email
+#define PROJECTION_LINE_SIZE   (PROJECTION_MAX_COLUMNS * (COLUMN_EMAIL_SIZE + 2) + 4)
+
+typedef struct
+{
+    uint32_t num_columns;
+    Column   cols[PROJECTION_MAX_COLUMNS];     // not columns, which <term.h> defines
+    uint32_t leaf_columns;
+} Projection;
+
+void     projection_init(Projection* projection);
+int      projection_add(Projection* projection, Column column);
+uint32_t projection_format(Projection* projection, Row* row, char* line);
+void     print_projection(Projection* projection, Row* row, FILE* fp);
+
+// Order by and limit on a select. Without an order by, rows come out in
+// the order they are found, which is id order unless the email index is
+// used.
+typedef struct
+{
+    int      sorted;            // there is an order by
+    Column   column;
+    int      descending;
+    uint64_t limit;             // SORT_NO_LIMIT when there is none
+} OrderClause;
+
+// Group by on a select. The select list has to be the group key and
+// count(*), in either order.
+typedef enum
+{
+    GROUP_NONE,
+    GROUP_USERNAME,
+    GROUP_EMAIL,
+    GROUP_DOMAIN                // domain(email), everything after the @
+} GroupKey;
+
+typedef struct
+{
+    GroupKey key;
+    int      count_first;       // count(*) is listed before the key
+} GroupClause;
+
+// Columns assigned by an update. The id is the key so it can't be updated.
+typedef struct
+{
+    int set_username;
+    int set_email;
+    Row values;
+} UpdateClause;
+
+// The table named by create table, insert into and select * from. The
+// users table is left unnamed and uses the other clauses instead.
+typedef struct
+{
+    char     name[CATALOG_MAX_NAME + 1];    // empty for the users table
+    Schema   schema;                        // only used by create table
+    uint32_t num_values;                    // only used by insert into
+    char     values[CATALOG_MAX_COLUMNS][CATALOG_MAX_TEXT + 3];  // as written, with any quotes
+} TableClause;
+
 typedef struct
 {
     StatementType type;
     Row row_to_insert;      // only used by insert statement
+    int replace;            // insert or replace, an existing row with the id is overwritten
+    WhereClause where;      // used by select, delete and update statements
+    Aggregate aggregate;    // only used by select statement
+    Projection projection;  // only used by select statement
+    OrderClause order;      // only used by select statement
+    GroupClause group;      // only used by select statement
+    UpdateClause update;    // only used by update statement
+    TableClause table;      // used by create table, and insert and select on other tables
+    char text[CACHE_MAX_KEY];   // normalized, the key of a select in the result cache
 } Statement;
 
 // Metacommand stuff 
@@ -52,6 +198,7 @@ typedef enum
     PREPARE_NEGATIVE_ID,
     PREPARE_STRING_TOO_LONG,
     PREPARE_SYNTAX_ERROR,
+    PREPARE_ROW_TOO_WIDE,
     PREPARE_UNRECOGNIZED_STATEMENT
 } PrepareResult;
 
@@ -62,11 +209,30 @@ PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement)
 typedef enum 
 {
     EXECUTE_SUCCESS,
-    EXECUTE_TABLE_FULL
+    EXECUTE_TABLE_FULL,
+    EXECUTE_TABLE_EXISTS,
+    EXECUTE_NO_SUCH_TABLE,
+    EXECUTE_BAD_VALUE,      // wrong number of values, or one that doesn't fit its column
+    EXECUTE_IO_ERROR,       // the temporary files of a sort or group by, or a commit, could not be written
+    EXECUTE_DUPLICATE_KEY,  // insert of an id that is already in the table
+    EXECUTE_IN_TRANSACTION, // begin inside a transaction
+    EXECUTE_NO_TRANSACTION, // commit or rollback outside one
+    EXECUTE_CORRUPT         // a page could not be read, or failed its checksum
 } ExecuteResult;
 
 ExecuteResult execute_insert(Statement* statement, Table* table);
 ExecuteResult execute_select(Statement* statement, Table* table);
+ExecuteResult execute_select_id(Statement* statement, Table* table, uint32_t id);
+ExecuteResult execute_select_index(Statement* statement, Table* table, const char* start);
+ExecuteResult execute_aggregate(Statement* statement, Table* table);
+ExecuteResult execute_group(Statement* statement, Table* table);
+ExecuteResult execute_delete(Statement* statement, Table* table);
+ExecuteResult execute_update(Statement* statement, Table* table);
+ExecuteResult execute_create_table(Statement* statement, Table* table);
+ExecuteResult execute_insert_into(Statement* statement, Table* table);
+ExecuteResult execute_select_from(Statement* statement, Table* table);
+ExecuteResult execute_select_cached(Statement* statement, Table* table);
+ExecuteResult execute_transaction(Statement* statement, Table* table);
 ExecuteResult execute_statement(Statement* statement, Table* table);
 
 #endif /*__SQ_INPUT_H*/
@@ -0,0 +1,391 @@
+/*
+ * INTEGRITY
+ * Check every page of a database and the invariants of its trees
+ *
+ * Nothing here trusts what it reads. Cell counts are checked before any
+ * cell is looked at and page numbers before any page is loaded, so a
+ * damaged file gives a list of problems rather than a crash.
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "integrity.h"
+#include "catalog.h"
+#include "index.h"
+
+typedef struct
+{
+    Pager*   pager;
+    uint32_t errors;
+    uint8_t  seen[TABLE_MAX_PAGES];
+    // for the tree being walked
+    int      is_index;
+    uint32_t root_page_num;
+    uint32_t leaf_depth;        // 0 until the first leaf is reached
+    uint32_t prev_leaf;         // 0 until the first leaf is reached
+    uint64_t num_entries;
+} IntegrityCheck;
+
+
+/*
+ * integrity_error()
+ */
+static void integrity_error(IntegrityCheck* check, uint32_t page_num, const char* fmt, ...)
+{
+    va_list args;
+
+    fprintf(stdout, "page %u: ", page_num);
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+    fprintf(stdout, "\n");
+    check->errors++;
+}
+
+/*
+ * integrity_compare()
+ */
+static int integrity_compare(IntegrityCheck* check, void* a, void* b)
+{
+    uint32_t x;
+    uint32_t y;
+
+    if(check->is_index)
+        return index_key_compare(a, b);
+
+    x = *((uint32_t*) a);
+    y = *((uint32_t*) b);
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * integrity_check_keys()
+ * Keys must be strictly increasing, greater than lower and no greater
+ * than upper. A NULL bound is not checked.
+ */
+static void integrity_check_keys(IntegrityCheck* check, uint32_t page_num, void* node,
+        uint32_t num_keys, void* lower, void* upper)
+{
+    void* prev = lower;
+
+    for(uint32_t k = 0; k < num_keys; ++k)
+    {
+        void* key;
+
+        if(get_node_type(node) == NODE_LEAF)
+            key = check->is_index ? index_leaf_node_key(node, k) : (void*) leaf_node_key(node, k);
+        else
+            key = check->is_index ? index_internal_node_key(node, k) : (void*) internal_node_key(node, k);
+
+        if(prev && integrity_compare(check, prev, key) >= 0)
+            integrity_error(check, page_num, "key %u is out of order", k);
+        if(upper && integrity_compare(check, key, upper) > 0)
+            integrity_error(check, page_num, "key %u is larger than the parent allows", k);
+        prev = key;
+    }
+}
+
+/*
+ * integrity_check_summary()
+ */
+static void integrity_check_summary(IntegrityCheck* check, uint32_t page_num, void* node)
+{
+    for(uint32_t c = 0; c < *leaf_node_num_cells(node); ++c)
+    {
+        uint32_t key = *leaf_node_key(node, c);
+
+        if(key < *leaf_node_min_key(node) || key > *leaf_node_max_key(node))
+            integrity_error(check, page_num, "key %u is outside the leaf summary", key);
+        if(!leaf_node_bloom_check(node, leaf_node_column(node, c, LEAF_COLUMN_USERNAME), USERNAME_SIZE, BLOOM_SEED_USERNAME) ||
+           !leaf_node_bloom_check(node, leaf_node_column(node, c, LEAF_COLUMN_EMAIL), EMAIL_SIZE, BLOOM_SEED_EMAIL))
+            integrity_error(check, page_num, "row %u is missing from the leaf bloom filter", key);
+    }
+}
+
+/*
+ * integrity_check_node()
+ * Check a node and everything under it. Returns the largest key under
+ * the node, or NULL if there isn't one.
+ */
+static void* integrity_check_node(IntegrityCheck* check, uint32_t page_num, uint32_t parent_page_num,
+        uint32_t depth, void* lower, void* upper)
+{
+    void*    node;
+    void*    max_key;
+    uint32_t num_keys;
+    uint32_t max_keys;
+    uint32_t min_keys;
+
+    if(page_num == DB_HEADER_PAGE_NUM || page_num >= check->pager->num_pages)
+    {
+        integrity_error(check, parent_page_num, "child page %u is outside the file", page_num);
+        return NULL;
+    }
+    if(check->seen[page_num])
+    {
+        integrity_error(check, page_num, "page is used more than once");
+        return NULL;
+    }
+    check->seen[page_num] = 1;
+
+    node = get_page(check->pager, page_num);
+    if(!node)
+    {
+        integrity_error(check, page_num, "page could not be read");
+        return NULL;
+    }
+    if(get_node_type(node) != NODE_LEAF && get_node_type(node) != NODE_INTERNAL)
+    {
+        integrity_error(check, page_num, "unknown node type %u", get_node_type(node));
+        return NULL;
+    }
+    if(is_node_root(node) != (page_num == check->root_page_num))
+        integrity_error(check, page_num, "root flag is %s", is_node_root(node) ? "set" : "not set");
+    if(page_num != check->root_page_num && *node_parent(node) != parent_page_num)
+        integrity_error(check, page_num, "parent is %u, not %u", *node_parent(node), parent_page_num);
+
+    if(get_node_type(node) == NODE_LEAF)
+    {
+        num_keys = *leaf_node_num_cells(node);
+        max_keys = check->is_index ? INDEX_LEAF_NODE_MAX_CELLS : LEAF_NODE_MAX_CELLS;
+        min_keys = check->is_index ? INDEX_LEAF_NODE_MIN_CELLS : LEAF_NODE_MIN_CELLS;
+        if(num_keys > max_keys)
+        {
+            integrity_error(check, page_num, "leaf has %u cells, more than the maximum %u", num_keys, max_keys);
+            return NULL;
+        }
+        // The last leaf of the table is split to be filled by appends
+        if(page_num != check->root_page_num && num_keys < min_keys &&
+           (check->is_index || *leaf_node_next_leaf(node) != 0))
+            integrity_error(check, page_num, "leaf has %u cells, fewer than the minimum %u", num_keys, min_keys);
+
+        if(check->leaf_depth == 0)
+            check->leaf_depth = depth;
+        else if(depth != check->leaf_depth)
+            integrity_error(check, page_num, "leaf is at depth %u, not %u", depth, check->leaf_depth);
+        if(check->prev_leaf != 0 && *leaf_node_next_leaf(get_page(check->pager, check->prev_leaf)) != page_num)
+            integrity_error(check, check->prev_leaf, "next leaf is %u, not %u",
+                    *leaf_node_next_leaf(get_page(check->pager, check->prev_leaf)), page_num);
+        check->prev_leaf = page_num;
+
+        integrity_check_keys(check, page_num, node, num_keys, lower, upper);
+        if(!check->is_index)
+            integrity_check_summary(check, page_num, node);
+        check->num_entries += num_keys;
+
+        if(num_keys == 0)
+            return NULL;
+        return check->is_index ? index_leaf_node_key(node, num_keys - 1) : (void*) leaf_node_key(node, num_keys - 1);
+    }
+
+    num_keys = *internal_node_num_keys(node);
+    max_keys = check->is_index ? INDEX_INTERNAL_NODE_MAX_CELLS : INTERNAL_NODE_MAX_CELLS;
+    min_keys = check->is_index ? INDEX_INTERNAL_NODE_MIN_KEYS : INTERNAL_NODE_MIN_KEYS;
+    if(num_keys > max_keys)
+    {
+        integrity_error(check, page_num, "internal node has %u keys, more than the maximum %u", num_keys, max_keys);
+        return NULL;
+    }
+    // Even the root needs a key, a root with one child is collapsed
+    if(num_keys == 0 || (page_num != check->root_page_num && num_keys < min_keys))
+        integrity_error(check, page_num, "internal node has %u keys, fewer than the minimum %u",
+                num_keys, (page_num == check->root_page_num) ? 1 : min_keys);
+    integrity_check_keys(check, page_num, node, num_keys, lower, upper);
+
+    max_key = NULL;
+    for(uint32_t c = 0; c <= num_keys; ++c)
+    {
+        void* child_lower;
+        void* child_upper;
+
+        if(check->is_index)
+        {
+            child_lower = (c == 0) ? lower : index_internal_node_key(node, c - 1);
+            child_upper = (c == num_keys) ? upper : index_internal_node_key(node, c);
+            max_key     = integrity_check_node(check, *index_internal_node_child(node, c), page_num,
+                    depth + 1, child_lower, child_upper);
+        }
+        else
+        {
+            child_lower = (c == 0) ? lower : (void*) internal_node_key(node, c - 1);
+            child_upper = (c == num_keys) ? upper : (void*) internal_node_key(node, c);
+            max_key     = integrity_check_node(check, *internal_node_child(node, c), page_num,
+                    depth + 1, child_lower, child_upper);
+        }
+        if(c < num_keys && max_key && integrity_compare(check, max_key, child_upper) != 0)
+            integrity_error(check, page_num, "key %u is not the largest key in its child", c);
+    }
+
+    return max_key;
+}
+
+/*
+ * integrity_check_tree()
+ * Returns the number of entries in the tree
+ */
+static uint64_t integrity_check_tree(IntegrityCheck* check, uint32_t root_page_num, int is_index)
+{
+    check->is_index      = is_index;
+    check->root_page_num = root_page_num;
+    check->leaf_depth    = 0;
+    check->prev_leaf     = 0;
+    check->num_entries   = 0;
+
+    integrity_check_node(check, root_page_num, DB_HEADER_PAGE_NUM, 1, NULL, NULL);
+    if(check->prev_leaf != 0 && *leaf_node_next_leaf(get_page(check->pager, check->prev_leaf)) != 0)
+        integrity_error(check, check->prev_leaf, "last leaf links to page %u",
+                *leaf_node_next_leaf(get_page(check->pager, check->prev_leaf)));
+
+    return check->num_entries;
+}
+
+/*
+ * integrity_check_index_entries()
+ * Only run once both trees are known to be sound, since it searches them
+ */
+static void integrity_check_index_entries(IntegrityCheck* check, Table* table)
+{
+    Cursor* cursor;
+    Cursor* index_cursor;
+    Row     row;
+    uint8_t key[INDEX_KEY_SIZE];
+
+    cursor = table_start(table);
+    while(!cursor->end_of_table)
+    {
+        cursor_read_columns(cursor, LEAF_COLUMN_BIT(LEAF_COLUMN_ID) | LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL), &row);
+        index_make_key(key, row.email, row.id);
+        index_cursor = index_find(table, row.email, row.id);
+        if(index_cursor->end_of_table || index_key_compare(index_cursor_key(index_cursor), key) != 0)
+            integrity_error(check, cursor->page_num, "row %u has no index entry", row.id);
+        cursor_advance(cursor);
+    }
+}
+
+/*
+ * integrity_check_table_keys()
+ * The key of each row in a table from the catalog is its first column
+ */
+static void integrity_check_table_keys(IntegrityCheck* check, CatalogEntry* entry)
+{
+    Cursor* cursor;
+
+    cursor = table_start(entry->table);
+    while(!cursor->end_of_table)
+    {
+        uint32_t key = *leaf_node_key(get_page(check->pager, cursor->page_num), cursor->cell_num);
+
+        if(schema_record_key(cursor_value(cursor)) != key)
+            integrity_error(check, cursor->page_num, "row %u of table %s has a different first column",
+                    key, entry->schema.name);
+        cursor_advance(cursor);
+    }
+    table_reset_arena(entry->table);
+}
+
+/*
+ * integrity_check_catalog()
+ * Check the catalog tree, then every table in it. The catalog is only 
+ * read once its tree is known to be sound.
+ */
+static void integrity_check_catalog(IntegrityCheck* check, Table* table, uint32_t root_page_num)
+{
+    Catalog* catalog;
+    uint64_t num_records;
+    uint32_t errors;
+
+    errors      = check->errors;
+    num_records = integrity_check_tree(check, root_page_num, 0);
+    if(check->errors != errors)
+        return;
+
+    catalog = catalog_get(table);
+    if(catalog->num_tables != num_records)
+        integrity_error(check, root_page_num, "catalog has %lu records but only %u tables could be read",
+                (unsigned long) num_records, catalog->num_tables);
+    for(uint32_t t = 0; t < catalog->num_tables; ++t)
+    {
+        CatalogEntry* entry = &catalog->tables[t];
+
+        errors = check->errors;
+        integrity_check_tree(check, entry->table->root_page_num, 0);
+        if(check->errors == errors)
+            integrity_check_table_keys(check, entry);
+    }
+}
+
+/*
+ * db_integrity_check()
+ */
+uint32_t db_integrity_check(Table* table)
+{
+    IntegrityCheck check;
+    void*          header;
+    uint32_t       free_page_num;
+    uint32_t       num_free;
+    uint64_t       num_rows;
+    uint64_t       num_index_entries;
+
+    memset(&check, 0, sizeof(check));
+    check.pager = table->pager;
+
+    header = get_page(check.pager, DB_HEADER_PAGE_NUM);
+    if(!(*db_header_flags(header) & DB_FLAG_CHECKSUMS))
+        fprintf(stdout, "file has no page checksums, .vacuum adds them\n");
+    for(uint32_t p = 0; p < check.pager->num_pages; ++p)
+    {
+        PageReadResult result = pager_verify_page(check.pager, p);
+
+        if(result == PAGE_READ_BAD_CHECKSUM)
+            integrity_error(&check, p, "checksum mismatch");
+        else if(result == PAGE_READ_IO_ERROR)
+            integrity_error(&check, p, "page could not be read");
+    }
+
+    check.seen[DB_HEADER_PAGE_NUM] = 1;
+    num_rows          = integrity_check_tree(&check, table->root_page_num, 0);
+    num_index_entries = integrity_check_tree(&check, table->index_root_page_num, 1);
+    if(num_rows != num_index_entries)
+        integrity_error(&check, table->index_root_page_num, "index has %lu entries for %lu rows",
+                (unsigned long) num_index_entries, (unsigned long) num_rows);
+    else if(check.errors == 0)
+        integrity_check_index_entries(&check, table);
+    if(*db_header_catalog_root(header) != 0)
+        integrity_check_catalog(&check, table, *db_header_catalog_root(header));
+
+    // Free pages hold the number of the next free page
+    num_free      = 0;
+    free_page_num = *db_header_free_head(header);
+    while(free_page_num != 0)
+    {
+        if(free_page_num >= check.pager->num_pages || check.seen[free_page_num])
+        {
+            integrity_error(&check, free_page_num, "free list entry is outside the file or already in use");
+            break;
+        }
+        check.seen[free_page_num] = 1;
+        num_free++;
+        if(!get_page(check.pager, free_page_num))
+        {
+            integrity_error(&check, free_page_num, "page could not be read");
+            break;
+        }
+        free_page_num = *((uint32_t*) get_page(check.pager, free_page_num));
+    }
+    if(num_free != *db_header_free_count(header))
+        integrity_error(&check, DB_HEADER_PAGE_NUM, "free list has %u pages, the header says %u",
+                num_free, *db_header_free_count(header));
+
+    for(uint32_t p = 0; p < check.pager->num_pages; ++p)
+    {
+        if(!check.seen[p])
+            integrity_error(&check, p, "page is not in a tree or the free list");
+    }
+
+    return check.errors;
+}
@@ -0,0 +1,34 @@
+/*
+ * INTEGRITY
+ * Check every page of a database and the invariants of its trees
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_INTEGRITY_H
+#define __SQ_INTEGRITY_H
+
+#include <stdint.h>
+#include "table.h"
+
+/*
+ * db_integrity_check()
+ * Checks that
+ *   - every page in the file matches its checksum
+ *   - nodes have a valid type, root flag and parent pointer
+ *   - nodes are no more than full, and no less than half full unless
+ *     they are the root
+ *   - keys are in order and within the range given by the parent, and
+ *     each separator key is the largest key in its child
+ *   - all leaves are at the same depth and linked in key order
+ *   - table leaf summaries cover the keys and strings in the leaf
+ *   - every row has an index entry and there are no others
+ *   - the catalog and every table in it are sound trees, and each row 
+ *     is keyed on its first column
+ *   - every page is in exactly one tree or the free list
+ * Each problem is printed to stdout. Returns the number of problems.
+ */
+uint32_t db_integrity_check(Table* table);
+
+
+#endif /*__SQ_INTEGRITY_H*/
@@ -0,0 +1,379 @@
+/*
+ * KERNEL
+ * Vectorized string filters over serialized rows
+ *
+ * Strings in a serialized row are zero padded to the width of their 
+ * column, so the start of a field can always be loaded as a whole 
+ * vector and compared against a padded copy of the pattern that is 
+ * loaded once per page rather than once per row. Substring search
+ * compares the first and last byte of the pattern at 16 or 32 positions
+ * at once and only checks the full pattern where both match.
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SQ_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*KernelFunc)(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap);
+
+static KernelFunc  kernel_func = NULL;
+static const char* kernel_name = NULL;
+
+
+/*
+ * kernel_pattern_init()
+ */
+void kernel_pattern_init(KernelPattern* pattern, KernelOp op, uint32_t offset, uint32_t size, const char* text)
+{
+    pattern->op     = op;
+    pattern->offset = offset;
+    pattern->size   = size;
+    pattern->text   = text;
+    pattern->len    = strlen(text);
+    memset(pattern->block, 0, KERNEL_VECTOR_SIZE);
+    memcpy(
+        pattern->block, 
+        text, 
+        (pattern->len < KERNEL_VECTOR_SIZE) ? pattern->len : KERNEL_VECTOR_SIZE
+    );
+}
+
+/*
+ * kernel_bitmap_fill()
+ * Set the bits for the first num_values values
+ */
+void kernel_bitmap_fill(uint64_t* bitmap, uint32_t num_values)
+{
+    uint32_t w;
+
+    for(w = 0; w < num_values / 64; ++w)
+        bitmap[w] = UINT64_MAX;
+    if(num_values % 64)
+        bitmap[w] = (1ULL << (num_values % 64)) - 1;
+}
+
+/*
+ * field_length()
+ * Length of a zero padded string field
+ */
+static inline uint32_t field_length(const char* field, uint32_t size)
+{
+    const char* end = memchr(field, '\0', size);
+
+    return (end != NULL) ? (uint32_t) (end - field) : size;
+}
+
+/*
+ * scalar_contains()
+ * Look for the pattern at positions from start onwards
+ */
+static inline int scalar_contains(const char* field, uint32_t field_len, KernelPattern* pattern, uint32_t start)
+{
+    for(uint32_t i = start; i + pattern->len <= field_len; ++i)
+    {
+        if(field[i] == pattern->text[0] && memcmp(field + i, pattern->text, pattern->len) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * kernel_filter_scalar()
+ */
+void kernel_filter_scalar(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    for(uint32_t v = 0; v < num_values; ++v)
+    {
+        uint64_t    bit = 1ULL << (v % 64);
+        const char* field;
+        int         match;
+
+        if((bitmap[v / 64] & bit) == 0)
+            continue;
+
+        field = values + v * stride + pattern->offset;
+        switch(pattern->op)
+        {
+            case KERNEL_EQ:
+                match = memcmp(field, pattern->text, pattern->len + 1) == 0;
+                break;
+            case KERNEL_PREFIX:
+                match = memcmp(field, pattern->text, pattern->len) == 0;
+                break;
+            case KERNEL_CONTAINS:
+                match = (pattern->len == 0) ||
+                    scalar_contains(field, field_length(field, pattern->size), pattern, 0);
+                break;
+            default:
+                match = 0;
+        }
+        if(!match)
+            bitmap[v / 64] &= ~bit;
+    }
+}
+
+#ifdef SQ_X86
+/*
+ * sse4_contains()
+ * Candidate positions are the ones where both the first and last byte
+ * of the pattern match. The scan stops at the first block holding the 
+ * end of the string since no match can start after it.
+ */
+__attribute__((target("sse4.2")))
+static inline int sse4_contains(const char* field, KernelPattern* pattern, __m128i first, __m128i last)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t      i;
+
+    for(i = 0; i + pattern->len - 1 + 16 <= pattern->size; i += 16)
+    {
+        __m128i  block = _mm_loadu_si128((const __m128i*) (field + i));
+        uint32_t mask  = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(first, block),
+                _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i*) (field + i + pattern->len - 1)))
+        ));
+
+        while(mask)
+        {
+            if(memcmp(field + i + __builtin_ctz(mask), pattern->text, pattern->len) == 0)
+                return 1;
+            mask &= mask - 1;
+        }
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)))
+            return 0;
+    }
+
+    // Positions too close to the end of the field for a vector load
+    return scalar_contains(field, field_length(field, pattern->size), pattern, i);
+}
+
+/*
+ * kernel_filter_sse4()
+ */
+__attribute__((target("sse4.2")))
+void kernel_filter_sse4(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    __m128i  text;
+    __m128i  first;
+    __m128i  last;
+    uint32_t n;
+    uint32_t head;
+
+    // Fields narrower than a vector can't be loaded whole, and an empty
+    // pattern is a prefix or substring of everything
+    if(pattern->size < 16 || (pattern->len == 0 && pattern->op != KERNEL_EQ))
+    {
+        kernel_filter_scalar(pattern, values, stride, num_values, bitmap);
+        return;
+    }
+
+    n     = (pattern->op == KERNEL_EQ) ? pattern->len + 1 : pattern->len;
+    head  = (n >= 16) ? 0xFFFF : (1u << n) - 1;
+    text  = _mm_loadu_si128((const __m128i*) pattern->block);
+    first = _mm_set1_epi8(pattern->text[0]);
+    last  = _mm_set1_epi8(pattern->text[(pattern->len > 0) ? pattern->len - 1 : 0]);
+
+    for(uint32_t w = 0; w < KERNEL_BITMAP_WORDS(num_values); ++w)
+    {
+        uint32_t    count = (num_values - w * 64 < 64) ? num_values - w * 64 : 64;
+        const char* field = values + w * 64 * stride + pattern->offset;
+        uint64_t    word  = 0;
+
+        if(bitmap[w] == 0)
+            continue;
+
+        if(pattern->op == KERNEL_CONTAINS)
+        {
+            for(uint32_t v = 0; v < count; ++v, field += stride)
+            {
+                if(bitmap[w] & (1ULL << v))
+                    word |= (uint64_t) sse4_contains(field, pattern, first, last) << v;
+            }
+        }
+        else
+        {
+            // Compare the head of every field without branching, then
+            // check the rest of the pattern for the ones that matched
+            for(uint32_t v = 0; v < count; ++v, field += stride)
+            {
+                uint32_t mask = _mm_movemask_epi8(
+                        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) field), text)
+                );
+                word |= (uint64_t) ((mask & head) == head) << v;
+            }
+            word &= bitmap[w];
+            if(n > 16)
+            {
+                for(uint64_t m = word; m; m &= m - 1)
+                {
+                    uint32_t v = __builtin_ctzll(m);
+
+                    field = values + (w * 64 + v) * stride + pattern->offset;
+                    if(memcmp(field + 16, pattern->text + 16, n - 16) != 0)
+                        word &= ~(1ULL << v);
+                }
+            }
+        }
+        bitmap[w] &= word;
+    }
+}
+
+/*
+ * avx2_contains()
+ */
+__attribute__((target("avx2")))
+static inline int avx2_contains(const char* field, KernelPattern* pattern, __m256i first, __m256i last)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t      i;
+
+    for(i = 0; i + pattern->len - 1 + 32 <= pattern->size; i += 32)
+    {
+        __m256i  block = _mm256_loadu_si256((const __m256i*) (field + i));
+        uint32_t mask  = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(first, block),
+                _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i*) (field + i + pattern->len - 1)))
+        ));
+
+        while(mask)
+        {
+            if(memcmp(field + i + __builtin_ctz(mask), pattern->text, pattern->len) == 0)
+                return 1;
+            mask &= mask - 1;
+        }
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero)))
+            return 0;
+    }
+
+    return scalar_contains(field, field_length(field, pattern->size), pattern, i);
+}
+
+/*
+ * kernel_filter_avx2()
+ */
+__attribute__((target("avx2")))
+void kernel_filter_avx2(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    __m256i  text;
+    __m256i  first;
+    __m256i  last;
+    uint32_t n;
+    uint32_t head;
+
+    if(pattern->size < 32 || (pattern->len == 0 && pattern->op != KERNEL_EQ))
+    {
+        kernel_filter_sse4(pattern, values, stride, num_values, bitmap);
+        return;
+    }
+
+    n     = (pattern->op == KERNEL_EQ) ? pattern->len + 1 : pattern->len;
+    head  = (n >= 32) ? 0xFFFFFFFF : (1u << n) - 1;
+    text  = _mm256_loadu_si256((const __m256i*) pattern->block);
+    first = _mm256_set1_epi8(pattern->text[0]);
+    last  = _mm256_set1_epi8(pattern->text[(pattern->len > 0) ? pattern->len - 1 : 0]);
+
+    for(uint32_t w = 0; w < KERNEL_BITMAP_WORDS(num_values); ++w)
+    {
+        uint32_t    count = (num_values - w * 64 < 64) ? num_values - w * 64 : 64;
+        const char* field = values + w * 64 * stride + pattern->offset;
+        uint64_t    word  = 0;
+
+        if(bitmap[w] == 0)
+            continue;
+
+        if(pattern->op == KERNEL_CONTAINS)
+        {
+            for(uint32_t v = 0; v < count; ++v, field += stride)
+            {
+                if(bitmap[w] & (1ULL << v))
+                    word |= (uint64_t) avx2_contains(field, pattern, first, last) << v;
+            }
+        }
+        else
+        {
+            for(uint32_t v = 0; v < count; ++v, field += stride)
+            {
+                uint32_t mask = (uint32_t) _mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) field), text)
+                );
+                word |= (uint64_t) ((mask & head) == head) << v;
+            }
+            word &= bitmap[w];
+            if(n > 32)
+            {
+                for(uint64_t m = word; m; m &= m - 1)
+                {
+                    uint32_t v = __builtin_ctzll(m);
+
+                    field = values + (w * 64 + v) * stride + pattern->offset;
+                    if(memcmp(field + 32, pattern->text + 32, n - 32) != 0)
+                        word &= ~(1ULL << v);
+                }
+            }
+        }
+        bitmap[w] &= word;
+    }
+}
+#else
+void kernel_filter_sse4(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    kernel_filter_scalar(pattern, values, stride, num_values, bitmap);
+}
+
+void kernel_filter_avx2(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    kernel_filter_scalar(pattern, values, stride, num_values, bitmap);
+}
+#endif /*SQ_X86*/
+
+/*
+ * kernel_init()
+ * Pick the widest implementation that the CPU supports
+ */
+static void kernel_init(void)
+{
+    kernel_func = kernel_filter_scalar;
+    kernel_name = "scalar";
+#ifdef SQ_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        kernel_func = kernel_filter_avx2;
+        kernel_name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse4.2"))
+    {
+        kernel_func = kernel_filter_sse4;
+        kernel_name = "sse4";
+    }
+#endif /*SQ_X86*/
+}
+
+/*
+ * kernel_filter()
+ */
+void kernel_filter(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap)
+{
+    if(kernel_func == NULL)
+        kernel_init();
+
+    kernel_func(pattern, values, stride, num_values, bitmap);
+}
+
+/*
+ * kernel_impl_name()
+ */
+const char* kernel_impl_name(void)
+{
+    if(kernel_func == NULL)
+        kernel_init();
+
+    return kernel_name;
+}
@@ -0,0 +1,57 @@
+/*
+ * KERNEL
+ * Vectorized string filters over serialized rows
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_KERNEL_H
+#define __SQ_KERNEL_H
+
+#include <stdint.h>
+
+// Number of 64-bit words needed for a bitmap with one bit per value
+#define KERNEL_BITMAP_WORDS(n) (((n) + 63) / 64)
+// Width of the widest vector, used to size the padded pattern
+#define KERNEL_VECTOR_SIZE     32
+
+typedef enum
+{
+    KERNEL_EQ,
+    KERNEL_PREFIX,
+    KERNEL_CONTAINS
+} KernelOp;
+
+/*
+ * A pattern to test a zero padded string field against. The field is at
+ * the same offset in every value.
+ */
+typedef struct
+{
+    KernelOp    op;
+    uint32_t    offset;     // offset of the field within each value
+    uint32_t    size;       // width of the field
+    const char* text;
+    uint32_t    len;        // length of text, not counting the zero
+    // text copied into a zero padded block that vectors can be loaded from
+    char        block[KERNEL_VECTOR_SIZE];
+} KernelPattern;
+
+void kernel_pattern_init(KernelPattern* pattern, KernelOp op, uint32_t offset, uint32_t size, const char* text);
+
+/*
+ * kernel_filter()
+ * Test the field in each of num_values values, stride bytes apart. Only
+ * values whose bit is already set in bitmap are tested, and bits are
+ * cleared for the ones that don't match, so several patterns can be
+ * applied one after another.
+ */
+void kernel_filter(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap);
+void kernel_filter_scalar(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap);
+void kernel_filter_sse4(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap);
+void kernel_filter_avx2(KernelPattern* pattern, const void* values, uint32_t stride, uint32_t num_values, uint64_t* bitmap);
+void kernel_bitmap_fill(uint64_t* bitmap, uint32_t num_values);
+const char* kernel_impl_name(void);
+
+
+#endif /*__SQ_KERNEL_H*/
@@ -0,0 +1,213 @@
+/*
+ * ROWCACHE
+ * Rows read by id, kept so hot ids skip the tree
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rowcache.h"
+
+
+/*
+ * row_cache_hash()
+ * Ids are often dense, so they are mixed before picking a stripe
+ */
+static uint32_t row_cache_hash(uint32_t id)
+{
+    id ^= id >> 16;
+    id *= 0x45d9f3bu;
+    id ^= id >> 16;
+
+    return id;
+}
+
+/*
+ * row_cache_find()
+ * The bucket for id in its stripe
+ */
+static RowCacheSlot* row_cache_find(RowCache* cache, uint32_t id, RowCacheStripe** stripe)
+{
+    uint32_t hash = row_cache_hash(id);
+
+    *stripe = &cache->stripes[hash % ROW_CACHE_STRIPES];
+
+    return &(*stripe)->slots[((hash / ROW_CACHE_STRIPES) % cache->num_buckets) * ROW_CACHE_WAYS];
+}
+
+/*
+ * row_cache_create()
+ * Room for at least num_rows rows
+ */
+RowCache* row_cache_create(uint32_t num_rows)
+{
+    RowCache* cache;
+    uint32_t  per_bucket = ROW_CACHE_STRIPES * ROW_CACHE_WAYS;
+
+    cache = malloc(sizeof(RowCache));
+    if(!cache)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for row cache\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    cache->num_buckets = (num_rows + per_bucket - 1) / per_bucket;
+    if(cache->num_buckets == 0)
+        cache->num_buckets = 1;
+    for(uint32_t s = 0; s < ROW_CACHE_STRIPES; ++s)
+    {
+        RowCacheStripe* stripe = &cache->stripes[s];
+
+        pthread_mutex_init(&stripe->lock, NULL);
+        stripe->slots  = calloc((size_t) cache->num_buckets * ROW_CACHE_WAYS, sizeof(RowCacheSlot));
+        stripe->clock  = 0;
+        stripe->hits   = 0;
+        stripe->misses = 0;
+        if(!stripe->slots)
+        {
+            fprintf(stderr, "[%s] failed to allocate %u rows for row cache\n", __func__, num_rows);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return cache;
+}
+
+/*
+ * row_cache_free()
+ */
+void row_cache_free(RowCache* cache)
+{
+    if(!cache)
+        return;
+    for(uint32_t s = 0; s < ROW_CACHE_STRIPES; ++s)
+    {
+        pthread_mutex_destroy(&cache->stripes[s].lock);
+        free(cache->stripes[s].slots);
+    }
+    free(cache);
+}
+
+/*
+ * row_cache_get()
+ * Returns 1 and copies the row if id is cached
+ */
+int row_cache_get(RowCache* cache, uint32_t id, Row* row)
+{
+    RowCacheStripe* stripe;
+    RowCacheSlot*   bucket;
+    int             hit = 0;
+
+    bucket = row_cache_find(cache, id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    for(uint32_t w = 0; w < ROW_CACHE_WAYS; ++w)
+    {
+        if(bucket[w].valid && bucket[w].row.id == id)
+        {
+            *row                = bucket[w].row;
+            bucket[w].last_used = ++stripe->clock;
+            hit                 = 1;
+            break;
+        }
+    }
+    if(hit)
+        stripe->hits++;
+    else
+        stripe->misses++;
+    pthread_mutex_unlock(&stripe->lock);
+
+    return hit;
+}
+
+/*
+ * row_cache_put()
+ * Keep a row, in place of the older copy of it or the least recently
+ * used row in its bucket
+ */
+void row_cache_put(RowCache* cache, Row* row)
+{
+    RowCacheStripe* stripe;
+    RowCacheSlot*   bucket;
+    RowCacheSlot*   victim;
+
+    bucket = row_cache_find(cache, row->id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    victim = &bucket[0];
+    for(uint32_t w = 0; w < ROW_CACHE_WAYS; ++w)
+    {
+        if(bucket[w].valid && bucket[w].row.id == row->id)
+        {
+            victim = &bucket[w];
+            break;
+        }
+        if(!bucket[w].valid)
+            victim = &bucket[w];
+        else if(victim->valid && bucket[w].last_used < victim->last_used)
+            victim = &bucket[w];
+    }
+    victim->row       = *row;
+    victim->valid     = 1;
+    victim->last_used = ++stripe->clock;
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/*
+ * row_cache_invalidate()
+ * Forget id, called whenever its row changes or is deleted
+ */
+void row_cache_invalidate(RowCache* cache, uint32_t id)
+{
+    RowCacheStripe* stripe;
+    RowCacheSlot*   bucket;
+
+    bucket = row_cache_find(cache, id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    for(uint32_t w = 0; w < ROW_CACHE_WAYS; ++w)
+    {
+        if(bucket[w].valid && bucket[w].row.id == id)
+            bucket[w].valid = 0;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/*
+ * row_cache_clear()
+ * Forget every row, the counters are kept
+ */
+void row_cache_clear(RowCache* cache)
+{
+    for(uint32_t s = 0; s < ROW_CACHE_STRIPES; ++s)
+    {
+        RowCacheStripe* stripe = &cache->stripes[s];
+
+        pthread_mutex_lock(&stripe->lock);
+        for(uint32_t i = 0; i < cache->num_buckets * ROW_CACHE_WAYS; ++i)
+            stripe->slots[i].valid = 0;
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
+
+/*
+ * row_cache_capacity()
+ */
+uint32_t row_cache_capacity(RowCache* cache)
+{
+    return cache->num_buckets * ROW_CACHE_WAYS * ROW_CACHE_STRIPES;
+}
+
+/*
+ * row_cache_stats()
+ * Hits and misses over every stripe
+ */
+void row_cache_stats(RowCache* cache, uint64_t* hits, uint64_t* misses)
+{
+    *hits   = 0;
+    *misses = 0;
+    for(uint32_t s = 0; s < ROW_CACHE_STRIPES; ++s)
+    {
+        pthread_mutex_lock(&cache->stripes[s].lock);
+        *hits   += cache->stripes[s].hits;
+        *misses += cache->stripes[s].misses;
+        pthread_mutex_unlock(&cache->stripes[s].lock);
+    }
+}
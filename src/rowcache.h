@@ -0,0 +1,62 @@
+/*
+ * ROWCACHE
+ * Rows read by id, kept so hot ids skip the tree
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_ROWCACHE_H
+#define __SQ_ROWCACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "table.h"
+
+/*
+ * Rows are kept whole, as they were read from their cell, in a fixed
+ * number of slots. The slots are split into stripes by the hash of the
+ * id, each stripe with its own lock, so lookups of different ids rarely
+ * wait on each other. Within a stripe the hash picks a bucket of
+ * ROW_CACHE_WAYS slots, and a new row replaces the least recently used
+ * row of its bucket.
+ *
+ * The cache knows nothing of the tree, so every statement that changes
+ * a row has to invalidate its id.
+ */
+#define ROW_CACHE_DEFAULT_ROWS  1024
+#define ROW_CACHE_STRIPES       16
+#define ROW_CACHE_WAYS          4
+
+typedef struct
+{
+    Row      row;
+    uint32_t valid;
+    uint64_t last_used;
+} RowCacheSlot;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    RowCacheSlot*   slots;
+    uint64_t        clock;          // ticks on every use, for last_used
+    uint64_t        hits;
+    uint64_t        misses;
+} RowCacheStripe;
+
+typedef struct RowCache
+{
+    uint32_t       num_buckets;     // in each stripe
+    RowCacheStripe stripes[ROW_CACHE_STRIPES];
+} RowCache;
+
+RowCache* row_cache_create(uint32_t num_rows);
+void      row_cache_free(RowCache* cache);
+int       row_cache_get(RowCache* cache, uint32_t id, Row* row);
+void      row_cache_put(RowCache* cache, Row* row);
+void      row_cache_invalidate(RowCache* cache, uint32_t id);
+void      row_cache_clear(RowCache* cache);
+uint32_t  row_cache_capacity(RowCache* cache);
+void      row_cache_stats(RowCache* cache, uint64_t* hits, uint64_t* misses);
+
+
+#endif /*__SQ_ROWCACHE_H*/
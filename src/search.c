@@ -0,0 +1,184 @@
+/*
+ * SEARCH
+ * Key search within tree nodes
+ *
+ * Keys in leaf and internal nodes are stored in a contiguous array at 
+ * the front of the node, so a block of them can be compared against the
+ * search key with a handful of vector instructions. Since the keys are
+ * sorted, the number of keys in the block that are less than the search
+ * key is the offset of the lower bound within the block.
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include "search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SQ_X86
+#include <immintrin.h>
+#endif
+
+typedef uint32_t (*KeySearchFunc)(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+
+static KeySearchFunc key_search_func = NULL;
+static const char*   key_search_name = NULL;
+
+
+/*
+ * key_narrow()
+ * Binary search until at most KEY_SEARCH_BLOCK_SIZE keys are left in 
+ * [*lo, *hi). The lower bound is always inside that range.
+ */
+static inline void key_narrow(const uint32_t* keys, uint32_t* lo, uint32_t* hi, uint32_t key)
+{
+    while(*hi - *lo > KEY_SEARCH_BLOCK_SIZE)
+    {
+        uint32_t mid = (*lo + *hi) / 2;
+
+        if(keys[mid] < key)
+            *lo = mid + 1;
+        else
+            *hi = mid;
+    }
+}
+
+/*
+ * key_lower_bound_scalar()
+ */
+uint32_t key_lower_bound_scalar(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t lo = 0;
+    uint32_t hi = num_keys;
+
+    while(lo != hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if(keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+#ifdef SQ_X86
+/*
+ * key_lower_bound_sse4()
+ * There is no unsigned compare, so flip the sign bit of both sides to 
+ * get the same ordering out of a signed compare.
+ */
+__attribute__((target("sse4.2,popcnt")))
+uint32_t key_lower_bound_sse4(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t lo = 0;
+    uint32_t hi = num_keys;
+    uint32_t count = 0;
+    uint32_t k;
+    __m128i  bias;
+    __m128i  target;
+
+    key_narrow(keys, &lo, &hi, key);
+
+    bias   = _mm_set1_epi32((int) 0x80000000);
+    target = _mm_xor_si128(_mm_set1_epi32((int) key), bias);
+    for(k = lo; k + 4 <= hi; k += 4)
+    {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (keys + k)), bias);
+        __m128i less  = _mm_cmpgt_epi32(target, block);
+
+        count += _mm_popcnt_u32(_mm_movemask_ps(_mm_castsi128_ps(less)));
+    }
+    for(; k < hi; ++k)
+        count += (keys[k] < key);
+
+    return lo + count;
+}
+
+/*
+ * key_lower_bound_avx2()
+ */
+__attribute__((target("avx2,popcnt")))
+uint32_t key_lower_bound_avx2(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t lo = 0;
+    uint32_t hi = num_keys;
+    uint32_t count = 0;
+    uint32_t k;
+    __m256i  bias;
+    __m256i  target;
+
+    key_narrow(keys, &lo, &hi, key);
+
+    bias   = _mm256_set1_epi32((int) 0x80000000);
+    target = _mm256_xor_si256(_mm256_set1_epi32((int) key), bias);
+    for(k = lo; k + 8 <= hi; k += 8)
+    {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (keys + k)), bias);
+        __m256i less  = _mm256_cmpgt_epi32(target, block);
+
+        count += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+    }
+    for(; k < hi; ++k)
+        count += (keys[k] < key);
+
+    return lo + count;
+}
+#else
+uint32_t key_lower_bound_sse4(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    return key_lower_bound_scalar(keys, num_keys, key);
+}
+
+uint32_t key_lower_bound_avx2(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    return key_lower_bound_scalar(keys, num_keys, key);
+}
+#endif /*SQ_X86*/
+
+/*
+ * key_search_init()
+ * Pick the widest implementation that the CPU supports
+ */
+static void key_search_init(void)
+{
+    key_search_func = key_lower_bound_scalar;
+    key_search_name = "scalar";
+#ifdef SQ_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        key_search_func = key_lower_bound_avx2;
+        key_search_name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+    {
+        key_search_func = key_lower_bound_sse4;
+        key_search_name = "sse4";
+    }
+#endif /*SQ_X86*/
+}
+
+/*
+ * key_lower_bound()
+ */
+uint32_t key_lower_bound(const uint32_t* keys, uint32_t num_keys, uint32_t key)
+{
+    if(key_search_func == NULL)
+        key_search_init();
+
+    return key_search_func(keys, num_keys, key);
+}
+
+/*
+ * key_search_impl_name()
+ */
+const char* key_search_impl_name(void)
+{
+    if(key_search_func == NULL)
+        key_search_init();
+
+    return key_search_name;
+}
@@ -0,0 +1,30 @@
+/*
+ * SEARCH
+ * Key search within tree nodes
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_SEARCH_H
+#define __SQ_SEARCH_H
+
+#include <stdint.h>
+
+// Binary search narrows the range down to at most this many keys, 
+// which are then compared all at once.
+#define KEY_SEARCH_BLOCK_SIZE 32
+
+/*
+ * key_lower_bound()
+ * Index of the first key in a sorted array that is not less than key.
+ * The implementation is picked the first time this is called based on
+ * what the CPU supports.
+ */
+uint32_t    key_lower_bound(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+uint32_t    key_lower_bound_scalar(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+uint32_t    key_lower_bound_sse4(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+uint32_t    key_lower_bound_avx2(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+const char* key_search_impl_name(void);
+
+
+#endif /*__SQ_SEARCH_H*/
@@ -0,0 +1,425 @@
+/*
+ * SORT
+ * Sorting rows for order by, in memory or in runs spilled to files
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sort.h"
+
+
+// ================ COMPARISON
+
+/*
+ * compare_column()
+ * Only the sorted column is reversed for descending order, ties are
+ * always in id order.
+ */
+static int compare_column(LeafColumn column, int descending, const Row* a, const Row* b)
+{
+    int diff = 0;
+
+    if(column == LEAF_COLUMN_USERNAME)
+        diff = strcmp(a->username, b->username);
+    else if(column == LEAF_COLUMN_EMAIL)
+        diff = strcmp(a->email, b->email);
+    else
+        diff = (a->id > b->id) - (a->id < b->id);
+    if(descending)
+        diff = -diff;
+    if(diff == 0)
+        diff = (a->id > b->id) - (a->id < b->id);
+
+    return diff;
+}
+
+/*
+ * sort_compare()
+ * Less than zero if a comes before b in the output
+ */
+int sort_compare(Sorter* sorter, Row* a, Row* b)
+{
+    return compare_column(sorter->column, sorter->descending, a, b);
+}
+
+// qsort() has no argument for the column, so there is a function for
+// each column and direction
+static int qsort_id(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_ID, 0, *(Row* const*) a, *(Row* const*) b);
+}
+
+static int qsort_id_desc(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_ID, 1, *(Row* const*) a, *(Row* const*) b);
+}
+
+static int qsort_username(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_USERNAME, 0, *(Row* const*) a, *(Row* const*) b);
+}
+
+static int qsort_username_desc(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_USERNAME, 1, *(Row* const*) a, *(Row* const*) b);
+}
+
+static int qsort_email(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_EMAIL, 0, *(Row* const*) a, *(Row* const*) b);
+}
+
+static int qsort_email_desc(const void* a, const void* b)
+{
+    return compare_column(LEAF_COLUMN_EMAIL, 1, *(Row* const*) a, *(Row* const*) b);
+}
+
+/*
+ * sort_rows()
+ * Sort the rows held in memory
+ */
+static void sort_rows(Sorter* sorter)
+{
+    static int (* const funcs[LEAF_NUM_COLUMNS][2])(const void*, const void*) = {
+        [LEAF_COLUMN_ID]       = {qsort_id, qsort_id_desc},
+        [LEAF_COLUMN_USERNAME] = {qsort_username, qsort_username_desc},
+        [LEAF_COLUMN_EMAIL]    = {qsort_email, qsort_email_desc}
+    };
+
+    qsort(sorter->order, sorter->num_rows, sizeof(Row*), funcs[sorter->column][sorter->descending ? 1 : 0]);
+}
+
+
+// ================ TOP N HEAP
+
+/*
+ * top_n_sift_down()
+ * The heap is kept in order with the row that sorts last on top
+ */
+static void top_n_sift_down(Sorter* sorter, uint32_t pos)
+{
+    Row** heap = sorter->order;
+
+    while(1)
+    {
+        uint32_t largest = pos;
+        uint32_t left    = 2 * pos + 1;
+        uint32_t right   = 2 * pos + 2;
+        Row*     tmp;
+
+        if(left < sorter->num_rows && sort_compare(sorter, heap[left], heap[largest]) > 0)
+            largest = left;
+        if(right < sorter->num_rows && sort_compare(sorter, heap[right], heap[largest]) > 0)
+            largest = right;
+        if(largest == pos)
+            return;
+        tmp           = heap[pos];
+        heap[pos]     = heap[largest];
+        heap[largest] = tmp;
+        pos           = largest;
+    }
+}
+
+/*
+ * top_n_add()
+ */
+static void top_n_add(Sorter* sorter, Row* row)
+{
+    Row**    heap = sorter->order;
+    uint32_t pos;
+
+    if(sorter->num_rows < sorter->limit)
+    {
+        pos       = sorter->num_rows++;
+        heap[pos] = &sorter->rows[pos];
+        *heap[pos] = *row;
+        while(pos > 0 && sort_compare(sorter, heap[pos], heap[(pos - 1) / 2]) > 0)
+        {
+            Row* tmp = heap[pos];
+
+            heap[pos]           = heap[(pos - 1) / 2];
+            heap[(pos - 1) / 2] = tmp;
+            pos                 = (pos - 1) / 2;
+        }
+        return;
+    }
+
+    // Replace the worst row kept so far if this one sorts before it
+    if(sort_compare(sorter, row, heap[0]) < 0)
+    {
+        *heap[0] = *row;
+        top_n_sift_down(sorter, 0);
+    }
+}
+
+
+// ================ RUNS
+
+/*
+ * sort_merge_init()
+ * Start merging runs that have been written out. Each run is read from
+ * its start.
+ */
+static SortResult sort_merge_init(Sorter* sorter, SortMerge* merge, FILE** runs, uint32_t num_runs)
+{
+    merge->num_runs  = num_runs;
+    merge->heap_size = 0;
+    for(uint32_t r = 0; r < num_runs; ++r)
+    {
+        uint32_t pos;
+
+        merge->runs[r] = runs[r];
+        rewind(runs[r]);
+        if(fread(&merge->heads[r], sizeof(Row), 1, runs[r]) != 1)
+        {
+            if(ferror(runs[r]))
+                return SORT_IO_ERROR;
+            continue;
+        }
+
+        // Sift the new run up the heap
+        pos              = merge->heap_size++;
+        merge->heap[pos] = r;
+        while(pos > 0 && sort_compare(sorter, &merge->heads[merge->heap[pos]], &merge->heads[merge->heap[(pos - 1) / 2]]) < 0)
+        {
+            uint32_t tmp = merge->heap[pos];
+
+            merge->heap[pos]           = merge->heap[(pos - 1) / 2];
+            merge->heap[(pos - 1) / 2] = tmp;
+            pos                        = (pos - 1) / 2;
+        }
+    }
+
+    return SORT_OK;
+}
+
+/*
+ * sort_merge_next()
+ * Take the smallest head and replace it with the next row of its run
+ */
+static SortResult sort_merge_next(Sorter* sorter, SortMerge* merge, Row* row)
+{
+    uint32_t run;
+    uint32_t pos = 0;
+
+    if(merge->heap_size == 0)
+        return SORT_END;
+
+    run  = merge->heap[0];
+    *row = merge->heads[run];
+    if(fread(&merge->heads[run], sizeof(Row), 1, merge->runs[run]) != 1)
+    {
+        if(ferror(merge->runs[run]))
+            return SORT_IO_ERROR;
+        merge->heap[0] = merge->heap[--merge->heap_size];
+    }
+
+    while(1)
+    {
+        uint32_t smallest = pos;
+        uint32_t left     = 2 * pos + 1;
+        uint32_t right    = 2 * pos + 2;
+        uint32_t tmp;
+
+        if(left < merge->heap_size &&
+           sort_compare(sorter, &merge->heads[merge->heap[left]], &merge->heads[merge->heap[smallest]]) < 0)
+            smallest = left;
+        if(right < merge->heap_size &&
+           sort_compare(sorter, &merge->heads[merge->heap[right]], &merge->heads[merge->heap[smallest]]) < 0)
+            smallest = right;
+        if(smallest == pos)
+            break;
+        tmp                    = merge->heap[pos];
+        merge->heap[pos]       = merge->heap[smallest];
+        merge->heap[smallest]  = tmp;
+        pos                    = smallest;
+    }
+
+    return SORT_OK;
+}
+
+/*
+ * sort_merge_runs()
+ * Merge every run written so far into a single run
+ */
+static SortResult sort_merge_runs(Sorter* sorter)
+{
+    FILE*      fp;
+    Row        row;
+    SortResult result;
+
+    fp = tmpfile();
+    if(!fp)
+        return SORT_IO_ERROR;
+
+    result = sort_merge_init(sorter, &sorter->merge, sorter->runs, sorter->num_runs);
+    while(result == SORT_OK)
+    {
+        result = sort_merge_next(sorter, &sorter->merge, &row);
+        if(result == SORT_OK && fwrite(&row, sizeof(Row), 1, fp) != 1)
+            result = SORT_IO_ERROR;
+    }
+    for(uint32_t r = 0; r < sorter->num_runs; ++r)
+        fclose(sorter->runs[r]);
+    sorter->runs[0]  = fp;
+    sorter->num_runs = 1;
+    sorter->num_spills++;
+
+    return (result == SORT_END) ? SORT_OK : result;
+}
+
+/*
+ * sort_spill()
+ * Sort the rows in memory and write them out as a run
+ */
+static SortResult sort_spill(Sorter* sorter)
+{
+    FILE* fp;
+
+    if(sorter->num_runs == SORT_MERGE_FANIN && sort_merge_runs(sorter) != SORT_OK)
+        return SORT_IO_ERROR;
+
+    fp = tmpfile();
+    if(!fp)
+        return SORT_IO_ERROR;
+    sorter->runs[sorter->num_runs++] = fp;
+    sorter->num_spills++;
+
+    sort_rows(sorter);
+    for(uint32_t r = 0; r < sorter->num_rows; ++r)
+    {
+        if(fwrite(sorter->order[r], sizeof(Row), 1, fp) != 1)
+            return SORT_IO_ERROR;
+    }
+    sorter->num_rows = 0;
+
+    return SORT_OK;
+}
+
+
+// ================ SORTER
+
+/*
+ * sort_init()
+ * The budget covers the rows held in memory and the array they are
+ * sorted through. It is never less than SORT_MIN_MEMORY.
+ */
+SortResult sort_init(Sorter* sorter, LeafColumn column, int descending, uint64_t limit, size_t memory)
+{
+    size_t max_rows;
+
+    if(memory < SORT_MIN_MEMORY)
+        memory = SORT_MIN_MEMORY;
+    max_rows = memory / (sizeof(Row) + sizeof(Row*));
+    if(max_rows > UINT32_MAX)
+        max_rows = UINT32_MAX;
+
+    sorter->column     = column;
+    sorter->descending = descending;
+    sorter->limit      = limit;
+    sorter->top_n      = (limit <= max_rows);
+    // A top n heap only needs room for limit rows
+    sorter->max_rows   = sorter->top_n ? (uint32_t) limit : (uint32_t) max_rows;
+    sorter->num_rows   = 0;
+    sorter->num_runs   = 0;
+    sorter->num_spills = 0;
+    sorter->merging    = 0;
+    sorter->next_row   = 0;
+    sorter->num_output = 0;
+    sorter->rows       = malloc((size_t) sorter->max_rows * sizeof(Row) + 1);
+    sorter->order      = malloc((size_t) sorter->max_rows * sizeof(Row*) + 1);
+    if(!sorter->rows || !sorter->order)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for %u rows\n", __func__, sorter->max_rows);
+        exit(EXIT_FAILURE);
+    }
+
+    return SORT_OK;
+}
+
+/*
+ * sort_add()
+ */
+SortResult sort_add(Sorter* sorter, Row* row)
+{
+    if(sorter->top_n)
+    {
+        if(sorter->limit > 0)
+            top_n_add(sorter, row);
+        return SORT_OK;
+    }
+
+    if(sorter->num_rows == sorter->max_rows && sort_spill(sorter) != SORT_OK)
+        return SORT_IO_ERROR;
+    sorter->rows[sorter->num_rows]  = *row;
+    sorter->order[sorter->num_rows] = &sorter->rows[sorter->num_rows];
+    sorter->num_rows++;
+
+    return SORT_OK;
+}
+
+/*
+ * sort_finish()
+ * Called once every row has been added. If nothing was spilled the rows
+ * are sorted in memory, otherwise the last rows are spilled too and the
+ * runs are merged as they are read.
+ */
+SortResult sort_finish(Sorter* sorter)
+{
+    if(sorter->num_runs == 0)
+    {
+        sort_rows(sorter);
+        return SORT_OK;
+    }
+
+    if(sorter->num_rows > 0 && sort_spill(sorter) != SORT_OK)
+        return SORT_IO_ERROR;
+    sorter->merging = 1;
+
+    return sort_merge_init(sorter, &sorter->merge, sorter->runs, sorter->num_runs);
+}
+
+/*
+ * sort_next()
+ * Rows in order, up to the limit
+ */
+SortResult sort_next(Sorter* sorter, Row* row)
+{
+    SortResult result;
+
+    if(sorter->num_output >= sorter->limit)
+        return SORT_END;
+
+    if(sorter->merging)
+    {
+        result = sort_merge_next(sorter, &sorter->merge, row);
+        if(result != SORT_OK)
+            return result;
+    }
+    else
+    {
+        if(sorter->next_row >= sorter->num_rows)
+            return SORT_END;
+        *row = *sorter->order[sorter->next_row++];
+    }
+    sorter->num_output++;
+
+    return SORT_OK;
+}
+
+/*
+ * sort_free()
+ * Release the memory and close (and so remove) the run files
+ */
+void sort_free(Sorter* sorter)
+{
+    for(uint32_t r = 0; r < sorter->num_runs; ++r)
+        fclose(sorter->runs[r]);
+    sorter->num_runs = 0;
+    free(sorter->rows);
+    free(sorter->order);
+    sorter->rows  = NULL;
+    sorter->order = NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * SORT
+ * Sorting rows for order by, in memory or in runs spilled to files
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_SORT_H
+#define __SQ_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "table.h"
+
+/*
+ * Rows are sorted on one column, with ties broken by id so the order is
+ * always the same. Rows are collected in memory up to the memory budget.
+ * Each time the budget is used up the rows are sorted and written out
+ * as a run to a temporary file, and at the end the runs are merged. When
+ * there are more than SORT_MERGE_FANIN runs they are first merged into
+ * one, so the merge never has more than that many files open.
+ *
+ * With a limit that fits in the budget there are never any runs. The
+ * best rows seen so far are kept in a heap with the worst of them on
+ * top, so each row after the first limit costs one comparison unless it
+ * displaces the top.
+ */
+#define SORT_DEFAULT_MEMORY  (4 * 1024 * 1024)
+#define SORT_MIN_MEMORY      (16 * 1024)
+#define SORT_MERGE_FANIN     16
+#define SORT_NO_LIMIT        UINT64_MAX
+
+typedef enum
+{
+    SORT_OK,
+    SORT_END,                   // no more rows
+    SORT_IO_ERROR               // a temporary file could not be written or read
+} SortResult;
+
+// Merges the heads of a set of runs
+typedef struct
+{
+    uint32_t num_runs;
+    FILE*    runs[SORT_MERGE_FANIN + 1];
+    Row      heads[SORT_MERGE_FANIN + 1];
+    uint32_t heap[SORT_MERGE_FANIN + 1];    // runs that have rows left, smallest head on top
+    uint32_t heap_size;
+} SortMerge;
+
+typedef struct
+{
+    LeafColumn column;
+    int        descending;
+    uint64_t   limit;
+    int        top_n;           // keep only the best limit rows in a heap
+    uint32_t   max_rows;        // rows that fit in the memory budget
+    uint32_t   num_rows;
+    Row*       rows;
+    Row**      order;           // rows, sorted once the sort is finished
+    uint32_t   num_runs;
+    FILE*      runs[SORT_MERGE_FANIN + 1];
+    uint32_t   num_spills;      // runs written, including merged ones
+    SortMerge  merge;
+    int        merging;
+    uint32_t   next_row;
+    uint64_t   num_output;
+} Sorter;
+
+SortResult sort_init(Sorter* sorter, LeafColumn column, int descending, uint64_t limit, size_t memory);
+SortResult sort_add(Sorter* sorter, Row* row);
+SortResult sort_finish(Sorter* sorter);
+SortResult sort_next(Sorter* sorter, Row* row);
+void       sort_free(Sorter* sorter);
+int        sort_compare(Sorter* sorter, Row* a, Row* b);
+
+
+#endif /*__SQ_SORT_H*/
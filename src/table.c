@@ -5,6 +5,9 @@
  * Stefan Wong 2019
  */
 
+// for O_DIRECT
+#define _GNU_SOURCE
+
 #include <errno.h>
 // For opening fd
 #include <sys/stat.h>
@@ -14,6 +17,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "table.h"
+#include "catalog.h"
+#include "checksum.h"
+#include "compress.h"
+#include "index.h"
+#include "search.h"
+#include "sort.h"
+#include "group.h"
+#include "cache.h"
+#include "rowcache.h"
+#include "trace.h"
 
 
 // ================ ROW
@@ -24,8 +37,8 @@
 void print_page_info(void)
 {
     fprintf(stdout, "ROW_SIZE        : %ld\n", ROW_SIZE);
-    fprintf(stdout, "PAGE_SIZE       : %ld\n", PAGE_SIZE);
-    fprintf(stdout, "TABLE_MAX_PAGES : %ld\n", TABLE_MAX_PAGES);
+    fprintf(stdout, "PAGE_SIZE       : %d\n", PAGE_SIZE);
+    fprintf(stdout, "TABLE_MAX_PAGES : %d\n", TABLE_MAX_PAGES);
 }
 
 /*
@@ -49,7 +62,7 @@ void serialize_row(Row* src, void* dest)
     // we use strncpy here to ensure that all bytes are
     // initialized to zeros
     strncpy(dest + USERNAME_OFFSET, src->username, USERNAME_SIZE);
-    strncpy(dest + EMAIL_OFFSET, src->email, USERNAME_SIZE);
+    strncpy(dest + EMAIL_OFFSET, src->email, EMAIL_SIZE);
 }
 
 /*
@@ -64,320 +77,452 @@ void deserialize_row(void* src, Row* dst)
 
 
 // ================ TREE NODES
-typedef enum
-{
-    NODE_INTERNAL,
-    NODE_LEAF
-} NodeType;
-
 
 /*
- * Leaf Node methods
- * All of these methods find elements in the B+Tree based on pointer offsets
+ * Common Node methods
  */
-uint32_t* leaf_node_num_cells(void* node)
+NodeType get_node_type(void* node)
 {
-    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+    uint8_t value = *((uint8_t*) (node + NODE_TYPE_OFFSET));
+    return (NodeType) value;
 }
 
-void* leaf_node_cell(void* node, uint32_t cell_num)
+void set_node_type(void* node, NodeType type)
 {
-    return node + LEAF_NODE_HEADER_SIZE +
-        cell_num * LEAF_NODE_CELL_SIZE;
+    *((uint8_t*) (node + NODE_TYPE_OFFSET)) = (uint8_t) type;
 }
 
-uint32_t* leaf_node_key(void* node, uint32_t cell_num)
+int is_node_root(void* node)
 {
-    return leaf_node_cell(node, cell_num);
+    uint8_t value = *((uint8_t*) (node + IS_ROOT_OFFSET));
+    return (int) value;
 }
 
-void* leaf_node_value(void* node, uint32_t cell_num)
+void set_node_root(void* node, int is_root)
 {
-    return leaf_node_cell(node, cell_num) + 
-        LEAF_NODE_KEY_SIZE;
+    *((uint8_t*) (node + IS_ROOT_OFFSET)) = (uint8_t) is_root;
 }
 
-void init_leaf_node_value(void* node)
+uint32_t* node_parent(void* node)
 {
-    *leaf_node_num_cells(node) = 0;
+    return node + PARENT_POINTER_OFFSET;
 }
 
+/*
+ * get_node_max_key()
+ * The largest key in a node is the largest key in its rightmost leaf
+ */
+uint32_t get_node_max_key(Pager* pager, void* node)
+{
+    if(get_node_type(node) == NODE_LEAF)
+        return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
 
-// ================ PAGER
+    return get_node_max_key(
+            pager, 
+            get_page(pager, *internal_node_right_child(node))
+    );
+}
 
 /*
- * pager_open()
+ * get_unused_page_num()
+ * Take a page off the free list if there is one, otherwise new pages go
+ * onto the end of the file. Every page number returned must be used.
  */
-Pager* pager_open(const char* filename)
+uint32_t get_unused_page_num(Pager* pager)
 {
-    int    fd;
-    Pager* pager;
+    void*    header;
+    uint32_t page_num;
 
-    fd = open(
-            filename, 
-            O_RDWR | O_CREAT,       // read/write mode, create if file does not exist
-            S_IWUSR | S_IRUSR       // user read permission, user write permission
-    );
+    header   = get_page(pager, DB_HEADER_PAGE_NUM);
+    page_num = *db_header_free_head(header);
+    if(page_num == 0)
+        return pager->num_pages;
 
-    if(fd == -1)
-    {
-        fprintf(stdout, "[%s] unable to open file %s\n", __func__, filename);
-        return NULL;
-    }
+    *db_header_free_head(header) = *((uint32_t*) get_page(pager, page_num));
+    *db_header_free_count(header) -= 1;
 
-    // setup pager
-    pager = malloc(sizeof(Pager));
-    pager->fd = fd;
-    pager->file_length = lseek(fd, 0, SEEK_END);
-    pager->num_pages   = (pager->file_length / PAGE_SIZE);
+    return page_num;
+}
+
+/*
+ * tree_depth()
+ * Number of levels in the tree rooted at root_page_num. Every level is 
+ * the same height so following the right children is enough. Only the 
+ * header layout is used here so this works for the table and the index.
+ */
+uint32_t tree_depth(Pager* pager, uint32_t root_page_num)
+{
+    void*    node;
+    uint32_t depth = 1;
 
-    if(pager->file_length % PAGE_SIZE != 0)
+    node = get_page(pager, root_page_num);
+    while(node && get_node_type(node) == NODE_INTERNAL)
     {
-        fprintf(stderr, "[%s] Corruption: DB file is a not a whole number of pages\n", __func__);
-        return NULL;
+        node = get_page(pager, *internal_node_right_child(node));
+        depth++;
     }
 
-    for(uint32_t p = 0; p < TABLE_MAX_PAGES; ++p)
-        pager->pages[p] = NULL;
-
-    return pager;
+    return depth;
 }
 
 /*
- * pager_flush()
+ * Leaf Node methods
+ * All of these methods find elements in the B+Tree based on pointer offsets
  */
-void pager_flush(Pager* pager, uint32_t page_num)
+uint32_t* leaf_node_num_cells(void* node)
 {
-    ssize_t bytes_written;
+    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+}
 
-    if(pager->pages[page_num] == NULL)
-    {
-        fprintf(stdout, "[%s] tried to flush null page %d\n", __func__, page_num);
-        return;
-    }
+uint32_t* leaf_node_next_leaf(void* node)
+{
+    return node + LEAF_NODE_NEXT_LEAF_OFFSET;
+}
 
-    bytes_written = write(
-            pager->fd, 
-            pager->pages[page_num],
-            PAGE_SIZE
-    );
+uint32_t* leaf_node_key(void* node, uint32_t cell_num)
+{
+    return node + LEAF_NODE_KEYS_OFFSET + 
+        cell_num * LEAF_NODE_KEY_SIZE;
+}
 
-    if(bytes_written == -1)
-    {
-        fprintf(stdout, "[%s] error writing [errno: %d]\n", __func__, errno);
-        return;     // EXIT_FAILURE?
-    }
+// Where each column sits in a serialized row
+static const uint32_t leaf_column_offset[LEAF_NUM_COLUMNS] = {ID_OFFSET, USERNAME_OFFSET, EMAIL_OFFSET};
+static const uint32_t leaf_column_size[LEAF_NUM_COLUMNS]   = {ID_SIZE, USERNAME_SIZE, EMAIL_SIZE};
+
+LeafLayout leaf_node_layout(void* node)
+{
+    uint8_t layout = *((uint8_t*) (node + LEAF_NODE_LAYOUT_OFFSET));
+
+    return (layout == LEAF_LAYOUT_COLUMNAR) ? LEAF_LAYOUT_COLUMNAR : LEAF_LAYOUT_ROW;
 }
 
 /*
- * get_page()
+ * leaf_node_set_layout()
+ * Only for a leaf with no cells, the cells already there are not moved
  */
-void* get_page(Pager* pager, uint32_t page_num)
+void leaf_node_set_layout(void* node, LeafLayout layout)
+{
+    *((uint8_t*) (node + LEAF_NODE_LAYOUT_OFFSET)) = (uint8_t) layout;
+}
+
+/*
+ * leaf_node_column()
+ * Where one column of a cell's value is. In a columnar leaf the 
+ * minipage of each column starts LEAF_NODE_MAX_CELLS times the column's
+ * offset in a row into the values, so the minipages fill the same space
+ * as the array of rows.
+ */
+void* leaf_node_column(void* node, uint32_t cell_num, LeafColumn column)
 {
-    if(page_num > TABLE_MAX_PAGES)
+    if(leaf_node_layout(node) == LEAF_LAYOUT_COLUMNAR)
     {
-        fprintf(stdout, "[%s] page %d out of bounds (max page %d)\n",
-                __func__, page_num, TABLE_MAX_PAGES);
-        return NULL;
+        return node + LEAF_NODE_VALUES_OFFSET + 
+            LEAF_NODE_MAX_CELLS * leaf_column_offset[column] + 
+            cell_num * leaf_column_size[column];
     }
 
-    if(pager->pages[page_num] == NULL)
-    {
-        // cache miss - allocate new memory
-        void* page;
-        uint32_t num_pages;
+    return node + LEAF_NODE_VALUES_OFFSET + 
+        cell_num * LEAF_NODE_VALUE_SIZE + leaf_column_offset[column];
+}
 
-        page = malloc(PAGE_SIZE);
-        if(!page)
-        {
-            fprintf(stdout, "[%s] failed to allocate memory for page %d\n", __func__, page_num);
-            return NULL;
-        }
+/*
+ * leaf_node_column_stride()
+ * Distance from a column in one cell to the same column in the next
+ */
+uint32_t leaf_node_column_stride(void* node, LeafColumn column)
+{
+    if(leaf_node_layout(node) == LEAF_LAYOUT_COLUMNAR)
+        return leaf_column_size[column];
 
-        num_pages = pager->file_length / PAGE_SIZE;
-        // account for partial pages saved at the end of the file
-        if(pager->file_length % PAGE_SIZE)
-            num_pages++;
+    return LEAF_NODE_VALUE_SIZE;
+}
 
-        if(page_num < num_pages)
-        {
-            lseek(pager->fd, page_num * PAGE_SIZE, SEEK_SET);
-            ssize_t bytes_read = read(pager->fd, page, PAGE_SIZE);
-            if(bytes_read == -1)
-            {
-                fprintf(stdout, "[%s] Error reading file [error %d]\n", __func__, errno);
-                return NULL;
-            }
-        }
-        pager->pages[page_num] = page;
+/*
+ * leaf_node_read_record()
+ * Copy out the whole value of a cell as a serialized record of 
+ * LEAF_NODE_VALUE_SIZE bytes, whatever the layout of the leaf.
+ */
+void leaf_node_read_record(void* node, uint32_t cell_num, void* record)
+{
+    for(uint32_t col = 0; col < LEAF_NUM_COLUMNS; ++col)
+    {
+        memcpy(
+            record + leaf_column_offset[col], 
+            leaf_node_column(node, cell_num, col), 
+            leaf_column_size[col]
+        );
+    }
+}
 
-        if(page_num > pager->num_pages)
-            pager->num_pages = page_num + 1;
+/*
+ * leaf_node_write_record()
+ */
+void leaf_node_write_record(void* node, uint32_t cell_num, const void* record)
+{
+    for(uint32_t col = 0; col < LEAF_NUM_COLUMNS; ++col)
+    {
+        memcpy(
+            leaf_node_column(node, cell_num, col), 
+            record + leaf_column_offset[col], 
+            leaf_column_size[col]
+        );
     }
+}
 
-    return pager->pages[page_num];
+/*
+ * leaf_node_read_columns()
+ * Deserialize only the columns in the set, the rest of the row is left
+ * as it was. In a columnar leaf the other minipages are never touched.
+ */
+void leaf_node_read_columns(void* node, uint32_t cell_num, uint32_t columns, Row* row)
+{
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_ID))
+        memcpy(&row->id, leaf_node_column(node, cell_num, LEAF_COLUMN_ID), ID_SIZE);
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_USERNAME))
+        memcpy(row->username, leaf_node_column(node, cell_num, LEAF_COLUMN_USERNAME), USERNAME_SIZE);
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL))
+        memcpy(row->email, leaf_node_column(node, cell_num, LEAF_COLUMN_EMAIL), EMAIL_SIZE);
 }
 
-// ================ TABLE
+/*
+ * leaf_node_write_columns()
+ * Serialize only the columns in the set. Strings are zero padded in 
+ * the same way as serialize_row().
+ */
+void leaf_node_write_columns(void* node, uint32_t cell_num, uint32_t columns, Row* row)
+{
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_ID))
+        memcpy(leaf_node_column(node, cell_num, LEAF_COLUMN_ID), &row->id, ID_SIZE);
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_USERNAME))
+        strncpy(leaf_node_column(node, cell_num, LEAF_COLUMN_USERNAME), row->username, USERNAME_SIZE);
+    if(columns & LEAF_COLUMN_BIT(LEAF_COLUMN_EMAIL))
+        strncpy(leaf_node_column(node, cell_num, LEAF_COLUMN_EMAIL), row->email, EMAIL_SIZE);
+}
 
 /*
- * db_open()
+ * leaf_node_move_cells()
+ * Copy the keys and values of num_cells cells. The source and
+ * destination may be in the same node and may overlap. Between leaves
+ * with the same layout the values move an array (or a minipage) at a
+ * time, otherwise one record at a time.
  */
-Table* db_open(const char* filename)
+void leaf_node_move_cells(void* dest_node, uint32_t dest_cell, void* src_node, uint32_t src_cell, uint32_t num_cells)
 {
-    Pager* pager;
-    Table* table;
+    LeafLayout layout;
 
-    pager = pager_open(filename);
-    if(pager == NULL)
+    memmove(
+        leaf_node_key(dest_node, dest_cell),
+        leaf_node_key(src_node, src_cell),
+        num_cells * LEAF_NODE_KEY_SIZE
+    );
+
+    layout = leaf_node_layout(src_node);
+    if(layout != leaf_node_layout(dest_node))
     {
-        fprintf(stderr, "[%s] failed to create pager object for table with db file [%s]\n",
-                __func__, filename);
-        return NULL;
-    }
+        uint8_t record[LEAF_NODE_VALUE_SIZE];
 
-    table = malloc(sizeof(Table));
-    if(!table)
+        for(uint32_t c = 0; c < num_cells; ++c)
+        {
+            leaf_node_read_record(src_node, src_cell + c, record);
+            leaf_node_write_record(dest_node, dest_cell + c, record);
+        }
+    }
+    else if(layout == LEAF_LAYOUT_COLUMNAR)
     {
-        fprintf(stderr, "[%s] failed to allocate memory for table with db file [%s]\n",
-                __func__, filename);
-        return NULL;
+        for(uint32_t col = 0; col < LEAF_NUM_COLUMNS; ++col)
+        {
+            memmove(
+                leaf_node_column(dest_node, dest_cell, col),
+                leaf_node_column(src_node, src_cell, col),
+                num_cells * leaf_column_size[col]
+            );
+        }
     }
-    table->root_page_num = 0;
-    table->pager         = pager;
-
-    // If this is a new db file then init page 0 as a leaf node
-    if(pager->num_pages == 0)
+    else
     {
-        void* root_node;
-
-        root_node = get_page(pager, 0);
-        init_leaf_node_value(root_node);
+        memmove(
+            leaf_node_column(dest_node, dest_cell, LEAF_COLUMN_ID),
+            leaf_node_column(src_node, src_cell, LEAF_COLUMN_ID),
+            num_cells * LEAF_NODE_VALUE_SIZE
+        );
     }
+}
 
-    return table;
+void init_leaf_node_value(void* node)
+{
+    set_node_type(node, NODE_LEAF);
+    set_node_root(node, 0);
+    *leaf_node_num_cells(node) = 0;
+    *leaf_node_next_leaf(node) = 0;     // 0 means no sibling, page 0 is the header
+    *leaf_node_min_key(node)   = UINT32_MAX;
+    *leaf_node_max_key(node)   = 0;
+    memset(leaf_node_bloom(node), 0, LEAF_NODE_BLOOM_SIZE);
+    leaf_node_set_layout(node, LEAF_LAYOUT_ROW);
 }
 
 /*
- * db_close()
+ * Leaf Node Summary methods
  */
-void db_close(Table* table)
+uint32_t* leaf_node_min_key(void* node)
 {
-    Pager* pager;
+    return node + LEAF_NODE_MIN_KEY_OFFSET;
+}
 
-    pager = table->pager;
-    for(uint32_t p = 0; p < pager->num_pages; ++p)
-    {
-        if(pager->pages[p] == NULL)
-            continue;
+uint32_t* leaf_node_max_key(void* node)
+{
+    return node + LEAF_NODE_MAX_KEY_OFFSET;
+}
 
-        pager_flush(pager, p);
-        free(pager->pages[p]);
-        pager->pages[p] = NULL;
-    }
+uint8_t* leaf_node_bloom(void* node)
+{
+    return node + LEAF_NODE_BLOOM_OFFSET;
+}
 
-    int result = close(pager->fd);      // <- TODO : segfault here
-    if(result == -1)
-    {
-        fprintf(stdout, "[%s] Error closing db file\n", __func__);
-        exit(EXIT_FAILURE);
-    }
+/*
+ * bloom_hash()
+ * 64-bit FNV-1a over a zero padded string. The two halves of the result
+ * are combined to generate each of the filter bit positions.
+ */
+static uint64_t bloom_hash(const char* str, size_t max_len, uint32_t seed)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL ^ seed;
 
-    for(uint32_t p = 0; p < TABLE_MAX_PAGES; ++p)
+    for(size_t c = 0; c < max_len && str[c] != '\0'; ++c)
     {
-       void* page = pager->pages[p];
-       if(page)
-       {
-           free(page);
-           pager->pages[p] = NULL;
-       }
+        hash ^= (uint8_t) str[c];
+        hash *= 0x100000001B3ULL;
     }
 
-    free(pager);
-    free(table);
+    return hash;
 }
 
+void leaf_node_bloom_add(void* node, const char* str, size_t max_len, uint32_t seed)
+{
+    uint8_t* bloom;
+    uint64_t hash;
+    uint32_t h1;
+    uint32_t h2;
+
+    bloom = leaf_node_bloom(node);
+    hash  = bloom_hash(str, max_len, seed);
+    h1    = (uint32_t) hash;
+    h2    = (uint32_t) (hash >> 32);
+    for(uint32_t k = 0; k < LEAF_NODE_BLOOM_HASHES; ++k)
+    {
+        uint32_t bit = (h1 + k * h2) % LEAF_NODE_BLOOM_BITS;
+        bloom[bit / 8] |= (1 << (bit % 8));
+    }
+}
 
+/*
+ * leaf_node_bloom_check()
+ * Returns 0 if the string is definitely not in the leaf
+ */
+int leaf_node_bloom_check(void* node, const char* str, size_t max_len, uint32_t seed)
+{
+    uint8_t* bloom;
+    uint64_t hash;
+    uint32_t h1;
+    uint32_t h2;
+
+    bloom = leaf_node_bloom(node);
+    hash  = bloom_hash(str, max_len, seed);
+    h1    = (uint32_t) hash;
+    h2    = (uint32_t) (hash >> 32);
+    for(uint32_t k = 0; k < LEAF_NODE_BLOOM_HASHES; ++k)
+    {
+        uint32_t bit = (h1 + k * h2) % LEAF_NODE_BLOOM_BITS;
+        if((bloom[bit / 8] & (1 << (bit % 8))) == 0)
+            return 0;
+    }
 
-// ================ CURSOR
+    return 1;
+}
 
 /*
- * table_start()
+ * leaf_node_summary_add()
+ * Fold the cell at cell_num into the leaf summary
  */
-Cursor* table_start(Table* table)
+void leaf_node_summary_add(void* node, uint32_t cell_num)
 {
-    void*   root_node;
-    Cursor* cursor;
+    uint32_t key;
 
-    cursor = malloc(sizeof(Cursor));
-    if(!cursor)
-    {
-        fprintf(stderr, "[%s] failed to allocate memory for Cursor object\n", __func__);
-        return NULL;
-    }
+    key = *leaf_node_key(node, cell_num);
+    if(key < *leaf_node_min_key(node))
+        *leaf_node_min_key(node) = key;
+    if(key > *leaf_node_max_key(node))
+        *leaf_node_max_key(node) = key;
 
-    cursor->table    = table;
-    cursor->page_num = table->root_page_num;
-    cursor->cell_num = 0;
+    leaf_node_bloom_add(node, leaf_node_column(node, cell_num, LEAF_COLUMN_USERNAME), USERNAME_SIZE, BLOOM_SEED_USERNAME);
+    leaf_node_bloom_add(node, leaf_node_column(node, cell_num, LEAF_COLUMN_EMAIL), EMAIL_SIZE, BLOOM_SEED_EMAIL);
+}
 
-    root_node = get_page(table->pager, table->root_page_num);
-    cursor->end_of_table = (*leaf_node_num_cells(root_node) == 0) ? 1 : 0;
+/*
+ * leaf_node_summary_rebuild()
+ * Bloom filters can't have entries removed, so whenever cells leave a
+ * leaf the summary is computed again from the remaining cells.
+ */
+void leaf_node_summary_rebuild(void* node)
+{
+    *leaf_node_min_key(node) = UINT32_MAX;
+    *leaf_node_max_key(node) = 0;
+    memset(leaf_node_bloom(node), 0, LEAF_NODE_BLOOM_SIZE);
 
-    return cursor;
+    for(uint32_t c = 0; c < *leaf_node_num_cells(node); ++c)
+        leaf_node_summary_add(node, c);
 }
 
 /*
- * table_end()
+ * leaf_node_find()
+ * Search for the position of key in a leaf node. If the key is not 
+ * present this is the position that it should be inserted at.
  */
-Cursor* table_end(Table* table)
+Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key)
 {
-    void* root_node;
-    Cursor* cursor;
+    void*    node;
+    uint32_t num_cells;
+    uint32_t min_index;
+    Cursor*  cursor;
+
+    node      = get_page(table->pager, page_num);
+    if(!node)
+        return NULL;
+    num_cells = *leaf_node_num_cells(node);
 
-    cursor = malloc(sizeof(Cursor));
+    cursor = arena_alloc(&table->arena, sizeof(Cursor));
     if(!cursor)
     {
         fprintf(stderr, "[%s] failed to allocate memory for Cursor object\n", __func__);
         return NULL;
     }
+    cursor->table    = table;
+    cursor->page_num = page_num;
 
-    cursor->table        = table;
-    cursor->page_num     = table->root_page_num;
-    cursor->end_of_table = 1;
-
-    root_node        = get_page(table->pager, table->root_page_num);
-    cursor->cell_num = *leaf_node_num_cells(root_node);
+    min_index = key_lower_bound(leaf_node_key(node, 0), num_cells, key);
+    cursor->cell_num     = min_index;
+    cursor->end_of_table = (min_index >= num_cells) ? 1 : 0;
 
     return cursor;
 }
 
 /*
- * cursor_value()
- * Figure out where to read/write in memory for a particular row 
+ * leaf_node_insert()
  */
-void* cursor_value(Cursor* cursor)
+void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value)
 {
-    void* page;
-
-    page = get_page(cursor->table->pager, cursor->page_num);
+    uint8_t record[ROW_SIZE];
 
-    return leaf_node_value(page, cursor->cell_num);
+    serialize_row(value, record);
+    leaf_node_insert_record(cursor, key, record);
 }
 
 /*
- * cursor_advance()
+ * leaf_node_insert_record()
+ * Insert a value that is already serialized. The record is copied in 
+ * whole, so it must be LEAF_NODE_VALUE_SIZE bytes, and is split into the
+ * minipages if the leaf is columnar.
  */
-void cursor_advance(Cursor* cursor)
-{
-    void* node;
-
-    node = get_page(cursor->table->pager, cursor->page_num);
-    cursor->cell_num++;
-    if(cursor->cell_num >= (*leaf_node_num_cells(node)))
-        cursor->end_of_table = 1;
-}
-
-void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value)
+void leaf_node_insert_record(Cursor* cursor, uint32_t key, const void* record)
 {
     void*    node;
     uint32_t num_cells;
@@ -387,24 +532,1903 @@ void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value)
     // check if node is full
     if(num_cells >= LEAF_NODE_MAX_CELLS)
     {
-        fprintf(stdout, "[%s] Leaf not splitting not yet implemented\n", __func__);
+        leaf_node_split_and_insert(cursor, key, record);
         return;
     }
 
     if(cursor->cell_num < num_cells)
     {
         // make room for a new cell
-        for(uint32_t i = 0; i < cursor->cell_num; ++i)
-        {
-            memcpy(
-               leaf_node_cell(node, i),
-               leaf_node_cell(node, i-1),
-               LEAF_NODE_CELL_SIZE
-           );
-        }
+        leaf_node_move_cells(
+                node, cursor->cell_num + 1,
+                node, cursor->cell_num,
+                num_cells - cursor->cell_num
+        );
     }
 
     *(leaf_node_num_cells(node)) += 1;
     *(leaf_node_key(node, cursor->cell_num)) = key;
-    serialize_row(value, leaf_node_value(node, cursor->cell_num));
+    leaf_node_write_record(node, cursor->cell_num, record);
+    leaf_node_summary_add(node, cursor->cell_num);
+}
+
+/*
+ * leaf_node_split_and_insert()
+ * Create a new node and move half the cells over. The new value is 
+ * inserted into one of the two nodes and then the parent is updated 
+ * (or a new root is created if the old node was the root). A key added
+ * to the end of the last leaf moves only a few cells, see 
+ * LEAF_NODE_APPEND_LEFT_COUNT.
+ */
+void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, const void* record)
+{
+    void*    old_node;
+    void*    new_node;
+    uint32_t old_max;
+    uint32_t new_page_num;
+    uint32_t left_count;
+
+    old_node     = get_page(cursor->table->pager, cursor->page_num);
+    old_max      = get_node_max_key(cursor->table->pager, old_node);
+    new_page_num = get_unused_page_num(cursor->table->pager);
+    new_node     = get_page(cursor->table->pager, new_page_num);
+    init_leaf_node_value(new_node);
+    leaf_node_set_layout(new_node, leaf_node_layout(old_node));
+    *node_parent(new_node) = *node_parent(old_node);
+    if(*leaf_node_next_leaf(old_node) == 0 && cursor->cell_num == LEAF_NODE_MAX_CELLS)
+        left_count = LEAF_NODE_APPEND_LEFT_COUNT;
+    else
+        left_count = LEAF_NODE_LEFT_SPLIT_COUNT;
+    // The new node is the last leaf from now on
+    if(*leaf_node_next_leaf(old_node) == 0)
+        cursor->table->rightmost_leaf = new_page_num;
+    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
+    *leaf_node_next_leaf(old_node) = new_page_num;
+
+    // All existing keys plus the new key are divided between the old 
+    // (left) and new (right) nodes. Starting from the right, move each 
+    // key to its correct position.
+    for(int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; --i)
+    {
+        void*    dest_node;
+        uint32_t index_within_node;
+
+        if(i >= (int32_t) left_count)
+        {
+            dest_node         = new_node;
+            index_within_node = i - left_count;
+        }
+        else
+        {
+            dest_node         = old_node;
+            index_within_node = i;
+        }
+
+        if(i == (int32_t) cursor->cell_num)
+        {
+            *(leaf_node_key(dest_node, index_within_node)) = key;
+            leaf_node_write_record(dest_node, index_within_node, record);
+        }
+        else if(i > (int32_t) cursor->cell_num)
+            leaf_node_move_cells(dest_node, index_within_node, old_node, i-1, 1);
+        else
+            leaf_node_move_cells(dest_node, index_within_node, old_node, i, 1);
+    }
+
+    *(leaf_node_num_cells(old_node)) = left_count;
+    *(leaf_node_num_cells(new_node)) = LEAF_NODE_MAX_CELLS + 1 - left_count;
+    leaf_node_summary_rebuild(old_node);
+    leaf_node_summary_rebuild(new_node);
+
+    if(is_node_root(old_node))
+        create_new_root(cursor->table, new_page_num);
+    else
+    {
+        uint32_t parent_page_num;
+        uint32_t new_max;
+        void*    parent;
+
+        parent_page_num = *node_parent(old_node);
+        new_max         = get_node_max_key(cursor->table->pager, old_node);
+        parent          = get_page(cursor->table->pager, parent_page_num);
+
+        update_internal_node_key(parent, old_max, new_max);
+        internal_node_insert(cursor->table, parent_page_num, new_page_num);
+    }
+}
+
+/*
+ * Internal Node methods
+ */
+uint32_t* internal_node_num_keys(void* node)
+{
+    return node + INTERNAL_NODE_NUM_KEYS_OFFSET;
+}
+
+uint32_t* internal_node_right_child(void* node)
+{
+    return node + INTERNAL_NODE_RIGHT_CHILD_OFFSET;
+}
+
+/*
+ * internal_node_move_cells()
+ * Move num_cells key/child pairs within a node. The ranges may overlap.
+ */
+void internal_node_move_cells(void* node, uint32_t dest_cell, uint32_t src_cell, uint32_t num_cells)
+{
+    memmove(
+        node + INTERNAL_NODE_KEYS_OFFSET + dest_cell * INTERNAL_NODE_KEY_SIZE,
+        node + INTERNAL_NODE_KEYS_OFFSET + src_cell * INTERNAL_NODE_KEY_SIZE,
+        num_cells * INTERNAL_NODE_KEY_SIZE
+    );
+    memmove(
+        node + INTERNAL_NODE_CHILDREN_OFFSET + dest_cell * INTERNAL_NODE_CHILD_SIZE,
+        node + INTERNAL_NODE_CHILDREN_OFFSET + src_cell * INTERNAL_NODE_CHILD_SIZE,
+        num_cells * INTERNAL_NODE_CHILD_SIZE
+    );
+}
+
+uint32_t* internal_node_child(void* node, uint32_t child_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    if(child_num > num_keys)
+    {
+        fprintf(stderr, "[%s] tried to access child_num %d > num_keys %d\n",
+                __func__, child_num, num_keys);
+        exit(EXIT_FAILURE);
+    }
+    if(child_num == num_keys)
+        return internal_node_right_child(node);
+
+    return node + INTERNAL_NODE_CHILDREN_OFFSET + child_num * INTERNAL_NODE_CHILD_SIZE;
+}
+
+uint32_t* internal_node_key(void* node, uint32_t key_num)
+{
+    return node + INTERNAL_NODE_KEYS_OFFSET + key_num * INTERNAL_NODE_KEY_SIZE;
+}
+
+void init_internal_node(void* node)
+{
+    set_node_type(node, NODE_INTERNAL);
+    set_node_root(node, 0);
+    *internal_node_num_keys(node) = 0;
+    // Necessary because 0 is a valid page number (the header). Without
+    // this an empty internal node would appear to point at it.
+    *internal_node_right_child(node) = INVALID_PAGE_NUM;
+}
+
+/*
+ * internal_node_find_child()
+ * Return the index of the child which should contain the given key
+ */
+uint32_t internal_node_find_child(void* node, uint32_t key)
+{
+    // The child for key is the first one whose max key is not less than
+    // key. If every key is less the result is num_keys, the right child.
+    return key_lower_bound(internal_node_key(node, 0), *internal_node_num_keys(node), key);
+}
+
+/*
+ * internal_node_find()
+ */
+Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key)
+{
+    void*    node;
+    void*    child;
+    uint32_t child_num;
+
+    node      = get_page(table->pager, page_num);
+    if(!node)
+        return NULL;
+    child_num = *internal_node_child(node, internal_node_find_child(node, key));
+    child     = get_page(table->pager, child_num);
+    if(!child)
+        return NULL;
+
+    switch(get_node_type(child))
+    {
+        case NODE_LEAF:
+            return leaf_node_find(table, child_num, key);
+        case NODE_INTERNAL:
+            return internal_node_find(table, child_num, key);
+    }
+
+    return NULL;
+}
+
+/*
+ * update_internal_node_key()
+ */
+void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key)
+{
+    uint32_t old_child_index;
+
+    old_child_index = internal_node_find_child(node, old_key);
+    // The right child has no key of its own
+    if(old_child_index < *internal_node_num_keys(node))
+        *internal_node_key(node, old_child_index) = new_key;
+}
+
+/*
+ * internal_node_insert()
+ * Add a new child/key pair to the parent that corresponds to the child
+ */
+void internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num)
+{
+    void*    parent;
+    void*    child;
+    void*    right_child;
+    uint32_t child_max_key;
+    uint32_t index;
+    uint32_t original_num_keys;
+    uint32_t right_child_page_num;
+
+    parent            = get_page(table->pager, parent_page_num);
+    child             = get_page(table->pager, child_page_num);
+    child_max_key     = get_node_max_key(table->pager, child);
+    index             = internal_node_find_child(parent, child_max_key);
+    original_num_keys = *internal_node_num_keys(parent);
+
+    if(original_num_keys >= INTERNAL_NODE_MAX_CELLS)
+    {
+        internal_node_split_and_insert(table, parent_page_num, child_page_num);
+        return;
+    }
+
+    right_child_page_num = *internal_node_right_child(parent);
+    // An internal node with an invalid right child is empty
+    if(right_child_page_num == INVALID_PAGE_NUM)
+    {
+        *internal_node_right_child(parent) = child_page_num;
+        return;
+    }
+
+    right_child = get_page(table->pager, right_child_page_num);
+    *internal_node_num_keys(parent) = original_num_keys + 1;
+
+    if(child_max_key > get_node_max_key(table->pager, right_child))
+    {
+        // replace right child
+        *internal_node_child(parent, original_num_keys) = right_child_page_num;
+        *internal_node_key(parent, original_num_keys)   = get_node_max_key(table->pager, right_child);
+        *internal_node_right_child(parent) = child_page_num;
+    }
+    else
+    {
+        // make room for the new cell
+        internal_node_move_cells(parent, index + 1, index, original_num_keys - index);
+        *internal_node_child(parent, index) = child_page_num;
+        *internal_node_key(parent, index)   = child_max_key;
+    }
+}
+
+/*
+ * internal_node_split_and_insert()
+ * Move the upper half of the children of a full internal node into a 
+ * new sibling, then insert the new child into whichever half it 
+ * belongs in and link the sibling into the parent.
+ */
+void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num)
+{
+    uint32_t  old_page_num;
+    uint32_t  new_page_num;
+    uint32_t  old_max;
+    uint32_t  child_max;
+    uint32_t  cur_page_num;
+    uint32_t  max_after_split;
+    uint32_t  dest_page_num;
+    uint32_t* old_num_keys;
+    void*     old_node;
+    void*     new_node = NULL;
+    void*     child;
+    void*     parent;
+    void*     cur;
+    int       splitting_root;
+
+    old_page_num   = parent_page_num;
+    old_node       = get_page(table->pager, parent_page_num);
+    old_max        = get_node_max_key(table->pager, old_node);
+    child          = get_page(table->pager, child_page_num);
+    child_max      = get_node_max_key(table->pager, child);
+    new_page_num   = get_unused_page_num(table->pager);
+    splitting_root = is_node_root(old_node);
+
+    if(splitting_root)
+    {
+        // The old root contents move into the new left child
+        create_new_root(table, new_page_num);
+        parent       = get_page(table->pager, table->root_page_num);
+        old_page_num = *internal_node_child(parent, 0);
+        old_node     = get_page(table->pager, old_page_num);
+    }
+    else
+    {
+        parent   = get_page(table->pager, *node_parent(old_node));
+        new_node = get_page(table->pager, new_page_num);
+        init_internal_node(new_node);
+    }
+
+    old_num_keys = internal_node_num_keys(old_node);
+
+    // The right child always moves to the new node
+    cur_page_num = *internal_node_right_child(old_node);
+    cur          = get_page(table->pager, cur_page_num);
+    internal_node_insert(table, new_page_num, cur_page_num);
+    *node_parent(cur) = new_page_num;
+    *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
+
+    // followed by the upper half of the cells
+    for(uint32_t i = INTERNAL_NODE_MAX_CELLS - 1; i > INTERNAL_NODE_MAX_CELLS / 2; --i)
+    {
+        cur_page_num = *internal_node_child(old_node, i);
+        cur          = get_page(table->pager, cur_page_num);
+        internal_node_insert(table, new_page_num, cur_page_num);
+        *node_parent(cur) = new_page_num;
+        (*old_num_keys)--;
+    }
+
+    // The highest remaining cell becomes the right child of the old node
+    *internal_node_right_child(old_node) = *internal_node_child(old_node, *old_num_keys - 1);
+    (*old_num_keys)--;
+
+    max_after_split = get_node_max_key(table->pager, old_node);
+    dest_page_num   = (child_max < max_after_split) ? old_page_num : new_page_num;
+    internal_node_insert(table, dest_page_num, child_page_num);
+    *node_parent(child) = dest_page_num;
+
+    update_internal_node_key(parent, old_max, get_node_max_key(table->pager, old_node));
+
+    if(!splitting_root)
+    {
+        internal_node_insert(table, *node_parent(old_node), new_page_num);
+        *node_parent(new_node) = *node_parent(old_node);
+    }
+}
+
+/*
+ * create_new_root()
+ * Handle splitting the root. The old root is copied to a new page and 
+ * becomes the left child, and the root page is re-initialized as an
+ * internal node pointing at the two children. This way the root always
+ * stays at the same page number.
+ */
+void create_new_root(Table* table, uint32_t right_child_page_num)
+{
+    void*    root;
+    void*    right_child;
+    void*    left_child;
+    uint32_t left_child_page_num;
+
+    root                = get_page(table->pager, table->root_page_num);
+    right_child         = get_page(table->pager, right_child_page_num);
+    left_child_page_num = get_unused_page_num(table->pager);
+    left_child          = get_page(table->pager, left_child_page_num);
+
+    if(get_node_type(root) == NODE_INTERNAL)
+    {
+        init_internal_node(right_child);
+        init_internal_node(left_child);
+    }
+
+    // left child has data copied from old root
+    memcpy(left_child, root, PAGE_SIZE);
+    set_node_root(left_child, 0);
+
+    if(get_node_type(left_child) == NODE_INTERNAL)
+    {
+        void* child;
+
+        for(uint32_t i = 0; i < *internal_node_num_keys(left_child); ++i)
+        {
+            child = get_page(table->pager, *internal_node_child(left_child, i));
+            *node_parent(child) = left_child_page_num;
+        }
+        child = get_page(table->pager, *internal_node_right_child(left_child));
+        *node_parent(child) = left_child_page_num;
+    }
+
+    // root node is a new internal node with one key and two children
+    init_internal_node(root);
+    set_node_root(root, 1);
+    *internal_node_num_keys(root)    = 1;
+    *internal_node_child(root, 0)    = left_child_page_num;
+    *internal_node_key(root, 0)      = get_node_max_key(table->pager, left_child);
+    *internal_node_right_child(root) = right_child_page_num;
+    *node_parent(left_child)         = table->root_page_num;
+    *node_parent(right_child)        = table->root_page_num;
+}
+
+/*
+ * leaf_node_delete()
+ * Remove the cell at the cursor. If that leaves the leaf less than half
+ * full it is merged with or topped up from a sibling.
+ */
+void leaf_node_delete(Cursor* cursor)
+{
+    void*    node;
+    uint32_t num_cells;
+
+    node      = get_page(cursor->table->pager, cursor->page_num);
+    num_cells = *leaf_node_num_cells(node);
+    if(cursor->cell_num >= num_cells)
+        return;
+    // Rebalancing may free the last leaf, so it is found again on the 
+    // next insert
+    cursor->table->rightmost_leaf = INVALID_PAGE_NUM;
+
+    leaf_node_move_cells(
+            node, cursor->cell_num,
+            node, cursor->cell_num + 1,
+            num_cells - cursor->cell_num - 1
+    );
+    *leaf_node_num_cells(node) = num_cells - 1;
+    leaf_node_summary_rebuild(node);
+
+    // Removing the last cell changes the largest key in the leaf
+    if(cursor->cell_num == num_cells - 1 && num_cells > 1)
+        update_node_max_key(cursor->table, cursor->page_num);
+
+    rebalance_node(cursor->table, cursor->page_num);
+}
+
+/*
+ * leaf_node_merge()
+ * Move all the cells of the child after left_index into the child at 
+ * left_index, and free the emptied page.
+ */
+void leaf_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index)
+{
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+
+    parent         = get_page(table->pager, parent_page_num);
+    left_page_num  = *internal_node_child(parent, left_index);
+    right_page_num = *internal_node_child(parent, left_index + 1);
+    left           = get_page(table->pager, left_page_num);
+    right          = get_page(table->pager, right_page_num);
+
+    leaf_node_move_cells(
+            left, *leaf_node_num_cells(left),
+            right, 0,
+            *leaf_node_num_cells(right)
+    );
+    *leaf_node_num_cells(left) += *leaf_node_num_cells(right);
+    *leaf_node_next_leaf(left)  = *leaf_node_next_leaf(right);
+    leaf_node_summary_rebuild(left);
+
+    // The merged node takes the place (and the key) of the right node
+    internal_node_remove(parent, left_index);
+    *internal_node_child(parent, left_index) = left_page_num;
+    pager_free_page(table->pager, right_page_num);
+}
+
+/*
+ * leaf_node_redistribute()
+ * Even out the cells between two neighbouring leaves. Only the largest 
+ * key in the left leaf changes.
+ */
+void leaf_node_redistribute(void* left, void* right)
+{
+    uint32_t num_left;
+    uint32_t num_right;
+    uint32_t new_num_left;
+
+    num_left     = *leaf_node_num_cells(left);
+    num_right    = *leaf_node_num_cells(right);
+    new_num_left = (num_left + num_right) / 2;
+
+    if(num_left > new_num_left)
+    {
+        uint32_t num_moved = num_left - new_num_left;
+
+        leaf_node_move_cells(right, num_moved, right, 0, num_right);
+        leaf_node_move_cells(right, 0, left, new_num_left, num_moved);
+    }
+    else
+    {
+        uint32_t num_moved = new_num_left - num_left;
+
+        leaf_node_move_cells(left, num_left, right, 0, num_moved);
+        leaf_node_move_cells(right, 0, right, num_moved, num_right - num_moved);
+    }
+
+    *leaf_node_num_cells(left)  = new_num_left;
+    *leaf_node_num_cells(right) = num_left + num_right - new_num_left;
+    leaf_node_summary_rebuild(left);
+    leaf_node_summary_rebuild(right);
+}
+
+/*
+ * internal_node_child_index()
+ * Position of a child within its parent. The right child is at num_keys.
+ */
+uint32_t internal_node_child_index(void* node, uint32_t child_page_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    for(uint32_t i = 0; i < num_keys; ++i)
+    {
+        if(*internal_node_child(node, i) == child_page_num)
+            return i;
+    }
+    if(*internal_node_right_child(node) != child_page_num)
+    {
+        fprintf(stderr, "[%s] page %d is not a child of this node\n",
+                __func__, child_page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    return num_keys;
+}
+
+/*
+ * internal_node_remove()
+ * Remove the key and child at index. Everything after them moves down 
+ * one place, so the child that was at index+1 (which may be the right 
+ * child) is now at index.
+ */
+void internal_node_remove(void* node, uint32_t index)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    internal_node_move_cells(node, index, index + 1, num_keys - index - 1);
+    *internal_node_num_keys(node) = num_keys - 1;
+}
+
+/*
+ * internal_node_merge()
+ * Same as leaf_node_merge() for internal nodes. The right child of the 
+ * left node becomes an ordinary cell, followed by the cells of the 
+ * right node.
+ */
+void internal_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index)
+{
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+    uint32_t num_left;
+    uint32_t num_right;
+    uint32_t left_max;
+    uint32_t left_right_child;
+
+    parent           = get_page(table->pager, parent_page_num);
+    left_page_num    = *internal_node_child(parent, left_index);
+    right_page_num   = *internal_node_child(parent, left_index + 1);
+    left             = get_page(table->pager, left_page_num);
+    right            = get_page(table->pager, right_page_num);
+    num_left         = *internal_node_num_keys(left);
+    num_right        = *internal_node_num_keys(right);
+    left_max         = get_node_max_key(table->pager, left);
+    left_right_child = *internal_node_right_child(left);
+
+    *internal_node_num_keys(left)          = num_left + 1 + num_right;
+    *internal_node_child(left, num_left)   = left_right_child;
+    *internal_node_key(left, num_left)     = left_max;
+    for(uint32_t i = 0; i < num_right; ++i)
+    {
+        *internal_node_child(left, num_left + 1 + i) = *internal_node_child(right, i);
+        *internal_node_key(left, num_left + 1 + i)   = *internal_node_key(right, i);
+    }
+    *internal_node_right_child(left) = *internal_node_right_child(right);
+
+    for(uint32_t i = num_left + 1; i <= num_left + 1 + num_right; ++i)
+        *node_parent(get_page(table->pager, *internal_node_child(left, i))) = left_page_num;
+
+    internal_node_remove(parent, left_index);
+    *internal_node_child(parent, left_index) = left_page_num;
+    pager_free_page(table->pager, right_page_num);
+}
+
+/*
+ * internal_node_redistribute()
+ * Move children one at a time across the boundary between two 
+ * neighbouring internal nodes until they are even. 
+ */
+void internal_node_redistribute(Table* table, uint32_t left_page_num, uint32_t right_page_num)
+{
+    void*    left;
+    void*    right;
+    void*    child;
+    uint32_t child_page_num;
+    uint32_t num_keys;
+
+    left  = get_page(table->pager, left_page_num);
+    right = get_page(table->pager, right_page_num);
+
+    // first child of the right node becomes the right child of the left
+    while(*internal_node_num_keys(left) + 1 < *internal_node_num_keys(right))
+    {
+        num_keys       = *internal_node_num_keys(left);
+        child_page_num = *internal_node_child(right, 0);
+        child          = get_page(table->pager, *internal_node_right_child(left));
+
+        *internal_node_num_keys(left)        = num_keys + 1;
+        *internal_node_child(left, num_keys) = *internal_node_right_child(left);
+        *internal_node_key(left, num_keys)   = get_node_max_key(table->pager, child);
+        *internal_node_right_child(left)     = child_page_num;
+        *node_parent(get_page(table->pager, child_page_num)) = left_page_num;
+        internal_node_remove(right, 0);
+    }
+
+    // right child of the left node becomes the first child of the right
+    while(*internal_node_num_keys(right) + 1 < *internal_node_num_keys(left))
+    {
+        num_keys       = *internal_node_num_keys(right);
+        child_page_num = *internal_node_right_child(left);
+        child          = get_page(table->pager, child_page_num);
+
+        internal_node_move_cells(right, 1, 0, num_keys);
+        *internal_node_num_keys(right)    = num_keys + 1;
+        *internal_node_child(right, 0)    = child_page_num;
+        *internal_node_key(right, 0)      = get_node_max_key(table->pager, child);
+        *node_parent(child)               = right_page_num;
+
+        num_keys = *internal_node_num_keys(left);
+        *internal_node_right_child(left) = *internal_node_child(left, num_keys - 1);
+        *internal_node_num_keys(left)    = num_keys - 1;
+    }
+}
+
+/*
+ * update_node_max_key()
+ * After the largest key under a node changes, fix its key in the parent.
+ * The right child has no key of its own, but it holds the largest key 
+ * under the parent, so in that case carry on up the tree.
+ */
+void update_node_max_key(Table* table, uint32_t page_num)
+{
+    void*    node;
+    void*    parent;
+    uint32_t parent_page_num;
+    uint32_t index;
+    uint32_t max_key;
+
+    node    = get_page(table->pager, page_num);
+    max_key = get_node_max_key(table->pager, node);
+    while(!is_node_root(node))
+    {
+        parent_page_num = *node_parent(node);
+        parent          = get_page(table->pager, parent_page_num);
+        index           = internal_node_child_index(parent, page_num);
+        if(index < *internal_node_num_keys(parent))
+        {
+            *internal_node_key(parent, index) = max_key;
+            return;
+        }
+        page_num = parent_page_num;
+        node     = parent;
+    }
+}
+
+/*
+ * rebalance_node()
+ * Bring a node that is less than half full back up. If it fits in one 
+ * node with a sibling the two are merged, which takes a child away from
+ * the parent so the parent may need rebalancing in turn. Otherwise cells
+ * are moved across from the sibling.
+ */
+void rebalance_node(Table* table, uint32_t page_num)
+{
+    void*    node;
+    void*    parent;
+    void*    left;
+    void*    right;
+    uint32_t parent_page_num;
+    uint32_t left_page_num;
+    uint32_t right_page_num;
+    uint32_t left_index;
+    uint32_t index;
+
+    node = get_page(table->pager, page_num);
+    if(is_node_root(node))
+    {
+        // A root with a single child is replaced by that child
+        if(get_node_type(node) == NODE_INTERNAL && *internal_node_num_keys(node) == 0)
+            collapse_root(table);
+        return;
+    }
+    if(get_node_type(node) == NODE_LEAF && *leaf_node_num_cells(node) >= LEAF_NODE_MIN_CELLS)
+        return;
+    if(get_node_type(node) == NODE_INTERNAL && *internal_node_num_keys(node) >= INTERNAL_NODE_MIN_KEYS)
+        return;
+
+    // Pair with the left sibling if there is one, otherwise the right
+    parent_page_num = *node_parent(node);
+    parent          = get_page(table->pager, parent_page_num);
+    index           = internal_node_child_index(parent, page_num);
+    left_index      = (index > 0) ? index - 1 : 0;
+    left_page_num   = *internal_node_child(parent, left_index);
+    right_page_num  = *internal_node_child(parent, left_index + 1);
+    left            = get_page(table->pager, left_page_num);
+    right           = get_page(table->pager, right_page_num);
+
+    if(get_node_type(node) == NODE_LEAF)
+    {
+        if(*leaf_node_num_cells(left) + *leaf_node_num_cells(right) <= LEAF_NODE_MAX_CELLS)
+        {
+            leaf_node_merge(table, parent_page_num, left_index);
+            rebalance_node(table, parent_page_num);
+            return;
+        }
+        leaf_node_redistribute(left, right);
+    }
+    else
+    {
+        if(*internal_node_num_keys(left) + 1 + *internal_node_num_keys(right) <= INTERNAL_NODE_MAX_CELLS)
+        {
+            internal_node_merge(table, parent_page_num, left_index);
+            rebalance_node(table, parent_page_num);
+            return;
+        }
+        internal_node_redistribute(table, left_page_num, right_page_num);
+    }
+    *internal_node_key(parent, left_index) = get_node_max_key(table->pager, left);
+}
+
+/*
+ * collapse_root()
+ * The opposite of create_new_root(). When the root is left with only a 
+ * right child, the child is copied into the root page and the child's 
+ * page is freed. This is the only way the tree gets shorter.
+ */
+void collapse_root(Table* table)
+{
+    void*    root;
+    void*    child;
+    uint32_t child_page_num;
+
+    root           = get_page(table->pager, table->root_page_num);
+    child_page_num = *internal_node_right_child(root);
+    child          = get_page(table->pager, child_page_num);
+
+    memcpy(root, child, PAGE_SIZE);
+    set_node_root(root, 1);
+    if(get_node_type(root) == NODE_INTERNAL)
+    {
+        for(uint32_t i = 0; i <= *internal_node_num_keys(root); ++i)
+            *node_parent(get_page(table->pager, *internal_node_child(root, i))) = table->root_page_num;
+    }
+    pager_free_page(table->pager, child_page_num);
+}
+
+
+// ================ PAGER
+
+/*
+ * pager_open()
+ */
+Pager* pager_open(const char* filename)
+{
+    return pager_open_with_flags(filename, 0);
+}
+
+/*
+ * pager_open_with_flags()
+ * With DB_OPEN_DIRECT_IO the file is read and written with O_DIRECT, so
+ * pages are only ever held in the pager's frames. Direct I/O is turned 
+ * off again if the file system doesn't support it, or once the file turns
+ * out to be compressed since compressed pages aren't aligned.
+ */
+Pager* pager_open_with_flags(const char* filename, uint32_t flags)
+{
+    int    fd;
+    Pager* pager;
+
+    fd = open(
+            filename, 
+            O_RDWR | O_CREAT,       // read/write mode, create if file does not exist
+            S_IWUSR | S_IRUSR       // user read permission, user write permission
+    );
+
+    if(fd == -1)
+    {
+        fprintf(stdout, "[%s] unable to open file %s\n", __func__, filename);
+        return NULL;
+    }
+
+    // setup pager
+    pager = malloc(sizeof(Pager));
+    pager->fd = fd;
+    pager->filename = malloc(strlen(filename) + 1);
+    strcpy(pager->filename, filename);
+    pager->file_length = lseek(fd, 0, SEEK_END);
+    pager->num_pages   = (pager->file_length / PAGE_SIZE);
+    pager->compressed  = 0;
+    pager->checksums   = 0;
+    pager->direct_io   = 0;
+    pager->read_error  = PAGE_READ_OK;
+
+    pager->in_transaction  = 0;
+    pager->begin_num_pages = 0;
+
+    for(uint32_t p = 0; p < TABLE_MAX_PAGES; ++p)
+    {
+        pager->pages[p]   = NULL;
+        pager->touched[p] = 0;
+    }
+    // Frames are page aligned since they come from mmap, which is what
+    // O_DIRECT needs as well. The saved copies only take memory once a
+    // transaction uses them.
+    if(frame_pool_init(&pager->frames, PAGE_SIZE, TABLE_MAX_PAGES + 1) != 0)
+    {
+        close(fd);
+        free(pager->filename);
+        free(pager);
+        return NULL;
+    }
+    if(frame_pool_init(&pager->saved, PAGE_SIZE, TABLE_MAX_PAGES) != 0)
+    {
+        frame_pool_destroy(&pager->frames);
+        close(fd);
+        free(pager->filename);
+        free(pager);
+        return NULL;
+    }
+    if(flags & DB_OPEN_DIRECT_IO)
+        pager_set_direct_io(pager, 1);
+
+    // Pages in a compressed file are different sizes, so the number of 
+    // pages comes from the header instead
+    if(pager->file_length >= PAGE_SIZE)
+    {
+        void* header = get_page(pager, DB_HEADER_PAGE_NUM);
+
+        if(header && check_db_header(header) && (*db_header_flags(header) & DB_FLAG_COMPRESSED))
+        {
+            pager->compressed = 1;
+            pager->num_pages  = *db_header_page_count(header);
+            pager_set_direct_io(pager, 0);
+        }
+        if(header && check_db_header(header) && (*db_header_flags(header) & DB_FLAG_CHECKSUMS))
+        {
+            pager->checksums = 1;
+            if(*db_page_checksum(header, DB_HEADER_PAGE_NUM) != db_header_checksum(header))
+            {
+                fprintf(stderr, "[%s] Corruption: checksum mismatch on the header page\n", __func__);
+                pager_close(pager);
+                return NULL;
+            }
+        }
+    }
+
+    if(!pager->compressed && pager->file_length % PAGE_SIZE != 0)
+    {
+        fprintf(stderr, "[%s] Corruption: DB file is a not a whole number of pages\n", __func__);
+        pager_close(pager);
+        return NULL;
+    }
+
+    return pager;
+}
+
+/*
+ * pager_close()
+ * Close the file and drop all cached pages without writing them
+ */
+void pager_close(Pager* pager)
+{
+    frame_pool_destroy(&pager->frames);
+    frame_pool_destroy(&pager->saved);
+    close(pager->fd);
+    free(pager->filename);
+    free(pager);
+}
+
+/*
+ * pager_set_direct_io()
+ * Turn O_DIRECT on or off for the open file. Returns the new setting, 
+ * which stays off if the file system refuses O_DIRECT.
+ */
+int pager_set_direct_io(Pager* pager, int direct_io)
+{
+    int fd_flags;
+
+    fd_flags = fcntl(pager->fd, F_GETFL);
+    if(fd_flags == -1)
+        return pager->direct_io;
+    if(direct_io)
+        fd_flags |= O_DIRECT;
+    else
+        fd_flags &= ~O_DIRECT;
+
+    if(fcntl(pager->fd, F_SETFL, fd_flags) == -1)
+    {
+        fprintf(stderr, "[%s] %s doesn't support O_DIRECT, using buffered I/O [errno: %d]\n",
+                __func__, pager->filename, errno);
+        direct_io = 0;
+    }
+    pager->direct_io = direct_io;
+
+    return direct_io;
+}
+
+/*
+ * pager_read_at()
+ * With O_DIRECT the buffer, offset and length all have to be aligned. 
+ * Some file systems accept O_DIRECT when the file is opened and only 
+ * refuse it on the first transfer, in which case the pager carries on 
+ * with buffered I/O.
+ */
+static ssize_t pager_read_at(Pager* pager, void* buf, size_t length, uint64_t offset)
+{
+    ssize_t bytes_read;
+
+    lseek(pager->fd, (off_t) offset, SEEK_SET);
+    bytes_read = read(pager->fd, buf, length);
+    if(bytes_read == -1 && errno == EINVAL && pager->direct_io)
+    {
+        fprintf(stderr, "[%s] O_DIRECT read refused, using buffered I/O\n", __func__);
+        pager_set_direct_io(pager, 0);
+        lseek(pager->fd, (off_t) offset, SEEK_SET);
+        bytes_read = read(pager->fd, buf, length);
+    }
+
+    return bytes_read;
+}
+
+/*
+ * pager_write_at()
+ */
+static ssize_t pager_write_at(Pager* pager, const void* buf, size_t length, uint64_t offset)
+{
+    ssize_t bytes_written;
+
+    lseek(pager->fd, (off_t) offset, SEEK_SET);
+    bytes_written = write(pager->fd, buf, length);
+    if(bytes_written == -1 && errno == EINVAL && pager->direct_io)
+    {
+        fprintf(stderr, "[%s] O_DIRECT write refused, using buffered I/O\n", __func__);
+        pager_set_direct_io(pager, 0);
+        lseek(pager->fd, (off_t) offset, SEEK_SET);
+        bytes_written = write(pager->fd, buf, length);
+    }
+
+    return bytes_written;
+}
+
+/*
+ * pager_flush_compressed()
+ * Compress a page and write it back into its space in the file if it 
+ * fits, otherwise on the end of the file. The page map entry is updated,
+ * so the header has to be written after every other page.
+ */
+static void pager_flush_compressed(Pager* pager, uint32_t page_num)
+{
+    uint8_t  buf[PAGE_SIZE];
+    void*    header;
+    void*    data;
+    uint32_t length;
+    uint64_t offset;
+    ssize_t  bytes_written;
+
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    length = lz4_compress_block(pager->pages[page_num], PAGE_SIZE, buf, PAGE_SIZE - 1);
+    data   = buf;
+    if(length == 0)
+    {
+        length = PAGE_SIZE;
+        data   = pager->pages[page_num];
+    }
+
+    if(*db_page_map_length(header, page_num) != 0 && length <= *db_page_map_capacity(header, page_num))
+        offset = *db_page_map_offset(header, page_num);
+    else
+    {
+        // Nothing but the header may go in the first page
+        offset = (pager->file_length > PAGE_SIZE) ? pager->file_length : PAGE_SIZE;
+        *db_page_map_offset(header, page_num)   = offset;
+        *db_page_map_capacity(header, page_num) = (length + DB_PAGE_MAP_ALIGN - 1) & ~(DB_PAGE_MAP_ALIGN - 1);
+        pager->file_length = offset + *db_page_map_capacity(header, page_num);
+    }
+    *db_page_map_length(header, page_num) = length;
+
+    bytes_written = pager_write_at(pager, data, length, offset);
+    if(bytes_written == -1)
+        fprintf(stdout, "[%s] error writing [errno: %d]\n", __func__, errno);
+}
+
+/*
+ * pager_read_compressed()
+ */
+static PageReadResult pager_read_compressed(Pager* pager, uint32_t page_num, void* page)
+{
+    uint8_t  buf[PAGE_SIZE];
+    void*    header;
+    uint32_t length;
+    ssize_t  bytes_read;
+
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    length = *db_page_map_length(header, page_num);
+    // Never written, same as a page past the end of an uncompressed file
+    if(length == 0)
+        return PAGE_READ_NEW;
+
+    if(length > PAGE_SIZE || *db_page_map_offset(header, page_num) + length > pager->file_length)
+    {
+        fprintf(stdout, "[%s] page %d is outside the file\n", __func__, page_num);
+        return PAGE_READ_IO_ERROR;
+    }
+    bytes_read = pager_read_at(
+            pager,
+            (length == PAGE_SIZE) ? page : (void*) buf,
+            length,
+            *db_page_map_offset(header, page_num)
+    );
+    if(bytes_read != length)
+    {
+        fprintf(stdout, "[%s] Error reading file [error %d]\n", __func__, errno);
+        return PAGE_READ_IO_ERROR;
+    }
+    if(length == PAGE_SIZE)
+        return PAGE_READ_OK;
+
+    // A damaged block usually fails here rather than at the checksum
+    if(lz4_decompress_block(buf, length, page, PAGE_SIZE) != PAGE_SIZE)
+        return PAGE_READ_BAD_CHECKSUM;
+
+    return PAGE_READ_OK;
+}
+
+/*
+ * pager_read_page()
+ * Read a page from the file and check it against its checksum
+ */
+static PageReadResult pager_read_page(Pager* pager, uint32_t page_num, void* page)
+{
+    PageReadResult result;
+    uint32_t       num_pages;
+    uint32_t       checksum;
+
+    if(pager->compressed && page_num != DB_HEADER_PAGE_NUM)
+    {
+        result = pager_read_compressed(pager, page_num, page);
+        if(result != PAGE_READ_OK)
+            return result;
+    }
+    else
+    {
+        num_pages = pager->file_length / PAGE_SIZE;
+        // account for partial pages saved at the end of the file
+        if(pager->file_length % PAGE_SIZE)
+            num_pages++;
+        if(page_num >= num_pages)
+            return PAGE_READ_NEW;
+
+        ssize_t bytes_read = pager_read_at(pager, page, PAGE_SIZE, (uint64_t) page_num * PAGE_SIZE);
+        if(bytes_read == -1)
+        {
+            fprintf(stdout, "[%s] Error reading file [error %d]\n", __func__, errno);
+            return PAGE_READ_IO_ERROR;
+        }
+    }
+
+    if(!pager->checksums)
+        return PAGE_READ_OK;
+    if(page_num == DB_HEADER_PAGE_NUM)
+        checksum = db_header_checksum(page);
+    else
+        checksum = crc32c(page, PAGE_SIZE);
+    if(checksum != *db_page_checksum(get_page(pager, DB_HEADER_PAGE_NUM), page_num))
+        return PAGE_READ_BAD_CHECKSUM;
+
+    return PAGE_READ_OK;
+}
+
+/*
+ * pager_verify_page()
+ * Read a page from the file again and check it, whether or not it is in
+ * the cache. Cached pages that have changed are checked as they were
+ * last written. The page is read into the scratch frame, which is 
+ * aligned for O_DIRECT.
+ */
+PageReadResult pager_verify_page(Pager* pager, uint32_t page_num)
+{
+    return pager_read_page(pager, page_num, frame_pool_frame(&pager->frames, PAGER_SCRATCH_FRAME));
+}
+
+/*
+ * pager_flush()
+ */
+void pager_flush(Pager* pager, uint32_t page_num)
+{
+    ssize_t bytes_written;
+
+    if(pager->pages[page_num] == NULL)
+    {
+        fprintf(stdout, "[%s] tried to flush null page %d\n", __func__, page_num);
+        return;
+    }
+    if(pager->checksums)
+    {
+        void* header = get_page(pager, DB_HEADER_PAGE_NUM);
+
+        if(page_num == DB_HEADER_PAGE_NUM)
+            *db_page_checksum(header, page_num) = db_header_checksum(header);
+        else
+            *db_page_checksum(header, page_num) = crc32c(pager->pages[page_num], PAGE_SIZE);
+    }
+    if(pager->compressed && page_num != DB_HEADER_PAGE_NUM)
+    {
+        pager_flush_compressed(pager, page_num);
+        return;
+    }
+
+    // Offsets are 64 bits so that files can grow past 4 GB
+    bytes_written = pager_write_at(
+            pager,
+            pager->pages[page_num],
+            PAGE_SIZE,
+            (uint64_t) page_num * PAGE_SIZE
+    );
+
+    if(bytes_written == -1)
+    {
+        fprintf(stdout, "[%s] error writing [errno: %d]\n", __func__, errno);
+        return;     // EXIT_FAILURE?
+    }
+    if((uint64_t) (page_num + 1) * PAGE_SIZE > pager->file_length)
+        pager->file_length = (uint64_t) (page_num + 1) * PAGE_SIZE;
+}
+
+/*
+ * pager_flush_all()
+ * Write every cached page, with the header last since writing the other
+ * pages can change it
+ */
+void pager_flush_all(Pager* pager)
+{
+    *db_header_page_count(get_page(pager, DB_HEADER_PAGE_NUM)) = pager->num_pages;
+    for(uint32_t p = 0; p < pager->num_pages; ++p)
+    {
+        if(p != DB_HEADER_PAGE_NUM && pager->pages[p] != NULL)
+        {
+            TRACE_BEGIN(TRACE_FLUSH);
+            pager_flush(pager, p);
+            TRACE_END(TRACE_FLUSH);
+        }
+    }
+    TRACE_BEGIN(TRACE_FLUSH);
+    pager_flush(pager, DB_HEADER_PAGE_NUM);
+    TRACE_END(TRACE_FLUSH);
+}
+
+/*
+ * pager_file_size()
+ * Size of the file once every page has been written
+ */
+uint64_t pager_file_size(Pager* pager)
+{
+    if(pager->compressed)
+        return pager->file_length;
+
+    return (uint64_t) pager->num_pages * PAGE_SIZE;
+}
+
+/*
+ * get_page()
+ */
+void* get_page(Pager* pager, uint32_t page_num)
+{
+    if(page_num >= TABLE_MAX_PAGES)
+    {
+        fprintf(stdout, "[%s] page %d out of bounds (max page %d)\n",
+                __func__, page_num, TABLE_MAX_PAGES);
+        if(pager->read_error == PAGE_READ_OK)
+            pager->read_error = PAGE_READ_IO_ERROR;
+        return NULL;
+    }
+
+    if(pager->pages[page_num] == NULL)
+    {
+        // cache miss - the page always goes in its own frame
+        void*          page;
+        PageReadResult result;
+
+        page = frame_pool_frame(&pager->frames, page_num);
+
+        // A torn or damaged page is never handed to the tree code
+        TRACE_BEGIN(TRACE_PAGE_READ);
+        result = pager_read_page(pager, page_num, page);
+        TRACE_END(TRACE_PAGE_READ);
+        if(result == PAGE_READ_BAD_CHECKSUM)
+            fprintf(stdout, "[%s] Corruption: checksum mismatch on page %d\n", __func__, page_num);
+        if(result == PAGE_READ_BAD_CHECKSUM || result == PAGE_READ_IO_ERROR)
+        {
+            // Kept until the statement ends so it can be reported
+            if(pager->read_error == PAGE_READ_OK)
+                pager->read_error = result;
+            return NULL;
+        }
+        pager->pages[page_num] = page;
+
+        if(page_num >= pager->num_pages)
+            pager->num_pages = page_num + 1;
+    }
+    // Every change to a page starts with a get_page(), so this is the 
+    // last chance to keep the page as it was
+    if(pager->in_transaction && !pager->touched[page_num])
+    {
+        if(page_num < pager->begin_num_pages)
+            memcpy(frame_pool_frame(&pager->saved, page_num), pager->pages[page_num], PAGE_SIZE);
+        pager->touched[page_num] = 1;
+    }
+
+    return pager->pages[page_num];
+}
+
+/*
+ * pager_free_page()
+ * Put a page that is no longer part of any tree onto the free list
+ */
+void pager_free_page(Pager* pager, uint32_t page_num)
+{
+    void* header;
+    void* page;
+
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    page   = get_page(pager, page_num);
+    memset(page, 0, PAGE_SIZE);
+    *((uint32_t*) page) = *db_header_free_head(header);
+    *db_header_free_head(header)   = page_num;
+    *db_header_free_count(header) += 1;
+}
+
+/*
+ * pager_pages_available()
+ * Number of pages that can still be allocated, including free pages
+ */
+uint32_t pager_pages_available(Pager* pager)
+{
+    void* header;
+
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+
+    return TABLE_MAX_PAGES - pager->num_pages + *db_header_free_count(header);
+}
+
+/*
+ * pager_begin()
+ * Start a transaction. Pages are only written at commit, so that a 
+ * rollback can put back the copy of each page that get_page() saved 
+ * the first time the page was used, and drop the pages added since.
+ * Pages changed before the transaction are written first, so that the 
+ * file holds nothing but committed pages.
+ */
+void pager_begin(Pager* pager)
+{
+    pager_flush_all(pager);
+    pager->in_transaction  = 1;
+    pager->begin_num_pages = pager->num_pages;
+    memset(pager->touched, 0, sizeof(pager->touched));
+}
+
+/*
+ * pager_commit()
+ * Write the pages that changed in the transaction, the header last, and
+ * sync the file once. Returns -1 if the file could not be synced.
+ */
+int pager_commit(Pager* pager)
+{
+    pager->in_transaction = 0;
+    *db_header_page_count(get_page(pager, DB_HEADER_PAGE_NUM)) = pager->num_pages;
+    for(uint32_t p = 0; p < pager->num_pages; ++p)
+    {
+        if(p == DB_HEADER_PAGE_NUM || !pager->touched[p] || pager->pages[p] == NULL)
+            continue;
+        // Pages that were only read are the same as their saved copy
+        if(p < pager->begin_num_pages && 
+           memcmp(pager->pages[p], frame_pool_frame(&pager->saved, p), PAGE_SIZE) == 0)
+            continue;
+        TRACE_BEGIN(TRACE_FLUSH);
+        pager_flush(pager, p);
+        TRACE_END(TRACE_FLUSH);
+    }
+    TRACE_BEGIN(TRACE_FLUSH);
+    pager_flush(pager, DB_HEADER_PAGE_NUM);
+    TRACE_END(TRACE_FLUSH);
+    memset(pager->touched, 0, sizeof(pager->touched));
+
+    if(fdatasync(pager->fd) != 0)
+    {
+        fprintf(stdout, "[%s] error syncing db file [errno: %d]\n", __func__, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * pager_rollback()
+ * Put every page back as it was when the transaction began
+ */
+void pager_rollback(Pager* pager)
+{
+    pager->in_transaction = 0;
+    for(uint32_t p = 0; p < TABLE_MAX_PAGES; ++p)
+    {
+        if(!pager->touched[p])
+            continue;
+        if(p < pager->begin_num_pages)
+            memcpy(pager->pages[p], frame_pool_frame(&pager->saved, p), PAGE_SIZE);
+        else if(pager->pages[p] != NULL)
+        {
+            // A new page, which is read as zeroes if it is made again
+            memset(pager->pages[p], 0, PAGE_SIZE);
+            pager->pages[p] = NULL;
+        }
+    }
+    pager->num_pages = pager->begin_num_pages;
+    memset(pager->touched, 0, sizeof(pager->touched));
+}
+
+// ================ HEADER
+
+/*
+ * init_db_header()
+ */
+void init_db_header(void* header)
+{
+    memset(header, 0, PAGE_SIZE);
+    memcpy(header + DB_HEADER_MAGIC_OFFSET, DB_HEADER_MAGIC, DB_HEADER_MAGIC_SIZE);
+    *db_header_table_root(header) = TABLE_ROOT_PAGE_NUM;
+    *db_header_index_root(header) = INDEX_ROOT_PAGE_NUM;
+    *db_header_free_head(header)  = 0;
+    *db_header_free_count(header) = 0;
+    *db_header_version(header)    = DB_FORMAT_VERSION;
+    *db_header_page_size(header)  = PAGE_SIZE;
+    *db_header_page_count(header) = 0;
+    *db_header_flags(header)      = DB_FLAG_CHECKSUMS;
+    *db_header_catalog_root(header) = 0;
+}
+
+/*
+ * check_db_header()
+ * Returns 0 if the page is not a header. Files written before the header
+ * was added start with the table root node instead.
+ */
+int check_db_header(void* header)
+{
+    return memcmp(header + DB_HEADER_MAGIC_OFFSET, DB_HEADER_MAGIC, DB_HEADER_MAGIC_SIZE) == 0;
+}
+
+uint32_t* db_header_table_root(void* header)
+{
+    return header + DB_HEADER_TABLE_ROOT_OFFSET;
+}
+
+uint32_t* db_header_index_root(void* header)
+{
+    return header + DB_HEADER_INDEX_ROOT_OFFSET;
+}
+
+uint32_t* db_header_free_head(void* header)
+{
+    return header + DB_HEADER_FREE_HEAD_OFFSET;
+}
+
+uint32_t* db_header_free_count(void* header)
+{
+    return header + DB_HEADER_FREE_COUNT_OFFSET;
+}
+
+uint32_t* db_header_version(void* header)
+{
+    return header + DB_HEADER_VERSION_OFFSET;
+}
+
+uint32_t* db_header_page_size(void* header)
+{
+    return header + DB_HEADER_PAGE_SIZE_OFFSET;
+}
+
+uint32_t* db_header_page_count(void* header)
+{
+    return header + DB_HEADER_PAGE_COUNT_OFFSET;
+}
+
+uint32_t* db_header_flags(void* header)
+{
+    return header + DB_HEADER_FLAGS_OFFSET;
+}
+
+uint32_t* db_header_catalog_root(void* header)
+{
+    return header + DB_HEADER_CATALOG_ROOT_OFFSET;
+}
+
+uint32_t* db_page_checksum(void* header, uint32_t page_num)
+{
+    return header + DB_PAGE_CHECKSUM_OFFSET + page_num * DB_PAGE_CHECKSUM_SIZE;
+}
+
+/*
+ * db_header_checksum()
+ * Checksum of the header page, which holds its own checksum
+ */
+uint32_t db_header_checksum(void* header)
+{
+    uint32_t stored;
+    uint32_t checksum;
+
+    stored = *db_page_checksum(header, DB_HEADER_PAGE_NUM);
+    *db_page_checksum(header, DB_HEADER_PAGE_NUM) = 0;
+    checksum = crc32c(header, PAGE_SIZE);
+    *db_page_checksum(header, DB_HEADER_PAGE_NUM) = stored;
+
+    return checksum;
+}
+
+uint64_t* db_page_map_offset(void* header, uint32_t page_num)
+{
+    return header + DB_PAGE_MAP_OFFSET + page_num * DB_PAGE_MAP_ENTRY_SIZE;
+}
+
+uint32_t* db_page_map_length(void* header, uint32_t page_num)
+{
+    return header + DB_PAGE_MAP_OFFSET + page_num * DB_PAGE_MAP_ENTRY_SIZE + DB_PAGE_MAP_OFFSET_SIZE;
+}
+
+uint32_t* db_page_map_capacity(void* header, uint32_t page_num)
+{
+    return header + DB_PAGE_MAP_OFFSET + page_num * DB_PAGE_MAP_ENTRY_SIZE 
+        + DB_PAGE_MAP_OFFSET_SIZE + DB_PAGE_MAP_LENGTH_SIZE;
+}
+
+// ================ TABLE
+
+/*
+ * db_open()
+ */
+Table* db_open(const char* filename)
+{
+    return db_open_with_flags(filename, 0);
+}
+
+/*
+ * db_open_with_flags()
+ * The header flags are only used when the file is new, an existing file
+ * keeps the flags it was created with. DB_OPEN_DIRECT_IO applies to this
+ * open only.
+ */
+Table* db_open_with_flags(const char* filename, uint32_t flags)
+{
+    Pager* pager;
+    Table* table;
+
+    pager = pager_open_with_flags(filename, flags & DB_OPEN_DIRECT_IO);
+    if(pager == NULL)
+    {
+        fprintf(stderr, "[%s] failed to create pager object for table with db file [%s]\n",
+                __func__, filename);
+        return NULL;
+    }
+
+    table = malloc(sizeof(Table));
+    if(!table)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for table with db file [%s]\n",
+                __func__, filename);
+        return NULL;
+    }
+    table->pager          = pager;
+    table->rightmost_leaf = INVALID_PAGE_NUM;
+    table->catalog        = NULL;
+    table->sort_memory    = SORT_DEFAULT_MEMORY;
+    table->group_memory   = GROUP_DEFAULT_MEMORY;
+    table->version        = 0;
+    table->cache          = NULL;
+    table->row_cache      = NULL;
+    table->output         = stdout;
+    arena_init(&table->arena, ARENA_BLOCK_SIZE);
+
+    // If this is a new db file then write the header, init the page after
+    // it as the table root leaf, and the page after that as the (empty)
+    // root of the email index. Index leaves share the leaf header layout 
+    // with the table.
+    if(pager->num_pages == 0)
+    {
+        void* header;
+        void* root_node;
+        void* index_root_node;
+
+        header = get_page(pager, DB_HEADER_PAGE_NUM);
+        init_db_header(header);
+        *db_header_flags(header) |= flags & ~DB_OPEN_DIRECT_IO;
+        pager->compressed = (flags & DB_FLAG_COMPRESSED) ? 1 : 0;
+        pager->checksums  = 1;
+        if(pager->compressed)
+            pager_set_direct_io(pager, 0);
+
+        root_node = get_page(pager, TABLE_ROOT_PAGE_NUM);
+        init_leaf_node_value(root_node);
+        set_node_root(root_node, 1);
+        if(flags & DB_FLAG_COLUMNAR)
+            leaf_node_set_layout(root_node, LEAF_LAYOUT_COLUMNAR);
+
+        index_root_node = get_page(pager, INDEX_ROOT_PAGE_NUM);
+        init_leaf_node_value(index_root_node);
+        set_node_root(index_root_node, 1);
+    }
+    else if(!check_db_header(get_page(pager, DB_HEADER_PAGE_NUM)))
+    {
+        fprintf(stderr, "[%s] db file [%s] has no header, it is either not a database or was written by an older version\n",
+                __func__, filename);
+        pager_close(pager);
+        free(table);
+        return NULL;
+    }
+    else
+    {
+        void* header = get_page(pager, DB_HEADER_PAGE_NUM);
+        const char* reason = NULL;
+
+        if(*db_header_version(header) != DB_FORMAT_VERSION)
+            reason = "was written with a different format version";
+        else if(*db_header_page_size(header) != PAGE_SIZE)
+            reason = "was written with a different page size";
+        else if(*db_header_page_count(header) > pager->num_pages)
+            reason = "is shorter than its header says, it may have been truncated";
+        if(reason)
+        {
+            fprintf(stderr, "[%s] db file [%s] %s (version %u, %u byte pages, %u pages)\n",
+                    __func__, filename, reason,
+                    *db_header_version(header),
+                    *db_header_page_size(header),
+                    *db_header_page_count(header)
+            );
+            pager_close(pager);
+            free(table);
+            return NULL;
+        }
+    }
+    table->root_page_num       = *db_header_table_root(get_page(pager, DB_HEADER_PAGE_NUM));
+    table->index_root_page_num = *db_header_index_root(get_page(pager, DB_HEADER_PAGE_NUM));
+
+    return table;
+}
+
+/*
+ * db_close()
+ */
+void db_close(Table* table)
+{
+    Pager* pager;
+
+    catalog_free(table->catalog);
+    cache_free(table->cache);
+    row_cache_free(table->row_cache);
+    pager = table->pager;
+    // A transaction that was never committed is dropped
+    if(pager->in_transaction)
+        pager_rollback(pager);
+    pager_flush_all(pager);
+    // O_DIRECT skips the page cache but not the drive's own cache
+    if(pager->direct_io && fdatasync(pager->fd) != 0)
+        fprintf(stdout, "[%s] error syncing db file [errno: %d]\n", __func__, errno);
+
+    int result = close(pager->fd);      // <- TODO : segfault here
+    if(result == -1)
+    {
+        fprintf(stdout, "[%s] Error closing db file\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
+    frame_pool_destroy(&pager->frames);
+    frame_pool_destroy(&pager->saved);
+    free(pager->filename);
+    free(pager);
+    arena_destroy(&table->arena);
+    free(table);
+}
+
+/*
+ * db_begin()
+ */
+TransactionResult db_begin(Table* table)
+{
+    if(table->pager->in_transaction)
+        return TRANSACTION_ACTIVE;
+    pager_begin(table->pager);
+
+    return TRANSACTION_OK;
+}
+
+/*
+ * db_commit()
+ */
+TransactionResult db_commit(Table* table)
+{
+    if(!table->pager->in_transaction)
+        return TRANSACTION_NONE;
+    if(pager_commit(table->pager) != 0)
+        return TRANSACTION_IO_ERROR;
+
+    return TRANSACTION_OK;
+}
+
+/*
+ * db_rollback()
+ * Undo every change since db_begin(). Besides the pages, anything the 
+ * table keeps about them is forgotten.
+ */
+TransactionResult db_rollback(Table* table)
+{
+    void* header;
+
+    if(!table->pager->in_transaction)
+        return TRANSACTION_NONE;
+    pager_rollback(table->pager);
+
+    header = get_page(table->pager, DB_HEADER_PAGE_NUM);
+    table->root_page_num       = *db_header_table_root(header);
+    table->index_root_page_num = *db_header_index_root(header);
+    table->rightmost_leaf      = INVALID_PAGE_NUM;
+    // Tables created in the transaction are gone, so the catalog is read
+    // again when it is next used
+    catalog_free(table->catalog);
+    table->catalog = NULL;
+    // and cached results and rows may be from the transaction
+    table->version++;
+    if(table->row_cache != NULL)
+        row_cache_clear(table->row_cache);
+
+    return TRANSACTION_OK;
+}
+
+/*
+ * table_reset_arena()
+ * Called at the end of each statement. Frees every cursor and temporary
+ * allocated from the table's arena.
+ */
+void table_reset_arena(Table* table)
+{
+    arena_reset(&table->arena);
+}
+
+/*
+ * table_open_tree()
+ * A view of another tree in the file, for the tables in the catalog. 
+ * The view shares the pager with the users table but has its own arena.
+ * It has no index, and must be closed before the pager is.
+ */
+Table* table_open_tree(Pager* pager, uint32_t root_page_num)
+{
+    Table* tree;
+
+    tree = malloc(sizeof(Table));
+    if(!tree)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for tree at page %u\n", __func__, root_page_num);
+        exit(EXIT_FAILURE);
+    }
+    tree->root_page_num       = root_page_num;
+    tree->index_root_page_num = INVALID_PAGE_NUM;
+    tree->rightmost_leaf      = INVALID_PAGE_NUM;
+    tree->pager               = pager;
+    tree->catalog             = NULL;
+    tree->sort_memory         = SORT_DEFAULT_MEMORY;
+    tree->group_memory        = GROUP_DEFAULT_MEMORY;
+    tree->version             = 0;
+    tree->cache               = NULL;
+    tree->row_cache           = NULL;
+    tree->output              = stdout;
+    arena_init(&tree->arena, ARENA_BLOCK_SIZE);
+
+    return tree;
+}
+
+/*
+ * table_close_tree()
+ */
+void table_close_tree(Table* tree)
+{
+    if(!tree)
+        return;
+    arena_destroy(&tree->arena);
+    free(tree);
+}
+
+
+
+// ================ CURSOR
+
+/*
+ * table_start()
+ * Cursor at the smallest key in the table
+ */
+Cursor* table_start(Table* table)
+{
+    void*   node;
+    Cursor* cursor;
+
+    cursor = table_find(table, 0);
+    if(!cursor)
+        return NULL;
+
+    node = get_page(table->pager, cursor->page_num);
+    cursor->end_of_table = (*leaf_node_num_cells(node) == 0) ? 1 : 0;
+
+    return cursor;
+}
+
+/*
+ * table_end()
+ * Cursor one past the largest key in the table
+ */
+Cursor* table_end(Table* table)
+{
+    void*    node;
+    uint32_t page_num;
+    Cursor*  cursor;
+
+    cursor = arena_alloc(&table->arena, sizeof(Cursor));
+    if(!cursor)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for Cursor object\n", __func__);
+        return NULL;
+    }
+
+    // The last key is always in the rightmost leaf
+    page_num = table->root_page_num;
+    node     = get_page(table->pager, page_num);
+    while(node && get_node_type(node) == NODE_INTERNAL)
+    {
+        page_num = *internal_node_right_child(node);
+        node     = get_page(table->pager, page_num);
+    }
+    if(!node)
+        return NULL;
+
+    cursor->table        = table;
+    cursor->page_num     = page_num;
+    cursor->cell_num     = *leaf_node_num_cells(node);
+    cursor->end_of_table = 1;
+
+    return cursor;
+}
+
+/*
+ * table_find()
+ * Return the position of the given key. If the key is not present
+ * return the position where it should be inserted.
+ */
+Cursor* table_find(Table* table, uint32_t key)
+{
+    void* root_node;
+
+    root_node = get_page(table->pager, table->root_page_num);
+    if(!root_node)
+        return NULL;
+    if(get_node_type(root_node) == NODE_LEAF)
+        return leaf_node_find(table, table->root_page_num, key);
+
+    return internal_node_find(table, table->root_page_num, key);
+}
+
+/*
+ * table_find_append()
+ * Same as table_find(), but a key larger than every other key in the 
+ * table goes straight to the end of the last leaf, without a descent 
+ * from the root. Ids that are handed out in order are all inserted this 
+ * way.
+ */
+Cursor* table_find_append(Table* table, uint32_t key)
+{
+    void*    node;
+    uint32_t num_cells;
+    Cursor*  cursor;
+
+    if(table->rightmost_leaf != INVALID_PAGE_NUM)
+    {
+        node      = get_page(table->pager, table->rightmost_leaf);
+        num_cells = node ? *leaf_node_num_cells(node) : 0;
+        if(node && get_node_type(node) == NODE_LEAF && *leaf_node_next_leaf(node) == 0 &&
+           num_cells > 0 && key > *leaf_node_key(node, num_cells - 1))
+        {
+            cursor = arena_alloc(&table->arena, sizeof(Cursor));
+            if(!cursor)
+            {
+                fprintf(stderr, "[%s] failed to allocate memory for Cursor object\n", __func__);
+                return NULL;
+            }
+            cursor->table        = table;
+            cursor->page_num     = table->rightmost_leaf;
+            cursor->cell_num     = num_cells;
+            cursor->end_of_table = 1;
+
+            return cursor;
+        }
+    }
+
+    cursor = table_find(table, key);
+    if(cursor && *leaf_node_next_leaf(get_page(table->pager, cursor->page_num)) == 0)
+        table->rightmost_leaf = cursor->page_num;
+
+    return cursor;
+}
+
+/*
+ * cursor_value()
+ * Figure out where to read/write in memory for a particular row. Only
+ * a row leaf keeps a value in one piece, so this is for trees that are
+ * never columnar, such as the catalog. Rows of the table are read with
+ * cursor_read_columns().
+ */
+void* cursor_value(Cursor* cursor)
+{
+    void* page;
+
+    page = get_page(cursor->table->pager, cursor->page_num);
+
+    return leaf_node_column(page, cursor->cell_num, LEAF_COLUMN_ID);
+}
+
+/*
+ * cursor_read_columns()
+ * Read the columns in the set from the row at the cursor
+ */
+void cursor_read_columns(Cursor* cursor, uint32_t columns, Row* row)
+{
+    void* page;
+
+    page = get_page(cursor->table->pager, cursor->page_num);
+    leaf_node_read_columns(page, cursor->cell_num, columns, row);
+}
+
+/*
+ * cursor_advance()
+ * Step to the next cell, following the sibling pointer at the end of 
+ * a leaf. Index leaves have the same header layout so this also walks 
+ * the index.
+ */
+void cursor_advance(Cursor* cursor)
+{
+    void* node;
+
+    node = get_page(cursor->table->pager, cursor->page_num);
+    cursor->cell_num++;
+    if(cursor->cell_num >= (*leaf_node_num_cells(node)))
+    {
+        uint32_t next_page_num = *leaf_node_next_leaf(node);
+
+        if(next_page_num == 0)
+            cursor->end_of_table = 1;   // this was the rightmost leaf
+        else if(!get_page(cursor->table->pager, next_page_num))
+            cursor->end_of_table = 1;   // the scan stops, pager->read_error says why
+        else
+        {
+            cursor->page_num = next_page_num;
+            cursor->cell_num = 0;
+        }
+    }
+}
+
+/*
+ * cursor_next_leaf()
+ * Skip the rest of the current leaf
+ */
+void cursor_next_leaf(Cursor* cursor)
+{
+    void*    node;
+    uint32_t next_page_num;
+
+    node          = get_page(cursor->table->pager, cursor->page_num);
+    next_page_num = *leaf_node_next_leaf(node);
+    if(next_page_num == 0 || !get_page(cursor->table->pager, next_page_num))
+    {
+        cursor->cell_num     = *leaf_node_num_cells(node);
+        cursor->end_of_table = 1;
+    }
+    else
+    {
+        cursor->page_num = next_page_num;
+        cursor->cell_num = 0;
+    }
 }
@@ -13,7 +13,9 @@
 #define TABLE_MAX_PAGES 100   // NOTE: this limit may change in future
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include "arena.h"
 
 // Attribute size
 #define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
@@ -36,7 +38,20 @@
  *  email       255              36
  *  total       291
  */
+/*
+ * The page size is fixed when the program is built (make PAGE_SIZE=16384)
+ * since every node layout below is derived from it. It is recorded in the
+ * file header so that a file is never opened by a build with a different
+ * page size. Larger pages suit scan heavy databases.
+ */
+#ifndef PAGE_SIZE
 #define PAGE_SIZE 4096        // same as OS VM page size 
+#endif
+#define PAGE_SIZE_MIN 4096
+#define PAGE_SIZE_MAX 65536
+#if PAGE_SIZE < PAGE_SIZE_MIN || PAGE_SIZE > PAGE_SIZE_MAX || (PAGE_SIZE & (PAGE_SIZE - 1)) != 0
+#error "PAGE_SIZE must be a power of two from 4 KB to 64 KB"
+#endif
 /*
  * print_page_info()
  */
@@ -77,6 +92,14 @@ void print_row(Row* row);
 void serialize_row(Row* src, void* dest);
 void deserialize_row(void* src, Row* dst);
 
+typedef enum
+{
+    PAGE_READ_OK,
+    PAGE_READ_NEW,              // the page is not in the file yet
+    PAGE_READ_IO_ERROR,
+    PAGE_READ_BAD_CHECKSUM
+} PageReadResult;
+
 /*
  * Pager
  * Object that accesses the cache and file. Tables make 
@@ -85,14 +108,130 @@ void deserialize_row(void* src, Row* dst);
 typedef struct
 {
     int      fd;     // file descriptor
-    uint32_t file_length;
+    char*    filename;
+    uint64_t file_length;
     uint32_t num_pages;
+    int      compressed;    // pages are stored compressed at offsets in the page map
+    int      checksums;     // pages are checked against their checksum when read
+    int      direct_io;     // file is open with O_DIRECT, pages skip the kernel page cache
+    FramePool frames;       // memory for every page, pages[n] is frame n once loaded
     void*    pages[TABLE_MAX_PAGES];
+    PageReadResult read_error;  // first page that could not be read, until the statement ends
+    // Transactions, see pager_begin()
+    int      in_transaction;
+    uint32_t begin_num_pages;               // num_pages when the transaction began
+    FramePool saved;                        // page n as it was at begin, in frame n
+    uint8_t  touched[TABLE_MAX_PAGES];      // page was used since begin, and saved if it existed
 } Pager;
 
-Pager* pager_open(const char* filename);
-void   pager_flush(Pager* pager, uint32_t page_num);
-void*  get_page(Pager* pager, uint32_t page_num);
+// One frame past the last page, for reading pages outside the cache
+#define PAGER_SCRATCH_FRAME TABLE_MAX_PAGES
+
+Pager*   pager_open(const char* filename);
+Pager*   pager_open_with_flags(const char* filename, uint32_t flags);
+int      pager_set_direct_io(Pager* pager, int direct_io);
+void     pager_close(Pager* pager);
+void     pager_flush(Pager* pager, uint32_t page_num);
+void     pager_flush_all(Pager* pager);
+uint64_t pager_file_size(Pager* pager);
+PageReadResult pager_verify_page(Pager* pager, uint32_t page_num);
+void*    get_page(Pager* pager, uint32_t page_num);
+void     pager_free_page(Pager* pager, uint32_t page_num);
+uint32_t pager_pages_available(Pager* pager);
+void     pager_begin(Pager* pager);
+int      pager_commit(Pager* pager);
+void     pager_rollback(Pager* pager);
+
+/*
+ * Database Header Layout
+ * Page 0 of every file is a header rather than a tree node. It records 
+ * where the table and index roots are, and the head of a list of pages 
+ * that have been freed by deletes. Each free page holds the number of 
+ * the next free page in its first 4 bytes, and 0 ends the list. The 
+ * format version, page size and page count come after the fields that 
+ * were there first, so older files read as version 0. The catalog root 
+ * is the page of the tree that lists the tables made with create table,
+ * or 0 if there are none yet.
+ */
+#define DB_HEADER_PAGE_NUM           0
+#define DB_HEADER_MAGIC              "sqclone"   // 8 bytes with the terminating zero
+#define DB_HEADER_MAGIC_SIZE         8
+#define DB_HEADER_MAGIC_OFFSET       0
+#define DB_HEADER_TABLE_ROOT_SIZE    sizeof(uint32_t)
+#define DB_HEADER_TABLE_ROOT_OFFSET  (DB_HEADER_MAGIC_OFFSET + DB_HEADER_MAGIC_SIZE)
+#define DB_HEADER_INDEX_ROOT_SIZE    sizeof(uint32_t)
+#define DB_HEADER_INDEX_ROOT_OFFSET  (DB_HEADER_TABLE_ROOT_OFFSET + DB_HEADER_TABLE_ROOT_SIZE)
+#define DB_HEADER_FREE_HEAD_SIZE     sizeof(uint32_t)
+#define DB_HEADER_FREE_HEAD_OFFSET   (DB_HEADER_INDEX_ROOT_OFFSET + DB_HEADER_INDEX_ROOT_SIZE)
+#define DB_HEADER_FREE_COUNT_SIZE    sizeof(uint32_t)
+#define DB_HEADER_FREE_COUNT_OFFSET  (DB_HEADER_FREE_HEAD_OFFSET + DB_HEADER_FREE_HEAD_SIZE)
+#define DB_HEADER_VERSION_SIZE       sizeof(uint32_t)
+#define DB_HEADER_VERSION_OFFSET     (DB_HEADER_FREE_COUNT_OFFSET + DB_HEADER_FREE_COUNT_SIZE)
+#define DB_HEADER_PAGE_SIZE_SIZE     sizeof(uint32_t)
+#define DB_HEADER_PAGE_SIZE_OFFSET   (DB_HEADER_VERSION_OFFSET + DB_HEADER_VERSION_SIZE)
+#define DB_HEADER_PAGE_COUNT_SIZE    sizeof(uint32_t)
+#define DB_HEADER_PAGE_COUNT_OFFSET  (DB_HEADER_PAGE_SIZE_OFFSET + DB_HEADER_PAGE_SIZE_SIZE)
+#define DB_HEADER_FLAGS_SIZE         sizeof(uint32_t)
+#define DB_HEADER_FLAGS_OFFSET       (DB_HEADER_PAGE_COUNT_OFFSET + DB_HEADER_PAGE_COUNT_SIZE)
+#define DB_HEADER_CATALOG_ROOT_SIZE  sizeof(uint32_t)
+#define DB_HEADER_CATALOG_ROOT_OFFSET (DB_HEADER_FLAGS_OFFSET + DB_HEADER_FLAGS_SIZE)
+#define DB_HEADER_SIZE               (DB_HEADER_CATALOG_ROOT_OFFSET + DB_HEADER_CATALOG_ROOT_SIZE)
+#define DB_FORMAT_VERSION            1
+
+// Header flags, chosen when the file is created
+#define DB_FLAG_COMPRESSED           (1 << 0)
+#define DB_FLAG_CHECKSUMS            (1 << 1)     // set for every new file
+#define DB_FLAG_COLUMNAR             (1 << 2)     // the table's leaves use the columnar layout
+// Open flags, for this process only and never written to the header
+#define DB_OPEN_DIRECT_IO            (1u << 31)
+
+/*
+ * Page Map Layout
+ * In a compressed file every page other than the header is LZ4 compressed
+ * and stored at its own offset. The header page holds a map from page 
+ * number to the offset, the compressed length and the space reserved at 
+ * that offset. A page that no longer fits in its space is written at the
+ * end of the file, and .vacuum packs the file again. A length of PAGE_SIZE
+ * means the page did not compress and is stored as it is, and a length 
+ * of 0 means the page has never been written.
+ */
+#define DB_PAGE_MAP_OFFSET           64
+#define DB_PAGE_MAP_OFFSET_SIZE      sizeof(uint64_t)
+#define DB_PAGE_MAP_LENGTH_SIZE      sizeof(uint32_t)
+#define DB_PAGE_MAP_CAPACITY_SIZE    sizeof(uint32_t)
+#define DB_PAGE_MAP_ENTRY_SIZE       16
+#define DB_PAGE_MAP_ALIGN            64      // reserved space is rounded up to this
+
+/*
+ * Page Checksum Layout
+ * The header page also holds a CRC32C of every page, written when the 
+ * page is flushed and checked when it is read back. Entry 0 is the 
+ * checksum of the header page itself, taken with that entry set to 0.
+ */
+#define DB_PAGE_CHECKSUM_OFFSET      (DB_PAGE_MAP_OFFSET + TABLE_MAX_PAGES * DB_PAGE_MAP_ENTRY_SIZE)
+#define DB_PAGE_CHECKSUM_SIZE        4
+#if DB_PAGE_CHECKSUM_OFFSET + TABLE_MAX_PAGES * DB_PAGE_CHECKSUM_SIZE > PAGE_SIZE
+#error "The page map and checksums must fit in the header page"
+#endif
+// The table root follows the header and never moves
+#define TABLE_ROOT_PAGE_NUM          1
+
+void      init_db_header(void* header);
+int       check_db_header(void* header);
+uint32_t* db_header_table_root(void* header);
+uint32_t* db_header_index_root(void* header);
+uint32_t* db_header_free_head(void* header);
+uint32_t* db_header_free_count(void* header);
+uint32_t* db_header_version(void* header);
+uint32_t* db_header_page_size(void* header);
+uint32_t* db_header_page_count(void* header);
+uint32_t* db_header_flags(void* header);
+uint32_t* db_header_catalog_root(void* header);
+uint64_t* db_page_map_offset(void* header, uint32_t page_num);
+uint32_t* db_page_map_length(void* header, uint32_t page_num);
+uint32_t* db_page_map_capacity(void* header, uint32_t page_num);
+uint32_t* db_page_checksum(void* header, uint32_t page_num);
+uint32_t  db_header_checksum(void* header);
 
 /* 
  * Table - structure that points to pages of rows
@@ -101,17 +240,44 @@ void*  get_page(Pager* pager, uint32_t page_num);
 typedef struct 
 {
     uint32_t root_page_num;
+    uint32_t index_root_page_num;   // root of the secondary index on email
+    uint32_t rightmost_leaf;        // last leaf of the table, INVALID_PAGE_NUM if not known
     //uint32_t max_rows;
     Pager*   pager;
+    Arena    arena;                 // cursors and temporaries for one statement
+    struct Catalog* catalog;        // tables made with create table, loaded when first used
+    size_t   sort_memory;           // budget for order by before rows are spilled to files
+    size_t   group_memory;          // budget for group by before groups are spilled to files
+    uint64_t version;               // goes up with every statement that writes
+    struct ResultCache* cache;      // results of selects, NULL unless the cache is on
+    struct RowCache* row_cache;     // rows looked up by id, NULL unless the cache is on
+    FILE*    output;                // where selects print their rows
 } Table;
 
+typedef enum
+{
+    TRANSACTION_OK,
+    TRANSACTION_ACTIVE,         // begin inside a transaction
+    TRANSACTION_NONE,           // commit or rollback outside one
+    TRANSACTION_IO_ERROR        // the pages could not be written or synced
+} TransactionResult;
+
 Table* db_open(const char* filename);
+Table* db_open_with_flags(const char* filename, uint32_t flags);
 void   db_close(Table* table);
+TransactionResult db_begin(Table* table);
+TransactionResult db_commit(Table* table);
+TransactionResult db_rollback(Table* table);
+void   table_reset_arena(Table* table);
+Table* table_open_tree(Pager* pager, uint32_t root_page_num);
+void   table_close_tree(Table* tree);
 
 
 /*
  * Cursor
- * Represents a location in a table.
+ * Represents a location in a table. Cursors are allocated from the 
+ * table's arena and are not freed by the caller. They last until the 
+ * arena is reset at the end of the statement (table_reset_arena()).
  */
 typedef struct 
 {
@@ -123,8 +289,21 @@ typedef struct
 
 Cursor* table_start(Table* table);
 Cursor* table_end(Table* table);
+Cursor* table_find(Table* table, uint32_t key);
+Cursor* table_find_append(Table* table, uint32_t key);
 void*   cursor_value(Cursor* cursor);
+void    cursor_read_columns(Cursor* cursor, uint32_t columns, Row* row);
 void    cursor_advance(Cursor* cursor);
+void    cursor_next_leaf(Cursor* cursor);
+
+/*
+ * Node types
+ */
+typedef enum
+{
+    NODE_INTERNAL,
+    NODE_LEAF
+} NodeType;
 
 /*
  * Common Node Header Layout
@@ -142,28 +321,173 @@ void    cursor_advance(Cursor* cursor);
  */
 #define LEAF_NODE_NUM_CELLS_SIZE   sizeof(uint32_t)
 #define LEAF_NODE_NUM_CELLS_OFFSET COMMON_NODE_HEADER_SIZE
-#define LEAF_NODE_HEADER_SIZE      (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE)
+#define LEAF_NODE_NEXT_LEAF_SIZE   sizeof(uint32_t)
+#define LEAF_NODE_NEXT_LEAF_OFFSET (LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE)
+#define LEAF_NODE_HEADER_SIZE      (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE)
+/*
+ * Leaf Node Summary Layout
+ * Stored in the footer of each table leaf so that a scan can rule out
+ * a whole leaf without reading its cells. The bloom filter has an entry
+ * for the username and the email of every cell in the leaf.
+ */
+#define LEAF_NODE_MIN_KEY_SIZE    sizeof(uint32_t)
+#define LEAF_NODE_MAX_KEY_SIZE    sizeof(uint32_t)
+#define LEAF_NODE_BLOOM_SIZE      128
+#define LEAF_NODE_BLOOM_BITS      (LEAF_NODE_BLOOM_SIZE * 8)
+#define LEAF_NODE_BLOOM_HASHES    3
+#define LEAF_NODE_SUMMARY_SIZE    (LEAF_NODE_MIN_KEY_SIZE + LEAF_NODE_MAX_KEY_SIZE + LEAF_NODE_BLOOM_SIZE)
+#define LEAF_NODE_SUMMARY_OFFSET  (PAGE_SIZE - LEAF_NODE_SUMMARY_SIZE)
+#define LEAF_NODE_MIN_KEY_OFFSET  LEAF_NODE_SUMMARY_OFFSET
+#define LEAF_NODE_MAX_KEY_OFFSET  (LEAF_NODE_MIN_KEY_OFFSET + LEAF_NODE_MIN_KEY_SIZE)
+#define LEAF_NODE_BLOOM_OFFSET    (LEAF_NODE_MAX_KEY_OFFSET + LEAF_NODE_MAX_KEY_SIZE)
+// Seeds keep usernames and emails from sharing filter bits
+#define BLOOM_SEED_USERNAME       0x9E3779B9
+#define BLOOM_SEED_EMAIL          0x85EBCA6B
+
+/*
+ * Leaf Node Layout Byte
+ * Sits just in front of the summary, in space that is too small for
+ * another cell at every page size, so files from before it was added
+ * read as row leaves.
+ */
+#define LEAF_NODE_LAYOUT_SIZE     sizeof(uint8_t)
+#define LEAF_NODE_LAYOUT_OFFSET   (LEAF_NODE_SUMMARY_OFFSET - LEAF_NODE_LAYOUT_SIZE)
+
 /*
  * Leaf Node Body Layout
+ * The keys of all cells are kept together in an array at the front of
+ * the body, followed by the values. This way a search within the node 
+ * only touches the cache lines that hold the keys.
+ *
+ * How the values are arranged depends on the layout of the leaf. A row
+ * leaf has an array of whole values. A columnar leaf splits the same
+ * space into one minipage per column (id, username, then email), each
+ * an array of that column for every cell, so a scan that only needs
+ * one column reads only that column's minipage. Records that are not
+ * users rows are split at the same byte offsets, which is harmless.
+ * New leaves take the layout of the leaf they split from.
  */
+typedef enum
+{
+    LEAF_LAYOUT_ROW,
+    LEAF_LAYOUT_COLUMNAR
+} LeafLayout;
+
+typedef enum
+{
+    LEAF_COLUMN_ID,
+    LEAF_COLUMN_USERNAME,
+    LEAF_COLUMN_EMAIL,
+    LEAF_NUM_COLUMNS
+} LeafColumn;
+
+// Sets of columns to read or write
+#define LEAF_COLUMN_BIT(column)   (1u << (column))
+#define LEAF_COLUMNS_ALL          ((1u << LEAF_NUM_COLUMNS) - 1)
+
 #define LEAF_NODE_KEY_SIZE        sizeof(uint32_t)
-#define LEAF_NODE_KEY_OFFSET      0
 #define LEAF_NODE_VALUE_SIZE      ROW_SIZE     
-#define LEAF_NODE_VALUE_OFFSET    (LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE)
 #define LEAF_NODE_CELL_SIZE       (LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE)
-#define LEAF_NODE_SPACE_FOR_CELLS (PAGE_SIZE - LEAF_NODE_HEADER_SIZE)
+#define LEAF_NODE_SPACE_FOR_CELLS (PAGE_SIZE - LEAF_NODE_HEADER_SIZE - LEAF_NODE_LAYOUT_SIZE - LEAF_NODE_SUMMARY_SIZE)
 #define LEAF_NODE_MAX_CELLS       (LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE)
+#define LEAF_NODE_KEYS_OFFSET     LEAF_NODE_HEADER_SIZE
+#define LEAF_NODE_VALUES_OFFSET   (LEAF_NODE_KEYS_OFFSET + LEAF_NODE_MAX_CELLS * LEAF_NODE_KEY_SIZE)
+// When a leaf splits, the existing cells plus the new one are divided
+// evenly between the old (left) node and the new (right) node.
+#define LEAF_NODE_RIGHT_SPLIT_COUNT ((LEAF_NODE_MAX_CELLS + 1) / 2)
+#define LEAF_NODE_LEFT_SPLIT_COUNT  ((LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT)
+// Except when the new key goes on the end of the last leaf. Keys that 
+// only ever grow would leave every leaf half empty, so the old node 
+// keeps most of the cells and the new one is left to be filled.
+#define LEAF_NODE_APPEND_LEFT_COUNT (((LEAF_NODE_MAX_CELLS + 1) * 9) / 10)
+// Below this a leaf (other than the root) is merged or rebalanced. The
+// last leaf can be below it while appends are filling it.
+#define LEAF_NODE_MIN_CELLS         (LEAF_NODE_MAX_CELLS / 2)
+
+/*
+ * Internal Node Header Layout
+ */
+#define INTERNAL_NODE_NUM_KEYS_SIZE      sizeof(uint32_t)
+#define INTERNAL_NODE_NUM_KEYS_OFFSET    COMMON_NODE_HEADER_SIZE
+#define INTERNAL_NODE_RIGHT_CHILD_SIZE   sizeof(uint32_t)
+#define INTERNAL_NODE_RIGHT_CHILD_OFFSET (INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE)
+#define INTERNAL_NODE_HEADER_SIZE        (COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE)
+/*
+ * Internal Node Body Layout
+ * As with leaves, the keys are kept in their own array followed by the
+ * array of child pointers. Key i is the largest key in child i.
+ */
+#define INTERNAL_NODE_CHILD_SIZE         sizeof(uint32_t)
+#define INTERNAL_NODE_KEY_SIZE           sizeof(uint32_t)
+#define INTERNAL_NODE_CELL_SIZE          (INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE)
+#define INTERNAL_NODE_SPACE_FOR_CELLS    (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE)
+#define INTERNAL_NODE_MAX_CELLS          (INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE)
+#define INTERNAL_NODE_KEYS_OFFSET        INTERNAL_NODE_HEADER_SIZE
+#define INTERNAL_NODE_CHILDREN_OFFSET    (INTERNAL_NODE_KEYS_OFFSET + INTERNAL_NODE_MAX_CELLS * INTERNAL_NODE_KEY_SIZE)
+#define INTERNAL_NODE_MIN_KEYS           (INTERNAL_NODE_MAX_CELLS / 2)
+// Sentinel for an internal node that does not have a right child yet
+#define INVALID_PAGE_NUM                 UINT32_MAX
 
 
 /*
  * Tree Nodes
  */
+NodeType  get_node_type(void* node);
+void      set_node_type(void* node, NodeType type);
+int       is_node_root(void* node);
+void      set_node_root(void* node, int is_root);
+uint32_t* node_parent(void* node);
+uint32_t  get_node_max_key(Pager* pager, void* node);
+uint32_t  get_unused_page_num(Pager* pager);
+uint32_t  tree_depth(Pager* pager, uint32_t root_page_num);
+
 uint32_t* leaf_node_num_cells(void* node);
-void*     leaf_node_cell(void* node, uint32_t cell_num);
+uint32_t* leaf_node_next_leaf(void* node);
 uint32_t* leaf_node_key(void* node, uint32_t cell_num);
-void*     leaf_node_value(void* node, uint32_t cell_num);
+LeafLayout leaf_node_layout(void* node);
+void      leaf_node_set_layout(void* node, LeafLayout layout);
+void*     leaf_node_column(void* node, uint32_t cell_num, LeafColumn column);
+uint32_t  leaf_node_column_stride(void* node, LeafColumn column);
+void      leaf_node_read_record(void* node, uint32_t cell_num, void* record);
+void      leaf_node_write_record(void* node, uint32_t cell_num, const void* record);
+void      leaf_node_read_columns(void* node, uint32_t cell_num, uint32_t columns, Row* row);
+void      leaf_node_write_columns(void* node, uint32_t cell_num, uint32_t columns, Row* row);
+void      leaf_node_move_cells(void* dest_node, uint32_t dest_cell, void* src_node, uint32_t src_cell, uint32_t num_cells);
 void      init_leaf_node_value(void* node);
+uint32_t* leaf_node_min_key(void* node);
+uint32_t* leaf_node_max_key(void* node);
+uint8_t*  leaf_node_bloom(void* node);
+void      leaf_node_bloom_add(void* node, const char* str, size_t max_len, uint32_t seed);
+int       leaf_node_bloom_check(void* node, const char* str, size_t max_len, uint32_t seed);
+void      leaf_node_summary_add(void* node, uint32_t cell_num);
+void      leaf_node_summary_rebuild(void* node);
 void      leaf_node_insert(Cursor* cursor, uint32_t key, Row* value);
+void      leaf_node_insert_record(Cursor* cursor, uint32_t key, const void* record);
+void      leaf_node_split_and_insert(Cursor* cursor, uint32_t key, const void* record);
+Cursor*   leaf_node_find(Table* table, uint32_t page_num, uint32_t key);
+void      leaf_node_delete(Cursor* cursor);
+void      leaf_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index);
+void      leaf_node_redistribute(void* left, void* right);
+
+uint32_t* internal_node_num_keys(void* node);
+uint32_t* internal_node_right_child(void* node);
+void      internal_node_move_cells(void* node, uint32_t dest_cell, uint32_t src_cell, uint32_t num_cells);
+uint32_t* internal_node_child(void* node, uint32_t child_num);
+uint32_t* internal_node_key(void* node, uint32_t key_num);
+void      init_internal_node(void* node);
+uint32_t  internal_node_find_child(void* node, uint32_t key);
+Cursor*   internal_node_find(Table* table, uint32_t page_num, uint32_t key);
+void      internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+void      internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+void      update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key);
+void      create_new_root(Table* table, uint32_t right_child_page_num);
+uint32_t  internal_node_child_index(void* node, uint32_t child_page_num);
+void      internal_node_remove(void* node, uint32_t index);
+void      internal_node_merge(Table* table, uint32_t parent_page_num, uint32_t left_index);
+void      internal_node_redistribute(Table* table, uint32_t left_page_num, uint32_t right_page_num);
+void      update_node_max_key(Table* table, uint32_t page_num);
+void      rebalance_node(Table* table, uint32_t page_num);
+void      collapse_root(Table* table);
 
 
 #endif /*__SQ_TABLE_H*/
@@ -0,0 +1,222 @@
+/*
+ * TRACE
+ * Span timing for the hot paths of a statement
+ *
+ * Stefan Wong 2020
+ */
+
+// for clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+static const char* trace_span_names[TRACE_NUM_SPANS] = {
+    "statement",
+    "parse",
+    "plan",
+    "descend",
+    "page_read",
+    "cell_write",
+    "flush"
+};
+
+// Everything recorded since the last reset. The program is single
+// threaded, so there is only ever one of these.
+static struct
+{
+    TraceHistogram histograms[TRACE_NUM_SPANS];
+    TraceEvent     events[TRACE_MAX_EVENTS];
+    uint32_t       next_event;
+    uint32_t       num_events;
+} trace_state;
+
+
+/*
+ * trace_enabled()
+ * Returns 1 if the instrumentation was compiled in
+ */
+int trace_enabled(void)
+{
+#ifdef SQ_TRACE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * trace_span_name()
+ */
+const char* trace_span_name(TraceSpan span)
+{
+    if(span >= TRACE_NUM_SPANS)
+        return "unknown";
+
+    return trace_span_names[span];
+}
+
+/*
+ * trace_now()
+ * Nanoseconds on the monotonic clock. This is a vDSO call on Linux, so it
+ * doesn't enter the kernel, and unlike rdtsc it needs no calibration.
+ */
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * trace_bucket()
+ * Histogram bucket for a duration, one bucket per power of two
+ */
+uint32_t trace_bucket(uint64_t duration_ns)
+{
+    uint32_t bucket;
+
+    if(duration_ns == 0)
+        return 0;
+    bucket = 64 - __builtin_clzll(duration_ns);
+    if(bucket >= TRACE_HISTOGRAM_BUCKETS)
+        bucket = TRACE_HISTOGRAM_BUCKETS - 1;
+
+    return bucket;
+}
+
+/*
+ * trace_record()
+ */
+void trace_record(TraceSpan span, uint64_t start_ns, uint64_t end_ns)
+{
+    TraceHistogram* hist;
+    TraceEvent*     event;
+    uint64_t        duration_ns;
+
+    if(span >= TRACE_NUM_SPANS)
+        return;
+
+    duration_ns = (end_ns > start_ns) ? end_ns - start_ns : 0;
+    hist        = &trace_state.histograms[span];
+    if(hist->count == 0 || duration_ns < hist->min_ns)
+        hist->min_ns = duration_ns;
+    if(duration_ns > hist->max_ns)
+        hist->max_ns = duration_ns;
+    hist->count++;
+    hist->total_ns += duration_ns;
+    hist->buckets[trace_bucket(duration_ns)]++;
+
+    // Once the ring is full the oldest event is overwritten
+    event = &trace_state.events[trace_state.next_event];
+    event->span        = span;
+    event->start_ns    = start_ns;
+    event->duration_ns = duration_ns;
+    trace_state.next_event = (trace_state.next_event + 1) % TRACE_MAX_EVENTS;
+    if(trace_state.num_events < TRACE_MAX_EVENTS)
+        trace_state.num_events++;
+}
+
+/*
+ * trace_reset()
+ */
+void trace_reset(void)
+{
+    memset(&trace_state, 0, sizeof(trace_state));
+}
+
+/*
+ * trace_histogram()
+ */
+TraceHistogram* trace_histogram(TraceSpan span)
+{
+    if(span >= TRACE_NUM_SPANS)
+        return NULL;
+
+    return &trace_state.histograms[span];
+}
+
+/*
+ * trace_num_events()
+ * Number of events held for the Chrome trace, at most TRACE_MAX_EVENTS
+ */
+uint32_t trace_num_events(void)
+{
+    return trace_state.num_events;
+}
+
+/*
+ * trace_write_json()
+ * Write a summary and the non empty buckets of every histogram. Each
+ * bucket is given by its upper bound in ns.
+ */
+void trace_write_json(FILE* fp)
+{
+    fprintf(fp, "{\"enabled\": %s, \"spans\": [", trace_enabled() ? "true" : "false");
+    for(uint32_t s = 0; s < TRACE_NUM_SPANS; ++s)
+    {
+        TraceHistogram* hist  = &trace_state.histograms[s];
+        int             first = 1;
+
+        fprintf(fp, "%s\n  {\"name\": \"%s\", \"count\": %lu, \"total_ns\": %lu, "
+                "\"min_ns\": %lu, \"max_ns\": %lu, \"mean_ns\": %lu, \"histogram\": [",
+                (s == 0) ? "" : ",",
+                trace_span_names[s],
+                (unsigned long) hist->count,
+                (unsigned long) hist->total_ns,
+                (unsigned long) hist->min_ns,
+                (unsigned long) hist->max_ns,
+                (unsigned long) ((hist->count > 0) ? hist->total_ns / hist->count : 0)
+        );
+        for(uint32_t b = 0; b < TRACE_HISTOGRAM_BUCKETS; ++b)
+        {
+            if(hist->buckets[b] == 0)
+                continue;
+            fprintf(fp, "%s{\"lt_ns\": %lu, \"count\": %lu}",
+                    first ? "" : ", ",
+                    (unsigned long) (1ULL << b),
+                    (unsigned long) hist->buckets[b]
+            );
+            first = 0;
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n]}\n");
+}
+
+/*
+ * trace_write_chrome()
+ * Write the recent events in the Chrome trace event format, which can be
+ * loaded into chrome://tracing or Perfetto. Times are in microseconds
+ * from the earliest event held. Events are recorded when they end, so 
+ * an enclosing span comes after the spans inside it.
+ */
+void trace_write_chrome(FILE* fp)
+{
+    uint32_t first;
+    uint64_t origin_ns = UINT64_MAX;
+
+    first = (trace_state.next_event + TRACE_MAX_EVENTS - trace_state.num_events) % TRACE_MAX_EVENTS;
+    for(uint32_t e = 0; e < trace_state.num_events; ++e)
+    {
+        if(trace_state.events[(first + e) % TRACE_MAX_EVENTS].start_ns < origin_ns)
+            origin_ns = trace_state.events[(first + e) % TRACE_MAX_EVENTS].start_ns;
+    }
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for(uint32_t e = 0; e < trace_state.num_events; ++e)
+    {
+        TraceEvent* event = &trace_state.events[(first + e) % TRACE_MAX_EVENTS];
+
+        fprintf(fp, "%s\n  {\"name\": \"%s\", \"cat\": \"sqclone\", \"ph\": \"X\", "
+                "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+                (e == 0) ? "" : ",",
+                trace_span_names[event->span],
+                (double) (event->start_ns - origin_ns) / 1000.0,
+                (double) event->duration_ns / 1000.0
+        );
+    }
+    fprintf(fp, "\n]}\n");
+}
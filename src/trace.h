@@ -0,0 +1,90 @@
+/*
+ * TRACE
+ * Span timing for the hot paths of a statement
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_TRACE_H
+#define __SQ_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Spans
+ * Each span is timed with the monotonic clock and added to a histogram
+ * for its kind, and to a ring of recent events for the Chrome trace.
+ * Spans nest, so a page read during a descent is counted in both.
+ *
+ *  statement   all of execute_statement()
+ *  parse       prepare_statement()
+ *  plan        choosing how to find the rows, including collecting the
+ *              ids that a delete or update will change
+ *  descend     walking the tree from the root to a leaf
+ *  page_read   reading a page that wasn't in the cache
+ *  cell_write  inserting, deleting or rewriting cells in the table and index
+ *  flush       writing a page back to the file
+ */
+typedef enum
+{
+    TRACE_STATEMENT,
+    TRACE_PARSE,
+    TRACE_PLAN,
+    TRACE_DESCEND,
+    TRACE_PAGE_READ,
+    TRACE_CELL_WRITE,
+    TRACE_FLUSH,
+    TRACE_NUM_SPANS
+} TraceSpan;
+
+/*
+ * Histograms are log scale. Bucket 0 holds spans that took under 1ns and
+ * bucket b holds spans from 2^(b-1) up to 2^b ns, so the last bucket
+ * starts at about 9 minutes.
+ */
+#define TRACE_HISTOGRAM_BUCKETS 40
+#define TRACE_MAX_EVENTS        4096
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[TRACE_HISTOGRAM_BUCKETS];
+} TraceHistogram;
+
+typedef struct
+{
+    TraceSpan span;
+    uint64_t  start_ns;
+    uint64_t  duration_ns;
+} TraceEvent;
+
+/*
+ * Instrumentation is compiled in with -DSQ_TRACE (make TRACE=1, the
+ * default). Without it TRACE_BEGIN() and TRACE_END() compile to nothing.
+ * A span has to begin and end in the same block.
+ */
+#ifdef SQ_TRACE
+#define TRACE_BEGIN(span) uint64_t span##_start_ns = trace_now()
+#define TRACE_END(span)   trace_record(span, span##_start_ns, trace_now())
+#else
+#define TRACE_BEGIN(span) do {} while(0)
+#define TRACE_END(span)   do {} while(0)
+#endif
+
+int         trace_enabled(void);
+const char* trace_span_name(TraceSpan span);
+uint64_t    trace_now(void);
+uint32_t    trace_bucket(uint64_t duration_ns);
+void        trace_record(TraceSpan span, uint64_t start_ns, uint64_t end_ns);
+void        trace_reset(void);
+TraceHistogram* trace_histogram(TraceSpan span);
+uint32_t    trace_num_events(void);
+void        trace_write_json(FILE* fp);
+void        trace_write_chrome(FILE* fp);
+
+
+#endif /*__SQ_TRACE_H*/
@@ -0,0 +1,431 @@
+/*
+ * VACUUM
+ * Rebuild a database file with its leaves packed and in key order
+ *
+ * The trees are bulk loaded into a new file next to the old one. Each 
+ * tree is written a level at a time from the bottom up, so the leaves of
+ * the table and then of the index each take up one run of pages in key
+ * order, and a scan reads the file front to back. Tables from the 
+ * catalog follow, then the catalog itself. Once the new file is
+ * on disk it is renamed over the old one, so the database is always 
+ * either the old file or the new one.
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "catalog.h"
+#include "index.h"
+#include "vacuum.h"
+
+
+/*
+ * vacuum_num_nodes()
+ * How many nodes to spread num_entries over so that each one has about
+ * target entries, without any node ending up with fewer than min_entries.
+ */
+static uint32_t vacuum_num_nodes(uint32_t num_entries, uint32_t target, uint32_t min_entries)
+{
+    uint32_t num_nodes;
+
+    num_nodes = (num_entries + target - 1) / target;
+    if(num_nodes > num_entries / min_entries)
+        num_nodes = num_entries / min_entries;
+
+    return (num_nodes > 0) ? num_nodes : 1;
+}
+
+/*
+ * vacuum_fill()
+ * Number of entries per node for a fill factor
+ */
+static uint32_t vacuum_fill(uint32_t max_entries, uint32_t min_entries, uint32_t fill_factor)
+{
+    uint32_t target = (max_entries * fill_factor) / 100;
+
+    return (target > min_entries) ? target : min_entries;
+}
+
+/*
+ * vacuum_new_page()
+ * The new file has no free pages so every page goes on the end. At a low
+ * fill factor the new file can be larger than the old one.
+ */
+static void* vacuum_new_page(Pager* pager, uint32_t* page_num)
+{
+    if(pager->num_pages >= TABLE_MAX_PAGES)
+        return NULL;
+    *page_num = get_unused_page_num(pager);
+
+    return get_page(pager, *page_num);
+}
+
+/*
+ * vacuum_build_internal()
+ * Build the internal levels of a tree over a row of children, given by
+ * their page numbers and largest keys. Levels are added until all the
+ * children fit under the root, which always goes in root_page_num.
+ */
+static VacuumResult vacuum_build_internal(Pager* pager, uint32_t root_page_num, uint32_t* pages, uint8_t* keys, uint32_t num_children, int is_index, uint32_t fill_factor)
+{
+    uint32_t key_size;
+    uint32_t max_children;
+    uint32_t min_children;
+
+    key_size     = is_index ? INDEX_KEY_SIZE : INTERNAL_NODE_KEY_SIZE;
+    max_children = (is_index ? INDEX_INTERNAL_NODE_MAX_CELLS : INTERNAL_NODE_MAX_CELLS) + 1;
+    min_children = (is_index ? INDEX_INTERNAL_NODE_MIN_KEYS : INTERNAL_NODE_MIN_KEYS) + 1;
+
+    while(1)
+    {
+        uint32_t num_nodes;
+        uint32_t child = 0;
+        int      is_root;
+
+        is_root   = (num_children <= max_children);
+        num_nodes = is_root ? 1 : vacuum_num_nodes(
+                num_children, 
+                vacuum_fill(max_children, min_children, fill_factor),
+                min_children
+        );
+
+        for(uint32_t n = 0; n < num_nodes; ++n)
+        {
+            uint32_t page_num;
+            uint32_t count;
+            void*    node;
+
+            count    = num_children / num_nodes + ((n < num_children % num_nodes) ? 1 : 0);
+            page_num = root_page_num;
+            node     = is_root ? get_page(pager, page_num) : vacuum_new_page(pager, &page_num);
+            if(!node)
+                return VACUUM_TABLE_FULL;
+            init_internal_node(node);
+            set_node_root(node, is_root);
+
+            // All but the last child get a cell, the last is the right child
+            *internal_node_num_keys(node) = count - 1;
+            for(uint32_t c = 0; c < count; ++c, ++child)
+            {
+                *node_parent(get_page(pager, pages[child])) = page_num;
+                if(c == count - 1)
+                    *internal_node_right_child(node) = pages[child];
+                else if(is_index)
+                {
+                    *index_internal_node_child(node, c) = pages[child];
+                    memcpy(index_internal_node_key(node, c), keys + child * key_size, key_size);
+                }
+                else
+                {
+                    *internal_node_child(node, c) = pages[child];
+                    memcpy(internal_node_key(node, c), keys + child * key_size, key_size);
+                }
+            }
+
+            // This level becomes the row of children for the next one. 
+            // Node n never overwrites an entry that hasn't been read yet.
+            pages[n] = page_num;
+            memmove(keys + n * key_size, keys + (child - 1) * key_size, key_size);
+        }
+        if(is_root)
+            return VACUUM_SUCCESS;
+        num_children = num_nodes;
+    }
+}
+
+/*
+ * vacuum_count_entries()
+ * Number of cells across all the leaves of a tree. Every leaf is read
+ * here first, so a page that can't be read stops the vacuum before 
+ * anything is copied.
+ */
+static uint32_t vacuum_count_entries(Pager* pager, uint32_t root_page_num, int is_index)
+{
+    void*    node;
+    uint32_t count = 0;
+
+    node = get_page(pager, root_page_num);
+    while(node && get_node_type(node) == NODE_INTERNAL)
+    {
+        node = get_page(pager, is_index ? 
+                *index_internal_node_child(node, 0) : *internal_node_child(node, 0));
+    }
+    while(node)
+    {
+        count += *leaf_node_num_cells(node);
+        if(*leaf_node_next_leaf(node) == 0)
+            break;
+        node = get_page(pager, *leaf_node_next_leaf(node));
+    }
+
+    return count;
+}
+
+/*
+ * vacuum_build_tree()
+ * Copy every entry of one of the trees in table into new leaves, in 
+ * order, then build the internal nodes above them. The new root goes in
+ * root_page_num, which must already be in the new file. Table leaves 
+ * keep the layout of the old tree.
+ */
+static VacuumResult vacuum_build_tree(Table* table, Pager* pager, int is_index, uint32_t fill_factor, uint32_t root_page_num)
+{
+    uint32_t  num_entries;
+    uint32_t  num_leaves;
+    uint32_t  max_cells;
+    uint32_t  min_cells;
+    uint32_t  key_size;
+    uint32_t* pages;
+    uint8_t*  keys;
+    Cursor*   cursor;
+    LeafLayout layout;
+    VacuumResult result = VACUUM_SUCCESS;
+
+    max_cells     = is_index ? INDEX_LEAF_NODE_MAX_CELLS : LEAF_NODE_MAX_CELLS;
+    min_cells     = is_index ? INDEX_LEAF_NODE_MIN_CELLS : LEAF_NODE_MIN_CELLS;
+    key_size      = is_index ? INDEX_KEY_SIZE : LEAF_NODE_KEY_SIZE;
+    num_entries   = vacuum_count_entries(table->pager, 
+            is_index ? table->index_root_page_num : table->root_page_num, is_index);
+    if(table->pager->read_error != PAGE_READ_OK)
+        return VACUUM_IO_ERROR;
+    num_leaves    = (num_entries <= max_cells) ? 1 : vacuum_num_nodes(
+            num_entries, 
+            vacuum_fill(max_cells, min_cells, fill_factor), 
+            min_cells
+    );
+
+    pages = malloc(num_leaves * sizeof(uint32_t));
+    keys  = malloc(num_leaves * key_size);
+    if(!pages || !keys)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for %d leaves\n", __func__, num_leaves);
+        free(pages);
+        free(keys);
+        return VACUUM_IO_ERROR;
+    }
+
+    // With a single leaf the leaf is the root. Otherwise nothing else is
+    // allocated while the leaves are written, so they take up one run of 
+    // pages in key order.
+    cursor = is_index ? index_find(table, "", 0) : table_start(table);
+    if(!cursor)
+    {
+        free(pages);
+        free(keys);
+        return VACUUM_IO_ERROR;
+    }
+    layout = leaf_node_layout(get_page(table->pager, cursor->page_num));
+    for(uint32_t n = 0; n < num_leaves; ++n)
+    {
+        uint32_t count;
+        void*    node;
+        void*    src;
+
+        pages[n] = root_page_num;
+        node     = (num_leaves == 1) ? get_page(pager, pages[n]) : vacuum_new_page(pager, &pages[n]);
+        if(!node)
+        {
+            result = VACUUM_TABLE_FULL;
+            break;
+        }
+        init_leaf_node_value(node);
+        set_node_root(node, num_leaves == 1);
+        if(!is_index)
+            leaf_node_set_layout(node, layout);
+        if(n > 0)
+            *leaf_node_next_leaf(get_page(pager, pages[n-1])) = pages[n];
+
+        count = num_entries / num_leaves + ((n < num_entries % num_leaves) ? 1 : 0);
+        for(uint32_t c = 0; c < count; ++c)
+        {
+            src = get_page(table->pager, cursor->page_num);
+            if(is_index)
+            {
+                memcpy(
+                    index_leaf_node_key(node, c), 
+                    index_leaf_node_key(src, cursor->cell_num), 
+                    INDEX_LEAF_NODE_CELL_SIZE
+                );
+            }
+            else
+                leaf_node_move_cells(node, c, src, cursor->cell_num, 1);
+            cursor_advance(cursor);
+        }
+        *leaf_node_num_cells(node) = count;
+        if(!is_index)
+            leaf_node_summary_rebuild(node);
+
+        if(count > 0)
+        {
+            memcpy(
+                keys + n * key_size, 
+                is_index ? index_leaf_node_key(node, count - 1) : (void*) leaf_node_key(node, count - 1),
+                key_size
+            );
+        }
+    }
+
+    if(result == VACUUM_SUCCESS && num_leaves > 1)
+        result = vacuum_build_internal(pager, root_page_num, pages, keys, num_leaves, is_index, fill_factor);
+
+    free(pages);
+    free(keys);
+
+    return result;
+}
+
+/*
+ * vacuum_build_catalog()
+ * Rebuild every table in the catalog and then the catalog, whose records
+ * are changed to point at the new roots. Roots were set aside at the 
+ * front of the file, the catalog's first and then one for each table.
+ */
+static VacuumResult vacuum_build_catalog(Catalog* catalog, Pager* pager, uint32_t fill_factor, uint32_t* root_page_nums)
+{
+    Table*       tree;
+    Cursor*      cursor;
+    VacuumResult result;
+
+    for(uint32_t t = 0; t < catalog->num_tables; ++t)
+    {
+        result = vacuum_build_tree(catalog->tables[t].table, pager, 0, fill_factor, root_page_nums[t + 1]);
+        if(result != VACUUM_SUCCESS)
+            return result;
+    }
+    result = vacuum_build_tree(catalog->tree, pager, 0, fill_factor, root_page_nums[0]);
+    if(result != VACUUM_SUCCESS)
+        return result;
+
+    tree   = table_open_tree(pager, root_page_nums[0]);
+    cursor = table_start(tree);
+    while(!(cursor->end_of_table))
+    {
+        uint32_t table_id = *leaf_node_key(get_page(pager, cursor->page_num), cursor->cell_num);
+
+        for(uint32_t t = 0; t < catalog->num_tables; ++t)
+        {
+            if(catalog->tables[t].table_id == table_id)
+                memcpy(cursor_value(cursor) + CATALOG_RECORD_ROOT_OFFSET, &root_page_nums[t + 1], sizeof(uint32_t));
+        }
+        cursor_advance(cursor);
+    }
+    table_close_tree(tree);
+
+    return VACUUM_SUCCESS;
+}
+
+/*
+ * db_vacuum()
+ * Rebuild the table and the index into a new file and swap it in for 
+ * the current one. The table then uses a pager on the new file.
+ */
+VacuumResult db_vacuum(Table* table, uint32_t fill_factor, VacuumStats* stats)
+{
+    char*        new_filename;
+    Pager*       old_pager;
+    Pager*       new_pager;
+    VacuumResult result;
+    Catalog*     catalog;
+    uint32_t     catalog_roots[CATALOG_MAX_TABLES + 1];
+
+    if(fill_factor == 0 || fill_factor > 100)
+        return VACUUM_BAD_FILL_FACTOR;
+    if(table->pager->in_transaction)
+        return VACUUM_IN_TRANSACTION;
+    table->pager->read_error = PAGE_READ_OK;
+    catalog = catalog_get(table);
+    if(table->pager->read_error != PAGE_READ_OK)
+        return VACUUM_IO_ERROR;
+
+    old_pager    = table->pager;
+    new_filename = malloc(strlen(old_pager->filename) + strlen(VACUUM_FILE_SUFFIX) + 1);
+    if(!new_filename)
+    {
+        fprintf(stderr, "[%s] failed to allocate memory for file name\n", __func__);
+        return VACUUM_IO_ERROR;
+    }
+    sprintf(new_filename, "%s%s", old_pager->filename, VACUUM_FILE_SUFFIX);
+
+    // Left over from a vacuum that didn't finish
+    remove(new_filename);
+    new_pager = pager_open_with_flags(new_filename, old_pager->direct_io ? DB_OPEN_DIRECT_IO : 0);
+    if(!new_pager)
+    {
+        free(new_filename);
+        return VACUUM_IO_ERROR;
+    }
+
+    // The new file has the same header and roots as a fresh database, and
+    // is compressed if the old one was. Files from before checksums get 
+    // them here.
+    init_db_header(get_page(new_pager, DB_HEADER_PAGE_NUM));
+    *db_header_flags(get_page(new_pager, DB_HEADER_PAGE_NUM)) |= 
+        *db_header_flags(get_page(old_pager, DB_HEADER_PAGE_NUM));
+    new_pager->compressed = old_pager->compressed;
+    new_pager->checksums  = 1;
+    get_page(new_pager, TABLE_ROOT_PAGE_NUM);
+    get_page(new_pager, INDEX_ROOT_PAGE_NUM);
+    if(catalog->tree)
+    {
+        for(uint32_t r = 0; r <= catalog->num_tables; ++r)
+        {
+            catalog_roots[r] = INDEX_ROOT_PAGE_NUM + 1 + r;
+            get_page(new_pager, catalog_roots[r]);
+        }
+        *db_header_catalog_root(get_page(new_pager, DB_HEADER_PAGE_NUM)) = catalog_roots[0];
+    }
+
+    result = vacuum_build_tree(table, new_pager, 0, fill_factor, TABLE_ROOT_PAGE_NUM);
+    if(result == VACUUM_SUCCESS)
+        result = vacuum_build_tree(table, new_pager, 1, fill_factor, INDEX_ROOT_PAGE_NUM);
+    if(result == VACUUM_SUCCESS && catalog->tree)
+        result = vacuum_build_catalog(catalog, new_pager, fill_factor, catalog_roots);
+    if(result == VACUUM_SUCCESS)
+    {
+        pager_flush_all(new_pager);
+        if(fsync(new_pager->fd) != 0)
+            result = VACUUM_IO_ERROR;
+    }
+    if(result != VACUUM_SUCCESS)
+    {
+        pager_close(new_pager);
+        remove(new_filename);
+        free(new_filename);
+        return result;
+    }
+
+    // rename() replaces the old file in one step
+    if(rename(new_filename, old_pager->filename) != 0)
+    {
+        fprintf(stderr, "[%s] failed to rename [%s] to [%s]\n", 
+                __func__, new_filename, old_pager->filename);
+        pager_close(new_pager);
+        remove(new_filename);
+        free(new_filename);
+        return VACUUM_IO_ERROR;
+    }
+    free(new_filename);
+    free(new_pager->filename);
+    new_pager->filename = old_pager->filename;
+    old_pager->filename = NULL;
+
+    if(stats)
+    {
+        stats->old_size = pager_file_size(old_pager);
+        stats->new_size = pager_file_size(new_pager);
+    }
+    // Pages of the old file are dropped rather than written, the file 
+    // they belong to is gone. The catalog is read again from the new file.
+    catalog_free(table->catalog);
+    table->catalog = NULL;
+    pager_close(old_pager);
+    table->pager               = new_pager;
+    table->root_page_num       = *db_header_table_root(get_page(new_pager, DB_HEADER_PAGE_NUM));
+    table->index_root_page_num = *db_header_index_root(get_page(new_pager, DB_HEADER_PAGE_NUM));
+    table->rightmost_leaf      = INVALID_PAGE_NUM;
+
+    return VACUUM_SUCCESS;
+}
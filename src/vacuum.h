@@ -0,0 +1,37 @@
+/*
+ * VACUUM
+ * Rebuild a database file with its leaves packed and in key order
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_VACUUM_H
+#define __SQ_VACUUM_H
+
+#include <stdint.h>
+#include "table.h"
+
+// Percentage of each node that is filled when the trees are rebuilt. 
+// Leaving some room means the first few inserts don't split every leaf.
+#define VACUUM_DEFAULT_FILL_FACTOR 90
+#define VACUUM_FILE_SUFFIX         ".vacuum"
+
+typedef enum
+{
+    VACUUM_SUCCESS,
+    VACUUM_BAD_FILL_FACTOR,
+    VACUUM_TABLE_FULL,      // the rebuilt file would need more than TABLE_MAX_PAGES
+    VACUUM_IO_ERROR,
+    VACUUM_IN_TRANSACTION   // the file can't be replaced until the transaction ends
+} VacuumResult;
+
+typedef struct
+{
+    uint64_t old_size;      // bytes
+    uint64_t new_size;
+} VacuumStats;
+
+VacuumResult db_vacuum(Table* table, uint32_t fill_factor, VacuumStats* stats);
+
+
+#endif /*__SQ_VACUUM_H*/
@@ -0,0 +1,398 @@
+/*
+ * WORKLOAD
+ * Record the statements given to the REPL and replay them later
+ *
+ * Stefan Wong 2020
+ */
+
+// for nanosleep()
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "input.h"
+#include "trace.h"
+#include "workload.h"
+
+static const char* replay_type_names[REPLAY_NUM_TYPES] = {
+    "insert",
+    "select",
+    "delete",
+    "update",
+    "all"
+};
+
+
+// ================ LOG
+
+/*
+ * write_varint()
+ */
+static int write_varint(FILE* fp, uint64_t value)
+{
+    uint8_t  buf[10];
+    uint32_t len = 0;
+
+    do
+    {
+        buf[len] = value & 0x7F;
+        value >>= 7;
+        if(value)
+            buf[len] |= 0x80;
+        len++;
+    } while(value);
+
+    return fwrite(buf, 1, len, fp) == len;
+}
+
+/*
+ * read_varint()
+ * Returns WORKLOAD_END if the file ends before the first byte
+ */
+static WorkloadResult read_varint(FILE* fp, uint64_t* value)
+{
+    int c;
+
+    *value = 0;
+    for(uint32_t shift = 0; shift < 64; shift += 7)
+    {
+        c = fgetc(fp);
+        if(c == EOF)
+            return (shift == 0 && !ferror(fp)) ? WORKLOAD_END : WORKLOAD_CORRUPT;
+        *value |= (uint64_t) (c & 0x7F) << shift;
+        if((c & 0x80) == 0)
+            return WORKLOAD_OK;
+    }
+
+    return WORKLOAD_CORRUPT;
+}
+
+/*
+ * workload_writer_open()
+ * Create the log, replacing any file of the same name
+ */
+WorkloadResult workload_writer_open(WorkloadWriter* writer, const char* filename)
+{
+    writer->fp      = fopen(filename, "wb");
+    writer->last_ns = 0;
+    if(!writer->fp)
+    {
+        fprintf(stderr, "[%s] unable to create workload log [%s]\n", __func__, filename);
+        return WORKLOAD_IO_ERROR;
+    }
+    if(fwrite(WORKLOAD_MAGIC, 1, WORKLOAD_MAGIC_SIZE, writer->fp) != WORKLOAD_MAGIC_SIZE ||
+       !write_varint(writer->fp, WORKLOAD_VERSION))
+    {
+        fclose(writer->fp);
+        writer->fp = NULL;
+        return WORKLOAD_IO_ERROR;
+    }
+
+    return WORKLOAD_OK;
+}
+
+/*
+ * workload_record()
+ * The first record is at time 0, and every record after it is stored as
+ * the time since the one before.
+ */
+WorkloadResult workload_record(WorkloadWriter* writer, const char* text, uint32_t length, uint64_t time_ns)
+{
+    uint64_t delta_ns = 0;
+
+    if(!writer->fp)
+        return WORKLOAD_IO_ERROR;
+    if(length > WORKLOAD_MAX_STATEMENT)
+        length = WORKLOAD_MAX_STATEMENT;
+    if(writer->last_ns != 0 && time_ns > writer->last_ns)
+        delta_ns = time_ns - writer->last_ns;
+    writer->last_ns = time_ns;
+
+    if(!write_varint(writer->fp, delta_ns) ||
+       !write_varint(writer->fp, length) ||
+       fwrite(text, 1, length, writer->fp) != length)
+        return WORKLOAD_IO_ERROR;
+
+    return WORKLOAD_OK;
+}
+
+/*
+ * workload_writer_close()
+ */
+void workload_writer_close(WorkloadWriter* writer)
+{
+    if(writer->fp)
+        fclose(writer->fp);
+    writer->fp = NULL;
+}
+
+/*
+ * workload_reader_open()
+ */
+WorkloadResult workload_reader_open(WorkloadReader* reader, const char* filename)
+{
+    char     magic[WORKLOAD_MAGIC_SIZE];
+    uint64_t version;
+
+    reader->fp      = fopen(filename, "rb");
+    reader->time_ns = 0;
+    if(!reader->fp)
+    {
+        fprintf(stderr, "[%s] unable to open workload log [%s]\n", __func__, filename);
+        return WORKLOAD_IO_ERROR;
+    }
+    if(fread(magic, 1, WORKLOAD_MAGIC_SIZE, reader->fp) != WORKLOAD_MAGIC_SIZE ||
+       memcmp(magic, WORKLOAD_MAGIC, WORKLOAD_MAGIC_SIZE) != 0 ||
+       read_varint(reader->fp, &version) != WORKLOAD_OK ||
+       version != WORKLOAD_VERSION)
+    {
+        fprintf(stderr, "[%s] [%s] is not a workload log this version can read\n", __func__, filename);
+        workload_reader_close(reader);
+        return WORKLOAD_CORRUPT;
+    }
+
+    return WORKLOAD_OK;
+}
+
+/*
+ * workload_next()
+ * Read the next statement into text, which must hold at least
+ * WORKLOAD_MAX_STATEMENT + 1 bytes. The text is terminated and the
+ * time of the record is left in reader->time_ns.
+ */
+WorkloadResult workload_next(WorkloadReader* reader, char* text, uint32_t* length)
+{
+    WorkloadResult result;
+    uint64_t       delta_ns;
+    uint64_t       text_length;
+
+    result = read_varint(reader->fp, &delta_ns);
+    if(result != WORKLOAD_OK)
+        return result;
+    if(read_varint(reader->fp, &text_length) != WORKLOAD_OK || text_length > WORKLOAD_MAX_STATEMENT)
+        return WORKLOAD_CORRUPT;
+    if(fread(text, 1, text_length, reader->fp) != text_length)
+        return WORKLOAD_CORRUPT;
+
+    text[text_length] = '\0';
+    *length           = (uint32_t) text_length;
+    reader->time_ns  += delta_ns;
+
+    return WORKLOAD_OK;
+}
+
+/*
+ * workload_reader_close()
+ */
+void workload_reader_close(WorkloadReader* reader)
+{
+    if(reader->fp)
+        fclose(reader->fp);
+    reader->fp = NULL;
+}
+
+
+// ================ REPLAY
+
+/*
+ * replay_add_latency()
+ */
+static void replay_add_latency(ReplayStats* stats, ReplayType type, uint64_t latency_ns)
+{
+    if(stats->num_latencies[type] == stats->cap_latencies[type])
+    {
+        uint64_t  capacity = (stats->cap_latencies[type] == 0) ? 1024 : 2 * stats->cap_latencies[type];
+        uint64_t* latencies;
+
+        latencies = realloc(stats->latencies[type], capacity * sizeof(uint64_t));
+        if(!latencies)
+        {
+            fprintf(stderr, "[%s] failed to allocate memory for latencies\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+        stats->latencies[type]     = latencies;
+        stats->cap_latencies[type] = capacity;
+    }
+    stats->latencies[type][stats->num_latencies[type]++] = latency_ns;
+}
+
+/*
+ * replay_type()
+ */
+static ReplayType replay_type(StatementType type)
+{
+    switch(type)
+    {
+        case STATEMENT_INSERT:
+            return REPLAY_INSERT;
+        case STATEMENT_SELECT:
+            return REPLAY_SELECT;
+        case STATEMENT_DELETE:
+            return REPLAY_DELETE;
+        case STATEMENT_UPDATE:
+            return REPLAY_UPDATE;
+        case STATEMENT_CREATE_TABLE:
+        case STATEMENT_BEGIN:
+        case STATEMENT_COMMIT:
+        case STATEMENT_ROLLBACK:
+            break;
+    }
+
+    return REPLAY_ALL;
+}
+
+/*
+ * compare_latency()
+ */
+static int compare_latency(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * workload_replay()
+ */
+WorkloadResult workload_replay(Table* table, WorkloadReader* reader, ReplayOptions* options, ReplayStats* stats)
+{
+    char           text[WORKLOAD_MAX_STATEMENT + 1];
+    uint32_t       length;
+    InputBuffer    input_buffer;
+    Statement      statement;
+    WorkloadResult result;
+    uint64_t       start_ns;
+
+    memset(stats, 0, sizeof(ReplayStats));
+    input_buffer.buffer        = text;
+    input_buffer.buffer_length = sizeof(text);
+    input_buffer.recorder      = NULL;
+
+    start_ns = trace_now();
+    while((result = workload_next(reader, text, &length)) == WORKLOAD_OK)
+    {
+        PrepareResult prep_result;
+        ExecuteResult exec_result = EXECUTE_SUCCESS;
+        uint64_t      begin_ns;
+        uint64_t      end_ns;
+
+        if(options->paced)
+        {
+            uint64_t now_ns = trace_now() - start_ns;
+
+            if(now_ns < reader->time_ns)
+            {
+                struct timespec wait;
+
+                wait.tv_sec  = (reader->time_ns - now_ns) / 1000000000ULL;
+                wait.tv_nsec = (reader->time_ns - now_ns) % 1000000000ULL;
+                nanosleep(&wait, NULL);
+            }
+            else if(now_ns - reader->time_ns > stats->max_lag_ns)
+                stats->max_lag_ns = now_ns - reader->time_ns;
+        }
+        if(text[0] == '.')
+        {
+            stats->num_skipped++;
+            continue;
+        }
+
+        input_buffer.input_length = length;
+        begin_ns    = trace_now();
+        prep_result = prepare_statement(&input_buffer, &statement);
+        if(prep_result == PREPARE_SUCCESS)
+            exec_result = execute_statement(&statement, table);
+        end_ns      = trace_now();
+
+        stats->num_statements++;
+        if(prep_result != PREPARE_SUCCESS || exec_result != EXECUTE_SUCCESS)
+            stats->num_failed++;
+        if(prep_result == PREPARE_SUCCESS && replay_type(statement.type) != REPLAY_ALL)
+            replay_add_latency(stats, replay_type(statement.type), end_ns - begin_ns);
+        replay_add_latency(stats, REPLAY_ALL, end_ns - begin_ns);
+    }
+    stats->elapsed_ns = trace_now() - start_ns;
+
+    for(uint32_t t = 0; t < REPLAY_NUM_TYPES; ++t)
+    {
+        if(stats->num_latencies[t] > 0)
+            qsort(stats->latencies[t], stats->num_latencies[t], sizeof(uint64_t), compare_latency);
+    }
+
+    return (result == WORKLOAD_END) ? WORKLOAD_OK : result;
+}
+
+/*
+ * replay_percentile()
+ * Latency in ns that the given fraction of statements finished within,
+ * using the nearest rank
+ */
+uint64_t replay_percentile(ReplayStats* stats, ReplayType type, double fraction)
+{
+    uint64_t rank;
+
+    if(stats->num_latencies[type] == 0)
+        return 0;
+    rank = (uint64_t) (fraction * stats->num_latencies[type] + 0.999999);
+    if(rank == 0)
+        rank = 1;
+    if(rank > stats->num_latencies[type])
+        rank = stats->num_latencies[type];
+
+    return stats->latencies[type][rank - 1];
+}
+
+/*
+ * replay_print_report()
+ */
+void replay_print_report(ReplayStats* stats, FILE* fp)
+{
+    double seconds = (double) stats->elapsed_ns / 1e9;
+
+    fprintf(fp, "Replayed %lu statements in %.3f s (%.0f statements/s), %lu failed, %lu meta commands skipped\n",
+            (unsigned long) stats->num_statements,
+            seconds,
+            (seconds > 0.0) ? (double) stats->num_statements / seconds : 0.0,
+            (unsigned long) stats->num_failed,
+            (unsigned long) stats->num_skipped
+    );
+    fprintf(fp, "latency (us)     count       mean        p50        p90        p99      p99.9        max\n");
+    for(uint32_t t = 0; t < REPLAY_NUM_TYPES; ++t)
+    {
+        uint64_t total_ns = 0;
+        uint64_t count    = stats->num_latencies[t];
+
+        if(count == 0)
+            continue;
+        for(uint64_t i = 0; i < count; ++i)
+            total_ns += stats->latencies[t][i];
+        fprintf(fp, "%-10s %11lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                replay_type_names[t],
+                (unsigned long) count,
+                (double) total_ns / count / 1e3,
+                replay_percentile(stats, t, 0.50) / 1e3,
+                replay_percentile(stats, t, 0.90) / 1e3,
+                replay_percentile(stats, t, 0.99) / 1e3,
+                replay_percentile(stats, t, 0.999) / 1e3,
+                stats->latencies[t][count - 1] / 1e3
+        );
+    }
+    if(stats->max_lag_ns > 0)
+        fprintf(fp, "Fell up to %.1f us behind the recorded pace\n", stats->max_lag_ns / 1e3);
+}
+
+/*
+ * replay_stats_free()
+ */
+void replay_stats_free(ReplayStats* stats)
+{
+    for(uint32_t t = 0; t < REPLAY_NUM_TYPES; ++t)
+    {
+        free(stats->latencies[t]);
+        stats->latencies[t]     = NULL;
+        stats->num_latencies[t] = 0;
+        stats->cap_latencies[t] = 0;
+    }
+}
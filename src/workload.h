@@ -0,0 +1,97 @@
+/*
+ * WORKLOAD
+ * Record the statements given to the REPL and replay them later
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_WORKLOAD_H
+#define __SQ_WORKLOAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "table.h"
+
+/*
+ * Log Format
+ * A header of the magic "sqwl" and a version, then one record per input
+ * line. Each record is the time since the previous record in ns and the
+ * length of the line, both as unsigned LEB128 varints, then the line
+ * itself without its newline. A typical statement costs three or four
+ * bytes on top of its text.
+ */
+#define WORKLOAD_MAGIC          "sqwl"
+#define WORKLOAD_MAGIC_SIZE     4
+#define WORKLOAD_VERSION        1
+#define WORKLOAD_MAX_STATEMENT  4096
+
+typedef enum
+{
+    WORKLOAD_OK,
+    WORKLOAD_END,               // no more records
+    WORKLOAD_IO_ERROR,
+    WORKLOAD_CORRUPT            // bad header, or a record cut short
+} WorkloadResult;
+
+typedef struct
+{
+    FILE*    fp;
+    uint64_t last_ns;           // time of the previous record
+} WorkloadWriter;
+
+typedef struct
+{
+    FILE*    fp;
+    uint64_t time_ns;           // time of the last record read, from the first
+} WorkloadReader;
+
+WorkloadResult workload_writer_open(WorkloadWriter* writer, const char* filename);
+WorkloadResult workload_record(WorkloadWriter* writer, const char* text, uint32_t length, uint64_t time_ns);
+void           workload_writer_close(WorkloadWriter* writer);
+
+WorkloadResult workload_reader_open(WorkloadReader* reader, const char* filename);
+WorkloadResult workload_next(WorkloadReader* reader, char* text, uint32_t* length);
+void           workload_reader_close(WorkloadReader* reader);
+
+/*
+ * Replay
+ * Statements are run through prepare_statement() and execute_statement()
+ * back to back, or at the pace they were recorded at. Meta commands are
+ * counted and skipped, since .exit and .vacuum would end or reshape the
+ * run. The latency of every statement is kept for the report.
+ */
+typedef struct
+{
+    int paced;                  // wait until each statement's recorded time
+} ReplayOptions;
+
+// Latencies are kept for each kind of statement and for all of them
+typedef enum
+{
+    REPLAY_INSERT,
+    REPLAY_SELECT,
+    REPLAY_DELETE,
+    REPLAY_UPDATE,
+    REPLAY_ALL,
+    REPLAY_NUM_TYPES
+} ReplayType;
+
+typedef struct
+{
+    uint64_t  num_statements;   // prepared and executed, whatever the result
+    uint64_t  num_failed;       // didn't prepare or didn't execute successfully
+    uint64_t  num_skipped;      // meta commands
+    uint64_t  elapsed_ns;
+    uint64_t  max_lag_ns;       // furthest behind the recorded pace
+    uint64_t* latencies[REPLAY_NUM_TYPES];     // ns, sorted once the replay ends
+    uint64_t  num_latencies[REPLAY_NUM_TYPES];
+    uint64_t  cap_latencies[REPLAY_NUM_TYPES];
+} ReplayStats;
+
+WorkloadResult workload_replay(Table* table, WorkloadReader* reader, ReplayOptions* options, ReplayStats* stats);
+uint64_t       replay_percentile(ReplayStats* stats, ReplayType type, double fraction);
+void           replay_print_report(ReplayStats* stats, FILE* fp);
+void           replay_stats_free(ReplayStats* stats);
+
+
+#endif /*__SQ_WORKLOAD_H*/
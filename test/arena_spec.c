@@ -0,0 +1,120 @@
+/*
+ * ARENA_SPEC
+ * BDD test for the statement arena and page frame pool
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>     // for sysconf()
+
+// units under test
+#include "arena.h"
+#include "input.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+
+spec("arena")
+{
+    static const char* test_db_name = "test/test_arena.db";
+
+    it("hands out aligned memory and reuses it after a reset")
+    {
+        Arena  arena;
+        void*  first;
+        void*  ptr;
+        size_t capacity;
+
+        arena_init(&arena, 1024);
+        check(arena_capacity(&arena) == 0);
+
+        first = arena_alloc(&arena, 3);
+        check(first != NULL);
+        check(((uintptr_t) first % ARENA_ALIGN) == 0);
+        ptr = arena_alloc(&arena, 5);
+        check(((uintptr_t) ptr % ARENA_ALIGN) == 0);
+        check((char*) ptr == (char*) first + ARENA_ALIGN);
+
+        // Fill several blocks, then do the same again after a reset
+        for(int i = 0; i < 200; ++i)
+            memset(arena_alloc(&arena, 40), 0xAB, 40);
+        capacity = arena_capacity(&arena);
+        check(capacity >= 200 * 48);
+        for(int round = 0; round < 10; ++round)
+        {
+            arena_reset(&arena);
+            check(arena_alloc(&arena, 3) == first);
+            for(int i = 0; i < 200; ++i)
+                memset(arena_alloc(&arena, 40), 0xCD, 40);
+            check(arena_capacity(&arena) == capacity);
+        }
+
+        // Bigger than a block gets a block of its own
+        ptr = arena_alloc(&arena, 4096);
+        check(ptr != NULL);
+        check(((uintptr_t) ptr % ARENA_ALIGN) == 0);
+        memset(ptr, 0, 4096);
+        check(arena_capacity(&arena) >= capacity + 4096);
+
+        arena_destroy(&arena);
+        check(arena_capacity(&arena) == 0);
+    }
+
+    it("gives each page its own aligned frame")
+    {
+        FramePool pool;
+
+        check(frame_pool_init(&pool, PAGE_SIZE, TABLE_MAX_PAGES) == 0);
+        check(pool.mapped_size >= (size_t) PAGE_SIZE * TABLE_MAX_PAGES);
+        // The mapping is aligned to the OS page, which O_DIRECT needs. A
+        // larger PAGE_SIZE is a multiple of it, so every frame is as well.
+        check(((uintptr_t) frame_pool_frame(&pool, 0) % sysconf(_SC_PAGESIZE)) == 0);
+        for(uint32_t n = 1; n < TABLE_MAX_PAGES; n += 7)
+            check((char*) frame_pool_frame(&pool, n) == (char*) pool.base + (size_t) n * PAGE_SIZE);
+        check(frame_pool_frame(&pool, TABLE_MAX_PAGES) == NULL);
+
+        // Frames start out zeroed and can be written all the way through
+        check(*(uint8_t*) frame_pool_frame(&pool, TABLE_MAX_PAGES - 1) == 0);
+        memset(frame_pool_frame(&pool, TABLE_MAX_PAGES - 1), 0xFF, PAGE_SIZE);
+        frame_pool_destroy(&pool);
+        check(pool.base == NULL);
+    }
+
+    it("doesn't grow the table arena across statements")
+    {
+        char    input[256];
+        Table*  table;
+        size_t  capacity;
+
+        remove(test_db_name);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        for(int i = 1; i <= 300; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+        }
+        check(run_statement(table, "update set username = someone where id > 0", NULL, 0) == EXECUTE_SUCCESS);
+        capacity = arena_capacity(&table->arena);
+        check(capacity > 0);
+
+        for(int i = 0; i < 50; ++i)
+        {
+            check(run_statement(table, "select count(*) where email >= email1", NULL, 0) == EXECUTE_SUCCESS);
+            check(run_statement(table, "update set username = someone where id > 0", NULL, 0) == EXECUTE_SUCCESS);
+            sprintf(input, "insert %d user email@domain.net", 1000 + i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+            sprintf(input, "delete where id = %d", 1000 + i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+        }
+        check(arena_capacity(&table->arena) == capacity);
+        db_close(table);
+        remove(test_db_name);
+    }
+}
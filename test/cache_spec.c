@@ -0,0 +1,149 @@
+/*
+ * CACHE_SPEC
+ * BDD test for the select result cache
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "cache.h"
+#include "input.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+
+spec("cache")
+{
+    static const char* test_db_name = "test/test_cache.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("normalizes statement text")
+    {
+        char key[32];
+
+        check(cache_normalize("  select   id\twhere id = 1 \n", key, sizeof(key)) == strlen("select id where id = 1"));
+        check(strcmp(key, "select id where id = 1") == 0);
+        check(cache_normalize("select", key, sizeof(key)) == 6);
+        check(cache_normalize("   ", key, sizeof(key)) == 0);
+        check(strcmp(key, "") == 0);
+        // too long to be a key
+        check(cache_normalize("select id, username, email where id = 1", key, sizeof(key)) == 0);
+        check(strcmp(key, "") == 0);
+    }
+
+    it("evicts the least recently used results")
+    {
+        ResultCache* cache;
+        CacheEntry*  entry;
+        char         result[64];
+        size_t       entry_size;
+
+        memset(result, 'x', sizeof(result));
+        entry_size = sizeof(CacheEntry) + strlen("select a") + 1 + sizeof(result);
+        cache = cache_create(3 * entry_size);
+
+        cache_put(cache, "select a", 1, result, sizeof(result));
+        cache_put(cache, "select b", 1, result, sizeof(result));
+        cache_put(cache, "select c", 1, result, sizeof(result));
+        check(cache->num_entries == 3);
+        check(cache->memory == 3 * entry_size);
+
+        // a is used again, so b is the one to go
+        entry = cache_get(cache, "select a", 1);
+        check(entry != NULL);
+        check(entry->length == sizeof(result));
+        check(memcmp(entry->result, result, sizeof(result)) == 0);
+        cache_put(cache, "select d", 1, result, sizeof(result));
+        check(cache->num_entries == 3);
+        check(cache->evictions == 1);
+        check(cache_get(cache, "select b", 1) == NULL);
+        check(cache_get(cache, "select a", 1) != NULL);
+        check(cache_get(cache, "select c", 1) != NULL);
+        check(cache_get(cache, "select d", 1) != NULL);
+        check(cache->hits == 4);
+        check(cache->misses == 1);
+
+        // Replacing a result doesn't evict anything
+        cache_put(cache, "select a", 2, "y", 1);
+        check(cache->num_entries == 3);
+        check(cache->evictions == 1);
+
+        // and a result larger than the whole cache is not kept
+        cache_put(cache, "select e", 1, result, 3 * entry_size);
+        check(cache_get(cache, "select e", 1) == NULL);
+        check(cache->num_entries == 3);
+
+        cache_clear(cache);
+        check(cache->num_entries == 0);
+        check(cache->memory == 0);
+        cache_free(cache);
+    }
+
+    it("drops results from older versions")
+    {
+        ResultCache* cache;
+
+        cache = cache_create(CACHE_DEFAULT_MEMORY);
+        cache_put(cache, "select", 7, "(1)\n", 4);
+        check(cache_get(cache, "select", 7) != NULL);
+        check(cache_get(cache, "select", 8) == NULL);
+        check(cache->num_entries == 0);
+        check(cache_get(cache, "select", 7) == NULL);
+        cache_free(cache);
+    }
+
+    it("returns cached selects until the table changes")
+    {
+        char   first[1024];
+        char   output[1024];
+        Table* table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        table->cache = cache_create(CACHE_DEFAULT_MEMORY);
+        check(run_statement(table, "insert 1 user1 person1@example.com", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert 2 user2 person2@example.com", output, sizeof(output)) == EXECUTE_SUCCESS);
+
+        check(run_statement(table, "select id, username where id > 0", first, sizeof(first)) == EXECUTE_SUCCESS);
+        check(strcmp(first, "(1, user1)\n(2, user2)\n") == 0);
+        check(table->cache->misses == 1);
+        check(table->cache->num_entries == 1);
+
+        // The same statement with other spacing is a hit
+        check(run_statement(table, "select  id,   username where id > 0 ", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, first) == 0);
+        check(table->cache->hits == 1);
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(2)\n") == 0);
+        check(table->cache->num_entries == 2);
+
+        // Every kind of write makes the results stale
+        check(run_statement(table, "insert 3 user3 person3@example.com", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select id, username where id > 0", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(1, user1)\n(2, user2)\n(3, user3)\n") == 0);
+        check(table->cache->hits == 1);
+        check(run_statement(table, "update set username = renamed where id = 2", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select id, username where id > 0", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(1, user1)\n(2, renamed)\n(3, user3)\n") == 0);
+        check(run_statement(table, "delete where id = 1", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(2)\n") == 0);
+        check(table->cache->hits == 1);
+
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(2)\n") == 0);
+        check(table->cache->hits == 2);
+
+        db_close(table);
+    }
+}
@@ -0,0 +1,354 @@
+/*
+ * CATALOG_SPEC
+ * BDD test for create table and the schema catalog
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "input.h"
+#include "table.h"
+#include "catalog.h"
+#include "index.h"
+#include "integrity.h"
+#include "vacuum.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+
+/*
+ * count_rows()
+ * Walk a table from the catalog and check that keys go up by one from 1
+ */
+static uint32_t count_rows(CatalogEntry* entry)
+{
+    Cursor*  cursor;
+    Value    values[CATALOG_MAX_COLUMNS];
+    uint32_t count = 0;
+
+    cursor = table_start(entry->table);
+    while(!cursor->end_of_table)
+    {
+        schema_deserialize(&entry->schema, cursor_value(cursor), values);
+        if(values[0].integer != (int32_t) count + 1)
+            return 0;
+        count++;
+        cursor_advance(cursor);
+    }
+    table_reset_arena(entry->table);
+
+    return count;
+}
+
+
+spec("catalog")
+{
+    static const char* test_db_name = "test/test_catalog.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("lays out fixed size columns first")
+    {
+        Schema schema;
+
+        // The users table has the same layout as serialize_row()
+        schema_users(&schema);
+        check(schema.num_columns == 3);
+        check(schema.fixed_width == 1);
+        check(schema.cols[0].offset == ID_OFFSET);
+        check(schema.cols[1].offset == USERNAME_OFFSET);
+        check(schema.cols[2].offset == EMAIL_OFFSET);
+        check(schema.max_size == ROW_SIZE);
+        // Sized as an insert allows, without the terminator Row keeps
+        check(schema.cols[1].size == COLUMN_USERNAME_SIZE);
+        check(schema.cols[2].size == COLUMN_EMAIL_SIZE);
+
+        check(schema_init(&schema, "items") == CATALOG_OK);
+        check(schema_add_column(&schema, "id", COLUMN_TYPE_INTEGER, 0) == CATALOG_OK);
+        check(schema_add_column(&schema, "note", COLUMN_TYPE_VARCHAR, 40) == CATALOG_OK);
+        check(schema_add_column(&schema, "price", COLUMN_TYPE_REAL, 0) == CATALOG_OK);
+        check(schema_add_column(&schema, "code", COLUMN_TYPE_TEXT, 6) == CATALOG_OK);
+        check(schema_layout(&schema) == CATALOG_OK);
+        check(schema.fixed_width == 0);
+        check(schema.cols[0].offset == 0);
+        check(schema.cols[2].offset == 4);
+        check(schema.cols[3].offset == 12);
+        check(schema.fixed_size == 18);
+        check(schema.max_size == 18 + 2 + 40);
+        check(schema_find_column(&schema, "price") == 2);
+        check(schema_find_column(&schema, "cost") == -1);
+
+        // Bad schemas
+        check(schema_add_column(&schema, "note", COLUMN_TYPE_TEXT, 4) == CATALOG_DUPLICATE_COLUMN);
+        check(schema_add_column(&schema, "1st", COLUMN_TYPE_INTEGER, 0) == CATALOG_BAD_NAME);
+        check(schema_add_column(&schema, "a_very_long_column", COLUMN_TYPE_INTEGER, 0) == CATALOG_BAD_NAME);
+        check(schema_add_column(&schema, "big", COLUMN_TYPE_TEXT, CATALOG_MAX_TEXT + 1) == CATALOG_BAD_TYPE);
+        check(schema_add_column(&schema, "none", COLUMN_TYPE_VARCHAR, 0) == CATALOG_BAD_TYPE);
+        check(schema_init(&schema, "no-dashes") == CATALOG_BAD_NAME);
+
+        check(schema_init(&schema, "keyless") == CATALOG_OK);
+        check(schema_add_column(&schema, "name", COLUMN_TYPE_TEXT, 10) == CATALOG_OK);
+        check(schema_layout(&schema) == CATALOG_BAD_KEY);
+
+        check(schema_init(&schema, "wide") == CATALOG_OK);
+        check(schema_add_column(&schema, "id", COLUMN_TYPE_INTEGER, 0) == CATALOG_OK);
+        check(schema_add_column(&schema, "a", COLUMN_TYPE_TEXT, 255) == CATALOG_OK);
+        check(schema_add_column(&schema, "b", COLUMN_TYPE_VARCHAR, 40) == CATALOG_OK);
+        check(schema_layout(&schema) == CATALOG_ROW_TOO_WIDE);
+    }
+
+    it("serializes rows through the schema")
+    {
+        Schema  schema;
+        Value   values[CATALOG_MAX_COLUMNS];
+        Value   read_back[CATALOG_MAX_COLUMNS];
+        Row     row;
+        uint8_t record[ROW_SIZE];
+        uint8_t expected[ROW_SIZE];
+
+        // Fixed width rows come out the same as from serialize_row()
+        schema_users(&schema);
+        check(schema_parse_value(&schema.cols[0], "42", &values[0]));
+        check(schema_parse_value(&schema.cols[1], "'some user'", &values[1]));
+        check(schema_parse_value(&schema.cols[2], "user@domain.net", &values[2]));
+        memset(record, 0xFF, sizeof(record));
+        schema_serialize(&schema, values, record);
+        row.id = 42;
+        strcpy(row.username, "some user");
+        strcpy(row.email, "user@domain.net");
+        serialize_row(&row, expected);
+        check(memcmp(record, expected, ROW_SIZE) == 0);
+        check(schema_record_key(record) == 42);
+
+        schema_deserialize(&schema, record, read_back);
+        check(read_back[0].integer == 42);
+        check(strcmp(read_back[1].text, "some user") == 0);
+        check(read_back[2].length == strlen("user@domain.net"));
+
+        // A full text column has no terminator in the record
+        schema_init(&schema, "codes");
+        schema_add_column(&schema, "id", COLUMN_TYPE_INTEGER, 0);
+        schema_add_column(&schema, "code", COLUMN_TYPE_TEXT, 4);
+        check(schema_layout(&schema) == CATALOG_OK);
+        check(schema.max_size == 8);
+        check(schema_parse_value(&schema.cols[1], "abcd", &values[1]));
+        memset(record, 0xFF, sizeof(record));
+        schema_serialize(&schema, values, record);
+        schema_deserialize(&schema, record, read_back);
+        check(read_back[1].length == 4);
+        check(strcmp(read_back[1].text, "abcd") == 0);
+
+        // Varchars follow the fixed size columns
+        schema_init(&schema, "notes");
+        schema_add_column(&schema, "id", COLUMN_TYPE_INTEGER, 0);
+        schema_add_column(&schema, "title", COLUMN_TYPE_VARCHAR, 20);
+        schema_add_column(&schema, "score", COLUMN_TYPE_REAL, 0);
+        schema_add_column(&schema, "body", COLUMN_TYPE_VARCHAR, 100);
+        check(schema_layout(&schema) == CATALOG_OK);
+        check(schema_parse_value(&schema.cols[0], "-7", &values[0]));
+        check(schema_parse_value(&schema.cols[1], "'hello, world'", &values[1]));
+        check(schema_parse_value(&schema.cols[2], "2.5", &values[2]));
+        check(schema_parse_value(&schema.cols[3], "''", &values[3]));
+        memset(record, 0xFF, sizeof(record));
+        schema_serialize(&schema, values, record);
+        schema_deserialize(&schema, record, read_back);
+        check(read_back[0].integer == -7);
+        check(strcmp(read_back[1].text, "hello, world") == 0);
+        check(read_back[2].real == 2.5);
+        check(read_back[3].length == 0);
+        check(read_back[3].text[0] == '\0');
+        // unused space is zeroed
+        check(record[schema.max_size - 1] == 0);
+
+        // Values that don't fit their column
+        check(!schema_parse_value(&schema.cols[0], "12abc", &values[0]));
+        check(!schema_parse_value(&schema.cols[0], "3000000000", &values[0]));
+        check(!schema_parse_value(&schema.cols[0], "", &values[0]));
+        check(!schema_parse_value(&schema.cols[2], "two", &values[2]));
+        check(!schema_parse_value(&schema.cols[1], "'this title is much too long'", &values[1]));
+    }
+
+    it("creates tables that are still there after a reopen")
+    {
+        Table*        table;
+        CatalogEntry* entry;
+        char          input[256];
+        int           num_rows = 150 * (PAGE_SIZE / PAGE_SIZE_MIN);     // a few leaves of items
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(catalog_get(table)->num_tables == 0);
+        check(*db_header_catalog_root(get_page(table->pager, DB_HEADER_PAGE_NUM)) == 0);
+
+        check(run_statement(table, "create table items (id integer, name text(16), price real, note varchar(64))", NULL, 0) ==
+                EXECUTE_SUCCESS);
+        check(run_statement(table, "create table tags (tag_id integer, label varchar(12))", NULL, 0) ==
+                EXECUTE_SUCCESS);
+        // Inserted out of order so that the tree splits in the middle
+        for(int i = 0; i < num_rows; ++i)
+        {
+            int n = (i * 7) % num_rows + 1;
+
+            sprintf(input, "insert into items values (%d, item%d, %d.25, 'note for item %d')", n, n, n, n);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+        }
+        check(run_statement(table, "insert into tags values (1, red)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert 1 user1 user1@domain.net", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert into users values (2, 'user 2', user2@domain.net)", NULL, 0) == EXECUTE_SUCCESS);
+
+        entry = catalog_find(table, "items");
+        check(entry != NULL);
+        check(tree_depth(table->pager, entry->table->root_page_num) > 1);
+        check(count_rows(entry) == (uint32_t) num_rows);
+        check(run_statement(table, "select * from items", NULL, 0) == EXECUTE_SUCCESS);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(catalog_get(table)->num_tables == 2);
+        entry = catalog_find(table, "items");
+        check(entry != NULL);
+        check(entry->schema.num_columns == 4);
+        check(entry->schema.cols[3].type == COLUMN_TYPE_VARCHAR);
+        check(entry->schema.cols[3].size == 64);
+        check(count_rows(entry) == (uint32_t) num_rows);
+        {
+            Value   values[CATALOG_MAX_COLUMNS];
+            Cursor* cursor = table_find(entry->table, 77);
+
+            schema_deserialize(&entry->schema, cursor_value(cursor), values);
+            check(values[0].integer == 77);
+            check(strcmp(values[1].text, "item77") == 0);
+            check(values[2].real == 77.25);
+            check(strcmp(values[3].text, "note for item 77") == 0);
+            table_reset_arena(entry->table);
+        }
+        check(count_rows(catalog_find(table, "tags")) == 1);
+        check(run_statement(table, "select count(*)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select * from users", NULL, 0) == EXECUTE_SUCCESS);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+
+    it("rejects statements that don't fit the catalog")
+    {
+        Table* table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "create table t (id integer, name text(8))", NULL, 0) == EXECUTE_SUCCESS);
+
+        check(run_statement(table, "create table t (id integer)", NULL, 0) == EXECUTE_TABLE_EXISTS);
+        check(run_statement(table, "create table users (id integer)", NULL, 0) == EXECUTE_TABLE_EXISTS);
+        check(run_statement(table, "create table u (name text(8), id integer)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer, name blob)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer, name text)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer, name text(8)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer, id real)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer) extra", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "create table u (id integer, a text(200), b text(200))", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_ROW_TOO_WIDE));
+
+        check(run_statement(table, "insert into nothing values (1, a)", NULL, 0) == EXECUTE_NO_SUCH_TABLE);
+        check(run_statement(table, "select * from nothing", NULL, 0) == EXECUTE_NO_SUCH_TABLE);
+        check(run_statement(table, "insert into t values (1)", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(run_statement(table, "insert into t values (1, a, b)", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(run_statement(table, "insert into t values (x, a)", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(run_statement(table, "insert into t values (-1, a)", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(run_statement(table, "insert into t values (1, 'far too long')", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(run_statement(table, "insert into t values 1, a", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "insert into t values (1, a", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "insert into users values (-1, a, b)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_NEGATIVE_ID));
+        check(run_statement(table, "insert into users values (1, a)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+        check(run_statement(table, "select * from t where id = 1", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+
+        check(run_statement(table, "insert into t values (1, 'a, b')", NULL, 0) == EXECUTE_SUCCESS);
+        check(count_rows(catalog_find(table, "t")) == 1);
+        db_close(table);
+    }
+
+    it("keeps keys unique and replaces rows on request")
+    {
+        Table*        table;
+        CatalogEntry* entry;
+        Cursor*       cursor;
+        Value         values[CATALOG_MAX_COLUMNS];
+        uint64_t      version;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "create table t (id integer, name text(8))", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert into t values (1, first)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert into t values (2, second)", NULL, 0) == EXECUTE_SUCCESS);
+        version = table->version;
+        check(run_statement(table, "insert into t values (1, again)", NULL, 0) == EXECUTE_DUPLICATE_KEY);
+        check(run_statement(table, "insert into t values (x, bad)", NULL, 0) == EXECUTE_BAD_VALUE);
+        check(table->version == version);
+        check(run_statement(table, "insert or replace into t values (1, again)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert or replace into t values (3, third)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert or into t values (4, fourth)", NULL, 0) == RUN_PREPARE_FAILED(PREPARE_SYNTAX_ERROR));
+
+        entry = catalog_find(table, "t");
+        check(count_rows(entry) == 3);
+        cursor = table_find(entry->table, 1);
+        schema_deserialize(&entry->schema, cursor_value(cursor), values);
+        check(strcmp(values[1].text, "again") == 0);
+        table_reset_arena(entry->table);
+
+        // The users table goes through the same check
+        check(run_statement(table, "insert into users values (1, a, a@domain.net)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert into users values (1, b, b@domain.net)", NULL, 0) == EXECUTE_DUPLICATE_KEY);
+        check(run_statement(table, "insert or replace into users values (1, b, b@domain.net)", NULL, 0) == EXECUTE_SUCCESS);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+
+    it("keeps every table through a vacuum")
+    {
+        Table*        table;
+        CatalogEntry* entry;
+        char          input[256];
+        int           num_rows = 100;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "create table a (id integer, value real)", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "create table b (id integer, name varchar(100))", NULL, 0) == EXECUTE_SUCCESS);
+        for(int i = num_rows; i > 0; --i)
+        {
+            sprintf(input, "insert into a values (%d, %d.5)", i, i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+            sprintf(input, "insert into b values (%d, name%d)", i, i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+            sprintf(input, "insert %d user%d user%d@domain.net", i, i, i);
+            check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+        }
+
+        check(db_vacuum(table, VACUUM_DEFAULT_FILL_FACTOR, NULL) == VACUUM_SUCCESS);
+        check(db_integrity_check(table) == 0);
+        // The catalog and its tables have their roots just after the index
+        check(*db_header_catalog_root(get_page(table->pager, DB_HEADER_PAGE_NUM)) == INDEX_ROOT_PAGE_NUM + 1);
+        entry = catalog_find(table, "a");
+        check(entry != NULL);
+        check(entry->table->root_page_num == INDEX_ROOT_PAGE_NUM + 2);
+        check(count_rows(entry) == (uint32_t) num_rows);
+        check(count_rows(catalog_find(table, "b")) == (uint32_t) num_rows);
+        check(run_statement(table, "insert into b values (101, more)", NULL, 0) == EXECUTE_SUCCESS);
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(db_integrity_check(table) == 0);
+        check(count_rows(catalog_find(table, "b")) == (uint32_t) num_rows + 1);
+        check(count_rows(catalog_find(table, "a")) == (uint32_t) num_rows);
+        db_close(table);
+    }
+}
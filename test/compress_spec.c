@@ -0,0 +1,149 @@
+/*
+ * COMPRESS_SPEC
+ * BDD test for page compression
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>   // for stat()
+
+// units under test
+#include "compress.h"
+#include "input.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+/*
+ * count_leading_ones()
+ * Number of ids from first to last whose email, email<id>@..., sorts 
+ * from email1 up to email2
+ */
+static int count_leading_ones(int first, int last)
+{
+    char id[16];
+    int  count = 0;
+
+    for(int i = first; i <= last; ++i)
+    {
+        sprintf(id, "%d", i);
+        if(id[0] == '1')
+            count++;
+    }
+
+    return count;
+}
+
+
+spec("compress")
+{
+    static const char* test_db_name = "test/test_compress.db";
+
+    it("round trips blocks through the compressor")
+    {
+        uint8_t  src[PAGE_SIZE];
+        uint8_t  comp[PAGE_SIZE];
+        uint8_t  out[PAGE_SIZE];
+        uint32_t length;
+
+        // Mostly zeros, like a page of padded rows
+        memset(src, 0, PAGE_SIZE);
+        for(int i = 0; i < PAGE_SIZE; i += 291)
+            sprintf((char*) src + i, "user%d", i);
+        length = lz4_compress_block(src, PAGE_SIZE, comp, PAGE_SIZE);
+        check(length > 0);
+        check(length < PAGE_SIZE / 8);
+        check(lz4_decompress_block(comp, length, out, PAGE_SIZE) == PAGE_SIZE);
+        check(memcmp(src, out, PAGE_SIZE) == 0);
+
+        // Random bytes don't compress, and the compressor says so
+        srand(1);
+        for(int i = 0; i < PAGE_SIZE; ++i)
+            src[i] = rand() & 0xFF;
+        check(lz4_compress_block(src, PAGE_SIZE, comp, PAGE_SIZE - 1) == 0);
+
+        // Short blocks are all literals
+        length = lz4_compress_block(src, 7, comp, PAGE_SIZE);
+        check(length == 8);
+        check(lz4_decompress_block(comp, length, out, PAGE_SIZE) == 7);
+        check(memcmp(src, out, 7) == 0);
+
+        // A damaged block is an error rather than a bad write
+        memset(src, 'a', PAGE_SIZE);
+        length = lz4_compress_block(src, PAGE_SIZE, comp, PAGE_SIZE);
+        check(length > 0);
+        check(lz4_decompress_block(comp, length, out, PAGE_SIZE / 2) == -1);
+        check(lz4_decompress_block(comp, length - 1, out, PAGE_SIZE) != PAGE_SIZE);
+    }
+
+    it("stores compressed pages and reads them back")
+    {
+        char          input[256];
+        int           num_rows = 150 * (PAGE_SIZE / PAGE_SIZE_MIN);
+        Table*        table;
+        Statement     statement;
+        PrepareResult prep_result;
+        ExecuteResult exec_result;
+        InputBuffer*  input_buffer;
+        struct stat   file_stat;
+
+        remove(test_db_name);
+        table = db_open_with_flags(test_db_name, DB_FLAG_COMPRESSED);
+        check(table != NULL);
+        check(table->pager->compressed);
+        input_buffer = new_input_buffer();
+        check(input_buffer != NULL);
+
+        for(int i = 1; i <= num_rows; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            input_buffer->buffer = input;
+            prep_result = prepare_statement(input_buffer, &statement);
+            check(prep_result == PREPARE_SUCCESS);
+            exec_result = execute_statement(&statement, table);
+            check(exec_result == EXECUTE_SUCCESS);
+        }
+        db_close(table);
+
+        // Several times smaller than the same pages uncompressed
+        check(stat(test_db_name, &file_stat) == 0);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(table->pager->compressed);
+        check((uint64_t) file_stat.st_size * 4 < (uint64_t) table->pager->num_pages * PAGE_SIZE);
+
+        // Pages that grow are moved to the end of the file
+        strcpy(input, "update set username = somebodyelse where id > 0");
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(exec_result == EXECUTE_SUCCESS);
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        strcpy(input, "select count(*) where username = somebodyelse");
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(exec_result == EXECUTE_SUCCESS);
+        check(statement.aggregate.count == (uint64_t) num_rows);
+
+        strcpy(input, "select count(*) where email >= email1 and email < email2");
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(exec_result == EXECUTE_SUCCESS);
+        // 1, 10-19 and 100-150 with 4 KB pages
+        check(statement.aggregate.count == (uint64_t) count_leading_ones(1, num_rows));
+        db_close(table);
+        remove(test_db_name);
+    }
+}
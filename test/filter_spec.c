@@ -0,0 +1,66 @@
+/*
+ * FILTER_SPEC
+ * BDD test for compiled where clause filters
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+// units under test 
+#include "input.h"
+#include "table.h"
+#include "filter.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+spec("filter")
+{
+    it("agrees with where_matches() on serialized rows")
+    {
+        char* clauses[] = {
+            "select where id = 7",
+            "select where id >= 3 and id < 9",
+            "select where username = user7",
+            "select where username != user7 and id <= 12",
+            "select where username like 'user1%'",
+            "select where username > user3",
+            "select where email like 'email1' and id > 0",
+            "select where email contains il1",
+            "select where username like '%er1%' and id != 11",
+        };
+        char          input[256];
+        uint8_t       value[ROW_SIZE];
+        Statement     statement;
+        PrepareResult prep_result;
+        InputBuffer*  input_buffer;
+        Filter        filter;
+        Row           row;
+
+        input_buffer = new_input_buffer();
+        check(input_buffer != NULL);
+
+        for(size_t c = 0; c < sizeof(clauses) / sizeof(clauses[0]); ++c)
+        {
+            strcpy(input, clauses[c]);
+            input_buffer->buffer = input;
+            prep_result = prepare_statement(input_buffer, &statement);
+            check(prep_result == PREPARE_SUCCESS);
+            filter_compile(&filter, &statement.where);
+
+            for(uint32_t id = 0; id < 20; ++id)
+            {
+                memset(&row, 0, sizeof(row));
+                row.id = id;
+                sprintf(row.username, "user%d", id);
+                sprintf(row.email, "email%d", id);
+                serialize_row(&row, value);
+
+                check(filter_matches(&filter, id, value) == where_matches(&statement.where, &row), 
+                        "filter disagrees for [%s] on row %d", clauses[c], id);
+            }
+        }
+    }
+}
@@ -0,0 +1,266 @@
+/*
+ * GROUP_SPEC
+ * BDD test for group by and the hash aggregation table
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// units under test
+#include "input.h"
+#include "group.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+#define TEST_NUM_KEYS 5000
+
+// What the groups emitted by group_finish() added up to
+typedef struct
+{
+    uint32_t num_groups;
+    uint32_t num_bad;           // keys seen twice, or with the wrong count
+    uint64_t counts[TEST_NUM_KEYS];
+} GroupCheck;
+
+/*
+ * check_group()
+ * Keys are key<n> and key n was added n % 3 + 1 times
+ */
+static void check_group(void* arg, const char* key, uint32_t length, uint64_t count)
+{
+    GroupCheck* check = arg;
+    char        text[32];
+    uint32_t    n;
+
+    memcpy(text, key, length);
+    text[length] = '\0';
+    check->num_groups++;
+    if(sscanf(text, "key%u", &n) != 1 || n >= TEST_NUM_KEYS || check->counts[n] != 0 || count != n % 3 + 1)
+    {
+        check->num_bad++;
+        return;
+    }
+    check->counts[n] = count;
+}
+
+/*
+ * run_select()
+ * Execute a statement with stdout sent to a file, and read back what it
+ * printed into output
+ */
+static ExecuteResult run_select(Table* table, const char* text, char* output, size_t size)
+{
+    char          input[256];
+    InputBuffer   input_buffer;
+    Statement     statement;
+    ExecuteResult result;
+    FILE*         fp;
+    size_t        len;
+    int           saved;
+
+    strcpy(input, text);
+    input_buffer.buffer = input;
+    if(prepare_statement(&input_buffer, &statement) != PREPARE_SUCCESS)
+        return EXECUTE_BAD_VALUE;
+
+    fp = tmpfile();
+    fflush(stdout);
+    saved = dup(fileno(stdout));
+    dup2(fileno(fp), fileno(stdout));
+    result = execute_statement(&statement, table);
+    fflush(stdout);
+    dup2(saved, fileno(stdout));
+    close(saved);
+
+    rewind(fp);
+    len = fread(output, 1, size - 1, fp);
+    output[len] = '\0';
+    fclose(fp);
+
+    return result;
+}
+
+/*
+ * count_lines()
+ */
+static int count_lines(const char* output)
+{
+    int num_lines = 0;
+
+    for(; *output != '\0'; ++output)
+        num_lines += (*output == '\n');
+
+    return num_lines;
+}
+
+
+spec("group")
+{
+    static const char* test_db_name = "test/test_group.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("counts groups in memory")
+    {
+        GroupTable  groups;
+        GroupCheck* check;
+        char        key[32];
+
+        check = calloc(1, sizeof(GroupCheck));
+        group_init(&groups, GROUP_DEFAULT_MEMORY);
+        for(uint32_t round = 0; round < 3; ++round)
+        {
+            for(uint32_t n = 0; n < 1000; ++n)
+            {
+                if(n % 3 < round)
+                    continue;
+                sprintf(key, "key%u", n);
+                check(group_add(&groups, key, strlen(key), 1) == GROUP_OK);
+            }
+        }
+        check(groups.num_groups == 1000);
+        check(groups.num_spilled == 0);
+        check(group_finish(&groups, check_group, check) == GROUP_OK);
+        check(check->num_groups == 1000);
+        check(check->num_bad == 0);
+        group_free(&groups);
+        free(check);
+    }
+
+    it("spills partitions and counts every group once")
+    {
+        GroupTable  groups;
+        GroupCheck* check;
+        char        key[32];
+
+        check = calloc(1, sizeof(GroupCheck));
+        group_init(&groups, GROUP_MIN_MEMORY);
+        for(uint32_t round = 0; round < 3; ++round)
+        {
+            for(uint32_t n = 0; n < TEST_NUM_KEYS; ++n)
+            {
+                if(n % 3 < round)
+                    continue;
+                sprintf(key, "key%u", n);
+                check(group_add(&groups, key, strlen(key), 1) == GROUP_OK);
+            }
+        }
+        check(groups.num_groups < TEST_NUM_KEYS);
+        check(groups.num_spilled > 0);
+        check(group_finish(&groups, check_group, check) == GROUP_OK);
+        check(check->num_groups == TEST_NUM_KEYS);
+        check(check->num_bad == 0);
+        group_free(&groups);
+        free(check);
+    }
+
+    it("parses group by")
+    {
+        char         input[256];
+        const char*  bad_groups[] = {
+            "select domain(email), count(*)", "select username, count(*)",
+            "select username, count(*) group username", "select username, count(*) group by",
+            "select username, count(*) group by email", "select email, count(*) group by domain(email)",
+            "select username, email, count(*) group by username", "select username group by username",
+            "select username, sum(id) group by username", "select username, count(*) group by id",
+            "select username, count(*) group by username limit 3", "select count(*), count(*) group by username",
+            "select domain(email) group by domain(email)"
+        };
+        Statement    statement;
+        InputBuffer  buffer;
+        InputBuffer* input_buffer = &buffer;
+
+        strcpy(input, "select domain(email), count(*) where id > 3 group by domain(email)");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.group.key == GROUP_DOMAIN);
+        check(!statement.group.count_first);
+        check(statement.where.num_predicates == 1);
+
+        strcpy(input, "select count(*),username group by username");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.group.key == GROUP_USERNAME);
+        check(statement.group.count_first);
+
+        strcpy(input, "select email , count(*) group by email");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.group.key == GROUP_EMAIL);
+
+        // aggregates on their own are unchanged
+        strcpy(input, "select count(*) where id > 3");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.group.key == GROUP_NONE);
+        check(statement.aggregate.type == AGGREGATE_COUNT);
+
+        for(size_t b = 0; b < sizeof(bad_groups) / sizeof(bad_groups[0]); ++b)
+        {
+            strcpy(input, bad_groups[b]);
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SYNTAX_ERROR);
+        }
+    }
+
+    it("groups the rows of a select")
+    {
+        char         input[256];
+        char*        output;
+        Statement    statement;
+        InputBuffer  buffer;
+        InputBuffer* input_buffer = &buffer;
+        Table*       table;
+
+        output = malloc(64 * 1024);
+        check(output != NULL);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        // 3 domains, and usernames repeat every 50 rows
+        for(int i = 1; i <= 300; ++i)
+        {
+            sprintf(input, "insert %d user%d name%d@domain%d.net", i, i % 50, i, i % 3);
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+            check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+        }
+
+        check(run_select(table, "select domain(email), count(*) group by domain(email)", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(count_lines(output) == 3);
+        check(strstr(output, "(domain0.net, 100)\n") != NULL);
+        check(strstr(output, "(domain1.net, 100)\n") != NULL);
+        check(strstr(output, "(domain2.net, 100)\n") != NULL);
+
+        check(run_select(table, "select count(*), domain(email) where id <= 10 group by domain(email)",
+                    output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(count_lines(output) == 3);
+        check(strstr(output, "(3, domain0.net)\n") != NULL);
+        check(strstr(output, "(4, domain1.net)\n") != NULL);
+        check(strstr(output, "(3, domain2.net)\n") != NULL);
+
+        check(run_select(table, "select username, count(*) where username like user1% group by username",
+                    output, 64 * 1024) == EXECUTE_SUCCESS);
+        // user1 and user10 to user19
+        check(count_lines(output) == 11);
+        check(strstr(output, "(user1, 6)\n") != NULL);
+        check(strstr(output, "(user19, 6)\n") != NULL);
+
+        // Every email is its own group, and a small budget spills them
+        table->group_memory = GROUP_MIN_MEMORY;
+        check(run_select(table, "select email, count(*) group by email", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(count_lines(output) == 300);
+        check(strstr(output, "(name300@domain0.net, 1)\n") != NULL);
+
+        db_close(table);
+        free(output);
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ * INDEX_SPEC
+ * BDD test for the email index
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>     // for access()
+
+// units under test 
+#include "input.h"
+#include "table.h"
+#include "index.h"
+// testing framework
+#include "bdd-for-c.h"
+
+/*
+ * The root splits when it has INDEX_INTERNAL_NODE_MAX_CELLS + 2 leaves 
+ * under it. With 64 KB pages that is more pages than a file can have, so
+ * the index only grows to two levels there.
+ */
+#define INDEX_SPEC_DEPTH       ((INDEX_INTERNAL_NODE_MAX_CELLS + 8 <= TABLE_MAX_PAGES) ? 3 : 2)
+#define INDEX_SPEC_MAX_ENTRIES 65521    // prime, so i * 7919 scatters over all of them
+
+spec("index")
+{
+    static const char* test_db_name = "test/test_index.db";
+
+    after_each()
+    {
+        fprintf(stdout, "[%s] removing db file [%s]\n", __func__, test_db_name);
+        int status = remove(test_db_name);
+        if(status != 0)
+            fprintf(stderr, "[%s] failed to remove db file [%s]\n", __func__, test_db_name);
+    }
+
+    // Enough entries to split index leaves and internal nodes
+    it("keeps entries in email order across splits")
+    {
+        int      num_entries;
+        int      num_seen;
+        char     email[64];
+        char     prev_email[INDEX_KEY_EMAIL_SIZE];
+        Table*   table;
+        Cursor*  cursor;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+
+        // The number of entries that takes depends on the page size
+        for(num_entries = 0; tree_depth(table->pager, table->index_root_page_num) < INDEX_SPEC_DEPTH &&
+                pager_pages_available(table->pager) > INDEX_SPEC_DEPTH + 1; ++num_entries)
+        {
+            // scatter the insert order
+            int n = (int) (((long) num_entries * 7919) % INDEX_SPEC_MAX_ENTRIES);
+            sprintf(email, "user%d@domain%d.net", n, n % 5);
+            index_insert(table, email, n);
+        }
+        check(get_node_type(get_page(table->pager, table->index_root_page_num)) == NODE_INTERNAL);
+        check(tree_depth(table->pager, table->index_root_page_num) == INDEX_SPEC_DEPTH);
+
+        num_seen      = 0;
+        prev_email[0] = '\0';
+        cursor = index_find(table, "", 0);
+        while(!cursor->end_of_table)
+        {
+            char* cur_email = index_key_email(index_cursor_key(cursor));
+
+            check(strcmp(prev_email, cur_email) <= 0);
+            strcpy(prev_email, cur_email);
+            num_seen++;
+            cursor_advance(cursor);
+        }
+        check(num_seen == num_entries);
+
+        db_close(table);
+    }
+
+    it("removes entries and shrinks the tree")
+    {
+        int      num_entries;
+        int      num_seen;
+        char     email[64];
+        char     prev_email[INDEX_KEY_EMAIL_SIZE];
+        uint32_t depth;
+        Table*   table;
+        Cursor*  cursor;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+
+        for(num_entries = 0; tree_depth(table->pager, table->index_root_page_num) < INDEX_SPEC_DEPTH &&
+                pager_pages_available(table->pager) > INDEX_SPEC_DEPTH + 1; ++num_entries)
+        {
+            sprintf(email, "user%d@domain%d.net", num_entries, num_entries % 5);
+            index_insert(table, email, num_entries);
+        }
+        depth = tree_depth(table->pager, table->index_root_page_num);
+        check(depth == INDEX_SPEC_DEPTH);
+
+        // Remove all but every tenth entry, in scattered order
+        for(int i = 0; i < num_entries; ++i)
+        {
+            int n = (int) (((long) i * 7919) % num_entries);
+
+            if(n % 10 == 0)
+                continue;
+            sprintf(email, "user%d@domain%d.net", n, n % 5);
+            check(index_delete(table, email, n) == 1);
+        }
+        check(index_delete(table, "user1@domain1.net", 1) == 0);
+        check(tree_depth(table->pager, table->index_root_page_num) < depth);
+
+        num_seen      = 0;
+        prev_email[0] = '\0';
+        cursor = index_find(table, "", 0);
+        while(!cursor->end_of_table)
+        {
+            void* key = index_cursor_key(cursor);
+
+            check(strcmp(prev_email, index_key_email(key)) <= 0);
+            check(*index_key_row_id(key) % 10 == 0);
+            strcpy(prev_email, index_key_email(key));
+            num_seen++;
+            cursor_advance(cursor);
+        }
+        check(num_seen == (num_entries + 9) / 10);
+
+        db_close(table);
+    }
+
+    it("finds the first entry at or after an email")
+    {
+        Table*   table;
+        Cursor*  cursor;
+        void*    key;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+
+        index_insert(table, "b@domain.net", 2);
+        index_insert(table, "a@domain.net", 1);
+        index_insert(table, "c@domain.net", 4);
+        index_insert(table, "b@domain.net", 3);
+
+        cursor = index_find(table, "b", 0);
+        check(!cursor->end_of_table);
+        key = index_cursor_key(cursor);
+        check(strcmp(index_key_email(key), "b@domain.net") == 0);
+        check(*index_key_row_id(key) == 2);
+        cursor_advance(cursor);
+        key = index_cursor_key(cursor);
+        check(*index_key_row_id(key) == 3);
+
+        cursor = index_find(table, "d", 0);
+        check(cursor->end_of_table);
+
+        db_close(table);
+    }
+}
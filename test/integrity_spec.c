@@ -0,0 +1,237 @@
+/*
+ * INTEGRITY_SPEC
+ * BDD test for page checksums and the integrity check
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "checksum.h"
+#include "input.h"
+#include "integrity.h"
+#include "table.h"
+#include "vacuum.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+// Rows for a tree of several leaves whatever the page size. insert_rows()
+// needs a count that 37 doesn't divide.
+#define INTEGRITY_SPEC_ROWS (8 * LEAF_NODE_MAX_CELLS)
+
+/*
+ * insert_rows()
+ */
+static int insert_rows(Table* table, int num_rows)
+{
+    char          input[256];
+    Statement     statement;
+    InputBuffer*  input_buffer;
+    int           num_inserted = 0;
+
+    input_buffer = new_input_buffer();
+    for(int i = 1; i <= num_rows; ++i)
+    {
+        int n = (i * 37) % num_rows + 1;
+
+        sprintf(input, "insert %d user%d email%d@domain.net", n, n, n);
+        input_buffer->buffer = input;
+        if(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS &&
+           execute_statement(&statement, table) == EXECUTE_SUCCESS)
+            num_inserted++;
+    }
+    free(input_buffer);
+
+    return num_inserted;
+}
+
+
+spec("integrity")
+{
+    static const char* test_db_name = "test/test_integrity.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("computes crc32c the same way on every path")
+    {
+        uint8_t buf[3 * PAGE_SIZE];
+
+        // Check value from the CRC32C definition
+        check(crc32c_scalar("123456789", 9) == 0xE3069283);
+        check(crc32c_sse42("123456789", 9) == 0xE3069283);
+        check(crc32c("123456789", 9) == 0xE3069283);
+
+        srand(7);
+        for(uint32_t i = 0; i < sizeof(buf); ++i)
+            buf[i] = rand() & 0xFF;
+        for(uint32_t len = 0; len <= sizeof(buf); len += 97)
+            check(crc32c_scalar(buf, len) == crc32c_sse42(buf, len));
+        check(crc32c_scalar(buf, PAGE_SIZE) == crc32c(buf, PAGE_SIZE));
+    }
+
+    it("finds nothing wrong with a sound database")
+    {
+        Table* table;
+
+        remove(test_db_name);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(db_integrity_check(table) == 0);
+        check(insert_rows(table, 200) == 200);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(table->pager->checksums);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+
+    it("refuses pages that don't match their checksum")
+    {
+        FILE*    file;
+        Table*   table;
+        uint8_t  byte;
+        uint32_t leaf_page_num;
+
+        remove(test_db_name);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(insert_rows(table, INTEGRITY_SPEC_ROWS) == INTEGRITY_SPEC_ROWS);
+        leaf_page_num = *internal_node_child(get_page(table->pager, table->root_page_num), 0);
+        db_close(table);
+
+        // Flip one bit in the middle of a leaf
+        file = fopen(test_db_name, "r+b");
+        check(file != NULL);
+        fseek(file, (long) leaf_page_num * PAGE_SIZE + PAGE_SIZE / 2, SEEK_SET);
+        check(fread(&byte, 1, 1, file) == 1);
+        byte ^= 0x10;
+        fseek(file, (long) leaf_page_num * PAGE_SIZE + PAGE_SIZE / 2, SEEK_SET);
+        fwrite(&byte, 1, 1, file);
+        fclose(file);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(pager_verify_page(table->pager, leaf_page_num) == PAGE_READ_BAD_CHECKSUM);
+        check(pager_verify_page(table->pager, table->root_page_num) == PAGE_READ_OK);
+        check(get_page(table->pager, leaf_page_num) == NULL);
+        check(db_integrity_check(table) > 0);
+        pager_close(table->pager);
+        free(table);
+
+        // A damaged header means the file isn't opened at all
+        file = fopen(test_db_name, "r+b");
+        check(file != NULL);
+        fseek(file, DB_HEADER_TABLE_ROOT_OFFSET, SEEK_SET);
+        byte = 7;
+        fwrite(&byte, 1, 1, file);
+        fclose(file);
+        table = db_open(test_db_name);
+        check(table == NULL);
+    }
+
+    it("reports a damaged page to the statement that reads it")
+    {
+        FILE*    file;
+        Table*   table;
+        uint8_t  byte;
+        uint32_t leaf_page_num;
+        uint32_t bad_id;
+        char     input[64];
+
+        remove(test_db_name);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(insert_rows(table, INTEGRITY_SPEC_ROWS) == INTEGRITY_SPEC_ROWS);
+        // A leaf in the middle of the table, so scans read it part way through
+        leaf_page_num = *internal_node_child(get_page(table->pager, table->root_page_num), 1);
+        bad_id        = *leaf_node_key(get_page(table->pager, leaf_page_num), 0);
+        db_close(table);
+
+        file = fopen(test_db_name, "r+b");
+        check(file != NULL);
+        fseek(file, (long) leaf_page_num * PAGE_SIZE + PAGE_SIZE / 2, SEEK_SET);
+        check(fread(&byte, 1, 1, file) == 1);
+        byte ^= 0x10;
+        fseek(file, (long) leaf_page_num * PAGE_SIZE + PAGE_SIZE / 2, SEEK_SET);
+        fwrite(&byte, 1, 1, file);
+        fclose(file);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "select count(*)", NULL, 0) == EXECUTE_CORRUPT);
+        check(run_statement(table, "select sum(id)", NULL, 0) == EXECUTE_CORRUPT);
+        check(run_statement(table, "select", NULL, 0) == EXECUTE_CORRUPT);
+        check(run_statement(table, "select where username = user1", NULL, 0) == EXECUTE_CORRUPT);
+        check(run_statement(table, "select domain(email), count(*) group by domain(email)", NULL, 0) == EXECUTE_CORRUPT);
+        sprintf(input, "select where id = %u", bad_id);
+        check(run_statement(table, input, NULL, 0) == EXECUTE_CORRUPT);
+        sprintf(input, "insert %u user email@domain.net", (uint32_t) INTEGRITY_SPEC_ROWS + 1);
+        check(run_statement(table, input, NULL, 0) == EXECUTE_SUCCESS);
+        sprintf(input, "insert or replace %u user email@domain.net", bad_id);
+        check(run_statement(table, input, NULL, 0) == EXECUTE_CORRUPT);
+
+        // Nothing is deleted when some of the rows can't be read
+        check(run_statement(table, "select count(*) where id = 1", NULL, 0) == EXECUTE_SUCCESS);
+        check(run_statement(table, "delete where id > 0", NULL, 0) == EXECUTE_CORRUPT);
+        check(run_statement(table, "select where id = 1", NULL, 0) == EXECUTE_SUCCESS);
+        check(*leaf_node_num_cells(get_page(table->pager, *internal_node_child(
+                get_page(table->pager, table->root_page_num), 0))) > 0);
+
+        check(db_vacuum(table, VACUUM_DEFAULT_FILL_FACTOR, NULL) == VACUUM_IO_ERROR);
+        check(db_integrity_check(table) > 0);
+        pager_close(table->pager);
+        free(table);
+    }
+
+    it("finds broken tree invariants")
+    {
+        Table*   table;
+        void*    root;
+        void*    leaf;
+        uint32_t tmp;
+
+        remove(test_db_name);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(insert_rows(table, INTEGRITY_SPEC_ROWS) == INTEGRITY_SPEC_ROWS);
+        check(db_integrity_check(table) == 0);
+
+        // Keys out of order within a leaf
+        root = get_page(table->pager, table->root_page_num);
+        leaf = get_page(table->pager, *internal_node_child(root, 1));
+        tmp  = *leaf_node_key(leaf, 0);
+        *leaf_node_key(leaf, 0) = *leaf_node_key(leaf, 1);
+        *leaf_node_key(leaf, 1) = tmp;
+        check(db_integrity_check(table) > 0);
+        *leaf_node_key(leaf, 1) = *leaf_node_key(leaf, 0);
+        *leaf_node_key(leaf, 0) = tmp;
+        check(db_integrity_check(table) == 0);
+
+        // A wrong parent pointer and a broken leaf chain
+        *node_parent(leaf) = 0;
+        check(db_integrity_check(table) == 1);
+        *node_parent(leaf) = table->root_page_num;
+        tmp = *leaf_node_next_leaf(leaf);
+        *leaf_node_next_leaf(leaf) = 0;
+        check(db_integrity_check(table) > 0);
+        *leaf_node_next_leaf(leaf) = tmp;
+
+        // A page that nothing points to
+        get_page(table->pager, get_unused_page_num(table->pager));
+        init_leaf_node_value(get_page(table->pager, table->pager->num_pages - 1));
+        check(db_integrity_check(table) == 1);
+        pager_free_page(table->pager, table->pager->num_pages - 1);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+}
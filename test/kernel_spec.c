@@ -0,0 +1,91 @@
+/*
+ * KERNEL_SPEC
+ * BDD test for vectorized string filters
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// units under test 
+#include "kernel.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+
+#define KERNEL_SPEC_NUM_ROWS 200
+
+
+spec("kernel")
+{
+    it("matches the scalar kernel with every implementation")
+    {
+        static uint8_t values[KERNEL_SPEC_NUM_ROWS * ROW_SIZE];
+        char*    patterns[] = {"user1", "user12", "", "@domain3.net", "3.n", "x", 
+                               "a_very_long_pattern_that_is_longer_than_one_vector@d"};
+        KernelOp ops[] = {KERNEL_EQ, KERNEL_PREFIX, KERNEL_CONTAINS};
+        uint64_t expected[KERNEL_BITMAP_WORDS(KERNEL_SPEC_NUM_ROWS)];
+        uint64_t sse4[KERNEL_BITMAP_WORDS(KERNEL_SPEC_NUM_ROWS)];
+        uint64_t avx2[KERNEL_BITMAP_WORDS(KERNEL_SPEC_NUM_ROWS)];
+        uint64_t best[KERNEL_BITMAP_WORDS(KERNEL_SPEC_NUM_ROWS)];
+        Row      row;
+
+        fprintf(stdout, "[%s] using %s kernels\n", __func__, kernel_impl_name());
+        srand(2020);
+        for(int r = 0; r < KERNEL_SPEC_NUM_ROWS; ++r)
+        {
+            memset(&row, 0, sizeof(row));
+            row.id = r;
+            sprintf(row.username, "user%d", r % 40);
+            if(r % 17 == 0)
+                sprintf(row.email, "a_very_long_pattern_that_is_longer_than_one_vector@d%d", r);
+            else
+                sprintf(row.email, "user%d@domain%d.net", rand() % 1000, r % 7);
+            serialize_row(&row, values + r * ROW_SIZE);
+        }
+
+        for(size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); ++p)
+        {
+            for(size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o)
+            {
+                for(int column = 0; column < 2; ++column)
+                {
+                    KernelPattern pattern;
+
+                    kernel_pattern_init(
+                        &pattern, ops[o], 
+                        column ? EMAIL_OFFSET : USERNAME_OFFSET, 
+                        column ? EMAIL_SIZE : USERNAME_SIZE, 
+                        patterns[p]
+                    );
+                    kernel_bitmap_fill(expected, KERNEL_SPEC_NUM_ROWS);
+                    kernel_bitmap_fill(sse4, KERNEL_SPEC_NUM_ROWS);
+                    kernel_bitmap_fill(avx2, KERNEL_SPEC_NUM_ROWS);
+                    kernel_bitmap_fill(best, KERNEL_SPEC_NUM_ROWS);
+                    kernel_filter_scalar(&pattern, values, ROW_SIZE, KERNEL_SPEC_NUM_ROWS, expected);
+                    kernel_filter_sse4(&pattern, values, ROW_SIZE, KERNEL_SPEC_NUM_ROWS, sse4);
+                    kernel_filter_avx2(&pattern, values, ROW_SIZE, KERNEL_SPEC_NUM_ROWS, avx2);
+                    kernel_filter(&pattern, values, ROW_SIZE, KERNEL_SPEC_NUM_ROWS, best);
+
+                    check(memcmp(expected, sse4, sizeof(expected)) == 0, "sse4 differs for [%s]", patterns[p]);
+                    check(memcmp(expected, avx2, sizeof(expected)) == 0, "avx2 differs for [%s]", patterns[p]);
+                    check(memcmp(expected, best, sizeof(expected)) == 0);
+                }
+            }
+        }
+
+        // spot check the scalar kernel against the C library
+        for(int r = 0; r < KERNEL_SPEC_NUM_ROWS; ++r)
+        {
+            KernelPattern pattern;
+
+            kernel_pattern_init(&pattern, KERNEL_CONTAINS, EMAIL_OFFSET, EMAIL_SIZE, "@domain3.net");
+            kernel_bitmap_fill(expected, KERNEL_SPEC_NUM_ROWS);
+            kernel_filter_scalar(&pattern, values, ROW_SIZE, KERNEL_SPEC_NUM_ROWS, expected);
+            deserialize_row(values + r * ROW_SIZE, &row);
+            check(((expected[r / 64] >> (r % 64)) & 1) == (strstr(row.email, "@domain3.net") != NULL));
+        }
+    }
+}
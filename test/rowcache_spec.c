@@ -0,0 +1,214 @@
+/*
+ * ROWCACHE_SPEC
+ * BDD test for the cache of rows looked up by id
+ *
+ * Stefan Wong 2020
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "rowcache.h"
+#include "input.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+
+#define TEST_NUM_THREADS 4
+
+/*
+ * make_row()
+ */
+static void make_row(Row* row, uint32_t id)
+{
+    memset(row, 0, sizeof(Row));
+    row->id = id;
+    sprintf(row->username, "user%u", id);
+    sprintf(row->email, "user%u@domain.net", id);
+}
+
+// Each thread looks up and adds its own ids and some shared ones
+typedef struct
+{
+    RowCache* cache;
+    uint32_t  first_id;
+    uint32_t  num_bad;          // rows that came back with the wrong contents
+} ThreadArgs;
+
+/*
+ * lookup_thread()
+ */
+static void* lookup_thread(void* arg)
+{
+    ThreadArgs* args = arg;
+    Row         row;
+    Row         expected;
+
+    for(uint32_t i = 0; i < 20000; ++i)
+    {
+        uint32_t id = (i % 3 == 0) ? i % 50 : args->first_id + i % 500;
+
+        if(row_cache_get(args->cache, id, &row))
+        {
+            make_row(&expected, id);
+            if(memcmp(&row, &expected, sizeof(Row)) != 0)
+                args->num_bad++;
+        }
+        else
+        {
+            make_row(&row, id);
+            row_cache_put(args->cache, &row);
+        }
+    }
+
+    return NULL;
+}
+
+
+spec("rowcache")
+{
+    static const char* test_db_name = "test/test_rowcache.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("keeps, replaces and forgets rows")
+    {
+        RowCache* cache;
+        Row       row;
+        uint64_t  hits;
+        uint64_t  misses;
+
+        cache = row_cache_create(ROW_CACHE_DEFAULT_ROWS);
+        check(row_cache_capacity(cache) >= ROW_CACHE_DEFAULT_ROWS);
+        check(!row_cache_get(cache, 5, &row));
+        make_row(&row, 5);
+        row_cache_put(cache, &row);
+        memset(&row, 0, sizeof(Row));
+        check(row_cache_get(cache, 5, &row));
+        check(row.id == 5);
+        check(strcmp(row.username, "user5") == 0);
+        check(strcmp(row.email, "user5@domain.net") == 0);
+
+        // A newer copy of a row replaces the old one
+        strcpy(row.username, "renamed");
+        row_cache_put(cache, &row);
+        check(row_cache_get(cache, 5, &row));
+        check(strcmp(row.username, "renamed") == 0);
+
+        row_cache_invalidate(cache, 5);
+        check(!row_cache_get(cache, 5, &row));
+        make_row(&row, 6);
+        row_cache_put(cache, &row);
+        row_cache_clear(cache);
+        check(!row_cache_get(cache, 6, &row));
+
+        row_cache_stats(cache, &hits, &misses);
+        check(hits == 2);
+        check(misses == 3);
+        row_cache_free(cache);
+    }
+
+    it("keeps the hot rows when it is full")
+    {
+        RowCache* cache;
+        Row       row;
+        uint32_t  num_cached = 0;
+
+        // The smallest cache has one bucket in each stripe
+        cache = row_cache_create(1);
+        check(row_cache_capacity(cache) == ROW_CACHE_STRIPES * ROW_CACHE_WAYS);
+        make_row(&row, 7);
+        row_cache_put(cache, &row);
+        for(uint32_t id = 100; id < 2000; ++id)
+        {
+            make_row(&row, id);
+            row_cache_put(cache, &row);
+            check(row_cache_get(cache, 7, &row));
+        }
+        for(uint32_t id = 100; id < 2000; ++id)
+            num_cached += row_cache_get(cache, id, &row);
+        check(num_cached < row_cache_capacity(cache));
+        check(row_cache_get(cache, 1999, &row));
+        row_cache_free(cache);
+    }
+
+    it("is safe to share between threads")
+    {
+        RowCache*  cache;
+        pthread_t  threads[TEST_NUM_THREADS];
+        ThreadArgs args[TEST_NUM_THREADS];
+        uint64_t   hits;
+        uint64_t   misses;
+
+        cache = row_cache_create(256);
+        for(int t = 0; t < TEST_NUM_THREADS; ++t)
+        {
+            args[t].cache    = cache;
+            args[t].first_id = 1000 * (t + 1);
+            args[t].num_bad  = 0;
+            check(pthread_create(&threads[t], NULL, lookup_thread, &args[t]) == 0);
+        }
+        for(int t = 0; t < TEST_NUM_THREADS; ++t)
+            pthread_join(threads[t], NULL);
+        for(int t = 0; t < TEST_NUM_THREADS; ++t)
+            check(args[t].num_bad == 0);
+        row_cache_stats(cache, &hits, &misses);
+        check(hits + misses == TEST_NUM_THREADS * 20000);
+        check(hits > 0);
+        row_cache_free(cache);
+    }
+
+    it("serves selects on id and sees every write")
+    {
+        char     input[256];
+        char     output[1024];
+        Table*   table;
+        uint64_t hits;
+        uint64_t misses;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        table->row_cache = row_cache_create(ROW_CACHE_DEFAULT_ROWS);
+        for(int i = 1; i <= 50; ++i)
+        {
+            sprintf(input, "insert %d user%d person%d@example.com", i, i, i);
+            check(run_statement(table, input, output, sizeof(output)) == EXECUTE_SUCCESS);
+        }
+
+        check(run_statement(table, "select where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(20, user20, person20@example.com)\n") == 0);
+        check(run_statement(table, "select email where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(person20@example.com)\n") == 0);
+        row_cache_stats(table->row_cache, &hits, &misses);
+        check(hits == 1);
+        check(misses == 1);
+
+        // The other predicates are still checked against a cached row
+        check(run_statement(table, "select where id = 20 and username = nobody", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "") == 0);
+        check(run_statement(table, "select count(*) where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(1)\n") == 0);
+        check(run_statement(table, "select where id = 99", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "") == 0);
+
+        check(run_statement(table, "update set username = renamed where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(20, renamed, person20@example.com)\n") == 0);
+        check(run_statement(table, "delete where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "") == 0);
+        check(run_statement(table, "insert 20 again person20@example.com", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select username where id = 20", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(again)\n") == 0);
+
+        db_close(table);
+    }
+}
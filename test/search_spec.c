@@ -0,0 +1,49 @@
+/*
+ * SEARCH_SPEC
+ * BDD test for key search within nodes
+ *
+ * Stefan Wong 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test 
+#include "search.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+spec("search")
+{
+    it("finds the same lower bound with every implementation")
+    {
+        uint32_t keys[INTERNAL_NODE_MAX_CELLS];
+        uint32_t num_keys;
+        uint32_t expected;
+
+        fprintf(stdout, "[%s] using %s key search\n", __func__, key_search_impl_name());
+        srand(2020);
+        for(int trial = 0; trial < 200; ++trial)
+        {
+            // sorted keys with gaps and duplicates, some above INT32_MAX
+            num_keys = rand() % INTERNAL_NODE_MAX_CELLS;
+            keys[0]  = (trial % 2) ? 0x7FFFFFF0 : 0;
+            for(uint32_t k = 1; k < num_keys; ++k)
+                keys[k] = keys[k-1] + (rand() % 3);
+
+            for(int probe = 0; probe < 50; ++probe)
+            {
+                uint32_t key = keys[0] + (rand() % (2 * num_keys + 2)) - 1;
+
+                expected = key_lower_bound_scalar(keys, num_keys, key);
+                check(expected == 0 || keys[expected-1] < key);
+                check(expected == num_keys || keys[expected] >= key);
+                check(key_lower_bound_sse4(keys, num_keys, key) == expected);
+                check(key_lower_bound_avx2(keys, num_keys, key) == expected);
+                check(key_lower_bound(keys, num_keys, key) == expected);
+            }
+        }
+    }
+}
@@ -0,0 +1,302 @@
+/*
+ * SORT_SPEC
+ * BDD test for order by and the sorter
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// units under test
+#include "input.h"
+#include "sort.h"
+#include "table.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+/*
+ * make_row()
+ * Usernames repeat every 97 rows so that ties have to be broken by id
+ */
+static void make_row(Row* row, uint32_t id)
+{
+    row->id = id;
+    sprintf(row->username, "user%05u", (id * 7919) % 97);
+    sprintf(row->email, "user%u@domain.net", id);
+}
+
+/*
+ * check_sorted()
+ * Read every row out of a finished sorter. Returns the number of rows,
+ * or -1 if any row is out of order.
+ */
+static int check_sorted(Sorter* sorter)
+{
+    Row prev;
+    Row row;
+    int num_rows = 0;
+
+    while(sort_next(sorter, &row) == SORT_OK)
+    {
+        if(num_rows > 0 && sort_compare(sorter, &prev, &row) >= 0)
+            return -1;
+        prev = row;
+        num_rows++;
+    }
+
+    return num_rows;
+}
+
+/*
+ * run_select()
+ * Execute a statement with stdout sent to a file, and read back what it
+ * printed into output
+ */
+static ExecuteResult run_select(Table* table, const char* text, char* output, size_t size)
+{
+    char          input[256];
+    InputBuffer   input_buffer;
+    Statement     statement;
+    ExecuteResult result;
+    FILE*         fp;
+    size_t        len;
+    int           saved;
+
+    strcpy(input, text);
+    input_buffer.buffer = input;
+    if(prepare_statement(&input_buffer, &statement) != PREPARE_SUCCESS)
+        return EXECUTE_BAD_VALUE;
+
+    fp = tmpfile();
+    fflush(stdout);
+    saved = dup(fileno(stdout));
+    dup2(fileno(fp), fileno(stdout));
+    result = execute_statement(&statement, table);
+    fflush(stdout);
+    dup2(saved, fileno(stdout));
+    close(saved);
+
+    rewind(fp);
+    len = fread(output, 1, size - 1, fp);
+    output[len] = '\0';
+    fclose(fp);
+
+    return result;
+}
+
+
+spec("sort")
+{
+    static const char* test_db_name = "test/test_sort.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("sorts rows in memory")
+    {
+        Sorter   sorter;
+        Row      row;
+
+        check(sort_init(&sorter, LEAF_COLUMN_USERNAME, 0, SORT_NO_LIMIT, SORT_DEFAULT_MEMORY) == SORT_OK);
+        for(uint32_t i = 1; i <= 1000; ++i)
+        {
+            make_row(&row, i);
+            check(sort_add(&sorter, &row) == SORT_OK);
+        }
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sorter.num_spills == 0);
+        check(check_sorted(&sorter) == 1000);
+        sort_free(&sorter);
+
+        check(sort_init(&sorter, LEAF_COLUMN_EMAIL, 1, SORT_NO_LIMIT, SORT_DEFAULT_MEMORY) == SORT_OK);
+        for(uint32_t i = 1; i <= 1000; ++i)
+        {
+            make_row(&row, i);
+            check(sort_add(&sorter, &row) == SORT_OK);
+        }
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sort_next(&sorter, &row) == SORT_OK);
+        // '@' sorts after the digits
+        check(strcmp(row.email, "user9@domain.net") == 0);
+        sort_free(&sorter);
+    }
+
+    it("spills runs to files and merges them")
+    {
+        Sorter   sorter;
+        Row      row;
+        uint32_t num_rows;
+
+        // Enough rows for more runs than the merge fan in
+        check(sort_init(&sorter, LEAF_COLUMN_USERNAME, 1, SORT_NO_LIMIT, SORT_MIN_MEMORY) == SORT_OK);
+        num_rows = sorter.max_rows * (SORT_MERGE_FANIN + 4) + 17;
+        for(uint32_t i = 1; i <= num_rows; ++i)
+        {
+            make_row(&row, i);
+            check(sort_add(&sorter, &row) == SORT_OK);
+        }
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sorter.num_spills > SORT_MERGE_FANIN);
+        check(sorter.num_runs <= SORT_MERGE_FANIN);
+        check(check_sorted(&sorter) == (int) num_rows);
+        sort_free(&sorter);
+    }
+
+    it("keeps only the top rows for a limit")
+    {
+        Sorter   sorter;
+        Row      row;
+
+        check(sort_init(&sorter, LEAF_COLUMN_EMAIL, 0, 10, SORT_MIN_MEMORY) == SORT_OK);
+        check(sorter.top_n);
+        for(uint32_t i = 5000; i >= 1; --i)
+        {
+            make_row(&row, i);
+            check(sort_add(&sorter, &row) == SORT_OK);
+        }
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sorter.num_spills == 0);
+        check(sort_next(&sorter, &row) == SORT_OK);
+        check(strcmp(row.email, "user1000@domain.net") == 0);
+        check(check_sorted(&sorter) == 9);
+        sort_free(&sorter);
+
+        // A limit larger than the budget falls back to a full sort
+        check(sort_init(&sorter, LEAF_COLUMN_EMAIL, 0, 100000, SORT_MIN_MEMORY) == SORT_OK);
+        check(!sorter.top_n);
+        for(uint32_t i = 1; i <= 1000; ++i)
+        {
+            make_row(&row, i);
+            check(sort_add(&sorter, &row) == SORT_OK);
+        }
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sorter.num_spills > 0);
+        check(check_sorted(&sorter) == 1000);
+        sort_free(&sorter);
+
+        // And a limit of zero returns nothing
+        check(sort_init(&sorter, LEAF_COLUMN_ID, 0, 0, SORT_MIN_MEMORY) == SORT_OK);
+        make_row(&row, 1);
+        check(sort_add(&sorter, &row) == SORT_OK);
+        check(sort_finish(&sorter) == SORT_OK);
+        check(sort_next(&sorter, &row) == SORT_END);
+        sort_free(&sorter);
+    }
+
+    it("parses order by and limit")
+    {
+        char         input[256];
+        const char*  bad_orders[] = {
+            "select order id", "select order by", "select order by bogus",
+            "select order by id up", "select limit", "select limit -1", "select limit 5x",
+            "select order by id limit 1 extra", "select count(*) order by id",
+            "select count(*) limit 1", "select limit 1 order by id"
+        };
+        Statement    statement;
+        InputBuffer  buffer;
+        InputBuffer* input_buffer = &buffer;
+
+
+        strcpy(input, "select id, email where id > 2 order by email desc limit 5");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.projection.num_columns == 2);
+        check(statement.where.num_predicates == 1);
+        check(statement.order.sorted);
+        check(statement.order.column == COLUMN_EMAIL);
+        check(statement.order.descending);
+        check(statement.order.limit == 5);
+
+        strcpy(input, "select order by username");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.order.sorted);
+        check(statement.order.column == COLUMN_USERNAME);
+        check(!statement.order.descending);
+        check(statement.order.limit == SORT_NO_LIMIT);
+
+        strcpy(input, "select limit 3");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(!statement.order.sorted);
+        check(statement.order.limit == 3);
+
+        strcpy(input, "select");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(!statement.order.sorted);
+        check(statement.order.limit == SORT_NO_LIMIT);
+
+        for(size_t b = 0; b < sizeof(bad_orders) / sizeof(bad_orders[0]); ++b)
+        {
+            strcpy(input, bad_orders[b]);
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SYNTAX_ERROR);
+        }
+        // the where clause of a delete still ends the statement
+        strcpy(input, "delete where id = 1 order by id");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SYNTAX_ERROR);
+
+    }
+
+    it("orders the rows of a select")
+    {
+        char         input[256];
+        char*        output;
+        Statement    statement;
+        InputBuffer  buffer;
+        InputBuffer* input_buffer = &buffer;
+        Table*       table;
+
+        output = malloc(64 * 1024);
+        check(output != NULL);
+        table = db_open(test_db_name);
+        check(table != NULL);
+        // usernames go down as ids go up
+        for(int i = 1; i <= 300; ++i)
+        {
+            sprintf(input, "insert %d user%03d email%03d@domain.net", i, 301 - i, i % 100);
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+            check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+        }
+
+        check(run_select(table, "select id order by username limit 3", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(300)\n(299)\n(298)\n") == 0);
+        check(run_select(table, "select username order by username desc limit 2", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(user300)\n(user299)\n") == 0);
+        check(run_select(table, "select id where id > 297 order by id desc", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(300)\n(299)\n(298)\n") == 0);
+        // already in order, and the limit ends the scan
+        check(run_select(table, "select id limit 2", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(1)\n(2)\n") == 0);
+        check(run_select(table, "select id limit 0", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "") == 0);
+
+        // Through the email index, with ties on email in id order
+        check(run_select(table, "select id, email where email < email002@domain.net order by email limit 4",
+                    output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(100, email000@domain.net)\n(200, email000@domain.net)\n"
+                             "(300, email000@domain.net)\n(1, email001@domain.net)\n") == 0);
+        check(run_select(table, "select id where email >= email098@domain.net order by username",
+                    output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(299)\n(298)\n(199)\n(198)\n(99)\n(98)\n") == 0);
+
+        // A small budget spills to files and gives the same rows
+        table->sort_memory = SORT_MIN_MEMORY;
+        check(run_select(table, "select id order by username", output, 64 * 1024) == EXECUTE_SUCCESS);
+        check(strncmp(output, "(300)\n(299)\n(298)\n", 18) == 0);
+        check(strcmp(output + strlen(output) - 8, "(2)\n(1)\n") == 0);
+        check(strlen(output) == 9 * 4 + 90 * 5 + 201 * 6);
+
+        db_close(table);
+        free(output);
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * SPEC_UTIL
+ * Helpers shared by the specs that run statements
+ *
+ * Stefan Wong 2020
+ */
+
+#ifndef __SQ_SPEC_UTIL_H
+#define __SQ_SPEC_UTIL_H
+
+#include <stdio.h>
+#include <string.h>
+#include "input.h"
+#include "table.h"
+
+/*
+ * A statement that doesn't prepare gives back its PrepareResult moved
+ * past every ExecuteResult, so it can never pass for one
+ */
+#define RUN_PREPARE_FAILED(prep_result) (1000 + (prep_result))
+
+/*
+ * run_statement()
+ * Prepare and execute a statement. What a select prints is kept in
+ * output, which may be NULL if it isn't needed. Returns the
+ * ExecuteResult, or RUN_PREPARE_FAILED() of the PrepareResult.
+ */
+static int run_statement(Table* table, const char* text, char* output, size_t size)
+{
+    char          input[512];
+    InputBuffer   input_buffer;
+    Statement     statement;
+    PrepareResult prep_result;
+    ExecuteResult result;
+    FILE*         fp;
+    size_t        len;
+
+    strcpy(input, text);
+    input_buffer.buffer = input;
+    prep_result = prepare_statement(&input_buffer, &statement);
+    if(prep_result != PREPARE_SUCCESS)
+        return RUN_PREPARE_FAILED(prep_result);
+
+    fp            = tmpfile();
+    table->output = fp;
+    result        = execute_statement(&statement, table);
+    table->output = stdout;
+
+    if(output != NULL)
+    {
+        rewind(fp);
+        len = fread(output, 1, size - 1, fp);
+        output[len] = '\0';
+    }
+    fclose(fp);
+
+    return result;
+}
+
+#endif /*__SQ_SPEC_UTIL_H*/
@@ -0,0 +1,157 @@
+/*
+ * TRACE_SPEC
+ * BDD test for span timing
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "input.h"
+#include "table.h"
+#include "trace.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+/*
+ * read_trace()
+ * Write a trace to a temporary file and read it back as a string
+ */
+static char* read_trace(void (*write_trace)(FILE*))
+{
+    FILE* fp;
+    long  length;
+    char* text;
+
+    fp = tmpfile();
+    write_trace(fp);
+    length = ftell(fp);
+    rewind(fp);
+    text = calloc(length + 1, 1);
+    if(fread(text, 1, length, fp) != (size_t) length)
+        text[0] = '\0';
+    fclose(fp);
+
+    return text;
+}
+
+
+spec("trace")
+{
+    static const char* test_db_name = "test/test_trace.db";
+
+    it("buckets durations by powers of two")
+    {
+        check(trace_bucket(0) == 0);
+        check(trace_bucket(1) == 1);
+        check(trace_bucket(2) == 2);
+        check(trace_bucket(3) == 2);
+        check(trace_bucket(4) == 3);
+        check(trace_bucket(1023) == 10);
+        check(trace_bucket(1024) == 11);
+        check(trace_bucket(UINT64_MAX) == TRACE_HISTOGRAM_BUCKETS - 1);
+        check(trace_now() > 0);
+        check(trace_now() <= trace_now());
+    }
+
+    it("keeps histograms and recent events")
+    {
+        TraceHistogram* hist;
+        char*           text;
+
+        trace_reset();
+        trace_record(TRACE_PAGE_READ, 1000, 1100);
+        trace_record(TRACE_PAGE_READ, 2000, 2003);
+        trace_record(TRACE_PAGE_READ, 3000, 3700);
+        hist = trace_histogram(TRACE_PAGE_READ);
+        check(hist->count == 3);
+        check(hist->total_ns == 803);
+        check(hist->min_ns == 3);
+        check(hist->max_ns == 700);
+        check(hist->buckets[trace_bucket(3)] == 1);
+        check(hist->buckets[trace_bucket(100)] == 1);
+        check(hist->buckets[trace_bucket(700)] == 1);
+        check(trace_histogram(TRACE_FLUSH)->count == 0);
+        check(trace_num_events() == 3);
+
+        text = read_trace(trace_write_json);
+        check(strstr(text, "\"name\": \"page_read\", \"count\": 3, \"total_ns\": 803") != NULL);
+        check(strstr(text, "{\"lt_ns\": 4, \"count\": 1}") != NULL);
+        check(strstr(text, "\"name\": \"flush\", \"count\": 0") != NULL);
+        free(text);
+
+        // Times are relative to the earliest event, in microseconds
+        text = read_trace(trace_write_chrome);
+        check(strstr(text, "\"traceEvents\"") != NULL);
+        check(strstr(text, "\"ph\": \"X\", \"ts\": 0.000, \"dur\": 0.100") != NULL);
+        check(strstr(text, "\"ts\": 2.000, \"dur\": 0.700") != NULL);
+        free(text);
+
+        // Only the newest events are kept
+        for(uint32_t e = 0; e < TRACE_MAX_EVENTS + 10; ++e)
+            trace_record(TRACE_FLUSH, e, e + 1);
+        check(trace_num_events() == TRACE_MAX_EVENTS);
+        check(trace_histogram(TRACE_FLUSH)->count == TRACE_MAX_EVENTS + 10);
+
+        trace_reset();
+        check(trace_num_events() == 0);
+        check(trace_histogram(TRACE_PAGE_READ)->count == 0);
+    }
+
+    it("times each part of a statement")
+    {
+        char          input[256];
+        Table*        table;
+        Statement     statement;
+        InputBuffer*  input_buffer;
+        int           num_rows = 50;
+        uint64_t      num_reads;
+
+        if(!trace_enabled())
+            return;
+
+        remove(test_db_name);
+        trace_reset();
+        table = db_open(test_db_name);
+        check(table != NULL);
+        input_buffer = new_input_buffer();
+        for(int i = 1; i <= num_rows; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+            check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+        }
+        check(trace_histogram(TRACE_PARSE)->count == (uint64_t) num_rows);
+        check(trace_histogram(TRACE_STATEMENT)->count == (uint64_t) num_rows);
+        check(trace_histogram(TRACE_DESCEND)->count == (uint64_t) num_rows);
+        check(trace_histogram(TRACE_CELL_WRITE)->count == (uint64_t) num_rows);
+        check(trace_histogram(TRACE_STATEMENT)->total_ns >= trace_histogram(TRACE_CELL_WRITE)->total_ns);
+        check(trace_histogram(TRACE_FLUSH)->count == 0);
+        db_close(table);
+        check(trace_histogram(TRACE_FLUSH)->count > 0);
+
+        // Pages only count as reads when they miss the cache
+        trace_reset();
+        table = db_open(test_db_name);
+        check(table != NULL);
+        strcpy(input, "select count(*) where id > 10");
+        input_buffer->buffer = input;
+        check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+        check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+        check(trace_histogram(TRACE_PLAN)->count == 1);
+        num_reads = trace_histogram(TRACE_PAGE_READ)->count;
+        check(num_reads > 1);
+        check(num_reads <= table->pager->num_pages);
+        check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+        check(trace_histogram(TRACE_PAGE_READ)->count == num_reads);
+        db_close(table);
+
+        free(input_buffer);
+        remove(test_db_name);
+    }
+}
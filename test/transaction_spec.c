@@ -0,0 +1,195 @@
+/*
+ * TRANSACTION_SPEC
+ * BDD test for begin, commit and rollback
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+// units under test
+#include "input.h"
+#include "table.h"
+#include "catalog.h"
+#include "integrity.h"
+#include "rowcache.h"
+#include "vacuum.h"
+// testing framework
+#include "bdd-for-c.h"
+#include "spec_util.h"
+
+
+/*
+ * insert_rows()
+ */
+static int insert_rows(Table* table, uint32_t first, uint32_t last)
+{
+    char input[256];
+    char output[64];
+
+    for(uint32_t i = first; i <= last; ++i)
+    {
+        sprintf(input, "insert %u user%u person%u@example.com", i, i, i);
+        if(run_statement(table, input, output, sizeof(output)) != EXECUTE_SUCCESS)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * file_size()
+ */
+static long file_size(const char* filename)
+{
+    struct stat st;
+
+    if(stat(filename, &st) != 0)
+        return -1;
+
+    return (long) st.st_size;
+}
+
+
+spec("transaction")
+{
+    static const char* test_db_name = "test/test_transaction.db";
+
+    after_each()
+    {
+        remove(test_db_name);
+    }
+
+    it("parses begin, commit and rollback")
+    {
+        char        input[64];
+        InputBuffer input_buffer;
+        Statement   statement;
+
+        input_buffer.buffer = input;
+        strcpy(input, "begin");
+        check(prepare_statement(&input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.type == STATEMENT_BEGIN);
+        strcpy(input, "commit");
+        check(prepare_statement(&input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.type == STATEMENT_COMMIT);
+        strcpy(input, "rollback ");
+        check(prepare_statement(&input_buffer, &statement) == PREPARE_SUCCESS);
+        check(statement.type == STATEMENT_ROLLBACK);
+
+        strcpy(input, "begin now");
+        check(prepare_statement(&input_buffer, &statement) == PREPARE_SYNTAX_ERROR);
+        strcpy(input, "beginning");
+        check(prepare_statement(&input_buffer, &statement) == PREPARE_UNRECOGNIZED_STATEMENT);
+    }
+
+    it("only commits or rolls back a transaction that was begun")
+    {
+        char   output[64];
+        Table* table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "commit", output, sizeof(output)) == EXECUTE_NO_TRANSACTION);
+        check(run_statement(table, "rollback", output, sizeof(output)) == EXECUTE_NO_TRANSACTION);
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_IN_TRANSACTION);
+        check(db_vacuum(table, VACUUM_DEFAULT_FILL_FACTOR, NULL) == VACUUM_IN_TRANSACTION);
+        check(run_statement(table, "commit", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "commit", output, sizeof(output)) == EXECUTE_NO_TRANSACTION);
+        db_close(table);
+    }
+
+    it("writes the file once at commit")
+    {
+        char   output[64];
+        long   begin_size;
+        Table* table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(insert_rows(table, 1, 10));
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_SUCCESS);
+        begin_size = file_size(test_db_name);
+        check(begin_size == (long) (table->pager->num_pages * PAGE_SIZE));
+
+        // Enough rows for new pages whatever the page size
+        check(insert_rows(table, 11, 100 * (PAGE_SIZE / PAGE_SIZE_MIN)));
+        check(file_size(test_db_name) == begin_size);
+        check(run_statement(table, "commit", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(file_size(test_db_name) == (long) (table->pager->num_pages * PAGE_SIZE));
+        check(file_size(test_db_name) > begin_size);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+
+    it("puts back every page on rollback")
+    {
+        char     output[256];
+        uint32_t num_pages;
+        Table*   table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        table->row_cache = row_cache_create(ROW_CACHE_DEFAULT_ROWS);
+        check(insert_rows(table, 1, 40));
+        check(run_statement(table, "select where id = 7", output, sizeof(output)) == EXECUTE_SUCCESS);
+        num_pages = table->pager->num_pages;
+
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_SUCCESS);
+        // enough rows to split the root
+        check(insert_rows(table, 41, 200));
+        check(run_statement(table, "delete where id > 10 and id <= 30", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "update set email = changed@example.com where id = 7", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "create table t (id integer, name text(8))", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "insert into t values (1, a)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(180)\n") == 0);
+        check(run_statement(table, "select where id = 7", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(7, user7, changed@example.com)\n") == 0);
+        check(table->pager->num_pages > num_pages);
+
+        check(run_statement(table, "rollback", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(table->pager->num_pages == num_pages);
+        check(catalog_find(table, "t") == NULL);
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(40)\n") == 0);
+        check(run_statement(table, "select where id = 7", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(7, user7, person7@example.com)\n") == 0);
+        check(run_statement(table, "select count(*) where email = changed@example.com", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(0)\n") == 0);
+        check(db_integrity_check(table) == 0);
+
+        // The table carries on from where it was
+        check(insert_rows(table, 41, 60));
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(60)\n") == 0);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+
+    it("keeps committed rows and drops the rest at close")
+    {
+        char   output[256];
+        Table* table;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(insert_rows(table, 1, 50));
+        check(run_statement(table, "commit", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(run_statement(table, "begin", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(insert_rows(table, 51, 100));
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(run_statement(table, "select count(*)", output, sizeof(output)) == EXECUTE_SUCCESS);
+        check(strcmp(output, "(50)\n") == 0);
+        check(db_integrity_check(table) == 0);
+        db_close(table);
+    }
+}
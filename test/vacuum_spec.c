@@ -0,0 +1,160 @@
+/*
+ * VACUUM_SPEC
+ * BDD test for rebuilding the database file
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>   // for stat()
+
+// units under test 
+#include "input.h"
+#include "table.h"
+#include "index.h"
+#include "vacuum.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+/*
+ * count_leading_ones()
+ * Number of ids from first to last whose email, email<id>@..., sorts 
+ * from email1 up to email2
+ */
+static int count_leading_ones(int first, int last)
+{
+    char id[16];
+    int  count = 0;
+
+    for(int i = first; i <= last; ++i)
+    {
+        sprintf(id, "%d", i);
+        if(id[0] == '1')
+            count++;
+    }
+
+    return count;
+}
+
+
+spec("vacuum")
+{
+    static const char* test_db_name = "test/test_vacuum.db";
+
+    after_each()
+    {
+        fprintf(stdout, "[%s] removing db file [%s]\n", __func__, test_db_name);
+        int status = remove(test_db_name);
+        if(status != 0)
+            fprintf(stderr, "[%s] failed to remove db file [%s]\n", __func__, test_db_name);
+    }
+
+    it("packs the leaves in key order and keeps every row")
+    {
+        char          input[256];
+        int           scale    = PAGE_SIZE / PAGE_SIZE_MIN;    // the same number of leaves for any page size
+        int           num_rows = 200 * scale;
+        int           first_deleted = 20 * scale + 1;
+        int           last_deleted  = 150 * scale;
+        int           num_seen;
+        uint32_t      prev_id;
+        uint32_t      prev_page_num;
+        Table*        table;
+        Statement     statement;
+        PrepareResult prep_result;
+        ExecuteResult exec_result;
+        InputBuffer*  input_buffer;
+        VacuumResult  vacuum_result;
+        VacuumStats   stats;
+        Cursor*       cursor;
+        Row           row;
+        struct stat   file_stat;
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        input_buffer = new_input_buffer();
+        check(input_buffer != NULL);
+
+        // Scattered inserts leave the leaves out of order in the file
+        for(int i = 0; i < num_rows; ++i)
+        {
+            int n = (i * 7919) % num_rows + 1;
+
+            sprintf(input, "insert %d user%d email%d@domain.net", n, n, n);
+            input_buffer->buffer = input;
+            prep_result = prepare_statement(input_buffer, &statement);
+            check(prep_result == PREPARE_SUCCESS);
+            exec_result = execute_statement(&statement, table);
+            check(exec_result == EXECUTE_SUCCESS);
+        }
+        // and deletes leave them part empty
+        sprintf(input, "delete where id >= %d and id <= %d", first_deleted, last_deleted);
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(exec_result == EXECUTE_SUCCESS);
+
+        check(db_vacuum(table, 0, &stats) == VACUUM_BAD_FILL_FACTOR);
+        vacuum_result = db_vacuum(table, VACUUM_DEFAULT_FILL_FACTOR, &stats);
+        check(vacuum_result == VACUUM_SUCCESS);
+        check(stats.new_size < stats.old_size);
+        check(stat(test_db_name, &file_stat) == 0);
+        check((uint64_t) file_stat.st_size == stats.new_size);
+
+        // Every row is still there and each leaf follows the previous one
+        num_seen      = 0;
+        prev_id       = 0;
+        prev_page_num = 0;
+        cursor        = table_start(table);
+        while(!cursor->end_of_table)
+        {
+            if(cursor->page_num != prev_page_num)
+            {
+                check(prev_page_num == 0 || cursor->page_num == prev_page_num + 1);
+                prev_page_num = cursor->page_num;
+            }
+            deserialize_row(cursor_value(cursor), &row);
+            check(row.id > prev_id);
+            prev_id = row.id;
+            num_seen++;
+            cursor_advance(cursor);
+        }
+        check(num_seen == num_rows - (last_deleted - first_deleted + 1));
+
+        // The index was rebuilt as well
+        strcpy(input, "select count(*) where email >= email1 and email < email2");
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(exec_result == EXECUTE_SUCCESS);
+        // 1, 10-19 and 151-199 with 4 KB pages
+        check(statement.aggregate.count == (uint64_t) (count_leading_ones(1, first_deleted - 1) +
+                    count_leading_ones(last_deleted + 1, num_rows)));
+
+        // and the tree can still change afterwards
+        for(int i = first_deleted; i <= last_deleted; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            input_buffer->buffer = input;
+            prep_result = prepare_statement(input_buffer, &statement);
+            check(prep_result == PREPARE_SUCCESS);
+            exec_result = execute_statement(&statement, table);
+            check(exec_result == EXECUTE_SUCCESS);
+        }
+        db_close(table);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        strcpy(input, "select count(*)");
+        input_buffer->buffer = input;
+        prep_result = prepare_statement(input_buffer, &statement);
+        check(prep_result == PREPARE_SUCCESS);
+        exec_result = execute_statement(&statement, table);
+        check(statement.aggregate.count == (uint64_t) num_rows);
+        db_close(table);
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * WORKLOAD_SPEC
+ * BDD test for workload recording and replay
+ *
+ * Stefan Wong 2020
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// units under test
+#include "input.h"
+#include "table.h"
+#include "workload.h"
+// testing framework
+#include "bdd-for-c.h"
+
+
+spec("workload")
+{
+    static const char* test_log_name = "test/test_workload.log";
+    static const char* test_db_name  = "test/test_workload.db";
+
+    after_each()
+    {
+        remove(test_log_name);
+        remove(test_db_name);
+    }
+
+    it("reads back what it records")
+    {
+        WorkloadWriter writer;
+        WorkloadReader reader;
+        FILE*          file;
+        char           text[WORKLOAD_MAX_STATEMENT + 1];
+        char           long_text[WORKLOAD_MAX_STATEMENT + 100];
+        char           log_data[2 * WORKLOAD_MAX_STATEMENT];
+        uint32_t       length;
+        long           file_size;
+
+        check(workload_writer_open(&writer, test_log_name) == WORKLOAD_OK);
+        check(workload_record(&writer, "insert 1 a b", 12, 5000000000ULL) == WORKLOAD_OK);
+        check(workload_record(&writer, "select", 6, 5000000500ULL) == WORKLOAD_OK);
+        check(workload_record(&writer, "", 0, 5000300500ULL) == WORKLOAD_OK);
+        memset(long_text, 'x', sizeof(long_text));
+        check(workload_record(&writer, long_text, sizeof(long_text), 5000300600ULL) == WORKLOAD_OK);
+        workload_writer_close(&writer);
+
+        check(workload_reader_open(&reader, test_log_name) == WORKLOAD_OK);
+        check(workload_next(&reader, text, &length) == WORKLOAD_OK);
+        check(length == 12);
+        check(strcmp(text, "insert 1 a b") == 0);
+        check(reader.time_ns == 0);
+        check(workload_next(&reader, text, &length) == WORKLOAD_OK);
+        check(strcmp(text, "select") == 0);
+        check(reader.time_ns == 500);
+        check(workload_next(&reader, text, &length) == WORKLOAD_OK);
+        check(length == 0);
+        check(text[0] == '\0');
+        check(reader.time_ns == 300500);
+        // Statements longer than the limit are cut short
+        check(workload_next(&reader, text, &length) == WORKLOAD_OK);
+        check(length == WORKLOAD_MAX_STATEMENT);
+        check(reader.time_ns == 300600);
+        check(workload_next(&reader, text, &length) == WORKLOAD_END);
+        workload_reader_close(&reader);
+
+        // A record cut off part way through is an error, not the end
+        file = fopen(test_log_name, "rb");
+        check(file != NULL);
+        file_size = fread(log_data, 1, sizeof(log_data), file);
+        fclose(file);
+        file = fopen(test_log_name, "wb");
+        check(file != NULL);
+        fwrite(log_data, 1, file_size - 10, file);
+        fclose(file);
+        check(workload_reader_open(&reader, test_log_name) == WORKLOAD_OK);
+        for(int i = 0; i < 3; ++i)
+            check(workload_next(&reader, text, &length) == WORKLOAD_OK);
+        check(workload_next(&reader, text, &length) == WORKLOAD_CORRUPT);
+        workload_reader_close(&reader);
+
+        // and so is a file that isn't a log at all
+        file = fopen(test_log_name, "wb");
+        check(file != NULL);
+        fprintf(file, "insert 1 a b\n");
+        fclose(file);
+        check(workload_reader_open(&reader, test_log_name) == WORKLOAD_CORRUPT);
+    }
+
+    it("replays a workload and reports its latencies")
+    {
+        WorkloadWriter writer;
+        WorkloadReader reader;
+        ReplayOptions  options;
+        ReplayStats    stats;
+        Table*         table;
+        char           input[256];
+        uint64_t       time_ns = 1000;
+        int            num_rows = 40;
+
+        check(workload_writer_open(&writer, test_log_name) == WORKLOAD_OK);
+        for(int i = 1; i <= num_rows; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        }
+        strcpy(input, "delete where id > 30");
+        check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        strcpy(input, "update set username = someone where id < 5");
+        check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        strcpy(input, "select count(*)");
+        check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        strcpy(input, ".integrity_check");
+        check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        strcpy(input, "bogus statement");
+        check(workload_record(&writer, input, strlen(input), time_ns++) == WORKLOAD_OK);
+        workload_writer_close(&writer);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(workload_reader_open(&reader, test_log_name) == WORKLOAD_OK);
+        options.paced = 0;
+        check(workload_replay(table, &reader, &options, &stats) == WORKLOAD_OK);
+        workload_reader_close(&reader);
+
+        check(stats.num_statements == (uint64_t) num_rows + 4);
+        check(stats.num_failed == 1);
+        check(stats.num_skipped == 1);
+        check(stats.num_latencies[REPLAY_INSERT] == (uint64_t) num_rows);
+        check(stats.num_latencies[REPLAY_DELETE] == 1);
+        check(stats.num_latencies[REPLAY_UPDATE] == 1);
+        check(stats.num_latencies[REPLAY_SELECT] == 1);
+        check(stats.num_latencies[REPLAY_ALL] == stats.num_statements);
+        check(stats.elapsed_ns > 0);
+        check(replay_percentile(&stats, REPLAY_ALL, 0.5) <= replay_percentile(&stats, REPLAY_ALL, 0.99));
+        check(replay_percentile(&stats, REPLAY_ALL, 1.0) == stats.latencies[REPLAY_ALL][stats.num_latencies[REPLAY_ALL] - 1]);
+        check(replay_percentile(&stats, REPLAY_ALL, 0.0) == stats.latencies[REPLAY_ALL][0]);
+
+        // The statements really ran
+        strcpy(input, "select count(*)");
+        {
+            InputBuffer* input_buffer = new_input_buffer();
+            Statement    statement;
+
+            input_buffer->buffer = input;
+            check(prepare_statement(input_buffer, &statement) == PREPARE_SUCCESS);
+            check(execute_statement(&statement, table) == EXECUTE_SUCCESS);
+            check(statement.aggregate.count == 30);
+            free(input_buffer);
+        }
+        replay_stats_free(&stats);
+        check(stats.latencies[REPLAY_ALL] == NULL);
+        db_close(table);
+    }
+
+    it("keeps to the recorded pace when asked")
+    {
+        WorkloadWriter writer;
+        WorkloadReader reader;
+        ReplayOptions  options;
+        ReplayStats    stats;
+        Table*         table;
+        char           input[256];
+
+        // Five statements 4 ms apart
+        check(workload_writer_open(&writer, test_log_name) == WORKLOAD_OK);
+        for(int i = 1; i <= 5; ++i)
+        {
+            sprintf(input, "insert %d user%d email%d@domain.net", i, i, i);
+            check(workload_record(&writer, input, strlen(input), 1000 + (uint64_t) i * 4000000) == WORKLOAD_OK);
+        }
+        workload_writer_close(&writer);
+
+        table = db_open(test_db_name);
+        check(table != NULL);
+        check(workload_reader_open(&reader, test_log_name) == WORKLOAD_OK);
+        options.paced = 1;
+        check(workload_replay(table, &reader, &options, &stats) == WORKLOAD_OK);
+        workload_reader_close(&reader);
+        check(stats.num_statements == 5);
+        check(stats.elapsed_ns >= 16000000);
+        replay_stats_free(&stats);
+        db_close(table);
+    }
+}